@@ -16,7 +16,7 @@ workspace "VulkanRenderer"
     filter "*"
 
     -- Include files
-    includedirs{"ExternalLibraries/Vulkan/Include", "ExternalLibraries/glfw/include", "ExternalLibraries/glm", "ExternalLibraries/VulkanMemoryAllocator/include", "ExternalLibraries/dds/include", "ExternalLibraries/stb/include", "C:/Program Files/Autodesk/FBX/FBX SDK/2020.3.7/include"}
+    includedirs{"ExternalLibraries/Vulkan/Include", "ExternalLibraries/glfw/include", "ExternalLibraries/glm", "ExternalLibraries/VulkanMemoryAllocator/include", "ExternalLibraries/dds/include", "ExternalLibraries/stb/include"}
     
     -- Libraries
     libdirs{"ExternalLibraries/glfw/lib-vc2022", "ExternalLibraries/Vulkan/Lib"}
@@ -27,10 +27,13 @@ project "Renderer"
     location "src"
     files {"src/**.cpp", "src/**.hpp"}
 
+    -- The culling and software occlusion have 8 wide paths that are only compiled when AVX is enabled
+    vectorextensions "AVX2"
+
     dependson "glm" 
 
 project "Shaders"
     kind "Utility"
     location "src/Shaders"
-    files {"src/Shaders/**.vert", "src/Shaders/**.frag"}
+    files {"src/Shaders/**.vert", "src/Shaders/**.frag", "src/Shaders/**.comp"}
         
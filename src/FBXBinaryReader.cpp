@@ -0,0 +1,623 @@
+#include "FBXBinaryReader.hpp"
+
+#include <array>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+
+namespace fbx::binary {
+
+    namespace {
+        // The magic bytes at the start of every binary FBX file (including the null terminator)
+        constexpr char kMagic[] = "Kaydara FBX Binary  ";
+        constexpr std::size_t kHeaderSize = 27;
+
+        /// <summary>
+        /// Reads a little endian value from an unaligned location in the file
+        /// </summary>
+        template<typename T>
+        T read(const std::uint8_t* location) {
+            T value;
+            std::memcpy(&value, location, sizeof(T));
+            return value;
+        }
+
+        /// <summary>
+        /// Bounds checked cursor over the mapped file
+        /// </summary>
+        struct Cursor
+        {
+            const std::uint8_t* begin;
+            const std::uint8_t* end;
+            const std::uint8_t* position;
+
+            void require(std::size_t bytes) const {
+                if (std::size_t(end - position) < bytes) {
+                    throw std::runtime_error("Unexpected end of FBX file.");
+                }
+            }
+
+            template<typename T>
+            T next() {
+                require(sizeof(T));
+                T value = read<T>(position);
+                position += sizeof(T);
+                return value;
+            }
+
+            const std::uint8_t* skip(std::size_t bytes) {
+                require(bytes);
+                const std::uint8_t* start = position;
+                position += bytes;
+                return start;
+            }
+
+            std::size_t offset() const { return std::size_t(position - begin); }
+        };
+
+        /// <summary>
+        /// Parses a single property of a node record
+        /// </summary>
+        Property parseProperty(Cursor& cursor) {
+            Property property;
+            property.type = cursor.next<char>();
+
+            switch (property.type) {
+            case 'Y': property.integer = cursor.next<std::int16_t>(); break;
+            case 'C': property.integer = cursor.next<std::uint8_t>(); break;
+            case 'I': property.integer = cursor.next<std::int32_t>(); break;
+            case 'L': property.integer = cursor.next<std::int64_t>(); break;
+            case 'F': property.real = cursor.next<float>(); break;
+            case 'D': property.real = cursor.next<double>(); break;
+            case 'f': case 'd': case 'l': case 'i': case 'b':
+                property.arrayLength = cursor.next<std::uint32_t>();
+                property.encoding = cursor.next<std::uint32_t>();
+                property.byteLength = cursor.next<std::uint32_t>();
+                property.data = cursor.skip(property.byteLength);
+                break;
+            case 'S': case 'R':
+                property.byteLength = cursor.next<std::uint32_t>();
+                property.data = cursor.skip(property.byteLength);
+                break;
+            default:
+                throw std::runtime_error("Unknown FBX property type: " + std::string(1, property.type));
+            }
+
+            return property;
+        }
+
+        /// <summary>
+        /// Parses a node record and all of its children. Returns false for the null record
+        /// that terminates a list of nodes.
+        /// </summary>
+        bool parseNode(Cursor& cursor, bool wideRecords, Node& node) {
+            std::uint64_t endOffset, numProperties, propertyListLength;
+            if (wideRecords) {
+                endOffset = cursor.next<std::uint64_t>();
+                numProperties = cursor.next<std::uint64_t>();
+                propertyListLength = cursor.next<std::uint64_t>();
+            }
+            else {
+                endOffset = cursor.next<std::uint32_t>();
+                numProperties = cursor.next<std::uint32_t>();
+                propertyListLength = cursor.next<std::uint32_t>();
+            }
+            std::uint8_t nameLength = cursor.next<std::uint8_t>();
+
+            // A record of all zeros marks the end of a node list
+            if (endOffset == 0) {
+                return false;
+            }
+            if (endOffset > std::uint64_t(cursor.end - cursor.begin) || endOffset < cursor.offset()) {
+                throw std::runtime_error("Corrupt FBX node record.");
+            }
+
+            node.name = std::string_view(reinterpret_cast<const char*>(cursor.skip(nameLength)), nameLength);
+
+            // Parse the properties
+            const std::uint8_t* propertiesEnd = cursor.position + propertyListLength;
+            node.properties.reserve(std::size_t(numProperties));
+            for (std::uint64_t i = 0; i < numProperties; i++) {
+                node.properties.emplace_back(parseProperty(cursor));
+            }
+            if (cursor.position != propertiesEnd) {
+                throw std::runtime_error("Corrupt FBX property list in node " + std::string(node.name));
+            }
+
+            // Anything left before the end offset is the nested list of child nodes
+            const std::uint8_t* nodeEnd = cursor.begin + endOffset;
+            while (cursor.position < nodeEnd) {
+                Node child;
+                if (!parseNode(cursor, wideRecords, child)) {
+                    break;
+                }
+                node.children.emplace_back(std::move(child));
+            }
+            cursor.position = nodeEnd;
+
+            return true;
+        }
+
+        /// <summary>
+        /// Splits an object name of the form "Name\0\1Class" into its name
+        /// </summary>
+        std::string_view objectName(std::string_view fullName) {
+            std::size_t separator = fullName.find(std::string_view("\0\1", 2));
+            if (separator == std::string_view::npos) {
+                return fullName;
+            }
+            return fullName.substr(0, separator);
+        }
+
+        /// <summary>
+        /// Little endian bit reader for the deflate stream
+        /// </summary>
+        struct BitReader
+        {
+            const std::uint8_t* input;
+            std::size_t inputSize;
+            std::size_t position = 0;
+            std::uint64_t bitBuffer = 0;
+            std::uint32_t bitCount = 0;
+
+            void refill() {
+                while (bitCount <= 56) {
+                    std::uint64_t byte = position < inputSize ? input[position] : 0;
+                    position++;
+                    bitBuffer |= byte << bitCount;
+                    bitCount += 8;
+                }
+            }
+
+            std::uint32_t bits(std::uint32_t count) {
+                if (count == 0) {
+                    return 0;
+                }
+                if (bitCount < count) {
+                    refill();
+                }
+                std::uint32_t value = std::uint32_t(bitBuffer & ((std::uint64_t(1) << count) - 1));
+                bitBuffer >>= count;
+                bitCount -= count;
+                return value;
+            }
+
+            void alignToByte() {
+                std::uint32_t discard = bitCount % 8;
+                bitBuffer >>= discard;
+                bitCount -= discard;
+            }
+
+            bool overrun() const {
+                // Bytes still held in the bit buffer have not been consumed yet
+                return position > inputSize + bitCount / 8;
+            }
+        };
+
+        // Number of bits resolved by a single table lookup when decoding Huffman codes
+        constexpr std::uint32_t kFastBits = 10;
+
+        /// <summary>
+        /// Canonical Huffman decoding table with a fast lookup for short codes
+        /// </summary>
+        struct Huffman
+        {
+            std::array<std::uint16_t, 16> counts{};
+            std::array<std::uint16_t, 288> symbols{};
+            // Low 9 bits hold the symbol, the top bits the code length (0 = not in the fast table)
+            std::array<std::uint16_t, 1 << kFastBits> fast{};
+
+            void build(const std::uint8_t* lengths, std::uint32_t count) {
+                counts.fill(0);
+                fast.fill(0);
+                for (std::uint32_t i = 0; i < count; i++) {
+                    counts[lengths[i]]++;
+                }
+                counts[0] = 0;
+
+                std::array<std::uint16_t, 16> offsets{};
+                for (std::uint32_t length = 1; length < 16; length++) {
+                    offsets[length] = offsets[length - 1] + counts[length - 1];
+                }
+                for (std::uint32_t i = 0; i < count; i++) {
+                    if (lengths[i] != 0) {
+                        symbols[offsets[lengths[i]]++] = std::uint16_t(i);
+                    }
+                }
+
+                // Fill the fast table with the bit reversed codes of every short symbol
+                std::uint32_t code = 0;
+                std::uint32_t index = 0;
+                for (std::uint32_t length = 1; length <= kFastBits; length++) {
+                    for (std::uint32_t i = 0; i < counts[length]; i++, code++, index++) {
+                        std::uint32_t reversed = 0;
+                        for (std::uint32_t bit = 0; bit < length; bit++) {
+                            reversed |= ((code >> bit) & 1) << (length - 1 - bit);
+                        }
+                        for (std::uint32_t fill = reversed; fill < (1u << kFastBits); fill += 1u << length) {
+                            fast[fill] = std::uint16_t((length << 9) | symbols[index]);
+                        }
+                    }
+                    code <<= 1;
+                }
+            }
+
+            std::uint32_t decode(BitReader& reader) const {
+                if (reader.bitCount < 16) {
+                    reader.refill();
+                }
+
+                std::uint16_t entry = fast[reader.bitBuffer & ((1u << kFastBits) - 1)];
+                if (entry != 0) {
+                    std::uint32_t length = entry >> 9;
+                    reader.bitBuffer >>= length;
+                    reader.bitCount -= length;
+                    return entry & 0x1ff;
+                }
+
+                // Slow path for long codes, walk the canonical code one bit at a time
+                std::int32_t code = 0;
+                std::int32_t first = 0;
+                std::int32_t index = 0;
+                for (std::uint32_t length = 1; length < 16; length++) {
+                    code |= std::int32_t(reader.bits(1));
+                    std::int32_t count = counts[length];
+                    if (code - count < first) {
+                        return symbols[index + (code - first)];
+                    }
+                    index += count;
+                    first += count;
+                    first <<= 1;
+                    code <<= 1;
+                }
+                throw std::runtime_error("Invalid Huffman code in compressed FBX array.");
+            }
+        };
+
+        constexpr std::uint16_t kLengthBase[29] = {
+            3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+            35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+        constexpr std::uint8_t kLengthExtra[29] = {
+            0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+            3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+        constexpr std::uint16_t kDistanceBase[30] = {
+            1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+            257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+        constexpr std::uint8_t kDistanceExtra[30] = {
+            0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+            7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+    }
+
+    bool Property::isArray() const {
+        return type == 'f' || type == 'd' || type == 'l' || type == 'i' || type == 'b';
+    }
+
+    std::int64_t Property::asInt() const {
+        if (type == 'F' || type == 'D') {
+            return std::int64_t(real);
+        }
+        return integer;
+    }
+
+    double Property::asDouble() const {
+        if (type == 'F' || type == 'D') {
+            return real;
+        }
+        return double(integer);
+    }
+
+    std::string_view Property::asString() const {
+        if (type != 'S' && type != 'R') {
+            return std::string_view();
+        }
+        return std::string_view(reinterpret_cast<const char*>(data), byteLength);
+    }
+
+    const Node* Node::findChild(std::string_view childName) const {
+        for (const Node& child : children) {
+            if (child.name == childName) {
+                return &child;
+            }
+        }
+        return nullptr;
+    }
+
+    Document::Document(const char* filename) : file(filename) {
+        fileDirectory = std::filesystem::path(filename).parent_path();
+
+        // Check the header
+        if (file.size() < kHeaderSize || std::memcmp(file.data(), kMagic, sizeof(kMagic)) != 0) {
+            throw std::runtime_error("Not a binary FBX file: " + std::string(filename));
+        }
+        fileVersion = read<std::uint32_t>(file.data() + 23);
+        if (fileVersion < 7000 || fileVersion >= 8000) {
+            throw std::runtime_error("Unsupported FBX version " + std::to_string(fileVersion) + ": " + std::string(filename));
+        }
+        // From 7.5 the record header uses 64 bit offsets
+        bool wideRecords = fileVersion >= 7500;
+
+        // Parse the top level node list
+        Cursor cursor{ file.data(), file.data() + file.size(), file.data() + kHeaderSize };
+        std::size_t nullRecordSize = wideRecords ? 25 : 13;
+        while (std::size_t(cursor.end - cursor.position) >= nullRecordSize) {
+            Node node;
+            if (!parseNode(cursor, wideRecords, node)) {
+                break;
+            }
+            topLevelNodes.emplace_back(std::move(node));
+        }
+
+        // Gather the objects
+        const Node* objectsNode = nullptr;
+        const Node* connectionsNode = nullptr;
+        for (const Node& node : topLevelNodes) {
+            if (node.name == "Objects") {
+                objectsNode = &node;
+            }
+            else if (node.name == "Connections") {
+                connectionsNode = &node;
+            }
+        }
+        if (objectsNode == nullptr || connectionsNode == nullptr) {
+            throw std::runtime_error("FBX file has no objects or connections: " + std::string(filename));
+        }
+
+        objects.reserve(objectsNode->children.size());
+        for (const Node& node : objectsNode->children) {
+            if (node.properties.size() < 3) {
+                continue;
+            }
+            Object object;
+            object.id = node.properties[0].asInt();
+            object.node = &node;
+            object.type = node.name;
+            object.name = objectName(node.properties[1].asString());
+            object.subType = node.properties[2].asString();
+            objects.emplace(object.id, std::move(object));
+        }
+
+        // Link the objects together, each connection is C: type, source, destination (, property)
+        rootObject.type = "Model";
+        rootObject.name = "RootNode";
+        for (const Node& connection : connectionsNode->children) {
+            if (connection.name != "C" || connection.properties.size() < 3) {
+                continue;
+            }
+            std::int64_t sourceID = connection.properties[1].asInt();
+            std::int64_t destinationID = connection.properties[2].asInt();
+
+            auto source = objects.find(sourceID);
+            if (source == objects.end()) {
+                continue;
+            }
+
+            Object* destination = nullptr;
+            if (destinationID == 0) {
+                destination = &rootObject;
+            }
+            else {
+                auto found = objects.find(destinationID);
+                if (found == objects.end()) {
+                    continue;
+                }
+                destination = &found->second;
+            }
+
+            Connection link;
+            link.object = &source->second;
+            if (connection.properties.size() > 3) {
+                link.property = connection.properties[3].asString();
+            }
+            destination->sources.emplace_back(link);
+        }
+    }
+
+    void inflate(const std::uint8_t* input, std::size_t inputSize, std::uint8_t* output, std::size_t outputSize) {
+        // Check the zlib header
+        if (inputSize < 2 || (input[0] & 0x0f) != 8 || ((input[0] << 8) | input[1]) % 31 != 0 || (input[1] & 0x20) != 0) {
+            throw std::runtime_error("Invalid zlib header in compressed FBX array.");
+        }
+
+        BitReader reader{ input + 2, inputSize - 2 };
+        std::size_t written = 0;
+        Huffman lengthCodes;
+        Huffman distanceCodes;
+
+        bool finalBlock = false;
+        while (!finalBlock) {
+            finalBlock = reader.bits(1) == 1;
+            std::uint32_t blockType = reader.bits(2);
+
+            if (blockType == 0) {
+                // Stored block
+                reader.alignToByte();
+                std::uint32_t length = reader.bits(16);
+                std::uint32_t inverse = reader.bits(16);
+                if ((length ^ 0xffff) != inverse || written + length > outputSize) {
+                    throw std::runtime_error("Invalid stored block in compressed FBX array.");
+                }
+                for (std::uint32_t i = 0; i < length; i++) {
+                    output[written++] = std::uint8_t(reader.bits(8));
+                }
+            }
+            else if (blockType == 1 || blockType == 2) {
+                std::array<std::uint8_t, 320> lengths{};
+
+                if (blockType == 1) {
+                    // Fixed Huffman codes
+                    std::size_t i = 0;
+                    for (; i < 144; i++) lengths[i] = 8;
+                    for (; i < 256; i++) lengths[i] = 9;
+                    for (; i < 280; i++) lengths[i] = 7;
+                    for (; i < 288; i++) lengths[i] = 8;
+                    lengthCodes.build(lengths.data(), 288);
+                    for (i = 0; i < 30; i++) lengths[i] = 5;
+                    distanceCodes.build(lengths.data(), 30);
+                }
+                else {
+                    // Dynamic Huffman codes
+                    std::uint32_t numLengthCodes = reader.bits(5) + 257;
+                    std::uint32_t numDistanceCodes = reader.bits(5) + 1;
+                    std::uint32_t numCodeLengthCodes = reader.bits(4) + 4;
+                    if (numLengthCodes > 286 || numDistanceCodes > 30) {
+                        throw std::runtime_error("Invalid dynamic block in compressed FBX array.");
+                    }
+
+                    constexpr std::uint8_t order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+                    std::array<std::uint8_t, 19> codeLengthLengths{};
+                    for (std::uint32_t i = 0; i < numCodeLengthCodes; i++) {
+                        codeLengthLengths[order[i]] = std::uint8_t(reader.bits(3));
+                    }
+                    Huffman codeLengthCodes;
+                    codeLengthCodes.build(codeLengthLengths.data(), 19);
+
+                    std::uint32_t total = numLengthCodes + numDistanceCodes;
+                    std::uint32_t i = 0;
+                    while (i < total) {
+                        std::uint32_t symbol = codeLengthCodes.decode(reader);
+                        if (symbol < 16) {
+                            lengths[i++] = std::uint8_t(symbol);
+                            continue;
+                        }
+
+                        std::uint8_t repeated = 0;
+                        std::uint32_t repeat = 0;
+                        if (symbol == 16) {
+                            if (i == 0) {
+                                throw std::runtime_error("Invalid code lengths in compressed FBX array.");
+                            }
+                            repeated = lengths[i - 1];
+                            repeat = 3 + reader.bits(2);
+                        }
+                        else if (symbol == 17) {
+                            repeat = 3 + reader.bits(3);
+                        }
+                        else {
+                            repeat = 11 + reader.bits(7);
+                        }
+                        if (i + repeat > total) {
+                            throw std::runtime_error("Invalid code lengths in compressed FBX array.");
+                        }
+                        while (repeat-- > 0) {
+                            lengths[i++] = repeated;
+                        }
+                    }
+
+                    lengthCodes.build(lengths.data(), numLengthCodes);
+                    distanceCodes.build(lengths.data() + numLengthCodes, numDistanceCodes);
+                }
+
+                // Decode the compressed data
+                while (true) {
+                    std::uint32_t symbol = lengthCodes.decode(reader);
+                    if (symbol < 256) {
+                        if (written >= outputSize) {
+                            throw std::runtime_error("Compressed FBX array is larger than expected.");
+                        }
+                        output[written++] = std::uint8_t(symbol);
+                        continue;
+                    }
+                    if (symbol == 256) {
+                        break;
+                    }
+
+                    symbol -= 257;
+                    if (symbol >= 29) {
+                        throw std::runtime_error("Invalid length code in compressed FBX array.");
+                    }
+                    std::size_t length = kLengthBase[symbol] + reader.bits(kLengthExtra[symbol]);
+
+                    std::uint32_t distanceSymbol = distanceCodes.decode(reader);
+                    if (distanceSymbol >= 30) {
+                        throw std::runtime_error("Invalid distance code in compressed FBX array.");
+                    }
+                    std::size_t distance = kDistanceBase[distanceSymbol] + reader.bits(kDistanceExtra[distanceSymbol]);
+
+                    if (distance > written || written + length > outputSize) {
+                        throw std::runtime_error("Invalid back reference in compressed FBX array.");
+                    }
+                    // Copy byte by byte as the source and destination may overlap
+                    const std::uint8_t* source = output + written - distance;
+                    std::uint8_t* destination = output + written;
+                    for (std::size_t i = 0; i < length; i++) {
+                        destination[i] = source[i];
+                    }
+                    written += length;
+                }
+            }
+            else {
+                throw std::runtime_error("Invalid block type in compressed FBX array.");
+            }
+
+            if (reader.overrun()) {
+                throw std::runtime_error("Unexpected end of compressed FBX array.");
+            }
+        }
+
+        if (written != outputSize) {
+            throw std::runtime_error("Compressed FBX array is smaller than expected.");
+        }
+    }
+
+    template<typename T>
+    void decodeArray(const Property& property, std::vector<T>& output) {
+        std::size_t elementSize;
+        switch (property.type) {
+        case 'f': case 'i': elementSize = 4; break;
+        case 'd': case 'l': elementSize = 8; break;
+        case 'b': elementSize = 1; break;
+        default: throw std::runtime_error("FBX property is not an array.");
+        }
+
+        std::size_t byteSize = std::size_t(property.arrayLength) * elementSize;
+        const std::uint8_t* raw = property.data;
+        std::vector<std::uint8_t> inflated;
+        if (property.encoding == 1) {
+            inflated.resize(byteSize);
+            inflate(property.data, property.byteLength, inflated.data(), byteSize);
+            raw = inflated.data();
+        }
+        else if (property.encoding != 0 || property.byteLength != byteSize) {
+            throw std::runtime_error("Invalid FBX array encoding.");
+        }
+
+        // Convert every element to the requested type
+        output.resize(property.arrayLength);
+        switch (property.type) {
+        case 'f':
+            for (std::size_t i = 0; i < output.size(); i++) output[i] = T(read<float>(raw + i * 4));
+            break;
+        case 'd':
+            for (std::size_t i = 0; i < output.size(); i++) output[i] = T(read<double>(raw + i * 8));
+            break;
+        case 'i':
+            for (std::size_t i = 0; i < output.size(); i++) output[i] = T(read<std::int32_t>(raw + i * 4));
+            break;
+        case 'l':
+            for (std::size_t i = 0; i < output.size(); i++) output[i] = T(read<std::int64_t>(raw + i * 8));
+            break;
+        case 'b':
+            for (std::size_t i = 0; i < output.size(); i++) output[i] = T(raw[i]);
+            break;
+        }
+    }
+
+    // The element types used by the loader
+    template void decodeArray<float>(const Property&, std::vector<float>&);
+    template void decodeArray<double>(const Property&, std::vector<double>&);
+    template void decodeArray<std::int32_t>(const Property&, std::vector<std::int32_t>&);
+    template void decodeArray<std::int64_t>(const Property&, std::vector<std::int64_t>&);
+
+    const Node* findProperty70(const Object& object, std::string_view propertyName) {
+        const Node* properties = object.node ? object.node->findChild("Properties70") : nullptr;
+        if (properties == nullptr) {
+            return nullptr;
+        }
+        for (const Node& property : properties->children) {
+            if (!property.properties.empty() && property.properties[0].asString() == propertyName) {
+                return &property;
+            }
+        }
+        return nullptr;
+    }
+}
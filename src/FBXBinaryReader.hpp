@@ -0,0 +1,166 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <filesystem>
+
+#include "mappedFile.hpp"
+
+/// A reader for the binary FBX 7.x file format that works directly on a memory mapped file.
+namespace fbx::binary {
+	/// <summary>
+	/// A single property of a node record. Arrays and strings point into the mapped file and
+	/// are only decoded when requested.
+	/// </summary>
+	struct Property
+	{
+		char type = 0;
+
+		// Scalar values (Y, C, I, L are stored as integers and F, D as reals)
+		std::int64_t integer = 0;
+		double real = 0.0;
+
+		// String, raw and array data
+		const std::uint8_t* data = nullptr;
+		std::uint32_t byteLength = 0;		// Size of the data in the file (compressed size for arrays)
+		std::uint32_t arrayLength = 0;		// Number of elements in an array
+		std::uint32_t encoding = 0;			// 0 = raw, 1 = zlib compressed
+
+		/// <summary>
+		/// Checks if the property is an array (f, d, l, i or b)
+		/// </summary>
+		bool isArray() const;
+
+		/// <summary>
+		/// Gets the property as an integer
+		/// </summary>
+		std::int64_t asInt() const;
+
+		/// <summary>
+		/// Gets the property as a double
+		/// </summary>
+		double asDouble() const;
+
+		/// <summary>
+		/// Gets the property as a string (empty if not a string)
+		/// </summary>
+		std::string_view asString() const;
+	};
+
+	/// <summary>
+	/// A node record in the file
+	/// </summary>
+	struct Node
+	{
+		std::string_view name;
+		std::vector<Property> properties;
+		std::vector<Node> children;
+
+		/// <summary>
+		/// Finds the first child with the given name
+		/// </summary>
+		/// <param name="childName">The name of the child</param>
+		/// <returns>The child or nullptr if it does not exist</returns>
+		const Node* findChild(std::string_view childName) const;
+	};
+
+	struct Object;
+
+	/// <summary>
+	/// A link between two objects in the scene. The property is empty for object to object links.
+	/// </summary>
+	struct Connection
+	{
+		const Object* object = nullptr;
+		std::string_view property;
+	};
+
+	/// <summary>
+	/// An object from the Objects section of the file along with everything connected to it
+	/// </summary>
+	struct Object
+	{
+		std::int64_t id = 0;
+		const Node* node = nullptr;
+
+		std::string_view type;			// The record name (Model, Geometry, Material, Texture...)
+		std::string_view name;			// The object name without the class suffix
+		std::string_view subType;		// The object sub type (Mesh, Light, Null...)
+
+		// Objects connected to this object in file order (child nodes, geometry, materials, textures)
+		std::vector<Connection> sources;
+	};
+
+	/// <summary>
+	/// A memory mapped binary FBX file and its object graph
+	/// </summary>
+	class Document
+	{
+	public:
+		/// <summary>
+		/// Maps and parses a binary FBX file
+		/// </summary>
+		/// <param name="filename">The .fbx file path</param>
+		explicit Document(const char* filename);
+
+		// The nodes point into the mapped file so the document can not be copied
+		Document(Document&) = delete;
+		Document& operator= (Document&) = delete;
+
+		/// <summary>
+		/// Gets the FBX version of the file (eg. 7400)
+		/// </summary>
+		std::uint32_t version() const { return fileVersion; }
+
+		/// <summary>
+		/// Gets the directory the file is in
+		/// </summary>
+		const std::filesystem::path& directory() const { return fileDirectory; }
+
+		/// <summary>
+		/// Gets the top level node records of the file
+		/// </summary>
+		const std::vector<Node>& nodes() const { return topLevelNodes; }
+
+		/// <summary>
+		/// Gets the scene root object (id 0) that all top level models connect to
+		/// </summary>
+		const Object& root() const { return rootObject; }
+
+	private:
+		utility::MappedFile file;
+		std::uint32_t fileVersion = 0;
+		std::filesystem::path fileDirectory;
+
+		std::vector<Node> topLevelNodes;
+		std::unordered_map<std::int64_t, Object> objects;
+		Object rootObject;
+	};
+
+	/// <summary>
+	/// Decodes (and inflates if compressed) an array property converting every element to T
+	/// </summary>
+	/// <param name="property">The array property</param>
+	/// <param name="output">The decoded values</param>
+	template<typename T>
+	void decodeArray(const Property& property, std::vector<T>& output);
+
+	/// <summary>
+	/// Inflates a zlib stream into an output buffer of a known size
+	/// </summary>
+	/// <param name="input">The zlib stream</param>
+	/// <param name="inputSize">The size of the zlib stream</param>
+	/// <param name="output">The output buffer</param>
+	/// <param name="outputSize">The expected size of the inflated data</param>
+	void inflate(const std::uint8_t* input, std::size_t inputSize, std::uint8_t* output, std::size_t outputSize);
+
+	/// <summary>
+	/// Finds a property in a Properties70 block and returns its values
+	/// </summary>
+	/// <param name="object">The object containing the Properties70 block</param>
+	/// <param name="propertyName">The name of the property (eg. Lcl Translation)</param>
+	/// <returns>The P record or nullptr if the property is not set</returns>
+	const Node* findProperty70(const Object& object, std::string_view propertyName);
+}
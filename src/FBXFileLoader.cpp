@@ -2,71 +2,455 @@
 
 #include "gtx/quaternion.hpp"
 #include "gtx/string_cast.hpp"
-#include "gtx/hash.hpp"
+#include "gtc/matrix_transform.hpp"
+
+#include "jobSystem.hpp"
+#include "meshOptimisation.hpp"
 
 #include <iostream>
-#include <unordered_map> 
-
-// Link the libraries necessary for the execution mode
-// The file paths are based on the default location for the 2020.3.7 version of the SDK
-#if _DEBUG
-#pragma comment (lib, "C:\\Program Files\\Autodesk\\FBX\\FBX SDK\\2020.3.7\\lib\\x64\\debug\\libfbxsdk-md.lib")
-#pragma comment (lib, "C:\\Program Files\\Autodesk\\FBX\\FBX SDK\\2020.3.7\\lib\\x64\\debug\\libxml2-md.lib")
-#pragma comment (lib, "C:\\Program Files\\Autodesk\\FBX\\FBX SDK\\2020.3.7\\lib\\x64\\debug\\zlib-md.lib")
-#else
-#pragma comment (lib, "C:\\Program Files\\Autodesk\\FBX\\FBX SDK\\2020.3.7\\lib\\x64\\release\\libfbxsdk-md.lib")
-#pragma comment (lib, "C:\\Program Files\\Autodesk\\FBX\\FBX SDK\\2020.3.7\\lib\\x64\\release\\libxml2-md.lib")
-#pragma comment (lib, "C:\\Program Files\\Autodesk\\FBX\\FBX SDK\\2020.3.7\\lib\\x64\\release\\zlib-md.lib")
-#endif
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <limits>
+#include <unordered_map>
+
+#include <immintrin.h>
 
 #define DEBUG_OUTPUTS false
+// Reorder clusters of triangles to reduce overdraw after optimising for the vertex cache
+#define OPTIMISE_OVERDRAW true
+// Triangles per block when solving tangents, each block records the range of vertices it touches
+#define TANGENT_BLOCK_SIZE 256
+// Vertices each tangent summing job owns
+#define TANGENT_VERTEX_RANGE 8192
+// Most levels of detail per mesh (including the full mesh), each keeping this fraction of the triangles of the last
+#define LOD_LEVELS 5
+#define LOD_REDUCTION 0.5f
+// Meshes are not simplified below this many triangles
+#define LOD_MIN_TRIANGLES 64
+// Limits of each meshlet, 124 triangles keeps a meshlet's primitive count inside 128 with room for vertex reuse
+#define MESHLET_MAX_VERTICES 64
+#define MESHLET_MAX_TRIANGLES 124
+// Relative difference allowed between the axis lengths and the sine allowed between the axes of an instance's transform
+#define INSTANCE_SIMILARITY_TOLERANCE 1e-3f
 
 namespace fbx {
 
-    Scene loadFBXFile(const char* filename) {
+    namespace {
+        /// <summary>
+        /// Gets a 3 component property of an object or the default if it is not set
+        /// </summary>
+        glm::dvec3 getVector3(const binary::Object& object, std::string_view name, glm::dvec3 fallback) {
+            const binary::Node* property = binary::findProperty70(object, name);
+            if (property == nullptr || property->properties.size() < 7) {
+                return fallback;
+            }
+            return glm::dvec3(property->properties[4].asDouble(), property->properties[5].asDouble(), property->properties[6].asDouble());
+        }
+
+        /// <summary>
+        /// Gets a single value property of an object or the default if it is not set
+        /// </summary>
+        double getValue(const binary::Object& object, std::string_view name, double fallback) {
+            const binary::Node* property = binary::findProperty70(object, name);
+            if (property == nullptr || property->properties.size() < 5) {
+                return fallback;
+            }
+            return property->properties[4].asDouble();
+        }
 
-        // Create the FBX Memory Manager
-        FbxManager* memoryManager = FbxManager::Create();
+        /// <summary>
+        /// Gets the string stored in a child node of an object
+        /// </summary>
+        std::string_view getChildString(const binary::Node& node, std::string_view name) {
+            const binary::Node* child = node.findChild(name);
+            if (child == nullptr || child->properties.empty()) {
+                return std::string_view();
+            }
+            return child->properties[0].asString();
+        }
 
-        // Create the IO settings for the import settings
-        FbxIOSettings* ioSettings = FbxIOSettings::Create(memoryManager, IOSROOT);
+        /// <summary>
+        /// Creates a rotation matrix from euler angles in degrees using the FBX rotation order
+        /// </summary>
+        glm::dmat4 eulerRotation(glm::dvec3 degrees, int rotationOrder) {
+            glm::dmat4 x = glm::rotate(glm::dmat4(1), glm::radians(degrees.x), glm::dvec3(1, 0, 0));
+            glm::dmat4 y = glm::rotate(glm::dmat4(1), glm::radians(degrees.y), glm::dvec3(0, 1, 0));
+            glm::dmat4 z = glm::rotate(glm::dmat4(1), glm::radians(degrees.z), glm::dvec3(0, 0, 1));
+
+            // The order is the order the rotations are applied in so the matrices are reversed
+            switch (rotationOrder) {
+            case 1: return y * z * x;   // XZY
+            case 2: return x * z * y;   // YZX
+            case 3: return z * x * y;   // YXZ
+            case 4: return y * x * z;   // ZXY
+            case 5: return x * y * z;   // ZYX
+            default: return z * y * x;  // XYZ (and spheric XYZ)
+            }
+        }
 
-        // Assign the IO settings to the memory manager
-        memoryManager->SetIOSettings(ioSettings);
+        /// <summary>
+        /// A layer element of a geometry (normals, uvs...) decoded into doubles
+        /// </summary>
+        struct LayerElement
+        {
+            std::vector<double> values;
+            std::vector<std::int32_t> indices;
+            std::string_view mapping;
+            bool indexed = false;
+            int components = 0;
+
+            bool empty() const { return values.empty(); }
+
+            /// <summary>
+            /// Gets the index of the value to use for a corner of a polygon
+            /// </summary>
+            std::size_t find(std::size_t polygonVertex, std::size_t polygon, std::size_t controlPoint) const {
+                std::size_t index = polygonVertex;
+                if (mapping == "ByVertice" || mapping == "ByVertex" || mapping == "ByControlPoint") {
+                    index = controlPoint;
+                }
+                else if (mapping == "ByPolygon") {
+                    index = polygon;
+                }
+                else if (mapping == "AllSame") {
+                    index = 0;
+                }
 
-        // Adjust the import settings in the memory manager so that only the required data is imported
-        (*(memoryManager->GetIOSettings())).SetBoolProp(IMP_FBX_LINK, false);
-        (*(memoryManager->GetIOSettings())).SetBoolProp(IMP_FBX_SHAPE, false);
-        (*(memoryManager->GetIOSettings())).SetBoolProp(IMP_FBX_GOBO, false);
-        (*(memoryManager->GetIOSettings())).SetBoolProp(IMP_FBX_ANIMATION, false);
+                if (indexed) {
+                    if (index >= indices.size()) {
+                        throw std::runtime_error("FBX layer element index out of range.");
+                    }
+                    index = std::size_t(indices[index]);
+                }
+                if ((index + 1) * components > values.size()) {
+                    throw std::runtime_error("FBX layer element value out of range.");
+                }
+                return index;
+            }
+        };
+
+        /// <summary>
+        /// Decodes the first layer element of the given type in a geometry
+        /// </summary>
+        LayerElement getLayerElement(const binary::Node& geometry, std::string_view elementName,
+            std::string_view valuesName, std::string_view indicesName, int components) {
+            LayerElement element;
+            element.components = components;
+
+            const binary::Node* layer = geometry.findChild(elementName);
+            if (layer == nullptr) {
+                return element;
+            }
 
-        // Create and initialise the importer using the above settings
-        FbxImporter* importer = FbxImporter::Create(memoryManager, "");
+            const binary::Node* values = layer->findChild(valuesName);
+            if (values == nullptr || values->properties.empty()) {
+                return element;
+            }
+            binary::decodeArray(values->properties[0], element.values);
+
+            element.mapping = getChildString(*layer, "MappingInformationType");
+            std::string_view reference = getChildString(*layer, "ReferenceInformationType");
+            if (reference == "IndexToDirect" || reference == "Index") {
+                const binary::Node* indices = layer->findChild(indicesName);
+                if (indices != nullptr && !indices->properties.empty()) {
+                    binary::decodeArray(indices->properties[0], element.indices);
+                    element.indexed = true;
+                }
+            }
 
-        // Use the first argument as the filename for the importer.
-        if (!importer->Initialize(filename, -1, memoryManager->GetIOSettings())) {
-            throw std::runtime_error("Failed to initialise the importer.");
+            return element;
         }
 
-        std::cout << "Loading " << filename << std::endl;
+        /// <summary>
+        /// Triangulates a polygon by ear clipping in the plane of the polygon. Adds the
+        /// triangles as polygon vertex indices.
+        /// </summary>
+        void triangulatePolygon(const std::vector<glm::dvec3>& controlPoints, const std::vector<std::int32_t>& polygonIndices,
+            std::size_t first, std::size_t count, std::vector<std::uint32_t>& corners) {
+            auto controlPoint = [&](std::size_t polygonVertex) {
+                std::int32_t index = polygonIndices[polygonVertex];
+                return std::size_t(index < 0 ? ~index : index);
+            };
+
+            if (count < 3) {
+                return;
+            }
+            if (count == 3) {
+                corners.insert(corners.end(), { std::uint32_t(first), std::uint32_t(first + 1), std::uint32_t(first + 2) });
+                return;
+            }
 
-        // Create a scene object to store the data from the .fbx file
-        FbxScene* scene = FbxScene::Create(memoryManager, "Scene");
+            // Find the normal of the polygon with Newell's method and project onto the dominant plane
+            glm::dvec3 normal(0.0);
+            for (std::size_t i = 0; i < count; i++) {
+                glm::dvec3 current = controlPoints[controlPoint(first + i)];
+                glm::dvec3 next = controlPoints[controlPoint(first + (i + 1) % count)];
+                normal += glm::cross(current, next);
+            }
+            glm::dvec3 absolute = glm::abs(normal);
+            int dropAxis = absolute.x > absolute.y ? (absolute.x > absolute.z ? 0 : 2) : (absolute.y > absolute.z ? 1 : 2);
+            int axisU = (dropAxis + 1) % 3;
+            int axisV = (dropAxis + 2) % 3;
+            double orientation = normal[dropAxis] < 0.0 ? -1.0 : 1.0;
+
+            std::vector<glm::dvec2> points(count);
+            for (std::size_t i = 0; i < count; i++) {
+                glm::dvec3 point = controlPoints[controlPoint(first + i)];
+                points[i] = glm::dvec2(point[axisU], point[axisV]);
+            }
 
-        // Import the .fbx file and store within the scene object created and destroy the importer.
-        importer->Import(scene);
-        importer->Destroy();
+            auto signedArea = [&](std::size_t a, std::size_t b, std::size_t c) {
+                glm::dvec2 ab = points[b] - points[a];
+                glm::dvec2 ac = points[c] - points[a];
+                return orientation * (ab.x * ac.y - ab.y * ac.x);
+            };
 
-        // Triangulate the scene
-        FbxGeometryConverter converter(memoryManager);
-        converter.Triangulate(scene, true);
+            std::vector<std::size_t> remaining(count);
+            for (std::size_t i = 0; i < count; i++) {
+                remaining[i] = i;
+            }
+
+            while (remaining.size() > 3) {
+                bool clipped = false;
+                for (std::size_t i = 0; i < remaining.size(); i++) {
+                    std::size_t a = remaining[(i + remaining.size() - 1) % remaining.size()];
+                    std::size_t b = remaining[i];
+                    std::size_t c = remaining[(i + 1) % remaining.size()];
+
+                    // The corner must be convex
+                    if (signedArea(a, b, c) <= 0.0) {
+                        continue;
+                    }
+
+                    // And no other vertex can be inside the ear
+                    bool isEar = true;
+                    for (std::size_t other : remaining) {
+                        if (other == a || other == b || other == c) {
+                            continue;
+                        }
+                        if (signedArea(a, b, other) >= 0.0 && signedArea(b, c, other) >= 0.0 && signedArea(c, a, other) >= 0.0) {
+                            isEar = false;
+                            break;
+                        }
+                    }
+                    if (!isEar) {
+                        continue;
+                    }
 
-        // Get the root node of the scene
-        FbxNode* rootNode = scene->GetRootNode();
+                    corners.insert(corners.end(), { std::uint32_t(first + a), std::uint32_t(first + b), std::uint32_t(first + c) });
+                    remaining.erase(remaining.begin() + i);
+                    clipped = true;
+                    break;
+                }
+
+                // Degenerate polygon, fall back to a fan over what is left
+                if (!clipped) {
+                    for (std::size_t i = 1; i + 1 < remaining.size(); i++) {
+                        corners.insert(corners.end(), { std::uint32_t(first + remaining[0]),
+                            std::uint32_t(first + remaining[i]), std::uint32_t(first + remaining[i + 1]) });
+                    }
+                    return;
+                }
+            }
+
+            corners.insert(corners.end(), { std::uint32_t(first + remaining[0]),
+                std::uint32_t(first + remaining[1]), std::uint32_t(first + remaining[2]) });
+        }
 
+        /// <summary>
+        /// Every attribute that has to match for two triangle corners to share a vertex.
+        /// The material is per triangle so corners of different materials still share.
+        /// </summary>
+        struct WeldVertex
+        {
+            glm::vec3 position;
+            glm::vec3 normal;
+            glm::vec2 uv;
+        };
+        static_assert(sizeof(WeldVertex) == 8 * sizeof(std::uint32_t), "Weld vertices are compared bitwise so can not have padding");
+
+        /// <summary>
+        /// A slot of the weld table, the hash is kept so most mismatches skip comparing the vertices
+        /// </summary>
+        struct WeldSlot
+        {
+            std::uint32_t hash = 0;
+            std::uint32_t vertex = std::numeric_limits<std::uint32_t>::max();
+        };
+
+        /// <summary>
+        /// Hashes the bits of a weld vertex (negative zeros must already be made positive)
+        /// </summary>
+        std::uint32_t hashWeldVertex(const WeldVertex& vertex) {
+            std::uint32_t words[8];
+            std::memcpy(words, &vertex, sizeof(words));
+
+            std::uint64_t hash = 0xcbf29ce484222325ull;
+            for (std::uint32_t word : words) {
+                hash = (hash ^ word) * 0x9E3779B97F4A7C15ull;
+            }
+            return std::uint32_t(hash ^ (hash >> 32));
+        }
+
+        /// <summary>
+        /// Adds 0 to each component so -0 and 0 weld together and hash the same
+        /// </summary>
+        WeldVertex makeWeldVertex(glm::vec3 position, glm::vec3 normal, glm::vec2 uv) {
+            return WeldVertex{ position + glm::vec3(0.f), normal + glm::vec3(0.f), uv + glm::vec2(0.f) };
+        }
+
+        /// <summary>
+        /// Solves the tangent and bitangent of one triangle
+        /// </summary>
+        void solveTangents(const std::uint32_t* triangle, const std::vector<glm::vec3>& positions, const std::vector<glm::vec2>& uvs,
+            glm::vec3& outTangent, glm::vec3& outBitangent) {
+
+            // Get the positions of all points in the triangle v0, v1, v2 
+            glm::vec3 v0 = positions[triangle[0]];
+            glm::vec3 v1 = positions[triangle[1]];
+            glm::vec3 v2 = positions[triangle[2]];
+
+            // and get the corresponding texture coordinates
+            glm::vec2 uv0 = uvs[triangle[0]];
+            glm::vec2 uv1 = uvs[triangle[1]];
+            glm::vec2 uv2 = uvs[triangle[2]];
+
+            // Get the coordinates in terms of v0
+            glm::vec3 AB = v1 - v0;
+            glm::vec3 AC = v2 - v0;
+
+            // again with the texture coordinates
+            glm::vec2 uvAB = uv1 - uv0;
+            glm::vec2 uvAC = uv2 - uv0;
+
+            // Solve to find the unnormalized tangent vector of the triangle
+            float determinant = 1.0f / (uvAB.x * uvAC.y - uvAC.x * uvAB.y);
+            outTangent = determinant * (uvAC.y * AB - uvAB.y * AC);
+            outBitangent = determinant * (-uvAC.x * AB + uvAB.x * AC);
+        }
+
+        /// <summary>
+        /// Solves the tangents and bitangents of four consecutive triangles with SSE. The triangles are
+        /// gathered into SoA registers and each operation matches solveTangents so the results are identical.
+        /// </summary>
+        void solveTangents4(const std::uint32_t* triangles, const std::vector<glm::vec3>& positions, const std::vector<glm::vec2>& uvs,
+            glm::vec3* outTangents, glm::vec3* outBitangents) {
+
+            // Gather the corners of the four triangles, one lane per triangle
+            alignas(16) float gathered[3][5][4];
+            for (int lane = 0; lane < 4; lane++) {
+                for (int corner = 0; corner < 3; corner++) {
+                    std::uint32_t index = triangles[lane * 3 + corner];
+                    gathered[corner][0][lane] = positions[index].x;
+                    gathered[corner][1][lane] = positions[index].y;
+                    gathered[corner][2][lane] = positions[index].z;
+                    gathered[corner][3][lane] = uvs[index].x;
+                    gathered[corner][4][lane] = uvs[index].y;
+                }
+            }
+
+            // Edges from the first corner
+            __m128 AB[5], AC[5];
+            for (int component = 0; component < 5; component++) {
+                __m128 c0 = _mm_load_ps(gathered[0][component]);
+                AB[component] = _mm_sub_ps(_mm_load_ps(gathered[1][component]), c0);
+                AC[component] = _mm_sub_ps(_mm_load_ps(gathered[2][component]), c0);
+            }
+            __m128 const uvABx = AB[3], uvABy = AB[4];
+            __m128 const uvACx = AC[3], uvACy = AC[4];
+
+            __m128 determinant = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sub_ps(_mm_mul_ps(uvABx, uvACy), _mm_mul_ps(uvACx, uvABy)));
+            __m128 negUVACx = _mm_xor_ps(uvACx, _mm_set1_ps(-0.0f));
+
+            alignas(16) float tangent[3][4], bitangent[3][4];
+            for (int component = 0; component < 3; component++) {
+                __m128 t = _mm_sub_ps(_mm_mul_ps(uvACy, AB[component]), _mm_mul_ps(uvABy, AC[component]));
+                __m128 b = _mm_add_ps(_mm_mul_ps(negUVACx, AB[component]), _mm_mul_ps(uvABx, AC[component]));
+                _mm_store_ps(tangent[component], _mm_mul_ps(determinant, t));
+                _mm_store_ps(bitangent[component], _mm_mul_ps(determinant, b));
+            }
+
+            for (int lane = 0; lane < 4; lane++) {
+                outTangents[lane] = glm::vec3(tangent[0][lane], tangent[1][lane], tangent[2][lane]);
+                outBitangents[lane] = glm::vec3(bitangent[0][lane], bitangent[1][lane], bitangent[2][lane]);
+            }
+        }
+    }
+
+    Scene loadFBXFile(const char* filename) {
+
+        std::cout << "Loading " << filename << std::endl;
+
+        // Map and parse the .fbx file
+        binary::Document document(filename);
+
+        // Walk the node tree from the root node, meshes are decoded after the walk
         Scene outputScene;
-        std::unordered_map<std::string, std::uint32_t> materialMap;
-        getChildren(rootNode, outputScene);
+        std::vector<MeshSource> meshSources;
+        getChildren(document.root(), glm::dmat4(1), document, outputScene, meshSources);
+
+        // Nodes that share a geometry object and materials are decoded once and drawn as instances of the first node
+        std::vector<std::vector<std::size_t>> instanceGroups = groupInstances(meshSources);
+
+        // Decode, triangulate, weld, optimise and simplify the meshes in parallel. Each mesh inflates its own arrays.
+        outputScene.meshes.resize(instanceGroups.size());
+        std::vector<optimisation::OptimisationReport> reports(instanceGroups.size());
+        jobs::shared().parallelFor(instanceGroups.size(), 1, [&](std::size_t begin, std::size_t end) {
+            for (std::size_t i = begin; i < end; i++) {
+                const std::vector<std::size_t>& group = instanceGroups[i];
+                MeshSource& first = meshSources[group[0]];
+                Mesh& mesh = outputScene.meshes[i];
+                mesh = createMeshData(*first.geometry, first.materialIndices, first.transform, &reports[i]);
+
+                // Other nodes place the world space geometry of the first relative to themselves
+                if (group.size() > 1) {
+                    glm::mat4 inverseFirst = glm::inverse(first.transform);
+                    for (std::size_t source : group) {
+                        mesh.instanceTransforms.emplace_back(source == group[0] ? glm::mat4(1) : meshSources[source].transform * inverseFirst);
+                    }
+                }
+            }
+        });
+
+        if (meshSources.size() != instanceGroups.size()) {
+            std::cout << "Shared geometry: " << meshSources.size() << " mesh nodes use " << instanceGroups.size() << " meshes" << std::endl;
+        }
+
+        // Report how much the index buffers were improved for the vertex cache
+        optimisation::OptimisationReport total;
+        for (const optimisation::OptimisationReport& report : reports) {
+            total.before += report.before;
+            total.after += report.after;
+        }
+        std::cout << "Vertex cache over " << total.after.triangles << " triangles: ACMR " << total.before.acmr() << " -> " << total.after.acmr()
+            << ", ATVR " << total.before.atvr() << " -> " << total.after.atvr() << std::endl;
+
+        // Report the scene's triangles at each level of detail, submeshes with fewer levels use their coarsest
+        std::cout << "Triangles per level of detail:";
+        for (std::size_t level = 0; level < LOD_LEVELS; level++) {
+            std::size_t triangles = 0;
+            for (const Mesh& mesh : outputScene.meshes) {
+                for (const Submesh& submesh : mesh.submeshes) {
+                    std::size_t const lod = submesh.firstLod + std::min<std::size_t>(level, submesh.lodCount - 1);
+                    triangles += mesh.lods[lod].indexCount / 3;
+                }
+            }
+            std::cout << " " << triangles;
+        }
+        std::cout << std::endl;
+
+        std::size_t submeshCount = 0;
+        for (const Mesh& mesh : outputScene.meshes) {
+            submeshCount += mesh.submeshes.size();
+        }
+        std::cout << "Submeshes (one per material of each mesh): " << submeshCount << std::endl;
+
+        std::size_t meshletCount = 0;
+        for (const Mesh& mesh : outputScene.meshes) {
+            meshletCount += mesh.meshlets.size();
+        }
+        std::cout << "Meshlets over every level of detail: " << meshletCount << std::endl;
         
         if (DEBUG_OUTPUTS) {
             std::cout << std::endl;
@@ -75,68 +459,55 @@ namespace fbx {
             std::cout << std::endl;
         }        
 
-        // Destroy the SDK manager and all the other objects it was handling.
-        memoryManager->Destroy();
-
         std::cout << "Finished loading " << filename << std::endl;
 
         return outputScene;
     }
 
-    void getChildren(FbxNode* node, Scene& outputScene) {
-        // Get the number of children in the node
-        int numChildren = node->GetChildCount();
-
-        if(DEBUG_OUTPUTS)
-            std::cout << "Name: " << node->GetName() << " Number of children: " << numChildren << " Number of materials: " << node->GetMaterialCount() << std::endl;
+    void getChildren(const binary::Object& node, const glm::dmat4& parentTransform, const binary::Document& document,
+        Scene& outputScene, std::vector<MeshSource>& meshSources) {
 
         // Get the global transform matrix of the node
-        FbxAMatrix nodeTransform = node->EvaluateGlobalTransform();
-
-        // Set the scale of the transform
-        //FbxVector4 fbxScale = nodeTransform.GetS() * 0.01;
-        FbxVector4 fbxScale = nodeTransform.GetS();
-        nodeTransform.SetS(fbxScale);
-
-        // Convert it to GLM
-        glm::mat4 transformMatrix;
-        FbxVector4 col0 = nodeTransform.GetRow(0);
-        transformMatrix[0] = glm::vec4(col0[0], col0[1], col0[2], col0[3]);
-        FbxVector4 col1 = nodeTransform.GetRow(1);
-        transformMatrix[1] = glm::vec4(col1[0], col1[1], col1[2], col1[3]);
-        FbxVector4 col2 = nodeTransform.GetRow(2);
-        transformMatrix[2] = glm::vec4(col2[0], col2[1], col2[2], col2[3]);
-        FbxVector4 col3 = nodeTransform.GetRow(3);
-        transformMatrix[3] = glm::vec4(col3[0], col3[1], col3[2], col3[3]);
-
-        // Reset the translation component so it is unaffected by scale
-        //FbxVector4 fbxTranslation = nodeTransform.GetT() * 0.01;
-        FbxVector4 fbxTranslation = nodeTransform.GetT();
-        glm::vec4 translation = glm::vec4(fbxTranslation[0], fbxTranslation[1], fbxTranslation[2], 1);
-        transformMatrix[3] = translation;
-
-        // Check for materials
+        glm::dmat4 nodeTransform = parentTransform;
+        if (&node != &document.root()) {
+            nodeTransform = parentTransform * getLocalTransform(node);
+        }
+        glm::mat4 transformMatrix = glm::mat4(nodeTransform);
+
+        // Check for materials, they are connected to the node in the order of the mesh material indices
         std::vector<uint32_t> materialIndices;
-        if (node->GetMaterialCount() > 0) {
-            for (int i = 0; i < node->GetMaterialCount(); i++) {
+        const binary::Object* geometry = nullptr;
+        const binary::Object* light = nullptr;
+        int numChildren = 0;
+        for (const binary::Connection& source : node.sources) {
+            const binary::Object& object = *source.object;
+
+            if (object.type == "Model") {
+                numChildren++;
+            }
+            else if (object.type == "Geometry" && object.subType == "Mesh") {
+                geometry = &object;
+            }
+            else if (object.type == "NodeAttribute" && object.subType == "Light") {
+                light = &object;
+            }
+            else if (object.type == "Material") {
                 // Reset material index
-                uint32_t materialIndex = -1;
-                
-                // Only get the first material for now and apply it to the entire mesh.
-                FbxSurfaceMaterial* material = node->GetMaterial(i);
+                constexpr uint32_t NO_MATERIAL = std::numeric_limits<uint32_t>::max();
+                uint32_t materialIndex = NO_MATERIAL;
 
                 // Check if the material data has already been made
                 for (size_t i = 0; i < outputScene.materials.size(); i++) {
-                    if (outputScene.materials[i].materialName == material->GetName()) {
-                        materialIndex = i;
+                    if (outputScene.materials[i].materialName == object.name) {
+                        materialIndex = uint32_t(i);
                         break;
                     }
                 }
 
                 // If material has not been found create one for it
-                if (materialIndex == -1) {
-                    outputScene.materials.emplace_back(createMaterialData(material, outputScene));
-                    materialIndex = outputScene.materials.size() - 1;
+                if (materialIndex == NO_MATERIAL) {
+                    outputScene.materials.emplace_back(createMaterialData(object, document, outputScene));
+                    materialIndex = uint32_t(outputScene.materials.size() - 1);
                 }
 
                 // Add to the material indices
@@ -146,27 +517,28 @@ namespace fbx {
                     std::cout << "Material name: " << outputScene.materials[materialIndex].materialName << " Material index: " << materialIndex << std::endl;
             }
         }
-        else {
-            if (DEBUG_OUTPUTS)
-                std::cout << "Node has no material component." << std::endl;
-        }
 
+        if (DEBUG_OUTPUTS)
+            std::cout << "Name: " << node.name << " Number of children: " << numChildren << " Number of materials: " << materialIndices.size() << std::endl;
 
         // Check if the node has a mesh component
-        FbxMesh* nodeMesh = node->GetMesh();
-        if (nodeMesh == NULL) {
+        if (geometry == nullptr) {
             if (DEBUG_OUTPUTS) {
                 std::cout << "Node has no mesh component." << std::endl;
             }
-            FbxLight* light = node->GetLight();
-            if (light != NULL) {
-                outputScene.lights.emplace_back(createLightData(light, transformMatrix));
+            if (light != nullptr) {
+                outputScene.lights.emplace_back(createLightData(*light, transformMatrix));
             }
         }
         else {
-            // Create the mesh data
-            outputScene.meshes.emplace_back(createMeshData(nodeMesh, materialIndices, transformMatrix));
-            outputScene.meshes.back().materials = materialIndices;
+            // The geometric transform only applies to the mesh of this node and is not inherited
+            glm::dmat4 geometricTransform =
+                glm::translate(glm::dmat4(1), getVector3(node, "GeometricTranslation", glm::dvec3(0))) *
+                eulerRotation(getVector3(node, "GeometricRotation", glm::dvec3(0)), 0) *
+                glm::scale(glm::dmat4(1), getVector3(node, "GeometricScaling", glm::dvec3(1)));
+
+            // Queue the mesh data to be created once the tree has been walked
+            meshSources.emplace_back(MeshSource{ geometry, materialIndices, glm::mat4(nodeTransform * geometricTransform) });
         }
 
         // If there is no children do not recurse
@@ -175,279 +547,448 @@ namespace fbx {
         }
 
         // Visit all the children of the current node
-        for (int i = 0; i < numChildren; i++) {
-            FbxNode* childNode = node->GetChild(i);
-            getChildren(childNode, outputScene);
+        for (const binary::Connection& source : node.sources) {
+            if (source.object->type == "Model") {
+                getChildren(*source.object, nodeTransform, document, outputScene, meshSources);
+            }
         }
     }
 
-    Mesh createMeshData(FbxMesh* inMesh, std::vector<uint32_t>& materialIndices, glm::mat4 transform) {
+    std::vector<std::vector<std::size_t>> groupInstances(const std::vector<MeshSource>& meshSources) {
+        std::vector<std::vector<std::size_t>> groups;
+        std::unordered_map<const binary::Object*, std::vector<std::size_t>> groupsOfGeometry;
+        for (std::size_t i = 0; i < meshSources.size(); i++) {
+            const MeshSource& source = meshSources[i];
+
+            // Find an earlier node with the same geometry and materials that this node can be an instance of
+            std::vector<std::size_t>& candidates = groupsOfGeometry[source.geometry];
+            std::vector<std::size_t>* match = nullptr;
+            for (std::size_t candidate : candidates) {
+                std::vector<std::size_t>& group = groups[candidate];
+                const MeshSource& first = meshSources[group[0]];
+                if (first.materialIndices != source.materialIndices) {
+                    continue;
+                }
+
+                // The relative transform must exist and keep the winding of the triangles
+                float firstDeterminant = glm::determinant(first.transform);
+                if (std::abs(firstDeterminant) < std::numeric_limits<float>::epsilon()) {
+                    continue;
+                }
+                glm::mat4 const relative = source.transform * glm::inverse(first.transform);
+                if (glm::determinant(relative) <= 0) {
+                    continue;
+                }
+
+                // Instances share the normals of the first node, so only rotation, translation and uniform scale are allowed
+                glm::vec3 const axes[3] = { glm::vec3(relative[0]), glm::vec3(relative[1]), glm::vec3(relative[2]) };
+                float const scale = glm::length(axes[0]);
+                bool similar = true;
+                for (int axis = 0; axis < 3; axis++) {
+                    similar = similar && std::abs(glm::length(axes[axis]) - scale) <= INSTANCE_SIMILARITY_TOLERANCE * scale &&
+                        std::abs(glm::dot(axes[axis], axes[(axis + 1) % 3])) <= INSTANCE_SIMILARITY_TOLERANCE * scale * scale;
+                }
+                if (!similar) {
+                    continue;
+                }
+                match = &group;
+                break;
+            }
+
+            if (match != nullptr) {
+                match->emplace_back(i);
+            }
+            else {
+                candidates.emplace_back(groups.size());
+                groups.emplace_back(std::vector<std::size_t>{ i });
+            }
+        }
+        return groups;
+    }
+
+    glm::dmat4 getLocalTransform(const binary::Object& node) {
+        // Translation, rotation and scale with their offsets and pivots
+        glm::dmat4 translation = glm::translate(glm::dmat4(1), getVector3(node, "Lcl Translation", glm::dvec3(0)));
+        glm::dmat4 rotationOffset = glm::translate(glm::dmat4(1), getVector3(node, "RotationOffset", glm::dvec3(0)));
+        glm::dmat4 rotationPivot = glm::translate(glm::dmat4(1), getVector3(node, "RotationPivot", glm::dvec3(0)));
+        glm::dmat4 scalingOffset = glm::translate(glm::dmat4(1), getVector3(node, "ScalingOffset", glm::dvec3(0)));
+        glm::dmat4 scalingPivot = glm::translate(glm::dmat4(1), getVector3(node, "ScalingPivot", glm::dvec3(0)));
+        glm::dmat4 scaling = glm::scale(glm::dmat4(1), getVector3(node, "Lcl Scaling", glm::dvec3(1)));
+
+        int rotationOrder = int(getValue(node, "RotationOrder", 0));
+        glm::dmat4 rotation = eulerRotation(getVector3(node, "Lcl Rotation", glm::dvec3(0)), rotationOrder);
+
+        // Pre and post rotations are only used when the rotation is active and always use XYZ order
+        glm::dmat4 preRotation(1);
+        glm::dmat4 postRotation(1);
+        if (getValue(node, "RotationActive", 0) != 0) {
+            preRotation = eulerRotation(getVector3(node, "PreRotation", glm::dvec3(0)), 0);
+            postRotation = eulerRotation(getVector3(node, "PostRotation", glm::dvec3(0)), 0);
+        }
+
+        return translation * rotationOffset * rotationPivot * preRotation * rotation * glm::inverse(postRotation) *
+            glm::inverse(rotationPivot) * scalingOffset * scalingPivot * scaling * glm::inverse(scalingPivot);
+    }
+
+    Mesh createMeshData(const binary::Object& geometry, std::vector<uint32_t>& materialIndices, glm::mat4 transform,
+        optimisation::OptimisationReport* report) {
         Mesh outMesh;
+        const binary::Node& geometryNode = *geometry.node;
 
-        // Get the number of triangles in the mesh and all the triangles
-        int numTriangles = inMesh->GetPolygonCount();
+        // Get all the vertices (control points)
+        const binary::Node* verticesNode = geometryNode.findChild("Vertices");
+        const binary::Node* indicesNode = geometryNode.findChild("PolygonVertexIndex");
+        if (verticesNode == nullptr || indicesNode == nullptr || verticesNode->properties.empty() || indicesNode->properties.empty()) {
+            throw std::runtime_error("Failed to gather mesh vertices.");
+        }
+        std::vector<double> vertexValues;
+        binary::decodeArray(verticesNode->properties[0], vertexValues);
+        std::vector<glm::dvec3> fbxVertices(vertexValues.size() / 3);
+        for (size_t i = 0; i < fbxVertices.size(); i++) {
+            fbxVertices[i] = glm::dvec3(vertexValues[i * 3], vertexValues[i * 3 + 1], vertexValues[i * 3 + 2]);
+        }
 
-        // Get the number of vertices and all vertices
-        int numVertices = inMesh->GetControlPointsCount();
-        FbxVector4* fbxVertices = inMesh->GetControlPoints();
+        // Get all the indices, the last index of each polygon is stored as its bitwise complement
+        std::vector<std::int32_t> fbxIndices;
+        binary::decodeArray(indicesNode->properties[0], fbxIndices);
+        for (std::int32_t index : fbxIndices) {
+            if ((index < 0 ? ~index : index) >= std::int32_t(fbxVertices.size())) {
+                throw std::runtime_error("Mesh index out of range.");
+            }
+        }
 
-        // Get the number of indices and all indices
-        int numIndices = inMesh->GetPolygonVertexCount();
-        int* fbxIndices = inMesh->GetPolygonVertices();
+        // Find the polygons and triangulate them
+        std::vector<size_t> polygonOfVertex(fbxIndices.size());
+        std::vector<std::uint32_t> corners;
+        corners.reserve(fbxIndices.size() * 2);
+        size_t polygonStart = 0;
+        size_t numPolygons = 0;
+        for (size_t i = 0; i < fbxIndices.size(); i++) {
+            polygonOfVertex[i] = numPolygons;
+            if (fbxIndices[i] < 0) {
+                triangulatePolygon(fbxVertices, fbxIndices, polygonStart, i + 1 - polygonStart, corners);
+                polygonStart = i + 1;
+                numPolygons++;
+            }
+        }
 
         // Get the normals for the mesh
-        FbxArray<FbxVector4> fbxNormals;
-        // Generate the normals (if there is none) and store them
-        if (!(inMesh->GenerateNormals() && inMesh->GetPolygonVertexNormals(fbxNormals))) {
-            throw std::runtime_error("Failed to gather mesh normals");
+        LayerElement fbxNormals = getLayerElement(geometryNode, "LayerElementNormal", "Normals", "NormalsIndex", 3);
+        if (fbxNormals.empty()) {
+            // Generate smooth normals from the area weighted triangle normals
+            std::vector<glm::dvec3> generated(fbxVertices.size(), glm::dvec3(0));
+            for (size_t i = 0; i < corners.size(); i += 3) {
+                size_t a = size_t(fbxIndices[corners[i]] < 0 ? ~fbxIndices[corners[i]] : fbxIndices[corners[i]]);
+                size_t b = size_t(fbxIndices[corners[i + 1]] < 0 ? ~fbxIndices[corners[i + 1]] : fbxIndices[corners[i + 1]]);
+                size_t c = size_t(fbxIndices[corners[i + 2]] < 0 ? ~fbxIndices[corners[i + 2]] : fbxIndices[corners[i + 2]]);
+                glm::dvec3 faceNormal = glm::cross(fbxVertices[b] - fbxVertices[a], fbxVertices[c] - fbxVertices[a]);
+                generated[a] += faceNormal;
+                generated[b] += faceNormal;
+                generated[c] += faceNormal;
+            }
+            fbxNormals.mapping = "ByControlPoint";
+            fbxNormals.values.resize(generated.size() * 3);
+            for (size_t i = 0; i < generated.size(); i++) {
+                glm::dvec3 normal = glm::length(generated[i]) > 0.0 ? glm::normalize(generated[i]) : glm::dvec3(0, 1, 0);
+                fbxNormals.values[i * 3] = normal.x;
+                fbxNormals.values[i * 3 + 1] = normal.y;
+                fbxNormals.values[i * 3 + 2] = normal.z;
+            }
         }
 
         // Get the uvs for the mesh 
         // For now use only the first uv set in the mesh
-        FbxStringList uvSets;
-        inMesh->GetUVSetNames(uvSets);
-        FbxArray<FbxVector2> fbxUVs;
-        if (!inMesh->GetPolygonVertexUVs(uvSets.GetStringAt(0), fbxUVs)) {
+        LayerElement fbxUVs = getLayerElement(geometryNode, "LayerElementUV", "UV", "UVIndex", 2);
+        if (fbxUVs.empty()) {
             throw std::runtime_error("Failed to gather mesh texture coordinates.");
         }
 
+        // Get the per polygon material indices
+        std::vector<std::int32_t> fbxMaterials;
+        std::string_view materialMapping;
+        if (const binary::Node* materialLayer = geometryNode.findChild("LayerElementMaterial")) {
+            const binary::Node* materials = materialLayer->findChild("Materials");
+            if (materials != nullptr && !materials->properties.empty()) {
+                binary::decodeArray(materials->properties[0], fbxMaterials);
+            }
+            materialMapping = getChildString(*materialLayer, "MappingInformationType");
+        }
+
         // Remove the translation component for the  
         glm::mat4 normalTransform = transform;
         normalTransform[3] = glm::vec4(0, 0, 0, 1);
 
-        std::vector<glm::vec3> positions;
-        std::vector<glm::vec2> uvs;
-        std::vector<glm::vec3> normals;
-        std::vector<uint32_t> materialIDs;
-        std::vector<uint32_t> indices;
-
-        // For each index
-        for (int i = 0; i < numIndices; i++) {  
-            // Get the index
-            int index = fbxIndices[i];
+        // Corners with identical attributes are welded into one vertex through an open addressing
+        // table. It is at least twice the corner count so it never fills and probes stay short.
+        std::size_t const tableSize = std::bit_ceil(std::max<std::size_t>(corners.size() * 2, 16));
+        std::size_t const tableMask = tableSize - 1;
+        std::vector<WeldSlot> weldTable(tableSize);
+        std::vector<std::uint32_t> weldedIndices;
+        weldedIndices.reserve(corners.size());
+
+        // The scene material of each triangle
+        std::vector<std::uint32_t> triangleMaterials(corners.size() / 3);
+
+        // For each triangle corner
+        for (size_t i = 0; i < corners.size(); i++) {  
+            // Get the polygon vertex, its polygon and its control point
+            size_t polygonVertex = corners[i];
+            size_t polygon = polygonOfVertex[polygonVertex];
+            std::int32_t index = fbxIndices[polygonVertex];
+            if (index < 0) {
+                index = ~index;
+            }
 
             // Get the vertex position
-            glm::vec3 vertex = glm::vec3(fbxVertices[index][0], fbxVertices[index][1], fbxVertices[index][2]);
+            glm::vec3 vertex = glm::vec3(fbxVertices[index]);
 
             // Get the vertex normal
-            glm::vec3 normal = glm::vec3(fbxNormals[i][0], fbxNormals[i][1], fbxNormals[i][2]);
+            size_t normalIndex = fbxNormals.find(polygonVertex, polygon, size_t(index)) * 3;
+            glm::vec3 normal = glm::vec3(fbxNormals.values[normalIndex], fbxNormals.values[normalIndex + 1], fbxNormals.values[normalIndex + 2]);
 
             // Get the vertex texture co-ordinate
-            glm::vec2 uv = glm::vec2(fbxUVs[i][0], fbxUVs[i][1]);
+            size_t uvIndex = fbxUVs.find(polygonVertex, polygon, size_t(index)) * 2;
+            glm::vec2 uv = glm::vec2(fbxUVs.values[uvIndex], fbxUVs.values[uvIndex + 1]);
+
+            // Material index for the current polygon, every corner of a triangle is from the same polygon
+            if (i % 3 == 0) {
+                size_t materialIndex = 0;
+                if (!fbxMaterials.empty()) {
+                    materialIndex = size_t(fbxMaterials[materialMapping == "AllSame" ? 0 : std::min(polygon, fbxMaterials.size() - 1)]);
+                }
+                triangleMaterials[i / 3] = materialIndex < materialIndices.size() ? materialIndices[materialIndex] : 0;
+            }
+
+            WeldVertex weldVertex = makeWeldVertex(
+                glm::vec3(transform * glm::vec4(vertex, 1)),
+                glm::vec3(normalTransform * glm::vec4(normal, 1)),
+                uv);
+
+            // Probe for an identical vertex, stopping at the first empty slot
+            std::uint32_t const hash = hashWeldVertex(weldVertex);
+            std::size_t slot = hash & tableMask;
+            while (weldTable[slot].vertex != std::numeric_limits<std::uint32_t>::max()) {
+                const WeldSlot& existing = weldTable[slot];
+                if (existing.hash == hash) {
+                    WeldVertex other = makeWeldVertex(outMesh.vertexPositions[existing.vertex], outMesh.vertexNormals[existing.vertex],
+                        outMesh.vertexTextureCoords[existing.vertex]);
+                    if (std::memcmp(&other, &weldVertex, sizeof(WeldVertex)) == 0) {
+                        break;
+                    }
+                }
+                slot = (slot + 1) & tableMask;
+            }
 
-            // Add the new vertex position and normal
-            positions.emplace_back(transform * glm::vec4(vertex, 1));
-            normals.emplace_back(normalTransform * glm::vec4(normal, 1));
-            uvs.emplace_back(uv);
+            // A new vertex
+            if (weldTable[slot].vertex == std::numeric_limits<std::uint32_t>::max()) {
+                weldTable[slot] = WeldSlot{ hash, std::uint32_t(outMesh.vertexPositions.size()) };
+                outMesh.vertexPositions.emplace_back(weldVertex.position);
+                outMesh.vertexNormals.emplace_back(weldVertex.normal);
+                outMesh.vertexTextureCoords.emplace_back(weldVertex.uv);
+            }
 
-            // Store the newly assigned index
-            indices.emplace_back(i);
+            // Store the (possibly shared) index
+            weldedIndices.emplace_back(weldTable[slot].vertex);
         }
-
-        // Calculate the per polygon material ids
-        FbxLayerElementMaterial* materialElement = inMesh->GetElementMaterial();
-        for (int i = 0; i < inMesh->GetPolygonCount(); i++) {
-            // Material index for the current polygon
-            int materialIndex = materialElement->GetIndexArray().GetAt(i);
-            materialIDs.emplace_back(materialIndices[materialIndex]);
-            materialIDs.emplace_back(materialIndices[materialIndex]);
-            materialIDs.emplace_back(materialIndices[materialIndex]);
+        std::size_t const vertexCount = outMesh.vertexPositions.size();
+        optimisation::CacheStatistics cacheBefore = optimisation::analyseVertexCache(weldedIndices, vertexCount);
+
+        // Group the triangles by material, each group becomes a contiguous range of the indices
+        std::vector<std::uint32_t> usedMaterials = triangleMaterials;
+        std::sort(usedMaterials.begin(), usedMaterials.end());
+        usedMaterials.erase(std::unique(usedMaterials.begin(), usedMaterials.end()), usedMaterials.end());
+        std::vector<std::vector<std::uint32_t>> materialIndexLists(usedMaterials.size());
+        for (std::size_t triangle = 0; triangle < triangleMaterials.size(); triangle++) {
+            std::size_t const group = std::size_t(std::lower_bound(usedMaterials.begin(), usedMaterials.end(), triangleMaterials[triangle]) -
+                usedMaterials.begin());
+            materialIndexLists[group].insert(materialIndexLists[group].end(),
+                weldedIndices.begin() + triangle * 3, weldedIndices.begin() + triangle * 3 + 3);
+        }
+        weldedIndices.clear();
+        weldedIndices.shrink_to_fit();
+
+        // Reorder the triangles of each material for the vertex cache and then for overdraw, then renumber the
+        // vertices in the order they are first used so vertex fetches stay local
+        outMesh.vertexIndices.reserve(corners.size());
+        for (std::vector<std::uint32_t>& indices : materialIndexLists) {
+            optimisation::optimiseVertexCache(indices, vertexCount);
+            if (OPTIMISE_OVERDRAW) {
+                optimisation::optimiseOverdraw(indices, outMesh.vertexPositions);
+            }
+            outMesh.vertexIndices.insert(outMesh.vertexIndices.end(), indices.begin(), indices.end());
         }
 
-        // Check if the mesh will benefit from redoing the indices
-        // Check for duplicate vertices and re-index them
+        std::vector<std::uint32_t> remap = optimisation::optimiseVertexFetch(outMesh.vertexIndices, vertexCount);
+        std::size_t const usedVertexCount = std::size_t(std::count_if(remap.begin(), remap.end(),
+            [](std::uint32_t vertex) { return vertex != optimisation::UNUSED_VERTEX; }));
+        optimisation::remapVertices(outMesh.vertexPositions, remap, usedVertexCount);
+        optimisation::remapVertices(outMesh.vertexNormals, remap, usedVertexCount);
+        optimisation::remapVertices(outMesh.vertexTextureCoords, remap, usedVertexCount);
 
-        
-        std::vector<int> seenIndex(indices.size(), -1);
-        std::unordered_map<glm::vec3, std::pair<uint32_t, uint32_t>> seenVertices;
-        std::vector<std::vector<std::uint32_t>> samePositionsArray;
+        // Calculate the per vertex tangents
+        outMesh.vertexTangents = calculateTangents(outMesh.vertexIndices, outMesh.vertexPositions, outMesh.vertexTextureCoords, outMesh.vertexNormals);
 
-        for (size_t i = 0; i < indices.size(); i++) {
-            uint32_t index = indices[i];
+        // Build the coarser levels of detail of each material, they share the vertices of the full mesh.
+        // Each submesh's levels are stored one after the other.
+        std::vector<std::uint32_t> fullIndices = std::move(outMesh.vertexIndices);
+        outMesh.vertexIndices.clear();
+        std::size_t materialStart = 0;
+        for (std::size_t group = 0; group < usedMaterials.size(); group++) {
+            std::size_t const materialCount = materialIndexLists[group].size();
+            std::vector<std::uint32_t> indices(fullIndices.begin() + materialStart, fullIndices.begin() + materialStart + materialCount);
+            materialStart += materialCount;
+
+            std::vector<simplification::LodLevel> lods = simplification::buildLodChain(indices, outMesh.vertexPositions,
+                LOD_LEVELS, LOD_REDUCTION, LOD_MIN_TRIANGLES);
+
+            Submesh submesh;
+            submesh.material = usedMaterials[group];
+            submesh.firstLod = std::uint32_t(outMesh.lods.size());
+            submesh.lodCount = std::uint32_t(lods.size());
+            for (simplification::LodLevel& lod : lods) {
+                lod.firstIndex += std::uint32_t(outMesh.vertexIndices.size());
+                outMesh.lods.emplace_back(lod);
+            }
 
-            // If index has already been seen and re-indexed, use that one
-            if (seenIndex[index] != -1) {
-                outMesh.vertexIndices.emplace_back(seenIndex[index]);
+            // Calculate the bounds used for culling from the full triangles (positions are already in world space)
+            submesh.boundsMin = outMesh.vertexPositions[indices[0]];
+            submesh.boundsMax = submesh.boundsMin;
+            for (std::size_t i = 0; i < materialCount; i++) {
+                submesh.boundsMin = glm::min(submesh.boundsMin, outMesh.vertexPositions[indices[i]]);
+                submesh.boundsMax = glm::max(submesh.boundsMax, outMesh.vertexPositions[indices[i]]);
             }
-            // Index has not been found so find the vertex and re-index accordingly
-            else {
-                // Check if that position has been seen before
-                if (seenVertices.find(positions[index]) == seenVertices.end()) {
-                    // New position found
-                    // Add the new vertex position normal and uv
-                    outMesh.vertexPositions.emplace_back(glm::vec4(positions[index], 1));
-                    outMesh.vertexNormals.emplace_back(glm::vec4(normals[index], 1));
-                    outMesh.vertexTextureCoords.emplace_back(uvs[index]);
-                    outMesh.vertexMaterialIDs.emplace_back(materialIDs[index]);
-
-                    // Store the newly assigned index
-                    std::uint32_t newIndex = outMesh.vertexPositions.size() - 1;
-                    outMesh.vertexIndices.emplace_back(newIndex);
-
-                    // Add it to the map of seen vertices
-                    samePositionsArray.emplace_back(std::vector<std::uint32_t>());
-                    samePositionsArray[samePositionsArray.size() - 1].emplace_back(newIndex);
-                    
-                    seenVertices[positions[index]] = std::pair<uint32_t, uint32_t>(newIndex, samePositionsArray.size() - 1);
-
-                    // Note that the index has been seen and remapped to a new index
-                    seenIndex[index] = newIndex;
-                }
-                else {
-                    // Position already exists
-                    // Get the already assigned index
-                    std::uint32_t newIndex = seenVertices.at(positions[index]).first;
-                    std::uint32_t vertexID = seenVertices.at(positions[index]).second;
-
-                    // Check that the uvs, normals and materials match up as well
-                    if ((outMesh.vertexTextureCoords[newIndex] != uvs[index]) || 
-                        outMesh.vertexNormals[newIndex] != normals[index] ||
-                        outMesh.vertexMaterialIDs[newIndex] != materialIDs[index]) {
-                        // If uvs or normals do not match
-                        // Add to index array as if its a new vertex
-                        outMesh.vertexPositions.emplace_back(glm::vec4(positions[index], 1));
-                        outMesh.vertexNormals.emplace_back(glm::vec4(normals[index], 1));
-                        outMesh.vertexTextureCoords.emplace_back(uvs[index]);
-                        outMesh.vertexMaterialIDs.emplace_back(materialIDs[index]);
-
-                        // Store the newly assigned index
-                        std::uint32_t oldIndex = newIndex;
-                        newIndex = outMesh.vertexPositions.size() - 1;
-                        outMesh.vertexIndices.emplace_back(newIndex);
-
-                        // Map the new index to the vertex
-                        samePositionsArray[vertexID].emplace_back(newIndex);
 
-                    }
-                    else {
-                        // Identical index so remap and store the index only
-                        // Store the index
-                        outMesh.vertexIndices.emplace_back(newIndex);
-
-                        // Map the new index to the seen indices
-                        seenIndex[index] = newIndex;
-                    }                    
-                }
+            outMesh.vertexIndices.insert(outMesh.vertexIndices.end(), indices.begin(), indices.end());
+            outMesh.submeshes.emplace_back(submesh);
+        }
+
+        // Split every level into meshlets, this reorders the triangles within each level
+        for (simplification::LodLevel& lod : outMesh.lods) {
+            lod.firstMeshlet = std::uint32_t(outMesh.meshlets.size());
+            meshlets::buildMeshlets(outMesh.vertexIndices, lod.firstIndex, lod.indexCount, outMesh.vertexPositions,
+                MESHLET_MAX_VERTICES, MESHLET_MAX_TRIANGLES, outMesh.meshlets);
+            lod.meshletCount = std::uint32_t(outMesh.meshlets.size()) - lod.firstMeshlet;
+        }
+
+        // Measure the full detail triangles as they will be drawn, after the meshlets have grouped them
+        if (report != nullptr) {
+            std::vector<std::uint32_t> drawnIndices;
+            drawnIndices.reserve(fullIndices.size());
+            for (const Submesh& submesh : outMesh.submeshes) {
+                const simplification::LodLevel& lod = outMesh.lods[submesh.firstLod];
+                drawnIndices.insert(drawnIndices.end(), outMesh.vertexIndices.begin() + lod.firstIndex,
+                    outMesh.vertexIndices.begin() + lod.firstIndex + lod.indexCount);
             }
+            report->before = cacheBefore;
+            report->after = optimisation::analyseVertexCache(drawnIndices, usedVertexCount);
         }
-        
-        // Calculate the per vertex tangents
-        outMesh.vertexTangents = calculateTangents(outMesh.vertexIndices, outMesh.vertexPositions, outMesh.vertexTextureCoords, outMesh.vertexNormals);
 
         return outMesh;
     }
 
-    Material createMaterialData(FbxSurfaceMaterial* inMaterial, Scene& outputScene) {
+    Material createMaterialData(const binary::Object& inMaterial, const binary::Document& document, Scene& outputScene) {
         Material outMaterial;
 
         // Get the material name and place it in the struct
-        outMaterial.materialName = inMaterial->GetName();
-
-        if (inMaterial->GetClassId().Is(FbxSurfacePhong::ClassId)) {
-            /* DEBUG LINE */
-            if (DEBUG_OUTPUTS)
-                std::cout << "Phong available" << std::endl;
+        outMaterial.materialName = std::string(inMaterial.name);
 
-            // Get the material as a phong material
-            FbxSurfacePhong* phongMaterial = ((FbxSurfacePhong*)inMaterial);
-
-            // Check for diffuse texture
-            if (phongMaterial->Diffuse.GetSrcObject(0)) {
-                // There is a diffuse texture
-                FbxFileTexture* diffuseTexture = ((FbxFileTexture*)phongMaterial->Diffuse.GetSrcObject(0));
-
-                // Add the index to the material
-                outMaterial.diffuseTextureID = createTexture(diffuseTexture, outputScene.diffuseTextures);
+        if (DEBUG_OUTPUTS)
+            std::cout << "Shading model: " << getChildString(*inMaterial.node, "ShadingModel") << std::endl;
 
-                // Check if the diffuse texture is alpha mapped
-                FbxTexture* alphaTexture = ((FbxTexture*)phongMaterial->Diffuse.GetSrcObject(0));
-                if (alphaTexture->Alpha < 1) {
-                    outMaterial.isAlphaMapped = true;
+        // Textures are connected to the material property they are used for
+        auto findTexture = [&](std::string_view propertyName) -> const binary::Object* {
+            for (const binary::Connection& source : inMaterial.sources) {
+                if (source.property == propertyName && source.object->type == "Texture") {
+                    return source.object;
                 }
             }
-            else {
-                // Place an empty texture in the array so it is aligned with material index
-                Texture emptyTexture;
-                emptyTexture.isEmpty = true;
-                outputScene.diffuseTextures.emplace_back(emptyTexture);
-
-                outMaterial.diffuseTextureID = 0xffffffff;
-            }
-
-            // NOTE: The specular is the roughness and metalness
-            // Check for specular texture
-            if (phongMaterial->Specular.GetSrcObject(0)) {
-                // There is a specular texture
-                FbxFileTexture* specularTexture = ((FbxFileTexture*)phongMaterial->Specular.GetSrcObject(0));
-
-                // Add the index to the material
-                outMaterial.specularTextureID = createTexture(specularTexture, outputScene.specularTextures);
-            }
-            else {
-                // Place an empty texture in the array so it is aligned with material index
-                Texture emptyTexture;
-                emptyTexture.isEmpty = true;
-                outputScene.specularTextures.emplace_back(emptyTexture);
+            return nullptr;
+        };
 
-                outMaterial.specularTextureID = 0xffffffff;
-            }
-
-            // Check for normal texture
-            if (phongMaterial->NormalMap.GetSrcObject(0)) {
-                // There is a specular texture
-                FbxFileTexture* normalTexture = ((FbxFileTexture*)phongMaterial->NormalMap.GetSrcObject(0));
+        // Check for diffuse texture
+        if (const binary::Object* diffuseTexture = findTexture("DiffuseColor")) {
+            // Add the index to the material
+            outMaterial.diffuseTextureID = createTexture(*diffuseTexture, document, outputScene.diffuseTextures);
 
-                // Add the index to the material
-                outMaterial.normalTextureID = createTexture(normalTexture, outputScene.normalTextures);
+            // Check if the diffuse texture is alpha mapped
+            if (getValue(*diffuseTexture, "Texture alpha", 1.0) < 1) {
+                outMaterial.isAlphaMapped = true;
             }
-            else {
-                // Place an empty texture in the array so it is aligned with material index
-                Texture emptyTexture;
-                emptyTexture.isEmpty = true;
-                outputScene.normalTextures.emplace_back(emptyTexture);
+        }
+        else {
+            // Place an empty texture in the array so it is aligned with material index
+            Texture emptyTexture;
+            emptyTexture.isEmpty = true;
+            outputScene.diffuseTextures.emplace_back(emptyTexture);
 
-                outMaterial.normalTextureID = 0xffffffff;
-            }
+            outMaterial.diffuseTextureID = 0xffffffff;
+        }
 
-            // Check for emissive texture
-            if (phongMaterial->Emissive.GetSrcObject(0)) {
-                // There is a specular texture
-                FbxFileTexture* emissiveTexture = ((FbxFileTexture*)phongMaterial->Emissive.GetSrcObject(0));
+        // NOTE: The specular is the roughness and metalness
+        // Check for specular texture
+        if (const binary::Object* specularTexture = findTexture("SpecularColor")) {
+            // Add the index to the material
+            outMaterial.specularTextureID = createTexture(*specularTexture, document, outputScene.specularTextures);
+        }
+        else {
+            // Place an empty texture in the array so it is aligned with material index
+            Texture emptyTexture;
+            emptyTexture.isEmpty = true;
+            outputScene.specularTextures.emplace_back(emptyTexture);
 
-                // Add the index to the material
-                outMaterial.emissiveTextureID = createTexture(emissiveTexture, outputScene.emissiveTextures);
-            }
-            else {
-                // Place an empty texture in the array so it is aligned with material index
-                Texture emptyTexture;
-                emptyTexture.isEmpty = true;
-                outputScene.emissiveTextures.emplace_back(emptyTexture);
+            outMaterial.specularTextureID = 0xffffffff;
+        }
 
-                outMaterial.emissiveTextureID = 0xffffffff;
-            }
+        // Check for normal texture
+        if (const binary::Object* normalTexture = findTexture("NormalMap")) {
+            // Add the index to the material
+            outMaterial.normalTextureID = createTexture(*normalTexture, document, outputScene.normalTextures);
+        }
+        else {
+            // Place an empty texture in the array so it is aligned with material index
+            Texture emptyTexture;
+            emptyTexture.isEmpty = true;
+            outputScene.normalTextures.emplace_back(emptyTexture);
 
+            outMaterial.normalTextureID = 0xffffffff;
         }
-        else if (inMaterial->GetClassId().Is(FbxSurfaceLambert::ClassId)) {
-            if (DEBUG_OUTPUTS)
-                std::cout << "Lambertian available" << std::endl;
+
+        // Check for emissive texture
+        if (const binary::Object* emissiveTexture = findTexture("EmissiveColor")) {
+            // Add the index to the material
+            outMaterial.emissiveTextureID = createTexture(*emissiveTexture, document, outputScene.emissiveTextures);
         }
         else {
-            if (DEBUG_OUTPUTS)
-                std::cout << "What is this" << std::endl;
+            // Place an empty texture in the array so it is aligned with material index
+            Texture emptyTexture;
+            emptyTexture.isEmpty = true;
+            outputScene.emissiveTextures.emplace_back(emptyTexture);
+
+            outMaterial.emissiveTextureID = 0xffffffff;
         }
 
         return outMaterial;
     }
 
-    std::uint32_t createTexture(FbxFileTexture* texture, std::vector<Texture>& textureSet) {
+    std::uint32_t createTexture(const binary::Object& texture, const binary::Document& document, std::vector<Texture>& textureSet) {
+        // Prefer the path relative to the .fbx file and fall back to the absolute path it was exported with
+        std::string fileName = std::string(getChildString(*texture.node, "FileName"));
+        std::string_view relativeFileName = getChildString(*texture.node, "RelativeFilename");
+        if (!relativeFileName.empty()) {
+            std::filesystem::path relativePath = document.directory() / std::filesystem::path(relativeFileName);
+            if (fileName.empty() || std::filesystem::exists(relativePath)) {
+                fileName = relativePath.string();
+            }
+        }
+
         /* DEBUG LINE */
         if (DEBUG_OUTPUTS)
-            std::cout << texture->GetFileName() << std::endl;
+            std::cout << fileName << std::endl;
 
         // Check if the texture already exists in the output scene
         int textureIndex = -1;
         for (size_t i = 0; i < textureSet.size(); i++) {
-            if (textureSet[i].filePath == texture->GetFileName()) {
+            if (textureSet[i].filePath == fileName) {
                 return i;
             }
         }
@@ -455,7 +996,7 @@ namespace fbx {
         // If texture index has not been found create texture and add it to the output
         if (textureIndex == -1) {
             Texture newTexture;
-            newTexture.filePath = texture->GetFileName();
+            newTexture.filePath = fileName;
             textureSet.emplace_back(newTexture);
             // Remember the ID
             textureIndex = textureSet.size() - 1;
@@ -464,19 +1005,19 @@ namespace fbx {
         return textureIndex;
     }
 
-    Light createLightData(FbxLight* inLight, glm::mat4 transform) {
+    Light createLightData(const binary::Object& inLight, glm::mat4 transform) {
         Light outLight;
 
         // The location of the light is simply defined by the transform matrix
         outLight.location = transform[3];
 
         // Get the light colour
-        FbxDouble3 colour = inLight->Color.Get();
-        outLight.colour = glm::vec3(colour[0], colour[1], colour[2]);
+        outLight.colour = glm::vec3(getVector3(inLight, "Color", glm::dvec3(1)));
 
         // Get the direction of the light if its a directional light
-        if (inLight->LightType.Get() == FbxLight::eSpot ||
-            inLight->LightType.Get() == FbxLight::eDirectional) {
+        // Light types are 0 = point, 1 = directional, 2 = spot
+        int lightType = int(getValue(inLight, "LightType", 0));
+        if (lightType == 2 || lightType == 1) {
             // It is not a point light
             outLight.isPointLight = false;
 
@@ -502,76 +1043,87 @@ namespace fbx {
         std::vector<glm::vec2>& uvs,
         std::vector<glm::vec3>& normals) {
 
-        // Initialise an array to store all the different tangents for each vertex
-        //std::vector<std::vector<glm::vec3>> vertexTriangleTangents(positions.size(), std::vector<glm::vec3>());
-        //std::vector<std::vector<glm::vec3>> vertexTriangleBitangents(positions.size(), std::vector<glm::vec3>());
-
-        std::vector<glm::vec3> vTangents(positions.size());
-        std::vector<glm::vec3> vBitangents(positions.size());
-
-        // Visit each triangle in the mesh
-        for (size_t i = 0; i < indices.size(); i += 3) {
-            // Get the positions of all points in the triangle v0, v1, v2 
-            glm::vec3 v0, v1, v2;
-            v0 = positions[indices[i]];
-            v1 = positions[indices[i + 1]];
-            v2 = positions[indices[i + 2]];
-
-            // and get the corresponding texture coordinates
-            glm::vec2 uv0, uv1, uv2;
-            uv0 = uvs[indices[i]];
-            uv1 = uvs[indices[i + 1]];
-            uv2 = uvs[indices[i + 2]];
-
-            // Get the coordinates in terms of v0
-            glm::vec3 AB, AC;
-            AB = v1 - v0;
-            AC = v2 - v0;
-
-            // again with the texture coordinates
-            glm::vec2 uvAB, uvAC;
-            uvAB = uv1 - uv0;
-            uvAC = uv2 - uv0;
-
-            // Solve to find the unnormalized tangent vector of the triangle
-            //glm::vec3 tangent = (1 / ((uvAB.x * uvAC.y) - (uvAC.x - uvAB.y))) * ((uvAC.y * AB) + (-uvAB.y * AC));
-            //glm::vec3 bitangent = (1 / ((uvAB.x * uvAC.y) - (uvAC.x - uvAB.y))) * ((-uvAC.x * AB) + (uvAB.x * AC));
+        // The work is split three ways, all of it keeping the exact float operations and summing order of
+        // a single threaded pass over the triangles so the output is bit identical to it:
+        // 1. Each triangle's tangent and bitangent is solved four triangles at a time with SSE
+        // 2. Each job owns a range of vertices and adds up the triangles touching them in triangle order
+        // 3. The same job orthogonalises the tangents of its vertices into the presized output
+        std::size_t const numTriangles = indices.size() / 3;
+        std::size_t const numBlocks = (numTriangles + TANGENT_BLOCK_SIZE - 1) / TANGENT_BLOCK_SIZE;
+
+        std::vector<glm::vec3> triangleTangents(numTriangles);
+        std::vector<glm::vec3> triangleBitangents(numTriangles);
+
+        // The lowest and highest vertex each block of triangles uses, welded vertices are numbered in
+        // order of first use so most blocks only touch a narrow range and can be skipped by most jobs
+        std::vector<std::uint32_t> blockMinVertex(numBlocks);
+        std::vector<std::uint32_t> blockMaxVertex(numBlocks);
+
+        // Solve every triangle
+        jobs::shared().parallelFor(numBlocks, 0, [&](std::size_t beginBlock, std::size_t endBlock) {
+            for (std::size_t block = beginBlock; block < endBlock; block++) {
+                std::size_t const first = block * TANGENT_BLOCK_SIZE;
+                std::size_t const last = std::min(numTriangles, first + TANGENT_BLOCK_SIZE);
+
+                std::size_t triangle = first;
+                for (; triangle + 4 <= last; triangle += 4) {
+                    solveTangents4(&indices[triangle * 3], positions, uvs, &triangleTangents[triangle], &triangleBitangents[triangle]);
+                }
+                for (; triangle < last; triangle++) {
+                    solveTangents(&indices[triangle * 3], positions, uvs, triangleTangents[triangle], triangleBitangents[triangle]);
+                }
 
-            float determinant = 1.0f / (uvAB.x * uvAC.y - uvAC.x * uvAB.y);
-            glm::vec3 tangent = determinant * (uvAC.y * AB - uvAB.y * AC);
-            glm::vec3 bitangent = determinant * (-uvAC.x * AB + uvAB.x * AC);
+                auto range = std::minmax_element(indices.begin() + first * 3, indices.begin() + last * 3);
+                blockMinVertex[block] = *range.first;
+                blockMaxVertex[block] = *range.second;
+            }
+        });
+
+        // Sum and orthogonalise each range of vertices
+        std::vector<glm::vec4> tangents(positions.size());
+        jobs::shared().parallelFor(positions.size(), TANGENT_VERTEX_RANGE, [&](std::size_t beginVertex, std::size_t endVertex) {
+            std::vector<glm::vec3> vTangents(endVertex - beginVertex);
+            std::vector<glm::vec3> vBitangents(endVertex - beginVertex);
+
+            // Triangles are visited in order so every vertex sums its tangents in the same order as a serial pass
+            for (std::size_t block = 0; block < numBlocks; block++) {
+                if (blockMaxVertex[block] < beginVertex || blockMinVertex[block] >= endVertex) {
+                    continue;
+                }
 
-            // Tangent is the same for all vertices of the triangle so add to all of them
-            vTangents[indices[i]] += tangent;
-            vTangents[indices[i + 1]] += tangent;
-            vTangents[indices[i + 2]] += tangent;
+                std::size_t const last = std::min(numTriangles, (block + 1) * TANGENT_BLOCK_SIZE);
+                for (std::size_t triangle = block * TANGENT_BLOCK_SIZE; triangle < last; triangle++) {
+                    for (std::size_t corner = 0; corner < 3; corner++) {
+                        std::size_t vertex = indices[triangle * 3 + corner];
+                        if (vertex >= beginVertex && vertex < endVertex) {
+                            vTangents[vertex - beginVertex] += triangleTangents[triangle];
+                            vBitangents[vertex - beginVertex] += triangleBitangents[triangle];
+                        }
+                    }
+                }
+            }
 
-            vBitangents[indices[i]] += bitangent;
-            vBitangents[indices[i + 1]] += bitangent;
-            vBitangents[indices[i + 2]] += bitangent;
-        }
+            // Average the tangents for all vertices
+            for (std::size_t i = beginVertex; i < endVertex; i++) {
+                glm::vec3 normal = normals[i];
 
-        // Average the tangents for all vertices
-        std::vector<glm::vec4> tangents;
-        for (size_t i = 0; i < vTangents.size(); i++) {
-            glm::vec3 normal = normals[i];
+                glm::vec3 tangent = vTangents[i - beginVertex];
+                glm::vec3 bitangent = vBitangents[i - beginVertex];
+                // Orthogonalize the tangent and normalise the output
+                tangent = glm::normalize(tangent - normal * glm::dot(normal, tangent));
 
-            glm::vec3 tangent = vTangents[i];
-            glm::vec3 bitangent = vBitangents[i];
-            // Orthogonalize the tangent and normalise the output
-            tangent = glm::normalize(tangent - normal * glm::dot(normal, tangent));
+                // Calculate the handedness of the bitangent
+                int handedness;
+                if (glm::dot(glm::cross(normal, tangent), bitangent) < 0) {
+                    handedness = -1;
+                }
+                else {
+                    handedness = 1;
+                }
 
-            // Calculate the handedness of the bitangent
-            int handedness;
-            if (glm::dot(glm::cross(normal, tangent), bitangent) < 0) {
-                handedness = -1;
-            }
-            else {
-                handedness = 1;
+                tangents[i] = glm::vec4(tangent, handedness);
             }
-
-            tangents.emplace_back(glm::vec4(tangent, handedness));
-        }
+        });
 
         return tangents;
 
@@ -1,9 +1,15 @@
 #pragma once
 #include <vector>
+#include <string>
+#include <cstdint>
 #include <functional>
 
 #include <glm.hpp>
-#include <fbxsdk.h>
+
+#include "FBXBinaryReader.hpp"
+#include "meshOptimisation.hpp"
+#include "meshSimplification.hpp"
+#include "meshlets.hpp"
 
 /// A set of structs used to hold the information from the FBX file.
 namespace fbx {
@@ -33,26 +39,47 @@ namespace fbx {
 
 	};
 
+	/// <summary>
+	/// The triangles of a mesh that use one material, drawn on their own from the mesh's shared vertices
+	/// </summary>
+	struct Submesh
+	{
+		std::uint32_t material = 0;
+
+		// The submesh's range of the mesh's levels of detail, the first is its full set of triangles
+		std::uint32_t firstLod = 0;
+		std::uint32_t lodCount = 0;
+
+		// World space axis aligned bounds of the submesh's vertex positions, where the first instance is
+		glm::vec3 boundsMin = glm::vec3(0);
+		glm::vec3 boundsMax = glm::vec3(0);
+	};
+
 	/// <summary>
 	/// Data for a mesh within a scene
 	/// </summary>
 	struct Mesh
 	{
-		// Per mesh variables
-		std::vector<uint32_t> materials;
-		
-		// Per vertex variables
+		// Per vertex variables (shared by every submesh)
 		std::vector<glm::vec3> vertexPositions;		
 		std::vector<glm::vec2> vertexTextureCoords;		
 		std::vector<glm::vec3> vertexNormals;
 		std::vector<glm::vec4> vertexTangents;
-		std::vector<uint32_t> vertexMaterialIDs;
-
-		// Per polygon variables
-		// VertexMaterialIDs could go here for later optimisation
 
-		// Per index variables
+		// Per index variables (every level of detail of every submesh, one after the other)
 		std::vector<uint32_t> vertexIndices;
+
+		// The triangles of each material, in order of material
+		std::vector<Submesh> submeshes;
+
+		// Levels of detail of every submesh, level 0 of a submesh is all of its triangles
+		std::vector<simplification::LodLevel> lods;
+
+		// Clusters of triangles for culling, each level's meshlets cover its indices exactly
+		std::vector<meshlets::Meshlet> meshlets;
+
+		// Transforms of every node drawing this mesh relative to the first, empty when only one node uses it
+		std::vector<glm::mat4> instanceTransforms;
 	};
 
 	/// <summary>
@@ -89,44 +116,78 @@ namespace fbx {
 	/// <returns>A Scene structure</returns>
 	Scene loadFBXFile(const char* filename);
 
+	/// <summary>
+	/// A mesh found while walking the node tree, decoded once the whole tree has been visited
+	/// </summary>
+	struct MeshSource
+	{
+		const binary::Object* geometry;
+		std::vector<uint32_t> materialIndices;
+		glm::mat4 transform;
+	};
+
 	/// <summary>
 	/// Gets the children of a given node
 	/// </summary>
-	/// <param name="node">A node in an FbxScene</param>
-	void getChildren(FbxNode* node, Scene& outputScene);
+	/// <param name="node">A model object in the FBX document</param>
+	/// <param name="parentTransform">The global transform of the parent node</param>
+	/// <param name="document">The FBX document</param>
+	/// <param name="outputScene">The output data for the program</param>
+	/// <param name="meshSources">The meshes found in the tree</param>
+	void getChildren(const binary::Object& node, const glm::dmat4& parentTransform, const binary::Document& document,
+		Scene& outputScene, std::vector<MeshSource>& meshSources);
+
+	/// <summary>
+	/// Groups the mesh nodes that share a geometry object and materials so their geometry is only kept once.
+	/// A node only joins a group if it is a rotation, translation and uniform scale of the group's first node.
+	/// </summary>
+	/// <param name="meshSources">The meshes found in the tree</param>
+	/// <returns>The indices of the sources in each group, the first is the node the mesh is decoded for</returns>
+	std::vector<std::vector<std::size_t>> groupInstances(const std::vector<MeshSource>& meshSources);
+
+	/// <summary>
+	/// Calculates the local transform of a model from its properties
+	/// </summary>
+	/// <param name="node">A model object in the FBX document</param>
+	/// <returns>The local transform matrix</returns>
+	glm::dmat4 getLocalTransform(const binary::Object& node);
 
 	/// <summary>
-	/// Creates and populates a mesh data structure given an Fbx mesh
+	/// Creates and populates a mesh data structure given an FBX geometry object
 	/// </summary>
-	/// <param name="inMesh">An FbxMesh</param>
-	/// <param name="materialIndices">The material indices from the node</param>
+	/// <param name="geometry">An FBX geometry object</param>
+	/// <param name="materialIndices">The material indices from the node, the polygons are grouped by these into submeshes</param>
 	/// <param name="transform">The node transform matrix</param>
+	/// <param name="report">Output vertex cache statistics from before and after optimising the mesh (optional)</param>
 	/// <returns>A mesh data structure</returns>
-	Mesh createMeshData(FbxMesh* inMesh, std::vector<uint32_t>& materialIndices, glm::mat4 transform);
+	Mesh createMeshData(const binary::Object& geometry, std::vector<uint32_t>& materialIndices, glm::mat4 transform,
+		optimisation::OptimisationReport* report = nullptr);
 
 	/// <summary>
-	/// Creates and populates a material data structure given an Fbx material
+	/// Creates and populates a material data structure given an FBX material object
 	/// </summary>
-	/// <param name="inMaterial">Fbx Material</param>
+	/// <param name="inMaterial">FBX Material</param>
+	/// <param name="document">The FBX document</param>
 	/// <param name="outputScene">The output data for the program</param>
 	/// <returns>Material data structure</returns>
-	Material createMaterialData(FbxSurfaceMaterial* inMaterial, Scene& outputScene);
+	Material createMaterialData(const binary::Object& inMaterial, const binary::Document& document, Scene& outputScene);
 
 	/// <summary>
 	/// Creates a texture and adds it to the output scene if it does not already exist
 	/// </summary>
 	/// <param name="texture">The texture to look for / add</param>
+	/// <param name="document">The FBX document</param>
 	/// <param name="textureSet">The output texture set to use</param>
 	/// <returns>The ID of the texture in the output scene</returns>
-	std::uint32_t createTexture(FbxFileTexture* texture, std::vector<Texture>& textureSet);
+	std::uint32_t createTexture(const binary::Object& texture, const binary::Document& document, std::vector<Texture>& textureSet);
 
 	/// <summary>
-	/// Creates and populates a light data structure given an fbx light
+	/// Creates and populates a light data structure given an FBX light attribute
 	/// </summary>
-	/// <param name="inLight">Fbx light</param>
+	/// <param name="inLight">FBX light attribute</param>
 	/// <param name="transform">The node transform matrix</param>
 	/// <returns></returns>
-	Light createLightData(FbxLight* inLight, glm::mat4 transform);
+	Light createLightData(const binary::Object& inLight, glm::mat4 transform);
 
 	/// <summary>
 	/// Calculates the vertex tangents for a given mesh
@@ -1,11 +1,33 @@
 #version 450
 
 // Bring in the vertex buffer values
+#ifdef PACKED_VERTICES
+// Quantised positions, w is padding
+layout(location = 0) in uvec4 inPackedPosition;
+layout(location = 1) in vec2 inTexCoord;
+// Octahedral encoded normal and tangent, the sign of the tangent's y is the handedness
+layout(location = 2) in vec2 inPackedNormal;
+layout(location = 3) in vec2 inPackedTangent;
+#else
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec2 inTexCoord;
 layout(location = 2) in vec3 inNormal;
 layout(location = 3) in vec4 inTangent;
-layout(location = 4) in int inMaterialID;
+#endif
+
+// Must match model::InstanceData, read through the visible instance ids
+struct Instance
+{
+	mat4 transform;
+	// Decodes the quantised positions of the mesh
+	vec4 positionOffset;
+	vec4 positionScale;
+	// The material of the submesh being drawn
+	uint materialID;
+};
+layout(set = 4, binding = 0, std430) readonly buffer Instances { Instance instances[]; };
+// The ids of the instances being drawn, each instanced draw starts at its first instance
+layout(set = 4, binding = 1, std430) readonly buffer VisibleInstances { uint visibleInstances[]; };
 
 // The world view uniform
 layout(set = 0, binding = 0) uniform worldView
@@ -34,17 +56,48 @@ layout (location = 3) out vec4 outTangent;
 layout (location = 4) out int outMatID;
 layout (location = 5) out vec4 outLightDir;
 
+#ifdef PACKED_VERTICES
+// Unfolds an octahedral encoded unit vector, must match octEncode in model.cpp
+vec3 octDecode(vec2 encoded)
+{
+	vec3 v = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+	float t = max(-v.z, 0.0);
+	v.x += v.x >= 0.0 ? -t : t;
+	v.y += v.y >= 0.0 ? -t : t;
+	return normalize(v);
+}
+#endif
+
 void main()
 {
+	Instance instance = instances[visibleInstances[gl_InstanceIndex]];
+
+#ifdef PACKED_VERTICES
+	vec3 inPosition = instance.positionOffset.xyz + vec3(inPackedPosition.xyz) * instance.positionScale.xyz;
+	vec3 inNormal = octDecode(inPackedNormal);
+
+	// The tangent's y is stored in [1, 127] / 127 with the handedness as its sign
+	float handedness = inPackedTangent.y < 0.0 ? -1.0 : 1.0;
+	float tangentY = (round(abs(inPackedTangent.y) * 127.0) - 1.0) / 63.0 - 1.0;
+	vec3 tangent = octDecode(vec2(inPackedTangent.x, tangentY));
+	// Remove the quantisation error so the tangent stays perpendicular to the normal
+	tangent = normalize(tangent - inNormal * dot(inNormal, tangent));
+	vec4 inTangent = vec4(tangent, handedness);
+#endif
+
+	// Place the vertex at its instance, the normals use the same matrix which is exact for rotations and uniform scales
+	vec3 position = (instance.transform * vec4(inPosition, 1.f)).xyz;
+	mat3 rotation = mat3(instance.transform);
+
 	// Set the output values to go to the fragment shader
 	outTexCoord = inTexCoord;
-	outPosition = inPosition;
-	outNormal = inNormal;
-	outTangent = inTangent;
-	outMatID = inMaterialID;
+	outPosition = position;
+	outNormal = normalize(rotation * inNormal);
+	outTangent = vec4(normalize(rotation * inTangent.xyz), inTangent.w);
+	outMatID = int(instance.materialID);
 
-	outLightDir = bias * light.lightDirection * vec4(inPosition, 1.f);
+	outLightDir = bias * light.lightDirection * vec4(position, 1.f);
 
 	// The position of the vertex as shown to screen
-	gl_Position = view.projectionCameraMatrix * vec4(inPosition, 1.f);
+	gl_Position = view.projectionCameraMatrix * vec4(position, 1.f);
 }
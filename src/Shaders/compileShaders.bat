@@ -1,8 +1,12 @@
 glslc colourShader.vert -o colourVert.spv
+glslc -DPACKED_VERTICES colourShader.vert -o colourPackedVert.spv
 glslc colourShader.frag -o colourFrag.spv
 glslc alphaShader.frag -o alphaFrag.spv
 glslc fullscreenShader.vert -o fullscreenVert.spv
 glslc fullscreenShader.frag -o fullscreenFrag.spv
 glslc shadowShader.vert -o shadowVert.spv
+glslc -DPACKED_VERTICES shadowShader.vert -o shadowPackedVert.spv
 glslc shadowShader.frag -o shadowFrag.spv
+glslc cullShader.comp -o cullComp.spv
+glslc depthPyramidShader.comp -o depthPyramidComp.spv
 pause
\ No newline at end of file
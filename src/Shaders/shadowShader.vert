@@ -2,7 +2,26 @@
 
 #define NUMLIGHTS 1
 
+#ifdef PACKED_VERTICES
+// Quantised positions, w is padding
+layout(location = 0) in uvec4 iPackedPosition;
+#else
 layout(location = 0) in vec3 iPosition;
+#endif
+
+// Must match model::InstanceData, read through the visible instance ids
+struct Instance
+{
+	mat4 transform;
+	// Decodes the quantised positions of the mesh
+	vec4 positionOffset;
+	vec4 positionScale;
+	// The material of the submesh being drawn
+	uint materialID;
+};
+layout(set = 1, binding = 0, std430) readonly buffer Instances { Instance instances[]; };
+// The ids of the instances being drawn, each instanced draw starts at its first instance
+layout(set = 1, binding = 1, std430) readonly buffer VisibleInstances { uint visibleInstances[]; };
 
 // The lighting uniform
 layout(set = 0, binding = 0, std140) uniform LightBuffer { 
@@ -13,5 +32,9 @@ layout(set = 0, binding = 0, std140) uniform LightBuffer {
 
 void main()
 {
-	gl_Position = light.lightDirection * vec4(iPosition, 1.f);
+	Instance instance = instances[visibleInstances[gl_InstanceIndex]];
+#ifdef PACKED_VERTICES
+	vec3 iPosition = instance.positionOffset.xyz + vec3(iPackedPosition.xyz) * instance.positionScale.xyz;
+#endif
+	gl_Position = light.lightDirection * instance.transform * vec4(iPosition, 1.f);
 }
@@ -0,0 +1,104 @@
+#include "commandRecording.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "utility.hpp"
+
+namespace recording {
+
+	ParallelRecorder::ParallelRecorder(app::AppContext& app, jobs::JobSystem& jobSystem, bool reusable)
+		: app(app), jobSystem(jobSystem), reusable(reusable), pools(jobSystem.threadCount())
+	{
+		// Buffers are only ever reset all at once with their pool
+		for (ThreadPool& pool : pools) {
+			pool.commandPool = utility::createCommandPool(app, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+		}
+	}
+
+	ParallelRecorder::~ParallelRecorder()
+	{
+		cleanup();
+	}
+
+	void ParallelRecorder::reset() {
+		for (ThreadPool& pool : pools) {
+			if (pool.used > 0) {
+				vkResetCommandPool(app.logicalDevice, pool.commandPool, 0);
+				pool.used = 0;
+			}
+		}
+	}
+
+	void ParallelRecorder::record(VkRenderPass renderPass, VkFramebuffer frameBuffer, std::size_t drawCount,
+		const std::function<void(VkCommandBuffer, std::size_t, std::size_t)>& recordDraws, std::vector<VkCommandBuffer>& outBuffers) {
+		outBuffers.clear();
+		if (drawCount == 0) {
+			return;
+		}
+
+		// A few chunks per thread lets threads that finish early take on more, but every buffer costs
+		// a begin, the state binds and an execute so chunks are kept from getting too small
+		std::size_t const chunkSize = std::max<std::size_t>(drawCount / (std::size_t(jobSystem.threadCount()) * CHUNKS_PER_THREAD), MIN_DRAWS_PER_CHUNK);
+		std::size_t const chunkCount = (drawCount + chunkSize - 1) / chunkSize;
+		outBuffers.resize(chunkCount, VK_NULL_HANDLE);
+
+		VkCommandBufferInheritanceInfo inheritanceInfo{};
+		inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+		inheritanceInfo.renderPass = renderPass;
+		inheritanceInfo.subpass = 0;
+		inheritanceInfo.framebuffer = frameBuffer;
+
+		VkCommandBufferBeginInfo recordInfo{};
+		recordInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		recordInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+		if (!reusable) {
+			recordInfo.flags |= VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		}
+		recordInfo.pInheritanceInfo = &inheritanceInfo;
+
+		auto recordChunks = [&](std::size_t firstChunk, std::size_t endChunk) {
+			for (std::size_t chunk = firstChunk; chunk < endChunk; chunk++) {
+				// A chunk is recorded from start to end without waiting so its thread's pool is not used by anything else meanwhile
+				VkCommandBuffer commandBuffer = acquire(jobSystem.threadIndex());
+				if (vkBeginCommandBuffer(commandBuffer, &recordInfo) != VK_SUCCESS) {
+					throw std::runtime_error("Failed to start secondary command buffer recording.");
+				}
+
+				recordDraws(commandBuffer, chunk * chunkSize, std::min(drawCount, (chunk + 1) * chunkSize));
+
+				if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+					throw std::runtime_error("Failed to end secondary command buffer recording.");
+				}
+				outBuffers[chunk] = commandBuffer;
+			}
+		};
+
+		if (chunkCount == 1) {
+			recordChunks(0, 1);
+		}
+		else {
+			jobSystem.parallelFor(chunkCount, 1, recordChunks);
+		}
+	}
+
+	void ParallelRecorder::cleanup() {
+		for (ThreadPool& pool : pools) {
+			if (pool.commandPool != VK_NULL_HANDLE) {
+				// Destroying the pool frees its buffers
+				vkDestroyCommandPool(app.logicalDevice, pool.commandPool, nullptr);
+				pool.commandPool = VK_NULL_HANDLE;
+				pool.buffers.clear();
+				pool.used = 0;
+			}
+		}
+	}
+
+	VkCommandBuffer ParallelRecorder::acquire(std::uint32_t thread) {
+		ThreadPool& pool = pools[thread];
+		if (pool.used == pool.buffers.size()) {
+			pool.buffers.emplace_back(utility::createCommandBuffer(app, pool.commandPool, VK_COMMAND_BUFFER_LEVEL_SECONDARY));
+		}
+		return pool.buffers[pool.used++];
+	}
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "setup.hpp"
+#include "jobSystem.hpp"
+
+// Fewest draws recorded into one secondary command buffer, and how many buffers each thread aims to record
+#define MIN_DRAWS_PER_CHUNK 64
+#define CHUNKS_PER_THREAD 4
+
+namespace recording {
+	/// <summary>
+	/// Records the draws of a render pass on every thread of the job system. The draws are split into
+	/// chunks and each chunk is recorded into its own secondary command buffer, allocated from a command
+	/// pool owned by the thread recording it so no pool is ever used by two threads at once. The buffers
+	/// are handed back in draw order for the primary command buffer to execute.
+	/// A recorder belongs to one frame in flight, its buffers are reused once the frame's fence has signalled.
+	/// </summary>
+	class ParallelRecorder
+	{
+	public:
+		/// <summary>
+		/// Parameterised constructor
+		/// </summary>
+		/// <param name="app">Application context</param>
+		/// <param name="jobSystem">Job system to record on, one command pool is made for each of its threads</param>
+		/// <param name="reusable">True if the buffers are submitted more than once between resets</param>
+		ParallelRecorder(app::AppContext& app, jobs::JobSystem& jobSystem, bool reusable = false);
+
+		/// <summary>
+		/// Destructor
+		/// </summary>
+		~ParallelRecorder();
+
+		// The recorder owns its command pools so it can not be copied
+		ParallelRecorder(ParallelRecorder&) = delete;
+		ParallelRecorder& operator= (ParallelRecorder&) = delete;
+
+		/// <summary>
+		/// Resets every command pool so its buffers can be recorded again. The GPU must have finished
+		/// every buffer recorded since the last reset.
+		/// </summary>
+		void reset();
+
+		/// <summary>
+		/// Records a list of draws in chunks on the job system and waits for them to finish. Each buffer
+		/// continues the given subpass and has nothing bound when it starts.
+		/// </summary>
+		/// <param name="renderPass">The render pass the buffers are executed in</param>
+		/// <param name="frameBuffer">The frame buffer of the render pass, or VK_NULL_HANDLE if unknown</param>
+		/// <param name="drawCount">Number of draws</param>
+		/// <param name="recordDraws">Called with a secondary command buffer and the [begin, end) range of draws to record into it</param>
+		/// <param name="outBuffers">The recorded buffers in the order of their draws</param>
+		void record(VkRenderPass renderPass, VkFramebuffer frameBuffer, std::size_t drawCount,
+			const std::function<void(VkCommandBuffer, std::size_t, std::size_t)>& recordDraws, std::vector<VkCommandBuffer>& outBuffers);
+
+		/// <summary>
+		/// Destroys the command pools, the recorder can not be used afterwards
+		/// </summary>
+		void cleanup();
+
+	private:
+		struct ThreadPool {
+			VkCommandPool commandPool = VK_NULL_HANDLE;
+			// Every buffer allocated from the pool, the first used of them have been recorded since the last reset
+			std::vector<VkCommandBuffer> buffers;
+			std::size_t used = 0;
+		};
+
+		VkCommandBuffer acquire(std::uint32_t thread);
+
+		app::AppContext& app;
+		jobs::JobSystem& jobSystem;
+		bool reusable;
+
+		// Indexed by the job system's thread index
+		std::vector<ThreadPool> pools;
+	};
+}
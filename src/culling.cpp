@@ -0,0 +1,237 @@
+#include "culling.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+#include <immintrin.h>
+
+namespace culling {
+
+	namespace {
+		/// <summary>
+		/// A frustum plane with each component broadcast across an SSE register
+		/// </summary>
+		struct SplatPlane4 {
+			__m128 normalX, normalY, normalZ;
+			__m128 absNormalX, absNormalY, absNormalZ;
+			__m128 distance;
+		};
+
+#if defined(__AVX__)
+		/// <summary>
+		/// A frustum plane with each component broadcast across an AVX register
+		/// </summary>
+		struct SplatPlane8 {
+			__m256 normalX, normalY, normalZ;
+			__m256 absNormalX, absNormalY, absNormalZ;
+			__m256 distance;
+		};
+#endif
+
+		/// <summary>
+		/// Tests a single set of bounds, used for the meshes left over after the SIMD loop
+		/// </summary>
+		bool isVisible(const Frustum& frustum, const model::MeshBounds& bounds, std::size_t i) {
+			for (const glm::vec4& plane : frustum.planes) {
+				// Distance of the centre plus the projected radius of the box onto the plane normal
+				float distance = plane.x * bounds.centreX[i] + plane.y * bounds.centreY[i] + plane.z * bounds.centreZ[i] + plane.w +
+					std::abs(plane.x) * bounds.extentX[i] + std::abs(plane.y) * bounds.extentY[i] + std::abs(plane.z) * bounds.extentZ[i];
+				if (distance < 0.f) {
+					return false;
+				}
+			}
+			return true;
+		}
+
+		/// <summary>
+		/// Adds the indices of the set bits of a visibility mask to the visible list
+		/// </summary>
+		void appendVisible(unsigned int mask, std::uint32_t firstIndex, std::vector<std::uint32_t>& visibleIndices) {
+			while (mask != 0) {
+				visibleIndices.emplace_back(firstIndex + std::uint32_t(std::countr_zero(mask)));
+				mask &= mask - 1;
+			}
+		}
+	}
+
+	Frustum extractFrustum(const glm::mat4& projectionView) {
+		// glm is column major so each row is gathered from the columns
+		glm::vec4 rows[4];
+		for (int i = 0; i < 4; i++) {
+			rows[i] = glm::vec4(projectionView[0][i], projectionView[1][i], projectionView[2][i], projectionView[3][i]);
+		}
+
+		Frustum frustum;
+		frustum.planes[0] = rows[3] + rows[0];	// Left
+		frustum.planes[1] = rows[3] - rows[0];	// Right
+		frustum.planes[2] = rows[3] + rows[1];	// Bottom
+		frustum.planes[3] = rows[3] - rows[1];	// Top
+		frustum.planes[4] = rows[2];			// Near (z >= 0)
+		frustum.planes[5] = rows[3] - rows[2];	// Far
+
+		return frustum;
+	}
+
+	void cullMeshes(const Frustum& frustum, const model::MeshBounds& bounds, std::vector<std::uint32_t>& visibleIndices) {
+		visibleIndices.clear();
+
+		std::size_t const count = bounds.size();
+		std::size_t i = 0;
+
+#if defined(__AVX__)
+		// Eight meshes at a time
+		SplatPlane8 planes[6];
+		for (int p = 0; p < 6; p++) {
+			const glm::vec4& plane = frustum.planes[p];
+			planes[p] = { _mm256_set1_ps(plane.x), _mm256_set1_ps(plane.y), _mm256_set1_ps(plane.z),
+				_mm256_set1_ps(std::abs(plane.x)), _mm256_set1_ps(std::abs(plane.y)), _mm256_set1_ps(std::abs(plane.z)),
+				_mm256_set1_ps(plane.w) };
+		}
+
+		for (; i + 8 <= count; i += 8) {
+			__m256 centreX = _mm256_loadu_ps(&bounds.centreX[i]);
+			__m256 centreY = _mm256_loadu_ps(&bounds.centreY[i]);
+			__m256 centreZ = _mm256_loadu_ps(&bounds.centreZ[i]);
+			__m256 extentX = _mm256_loadu_ps(&bounds.extentX[i]);
+			__m256 extentY = _mm256_loadu_ps(&bounds.extentY[i]);
+			__m256 extentZ = _mm256_loadu_ps(&bounds.extentZ[i]);
+
+			__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+			for (const SplatPlane8& plane : planes) {
+				__m256 distance = _mm256_add_ps(_mm256_mul_ps(plane.normalX, centreX), plane.distance);
+				distance = _mm256_add_ps(distance, _mm256_mul_ps(plane.normalY, centreY));
+				distance = _mm256_add_ps(distance, _mm256_mul_ps(plane.normalZ, centreZ));
+				distance = _mm256_add_ps(distance, _mm256_mul_ps(plane.absNormalX, extentX));
+				distance = _mm256_add_ps(distance, _mm256_mul_ps(plane.absNormalY, extentY));
+				distance = _mm256_add_ps(distance, _mm256_mul_ps(plane.absNormalZ, extentZ));
+				inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, _mm256_setzero_ps(), _CMP_GE_OQ));
+			}
+
+			appendVisible(unsigned(_mm256_movemask_ps(inside)), std::uint32_t(i), visibleIndices);
+		}
+#endif
+
+		// Four meshes at a time (SSE is always available on x64)
+		SplatPlane4 planes4[6];
+		for (int p = 0; p < 6; p++) {
+			const glm::vec4& plane = frustum.planes[p];
+			planes4[p] = { _mm_set1_ps(plane.x), _mm_set1_ps(plane.y), _mm_set1_ps(plane.z),
+				_mm_set1_ps(std::abs(plane.x)), _mm_set1_ps(std::abs(plane.y)), _mm_set1_ps(std::abs(plane.z)),
+				_mm_set1_ps(plane.w) };
+		}
+
+		for (; i + 4 <= count; i += 4) {
+			__m128 centreX = _mm_loadu_ps(&bounds.centreX[i]);
+			__m128 centreY = _mm_loadu_ps(&bounds.centreY[i]);
+			__m128 centreZ = _mm_loadu_ps(&bounds.centreZ[i]);
+			__m128 extentX = _mm_loadu_ps(&bounds.extentX[i]);
+			__m128 extentY = _mm_loadu_ps(&bounds.extentY[i]);
+			__m128 extentZ = _mm_loadu_ps(&bounds.extentZ[i]);
+
+			__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+			for (const SplatPlane4& plane : planes4) {
+				__m128 distance = _mm_add_ps(_mm_mul_ps(plane.normalX, centreX), plane.distance);
+				distance = _mm_add_ps(distance, _mm_mul_ps(plane.normalY, centreY));
+				distance = _mm_add_ps(distance, _mm_mul_ps(plane.normalZ, centreZ));
+				distance = _mm_add_ps(distance, _mm_mul_ps(plane.absNormalX, extentX));
+				distance = _mm_add_ps(distance, _mm_mul_ps(plane.absNormalY, extentY));
+				distance = _mm_add_ps(distance, _mm_mul_ps(plane.absNormalZ, extentZ));
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, _mm_setzero_ps()));
+			}
+
+			appendVisible(unsigned(_mm_movemask_ps(inside)), std::uint32_t(i), visibleIndices);
+		}
+
+		// Any remaining meshes
+		for (; i < count; i++) {
+			if (isVisible(frustum, bounds, i)) {
+				visibleIndices.emplace_back(std::uint32_t(i));
+			}
+		}
+	}
+
+	ClusterView createClusterView(const glm::mat4& projectionView, glm::vec3 position, float verticalFov, float viewportHeight, float minPixels) {
+		ClusterView view;
+		view.frustum = extractFrustum(projectionView);
+		for (glm::vec4& plane : view.frustum.planes) {
+			plane /= glm::length(glm::vec3(plane));
+		}
+		view.position = position;
+		view.pixelsPerUnit = viewportHeight / (2.f * std::tan(verticalFov * 0.5f));
+		view.minPixels = minPixels;
+		return view;
+	}
+
+	ClusterView createUnculledView() {
+		// Every sphere is in front of a plane with no normal and a positive offset
+		ClusterView view;
+		for (glm::vec4& plane : view.frustum.planes) {
+			plane = glm::vec4(0.f, 0.f, 0.f, 1.f);
+		}
+		view.coneCulling = false;
+		return view;
+	}
+
+	ClusterView transformClusterView(const ClusterView& view, const glm::mat4& transform) {
+		ClusterView local = view;
+
+		// Planes move by the transpose of the transform and are normalised again, the planes of an unculled view are kept
+		glm::mat4 const transposed = glm::transpose(transform);
+		for (glm::vec4& plane : local.frustum.planes) {
+			plane = transposed * plane;
+			float const length = glm::length(glm::vec3(plane));
+			if (length > 0.f) {
+				plane /= length;
+			}
+		}
+		local.position = glm::vec3(glm::inverse(transform) * glm::vec4(view.position, 1.f));
+
+		// Sizes and distances scale together so the pixels per unit hold, but the cones only survive a uniform scale without mirroring
+		glm::vec3 const scale(glm::length(glm::vec3(transform[0])), glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2])));
+		float const largest = std::max({ scale.x, scale.y, scale.z });
+		if (largest - std::min({ scale.x, scale.y, scale.z }) > largest * 1e-3f || glm::determinant(glm::mat3(transform)) <= 0.f) {
+			local.coneCulling = false;
+		}
+		return local;
+	}
+
+	void cullClusters(const ClusterView& view, const meshlets::Meshlet* clusters, std::size_t count, bool cullBackfaces, std::vector<DrawRange>& draws) {
+		draws.clear();
+
+		for (std::size_t i = 0; i < count; i++) {
+			const meshlets::Meshlet& cluster = clusters[i];
+
+			bool visible = true;
+			for (const glm::vec4& plane : view.frustum.planes) {
+				if (glm::dot(glm::vec3(plane), cluster.centre) + plane.w < -cluster.radius) {
+					visible = false;
+					break;
+				}
+			}
+			if (!visible) {
+				continue;
+			}
+
+			// Every triangle faces away when the view direction is inside the cone widened by the sphere
+			glm::vec3 const toCentre = cluster.centre - view.position;
+			float const distance = glm::length(toCentre);
+			if (cullBackfaces && view.coneCulling && glm::dot(toCentre, cluster.coneAxis) >= cluster.coneCutoff * distance + cluster.radius) {
+				continue;
+			}
+
+			// Projected diameter from the nearest point of the sphere
+			float const nearest = distance - cluster.radius;
+			if (nearest > 0.f && 2.f * cluster.radius * view.pixelsPerUnit < view.minPixels * nearest) {
+				continue;
+			}
+
+			if (!draws.empty() && draws.back().firstIndex + draws.back().indexCount == cluster.firstIndex) {
+				draws.back().indexCount += cluster.triangleCount * 3;
+			}
+			else {
+				draws.emplace_back(DrawRange{ cluster.firstIndex, cluster.triangleCount * 3 });
+			}
+		}
+	}
+}
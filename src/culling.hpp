@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "glm.hpp"
+
+#include "model.hpp"
+#include "meshlets.hpp"
+
+namespace culling {
+	/// <summary>
+	/// The six planes of a view frustum, stored as (normal, distance) with the normals pointing inwards
+	/// </summary>
+	struct Frustum {
+		glm::vec4 planes[6];
+	};
+
+	/// <summary>
+	/// A viewpoint meshlets are culled from. The frustum planes are normalised so spheres can be tested
+	/// against them, meshlets covering fewer than minPixels across are dropped.
+	/// </summary>
+	struct ClusterView {
+		Frustum frustum;
+		glm::vec3 position = glm::vec3(0.f);
+		float pixelsPerUnit = 1.f;
+		float minPixels = 0.f;
+		// False keeps the meshlets facing away from the position even when back faces are culled
+		bool coneCulling = true;
+	};
+
+	/// <summary>
+	/// A contiguous range of a mesh's index buffer to draw
+	/// </summary>
+	struct DrawRange {
+		std::uint32_t firstIndex = 0;
+		std::uint32_t indexCount = 0;
+	};
+
+	/// <summary>
+	/// Extracts the frustum planes from a projection view matrix. The planes follow the Vulkan
+	/// clip volume (0 <= z <= w) so nothing the hardware would draw is ever culled.
+	/// </summary>
+	/// <param name="projectionView">The combined projection and view matrix</param>
+	/// <returns>The frustum in world space</returns>
+	Frustum extractFrustum(const glm::mat4& projectionView);
+
+	/// <summary>
+	/// Tests every set of bounds against the frustum and writes out the indices of the visible ones.
+	/// Uses AVX when the build enables it and SSE otherwise.
+	/// </summary>
+	/// <param name="frustum">The frustum to test against</param>
+	/// <param name="bounds">The bounds of each mesh</param>
+	/// <param name="visibleIndices">Output list of visible mesh indices in ascending order (cleared first)</param>
+	void cullMeshes(const Frustum& frustum, const model::MeshBounds& bounds, std::vector<std::uint32_t>& visibleIndices);
+
+	/// <summary>
+	/// Creates a view for culling meshlets through a perspective projection
+	/// </summary>
+	/// <param name="projectionView">The combined projection and view matrix</param>
+	/// <param name="position">The position of the viewer</param>
+	/// <param name="verticalFov">The vertical field of view in radians</param>
+	/// <param name="viewportHeight">The height of the viewport in pixels</param>
+	/// <param name="minPixels">Smallest projected diameter in pixels a meshlet is drawn at</param>
+	/// <returns>The view</returns>
+	ClusterView createClusterView(const glm::mat4& projectionView, glm::vec3 position, float verticalFov, float viewportHeight, float minPixels);
+
+	/// <summary>
+	/// Creates a view that keeps every meshlet, for draws recorded once and seen from any viewpoint
+	/// </summary>
+	/// <returns>The view</returns>
+	ClusterView createUnculledView();
+
+	/// <summary>
+	/// Moves a view into the space a transform maps from, so the meshlets of an instance can be culled where they
+	/// are stored. Back facing meshlets are only culled if the transform keeps their shape and winding.
+	/// </summary>
+	/// <param name="view">The view in world space</param>
+	/// <param name="transform">The transform of the instance</param>
+	/// <returns>The view in the space of the instance's meshlets</returns>
+	ClusterView transformClusterView(const ClusterView& view, const glm::mat4& transform);
+
+	/// <summary>
+	/// Culls meshlets outside the frustum, too small to see or, optionally, facing away from the viewer,
+	/// then merges the visible meshlets that follow one another in the index buffer into single draws.
+	/// </summary>
+	/// <param name="view">The view to cull from</param>
+	/// <param name="clusters">The meshlets, in index buffer order</param>
+	/// <param name="count">Number of meshlets</param>
+	/// <param name="cullBackfaces">False for two sided geometry</param>
+	/// <param name="draws">Output index ranges to draw (cleared first)</param>
+	void cullClusters(const ClusterView& view, const meshlets::Meshlet* clusters, std::size_t count, bool cullBackfaces, std::vector<DrawRange>& draws);
+}
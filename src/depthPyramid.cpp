@@ -0,0 +1,285 @@
+#include "depthPyramid.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "utility.hpp"
+
+// Must match local_size_x and local_size_y in depthPyramidShader.comp
+#define PYRAMID_GROUP_SIZE 8
+
+namespace occlusion {
+
+	namespace {
+		/// <summary>
+		/// Push constants of the pyramid shader, laid out to match depthPyramidShader.comp
+		/// </summary>
+		struct LevelConstants
+		{
+			std::uint32_t width;
+			std::uint32_t height;
+			// 0 copies the source texel (level 0), otherwise the farthest of the 2x2 source texels is kept
+			std::uint32_t reduce;
+		};
+
+		/// <summary>
+		/// Creates a view of a range of levels of the pyramid image
+		/// </summary>
+		VkImageView createLevelView(app::AppContext& app, VkImage image, std::uint32_t firstLevel, std::uint32_t levelCount) {
+			VkImageViewCreateInfo viewInfo{};
+			viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+			viewInfo.image = image;
+			viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+			viewInfo.format = VK_FORMAT_R32_SFLOAT;
+			viewInfo.subresourceRange = VkImageSubresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, firstLevel, levelCount, 0, 1 };
+
+			VkImageView view = VK_NULL_HANDLE;
+			if (vkCreateImageView(app.logicalDevice, &viewInfo, nullptr, &view) != VK_SUCCESS) {
+				throw std::runtime_error("Failed to create depth pyramid image view.");
+			}
+			return view;
+		}
+	}
+
+	DepthPyramid::DepthPyramid(app::AppContext& inApp, VmaAllocator inAllocator, VkShaderModule buildShader)
+		: app(inApp)
+		, allocator(inAllocator)
+	{
+		// Each level reads the one below it and writes itself
+		VkDescriptorSetLayoutBinding bindings[2]{};
+		bindings[0].binding = 0;
+		bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		bindings[0].descriptorCount = 1;
+		bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		bindings[1].binding = 1;
+		bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		bindings[1].descriptorCount = 1;
+		bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+		VkDescriptorSetLayoutCreateInfo descriptorSetLayoutInfo{};
+		descriptorSetLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		descriptorSetLayoutInfo.bindingCount = 2;
+		descriptorSetLayoutInfo.pBindings = bindings;
+		if (vkCreateDescriptorSetLayout(app.logicalDevice, &descriptorSetLayoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create depth pyramid descriptor set layout.");
+		}
+
+		VkPushConstantRange pushConstantRange{};
+		pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		pushConstantRange.size = sizeof(LevelConstants);
+
+		VkPipelineLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		layoutInfo.setLayoutCount = 1;
+		layoutInfo.pSetLayouts = &descriptorSetLayout;
+		layoutInfo.pushConstantRangeCount = 1;
+		layoutInfo.pPushConstantRanges = &pushConstantRange;
+		if (vkCreatePipelineLayout(app.logicalDevice, &layoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create depth pyramid pipeline layout.");
+		}
+
+		VkComputePipelineCreateInfo pipelineInfo{};
+		pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		pipelineInfo.stage.module = buildShader;
+		pipelineInfo.stage.pName = "main";
+		pipelineInfo.layout = pipelineLayout;
+		if (vkCreateComputePipelines(app.logicalDevice, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create depth pyramid pipeline.");
+		}
+
+		// Texels are only ever fetched, never filtered
+		VkSamplerCreateInfo samplerInfo{};
+		samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+		samplerInfo.magFilter = VK_FILTER_NEAREST;
+		samplerInfo.minFilter = VK_FILTER_NEAREST;
+		samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+		if (vkCreateSampler(app.logicalDevice, &samplerInfo, nullptr, &pointSampler) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create depth pyramid sampler.");
+		}
+	}
+
+	DepthPyramid::~DepthPyramid()
+	{
+		cleanup();
+	}
+
+	void DepthPyramid::resize(VkImageView depthView, VkExtent2D extent) {
+		destroyImage();
+
+		// Halving and rounding up keeps every depth texel under exactly one texel of each level
+		levelExtents.emplace_back(extent);
+		while (levelExtents.back().width > 1 || levelExtents.back().height > 1) {
+			VkExtent2D const previous = levelExtents.back();
+			levelExtents.emplace_back(VkExtent2D{ std::max((previous.width + 1) / 2, 1u), std::max((previous.height + 1) / 2, 1u) });
+		}
+		std::uint32_t const levelCount = std::uint32_t(levelExtents.size());
+
+		VkImageCreateInfo imageInfo{};
+		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.format = VK_FORMAT_R32_SFLOAT;
+		imageInfo.extent = VkExtent3D{ extent.width, extent.height, 1 };
+		imageInfo.mipLevels = levelCount;
+		imageInfo.arrayLayers = 1;
+		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		VmaAllocationCreateInfo allocationInfo{};
+		allocationInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+		if (vmaCreateImage(allocator, &imageInfo, &allocationInfo, &image, &allocation, nullptr) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create the depth pyramid image.");
+		}
+
+		pyramidView = createLevelView(app, image, 0, levelCount);
+		for (std::uint32_t level = 0; level < levelCount; level++) {
+			levelViews.emplace_back(createLevelView(app, image, level, 1));
+		}
+
+		// One set per level, all remade with the image
+		VkDescriptorPoolSize poolSizes[2]{};
+		poolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		poolSizes[0].descriptorCount = levelCount;
+		poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		poolSizes[1].descriptorCount = levelCount;
+
+		VkDescriptorPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolInfo.poolSizeCount = 2;
+		poolInfo.pPoolSizes = poolSizes;
+		poolInfo.maxSets = levelCount;
+		if (vkCreateDescriptorPool(app.logicalDevice, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create depth pyramid descriptor pool.");
+		}
+
+		std::vector<VkDescriptorSetLayout> layouts(levelCount, descriptorSetLayout);
+		VkDescriptorSetAllocateInfo setInfo{};
+		setInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		setInfo.descriptorPool = descriptorPool;
+		setInfo.descriptorSetCount = levelCount;
+		setInfo.pSetLayouts = layouts.data();
+		levelDescriptorSets.resize(levelCount);
+		if (vkAllocateDescriptorSets(app.logicalDevice, &setInfo, levelDescriptorSets.data()) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create depth pyramid descriptor sets.");
+		}
+
+		// Level 0 reads the depth buffer, every other level reads the level below it
+		for (std::uint32_t level = 0; level < levelCount; level++) {
+			VkDescriptorImageInfo sourceInfo{};
+			sourceInfo.sampler = pointSampler;
+			sourceInfo.imageView = level == 0 ? depthView : levelViews[level - 1];
+			sourceInfo.imageLayout = level == 0 ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL;
+
+			VkDescriptorImageInfo destinationInfo{};
+			destinationInfo.imageView = levelViews[level];
+			destinationInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+			VkWriteDescriptorSet descriptors[2]{};
+			descriptors[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			descriptors[0].dstSet = levelDescriptorSets[level];
+			descriptors[0].dstBinding = 0;
+			descriptors[0].descriptorCount = 1;
+			descriptors[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			descriptors[0].pImageInfo = &sourceInfo;
+			descriptors[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			descriptors[1].dstSet = levelDescriptorSets[level];
+			descriptors[1].dstBinding = 1;
+			descriptors[1].descriptorCount = 1;
+			descriptors[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+			descriptors[1].pImageInfo = &destinationInfo;
+			vkUpdateDescriptorSets(app.logicalDevice, 2, descriptors, 0, nullptr);
+		}
+
+		prepared = false;
+	}
+
+	void DepthPyramid::prepare(VkCommandBuffer commandBuffer) {
+		if (prepared) {
+			return;
+		}
+
+		utility::createImageBarrier(image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL,
+			0, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+			VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, std::uint32_t(levelExtents.size()),
+			commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT
+		);
+		prepared = true;
+	}
+
+	void DepthPyramid::build(VkCommandBuffer commandBuffer) {
+		prepare(commandBuffer);
+
+		std::uint32_t const levelCount = std::uint32_t(levelExtents.size());
+
+		// The last frame's reads of the pyramid finish before it is overwritten
+		utility::createImageBarrier(image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL,
+			VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+			VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, levelCount,
+			commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT
+		);
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+		for (std::uint32_t level = 0; level < levelCount; level++) {
+			LevelConstants constants{ levelExtents[level].width, levelExtents[level].height, level == 0 ? 0u : 1u };
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &levelDescriptorSets[level], 0, nullptr);
+			vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(LevelConstants), &constants);
+			vkCmdDispatch(commandBuffer,
+				(constants.width + PYRAMID_GROUP_SIZE - 1) / PYRAMID_GROUP_SIZE,
+				(constants.height + PYRAMID_GROUP_SIZE - 1) / PYRAMID_GROUP_SIZE, 1);
+
+			// The next level (or the culling) reads what this level wrote
+			utility::createImageBarrier(image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL,
+				VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+				VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, levelCount,
+				commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT
+			);
+		}
+	}
+
+	void DepthPyramid::cleanup() {
+		destroyImage();
+
+		if (pipeline != VK_NULL_HANDLE) {
+			vkDestroyPipeline(app.logicalDevice, pipeline, nullptr);
+			vkDestroyPipelineLayout(app.logicalDevice, pipelineLayout, nullptr);
+			vkDestroyDescriptorSetLayout(app.logicalDevice, descriptorSetLayout, nullptr);
+			vkDestroySampler(app.logicalDevice, pointSampler, nullptr);
+			pipeline = VK_NULL_HANDLE;
+			pipelineLayout = VK_NULL_HANDLE;
+			descriptorSetLayout = VK_NULL_HANDLE;
+			pointSampler = VK_NULL_HANDLE;
+		}
+	}
+
+	void DepthPyramid::destroyImage() {
+		if (descriptorPool != VK_NULL_HANDLE) {
+			vkDestroyDescriptorPool(app.logicalDevice, descriptorPool, nullptr);
+			descriptorPool = VK_NULL_HANDLE;
+		}
+		levelDescriptorSets.clear();
+
+		for (VkImageView view : levelViews) {
+			vkDestroyImageView(app.logicalDevice, view, nullptr);
+		}
+		levelViews.clear();
+		levelExtents.clear();
+
+		if (pyramidView != VK_NULL_HANDLE) {
+			vkDestroyImageView(app.logicalDevice, pyramidView, nullptr);
+			pyramidView = VK_NULL_HANDLE;
+		}
+		if (image != VK_NULL_HANDLE) {
+			vmaDestroyImage(allocator, image, allocation);
+			image = VK_NULL_HANDLE;
+			allocation = VK_NULL_HANDLE;
+		}
+	}
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <cstdint>
+#include <vector>
+
+#include <vk_mem_alloc.h>
+#include "setup.hpp"
+
+namespace occlusion {
+	/// <summary>
+	/// A hierarchical depth (Hi-Z) pyramid of the depth buffer, built by a compute shader. Level 0 is a
+	/// copy of the depth buffer and every texel of the next level holds the farthest depth of the 2x2
+	/// texels below it, so a box can be tested against the depth buffer with at most four reads.
+	/// The pyramid is kept in the general layout so it can be written and sampled without transitions.
+	/// </summary>
+	class DepthPyramid
+	{
+	public:
+
+		/// <summary>
+		/// Parameterised constructor
+		/// </summary>
+		/// <param name="app">Application context</param>
+		/// <param name="allocator">Vulkan memory allocator</param>
+		/// <param name="buildShader">The pyramid compute shader, only needed until the constructor returns</param>
+		DepthPyramid(app::AppContext& app, VmaAllocator allocator, VkShaderModule buildShader);
+
+		/// <summary>
+		/// Destructor
+		/// </summary>
+		~DepthPyramid();
+
+		// The pyramid owns its image so it can not be copied
+		DepthPyramid(DepthPyramid&) = delete;
+		DepthPyramid& operator= (DepthPyramid&) = delete;
+
+		/// <summary>
+		/// Remakes the pyramid for a depth buffer, for when the depth buffer is created or remade.
+		/// Nothing may be using the old pyramid.
+		/// </summary>
+		/// <param name="depthView">View of the depth aspect of the depth buffer</param>
+		/// <param name="extent">Size of the depth buffer</param>
+		void resize(VkImageView depthView, VkExtent2D extent);
+
+		/// <summary>
+		/// Moves a newly made pyramid into the general layout. Must be recorded before any command that
+		/// binds the pyramid, it does nothing once the pyramid has been prepared.
+		/// </summary>
+		/// <param name="commandBuffer">Command buffer outside of any render pass</param>
+		void prepare(VkCommandBuffer commandBuffer);
+
+		/// <summary>
+		/// Records the build of every level. The depth buffer must be in the depth read only layout and its
+		/// writes visible to compute shaders. On return the pyramid can be read by compute shaders.
+		/// </summary>
+		/// <param name="commandBuffer">Command buffer outside of any render pass</param>
+		void build(VkCommandBuffer commandBuffer);
+
+		/// <summary>
+		/// View of every level of the pyramid, in the general layout
+		/// </summary>
+		VkImageView view() const { return pyramidView; }
+
+		/// <summary>
+		/// Nearest neighbour sampler to read the pyramid with
+		/// </summary>
+		VkSampler sampler() const { return pointSampler; }
+
+		/// <summary>
+		/// Destroys the image and pipeline, the pyramid can not be used afterwards
+		/// </summary>
+		void cleanup();
+
+	private:
+		void destroyImage();
+
+		app::AppContext& app;
+		VmaAllocator allocator;
+
+		VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+		VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+		VkPipeline pipeline = VK_NULL_HANDLE;
+		VkSampler pointSampler = VK_NULL_HANDLE;
+
+		// Remade with the image, one set per level
+		VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+		std::vector<VkDescriptorSet> levelDescriptorSets;
+
+		VkImage image = VK_NULL_HANDLE;
+		VmaAllocation allocation = VK_NULL_HANDLE;
+		VkImageView pyramidView = VK_NULL_HANDLE;
+		std::vector<VkImageView> levelViews;
+		std::vector<VkExtent2D> levelExtents;
+		bool prepared = false;
+	};
+}
@@ -0,0 +1,117 @@
+#include "drawSorting.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <stdexcept>
+
+// Lists shorter than this are sorted on the calling thread, each block of a parallel sort is at least this long
+#define PARALLEL_SORT_MIN 4096
+
+namespace sorting {
+
+	std::uint64_t createSortKey(Pass pass, Pipeline pipeline, float distance, std::uint32_t mesh) {
+		if (mesh > MAX_SORT_MESH) {
+			throw std::runtime_error("Too many draws to sort, the mesh index does not fit in the sort key");
+		}
+
+		// The bits of a positive float sort in the same order as its value
+		std::uint64_t const depth = std::bit_cast<std::uint32_t>(std::max(distance, 0.f));
+
+		return (std::uint64_t(pass) << 62) |
+			(std::uint64_t(pipeline) << 60) |
+			(depth << 28) |
+			std::uint64_t(mesh);
+	}
+
+	Pipeline keyPipeline(std::uint64_t key) {
+		return Pipeline((key >> 60) & 0x3);
+	}
+
+	std::uint32_t keyMesh(std::uint64_t key) {
+		return std::uint32_t(key & MAX_SORT_MESH);
+	}
+
+	void appendSortKeys(Pass pass, Pipeline pipeline, glm::vec3 viewPosition, const model::MeshBounds& bounds,
+		const std::vector<std::uint32_t>& indices, std::vector<std::uint64_t>& outKeys) {
+		outKeys.reserve(outKeys.size() + indices.size());
+		for (std::uint32_t i : indices) {
+			// Distance to the centre of the bounds, meshes the viewer is inside of come first
+			float const distance = glm::length(glm::vec3(bounds.centreX[i], bounds.centreY[i], bounds.centreZ[i]) - viewPosition);
+			outKeys.emplace_back(createSortKey(pass, pipeline, distance, i));
+		}
+	}
+
+	void radixSort(std::vector<std::uint64_t>& keys, std::vector<std::uint64_t>& scratch, jobs::JobSystem& jobSystem) {
+		std::size_t const count = keys.size();
+		if (count < 2) {
+			return;
+		}
+		scratch.resize(count);
+
+		// Bytes that are the same in every key do not change the order
+		std::uint64_t anyBits = 0;
+		std::uint64_t allBits = ~0ull;
+		for (std::uint64_t key : keys) {
+			anyBits |= key;
+			allBits &= key;
+		}
+		std::uint64_t const differentBits = anyBits ^ allBits;
+
+		// Each block counts and scatters its own range, blocks are scattered in order so the sort stays stable
+		std::size_t const blockCount = std::clamp<std::size_t>(count / PARALLEL_SORT_MIN, 1, jobSystem.threadCount());
+		std::size_t const blockSize = (count + blockCount - 1) / blockCount;
+		std::vector<std::array<std::size_t, 256>> offsets(blockCount);
+
+		for (int shift = 0; shift < 64; shift += 8) {
+			if (((differentBits >> shift) & 0xFF) == 0) {
+				continue;
+			}
+
+			auto countDigits = [&](std::size_t firstBlock, std::size_t endBlock) {
+				for (std::size_t block = firstBlock; block < endBlock; block++) {
+					std::array<std::size_t, 256>& histogram = offsets[block];
+					histogram.fill(0);
+					std::size_t const end = std::min(count, (block + 1) * blockSize);
+					for (std::size_t i = block * blockSize; i < end; i++) {
+						histogram[(keys[i] >> shift) & 0xFF]++;
+					}
+				}
+			};
+			auto scatter = [&](std::size_t firstBlock, std::size_t endBlock) {
+				for (std::size_t block = firstBlock; block < endBlock; block++) {
+					std::array<std::size_t, 256>& next = offsets[block];
+					std::size_t const end = std::min(count, (block + 1) * blockSize);
+					for (std::size_t i = block * blockSize; i < end; i++) {
+						scratch[next[(keys[i] >> shift) & 0xFF]++] = keys[i];
+					}
+				}
+			};
+
+			if (blockCount == 1) {
+				countDigits(0, 1);
+			}
+			else {
+				jobSystem.parallelFor(blockCount, 1, countDigits);
+			}
+
+			// Each digit of each block starts after every smaller digit and the same digit of earlier blocks
+			std::size_t start = 0;
+			for (std::size_t digit = 0; digit < 256; digit++) {
+				for (std::size_t block = 0; block < blockCount; block++) {
+					std::size_t const digitCount = offsets[block][digit];
+					offsets[block][digit] = start;
+					start += digitCount;
+				}
+			}
+
+			if (blockCount == 1) {
+				scatter(0, 1);
+			}
+			else {
+				jobSystem.parallelFor(blockCount, 1, scatter);
+			}
+			keys.swap(scratch);
+		}
+	}
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "glm.hpp"
+
+#include "model.hpp"
+#include "jobSystem.hpp"
+
+namespace sorting {
+	/// <summary>
+	/// The pass a draw belongs to, passes are drawn in this order
+	/// </summary>
+	enum class Pass : std::uint64_t {
+		Shadow = 0,
+		Colour = 1
+	};
+
+	/// <summary>
+	/// The pipeline a draw is made with, pipelines are bound in this order within a pass
+	/// </summary>
+	enum class Pipeline : std::uint64_t {
+		Opaque = 0,
+		Alpha = 1
+	};
+
+	/// <summary>
+	/// Largest mesh index a sort key can hold
+	/// </summary>
+	constexpr std::uint32_t MAX_SORT_MESH = 0xFFFFFFF;
+
+	/// <summary>
+	/// Packs the state of a draw into a key that sorts draws by pass, then pipeline, then front to back,
+	/// with the mesh index in the low bits to find the mesh again.
+	/// Bits: pass 63-62, pipeline 61-60, depth 59-28, mesh 27-0.
+	/// Materials are read per instance from a buffer and every texture is bound once, so changing
+	/// material between draws costs nothing and is not part of the key.
+	/// </summary>
+	/// <param name="pass">The pass</param>
+	/// <param name="pipeline">The pipeline</param>
+	/// <param name="distance">Distance from the viewer (not negative)</param>
+	/// <param name="mesh">Index of the mesh in its list, throws if it is above MAX_SORT_MESH</param>
+	/// <returns>The key</returns>
+	std::uint64_t createSortKey(Pass pass, Pipeline pipeline, float distance, std::uint32_t mesh);
+
+	/// <summary>
+	/// Gets the pipeline of a key
+	/// </summary>
+	Pipeline keyPipeline(std::uint64_t key);
+
+	/// <summary>
+	/// Gets the mesh index of a key
+	/// </summary>
+	std::uint32_t keyMesh(std::uint64_t key);
+
+	/// <summary>
+	/// Appends the sort keys of a list of meshes
+	/// </summary>
+	/// <param name="pass">The pass the meshes are drawn in</param>
+	/// <param name="pipeline">The pipeline the meshes are drawn with</param>
+	/// <param name="viewPosition">Position of the viewer</param>
+	/// <param name="bounds">The bounds of the meshes</param>
+	/// <param name="indices">Indices of the meshes to draw</param>
+	/// <param name="outKeys">The keys to append to</param>
+	void appendSortKeys(Pass pass, Pipeline pipeline, glm::vec3 viewPosition, const model::MeshBounds& bounds,
+		const std::vector<std::uint32_t>& indices, std::vector<std::uint64_t>& outKeys);
+
+	/// <summary>
+	/// Sorts keys in ascending order with a least significant digit radix sort, one byte per pass.
+	/// Large lists are split into blocks that are counted and scattered on the job system, and bytes
+	/// that are the same in every key are skipped.
+	/// </summary>
+	/// <param name="keys">The keys to sort</param>
+	/// <param name="scratch">Memory the keys are scattered through, kept between calls to avoid allocating</param>
+	/// <param name="jobSystem">Job system to sort on</param>
+	void radixSort(std::vector<std::uint64_t>& keys, std::vector<std::uint64_t>& scratch, jobs::JobSystem& jobSystem);
+}
@@ -0,0 +1,242 @@
+#include "geometryPool.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+namespace model {
+
+	namespace {
+		/// <summary>
+		/// Creates a virtual block counting in elements (it may not be empty)
+		/// </summary>
+		VmaVirtualBlock createBlock(std::uint32_t capacity) {
+			VmaVirtualBlockCreateInfo blockInfo{};
+			blockInfo.size = std::max<VkDeviceSize>(capacity, 1);
+
+			VmaVirtualBlock block = VK_NULL_HANDLE;
+			if (vmaCreateVirtualBlock(&blockInfo, &block) != VK_SUCCESS) {
+				throw std::runtime_error("Failed to create geometry pool block.");
+			}
+			return block;
+		}
+
+		/// <summary>
+		/// Reserves a range of elements in a block, an empty range takes no room
+		/// </summary>
+		/// <returns>False if the block has no room left</returns>
+		bool allocateRange(VmaVirtualBlock block, std::uint32_t count, VmaVirtualAllocation& outAllocation, std::uint32_t& outOffset) {
+			outAllocation = VK_NULL_HANDLE;
+			outOffset = 0;
+			if (count == 0) {
+				return true;
+			}
+
+			VmaVirtualAllocationCreateInfo allocationInfo{};
+			allocationInfo.size = count;
+
+			VkDeviceSize offset = 0;
+			if (vmaVirtualAllocate(block, &allocationInfo, &outAllocation, &offset) != VK_SUCCESS) {
+				return false;
+			}
+			outOffset = std::uint32_t(offset);
+			return true;
+		}
+
+		/// <summary>
+		/// Reserves the vertices and indices of a mesh in a pair of blocks
+		/// </summary>
+		GeometryAllocation allocateGeometry(VmaVirtualBlock vertexBlock, VmaVirtualBlock indexBlock, std::uint32_t vertexCount, std::uint32_t indexCount) {
+			GeometryAllocation allocation;
+			allocation.vertexCount = vertexCount;
+			allocation.indexCount = indexCount;
+
+			if (!allocateRange(vertexBlock, vertexCount, allocation.vertexAllocation, allocation.vertexOffset)) {
+				throw std::runtime_error("Geometry pool is out of room for vertices.");
+			}
+			if (!allocateRange(indexBlock, indexCount, allocation.indexAllocation, allocation.firstIndex)) {
+				if (allocation.vertexAllocation != VK_NULL_HANDLE) {
+					vmaVirtualFree(vertexBlock, allocation.vertexAllocation);
+				}
+				throw std::runtime_error("Geometry pool is out of room for indices.");
+			}
+			return allocation;
+		}
+	}
+
+	GeometryPool::GeometryPool(VmaAllocator& inAllocator, const std::vector<VkDeviceSize>& vertexStrides,
+		std::uint32_t vertexCapacity, std::uint32_t indexCapacity)
+		: allocator(inAllocator)
+		, strides(vertexStrides)
+	{
+		createStorage(vertexCapacity, indexCapacity);
+	}
+
+	GeometryPool::~GeometryPool()
+	{
+		cleanup();
+	}
+
+	GeometryAllocation GeometryPool::allocate(std::uint32_t vertexCount, std::uint32_t indexCount) {
+		return allocateGeometry(vertexBlock, indexBlock, vertexCount, indexCount);
+	}
+
+	void GeometryPool::free(GeometryAllocation& allocation) {
+		if (allocation.vertexAllocation != VK_NULL_HANDLE) {
+			vmaVirtualFree(vertexBlock, allocation.vertexAllocation);
+		}
+		if (allocation.indexAllocation != VK_NULL_HANDLE) {
+			vmaVirtualFree(indexBlock, allocation.indexAllocation);
+		}
+		allocation = GeometryAllocation();
+	}
+
+	void GeometryPool::uploadVertices(utility::UploadBatch& uploads, const GeometryAllocation& allocation, std::uint32_t stream, const void* data) {
+		VkDeviceSize const size = allocation.vertexCount * strides[stream];
+		if (size == 0) {
+			return;
+		}
+
+		utility::StagingAllocation staging = uploads.allocateStaging(size);
+		std::memcpy(staging.memory, data, size);
+
+		VkBufferCopy copy{};
+		copy.srcOffset = staging.offset;
+		copy.dstOffset = allocation.vertexOffset * strides[stream];
+		copy.size = size;
+		vkCmdCopyBuffer(uploads.commandBuffer(), staging.buffer, vertexStreams[stream].buffer, 1, &copy);
+
+		uploads.countBytes(size);
+	}
+
+	void GeometryPool::uploadIndices(utility::UploadBatch& uploads, const GeometryAllocation& allocation, const std::uint32_t* indices) {
+		VkDeviceSize const size = allocation.indexCount * sizeof(std::uint32_t);
+		if (size == 0) {
+			return;
+		}
+
+		utility::StagingAllocation staging = uploads.allocateStaging(size);
+		std::memcpy(staging.memory, indices, size);
+
+		VkBufferCopy copy{};
+		copy.srcOffset = staging.offset;
+		copy.dstOffset = allocation.firstIndex * sizeof(std::uint32_t);
+		copy.size = size;
+		vkCmdCopyBuffer(uploads.commandBuffer(), staging.buffer, indexBuffer.buffer, 1, &copy);
+
+		uploads.countBytes(size);
+	}
+
+	void GeometryPool::repack(utility::UploadBatch& uploads, const std::vector<GeometryAllocation*>& allocations,
+		std::uint32_t vertexCapacity, std::uint32_t indexCapacity) {
+		// Keep the old storage alive until the copies out of it have completed
+		std::vector<utility::BufferSet> oldStreams = std::move(vertexStreams);
+		utility::BufferSet oldIndices = std::move(indexBuffer);
+		VmaVirtualBlock oldVertexBlock = std::exchange(vertexBlock, VK_NULL_HANDLE);
+		VmaVirtualBlock oldIndexBlock = std::exchange(indexBlock, VK_NULL_HANDLE);
+		vertexStreams.clear();
+		createStorage(vertexCapacity, indexCapacity);
+
+		// Allocating in vertex order into empty blocks packs the meshes one after the other
+		std::vector<GeometryAllocation*> order(allocations);
+		std::sort(order.begin(), order.end(), [](const GeometryAllocation* a, const GeometryAllocation* b) {
+			return a->vertexOffset < b->vertexOffset;
+		});
+
+		std::vector<std::vector<VkBufferCopy>> vertexCopies(strides.size());
+		std::vector<VkBufferCopy> indexCopies;
+		for (GeometryAllocation* allocation : order) {
+			GeometryAllocation moved = allocateGeometry(vertexBlock, indexBlock, allocation->vertexCount, allocation->indexCount);
+
+			if (allocation->vertexCount > 0) {
+				for (std::size_t stream = 0; stream < strides.size(); stream++) {
+					VkBufferCopy copy{};
+					copy.srcOffset = allocation->vertexOffset * strides[stream];
+					copy.dstOffset = moved.vertexOffset * strides[stream];
+					copy.size = allocation->vertexCount * strides[stream];
+					vertexCopies[stream].emplace_back(copy);
+				}
+			}
+			if (allocation->indexCount > 0) {
+				VkBufferCopy copy{};
+				copy.srcOffset = allocation->firstIndex * sizeof(std::uint32_t);
+				copy.dstOffset = moved.firstIndex * sizeof(std::uint32_t);
+				copy.size = allocation->indexCount * sizeof(std::uint32_t);
+				indexCopies.emplace_back(copy);
+			}
+
+			*allocation = moved;
+		}
+
+		// One copy command per buffer
+		VkCommandBuffer commandBuffer = uploads.commandBuffer();
+		for (std::size_t stream = 0; stream < strides.size(); stream++) {
+			if (!vertexCopies[stream].empty()) {
+				vkCmdCopyBuffer(commandBuffer, oldStreams[stream].buffer, vertexStreams[stream].buffer,
+					std::uint32_t(vertexCopies[stream].size()), vertexCopies[stream].data());
+			}
+		}
+		if (!indexCopies.empty()) {
+			vkCmdCopyBuffer(commandBuffer, oldIndices.buffer, indexBuffer.buffer, std::uint32_t(indexCopies.size()), indexCopies.data());
+		}
+
+		uploads.flush();
+
+		// The old allocations are dropped along with their blocks
+		vmaClearVirtualBlock(oldVertexBlock);
+		vmaDestroyVirtualBlock(oldVertexBlock);
+		vmaClearVirtualBlock(oldIndexBlock);
+		vmaDestroyVirtualBlock(oldIndexBlock);
+	}
+
+	void GeometryPool::bind(VkCommandBuffer commandBuffer, bool positionsOnly) const {
+		std::vector<VkBuffer> buffers;
+		for (const utility::BufferSet& stream : vertexStreams) {
+			buffers.emplace_back(stream.buffer);
+		}
+		std::vector<VkDeviceSize> offsets(buffers.size(), 0);
+
+		std::uint32_t const bufferCount = positionsOnly ? 1 : std::uint32_t(buffers.size());
+		vkCmdBindVertexBuffers(commandBuffer, 0, bufferCount, buffers.data(), offsets.data());
+		vkCmdBindIndexBuffer(commandBuffer, indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+	}
+
+	void GeometryPool::cleanup() {
+		vertexStreams.clear();
+		indexBuffer = utility::BufferSet();
+
+		// Live allocations do not need freeing one by one
+		if (vertexBlock != VK_NULL_HANDLE) {
+			vmaClearVirtualBlock(vertexBlock);
+			vmaDestroyVirtualBlock(vertexBlock);
+			vertexBlock = VK_NULL_HANDLE;
+		}
+		if (indexBlock != VK_NULL_HANDLE) {
+			vmaClearVirtualBlock(indexBlock);
+			vmaDestroyVirtualBlock(indexBlock);
+			indexBlock = VK_NULL_HANDLE;
+		}
+	}
+
+	void GeometryPool::createStorage(std::uint32_t vertexCapacity, std::uint32_t indexCapacity) {
+		// Buffers may not be empty, the copy source usage lets the pool be repacked
+		for (VkDeviceSize stride : strides) {
+			vertexStreams.emplace_back(utility::createBuffer(
+				allocator,
+				std::max<VkDeviceSize>(vertexCapacity * stride, stride),
+				VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+				VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE
+			));
+		}
+		indexBuffer = utility::createBuffer(
+			allocator,
+			std::max<VkDeviceSize>(indexCapacity * sizeof(std::uint32_t), sizeof(std::uint32_t)),
+			VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE
+		);
+
+		vertexBlock = createBlock(vertexCapacity);
+		indexBlock = createBlock(indexCapacity);
+	}
+}
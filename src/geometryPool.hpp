@@ -0,0 +1,124 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <cstdint>
+#include <vector>
+
+#include <vk_mem_alloc.h>
+#include "utility.hpp"
+#include "uploadBatch.hpp"
+
+namespace model {
+	/// <summary>
+	/// The place of one mesh's vertices and indices within a geometry pool. Draws use firstIndex
+	/// and vertexOffset so every mesh in the pool can be drawn with the pool bound once.
+	/// </summary>
+	struct GeometryAllocation
+	{
+		std::uint32_t vertexOffset = 0;
+		std::uint32_t vertexCount = 0;
+		std::uint32_t firstIndex = 0;
+		std::uint32_t indexCount = 0;
+
+		VmaVirtualAllocation vertexAllocation = VK_NULL_HANDLE;
+		VmaVirtualAllocation indexAllocation = VK_NULL_HANDLE;
+	};
+
+	/// <summary>
+	/// A few large device buffers that the vertices and indices of many meshes are sub-allocated from.
+	/// Each vertex stream has its own buffer and every stream of a mesh starts at the same vertex, the
+	/// ranges are managed with VMA virtual blocks counted in vertices and indices.
+	/// </summary>
+	class GeometryPool
+	{
+	public:
+
+		/// <summary>
+		/// Parameterised constructor
+		/// </summary>
+		/// <param name="allocator">Vulkan memory allocator</param>
+		/// <param name="vertexStrides">Size of a vertex in each stream, stream 0 must hold the positions</param>
+		/// <param name="vertexCapacity">Number of vertices the pool can hold</param>
+		/// <param name="indexCapacity">Number of indices the pool can hold</param>
+		GeometryPool(VmaAllocator& allocator, const std::vector<VkDeviceSize>& vertexStrides,
+			std::uint32_t vertexCapacity, std::uint32_t indexCapacity);
+
+		/// <summary>
+		/// Destructor
+		/// </summary>
+		~GeometryPool();
+
+		// The pool owns its buffers so it can not be copied
+		GeometryPool(GeometryPool&) = delete;
+		GeometryPool& operator= (GeometryPool&) = delete;
+
+		/// <summary>
+		/// Reserves room for a mesh
+		/// </summary>
+		/// <param name="vertexCount">Number of vertices</param>
+		/// <param name="indexCount">Number of indices</param>
+		/// <returns>Where the mesh is stored, throws if the pool is out of room</returns>
+		GeometryAllocation allocate(std::uint32_t vertexCount, std::uint32_t indexCount);
+
+		/// <summary>
+		/// Releases the room of a mesh, the GPU must have finished drawing it
+		/// </summary>
+		/// <param name="allocation">The allocation, reset to empty</param>
+		void free(GeometryAllocation& allocation);
+
+		/// <summary>
+		/// Records a copy of one vertex stream of a mesh into the pool
+		/// </summary>
+		/// <param name="uploads">Upload batch the data is copied through</param>
+		/// <param name="allocation">Where the mesh is stored</param>
+		/// <param name="stream">The vertex stream</param>
+		/// <param name="data">The vertices, allocation.vertexCount of the stream's stride</param>
+		void uploadVertices(utility::UploadBatch& uploads, const GeometryAllocation& allocation, std::uint32_t stream, const void* data);
+
+		/// <summary>
+		/// Records a copy of the indices of a mesh into the pool
+		/// </summary>
+		/// <param name="uploads">Upload batch the data is copied through</param>
+		/// <param name="allocation">Where the mesh is stored</param>
+		/// <param name="indices">The indices, allocation.indexCount of them</param>
+		void uploadIndices(utility::UploadBatch& uploads, const GeometryAllocation& allocation, const std::uint32_t* indices);
+
+		/// <summary>
+		/// Moves every live allocation into new buffers with no gaps between them, so the room left by freed
+		/// meshes can be used again and the pool can grow or shrink. The batch is flushed before the old
+		/// buffers are destroyed, nothing may be drawing from the pool.
+		/// </summary>
+		/// <param name="uploads">Upload batch the copies are recorded into</param>
+		/// <param name="allocations">Every live allocation of the pool, updated to their new place</param>
+		/// <param name="vertexCapacity">Number of vertices the new buffers can hold</param>
+		/// <param name="indexCapacity">Number of indices the new buffers can hold</param>
+		void repack(utility::UploadBatch& uploads, const std::vector<GeometryAllocation*>& allocations,
+			std::uint32_t vertexCapacity, std::uint32_t indexCapacity);
+
+		/// <summary>
+		/// Binds the vertex streams and the index buffer of the pool
+		/// </summary>
+		/// <param name="commandBuffer">The command buffer to record into</param>
+		/// <param name="positionsOnly">Only bind stream 0 (for depth only passes)</param>
+		void bind(VkCommandBuffer commandBuffer, bool positionsOnly = false) const;
+
+		/// <summary>
+		/// Destroys the buffers and blocks, the pool can not be used afterwards
+		/// </summary>
+		void cleanup();
+
+	private:
+		void createStorage(std::uint32_t vertexCapacity, std::uint32_t indexCapacity);
+
+		VmaAllocator& allocator;
+		std::vector<VkDeviceSize> strides;
+
+		std::vector<utility::BufferSet> vertexStreams;
+		utility::BufferSet indexBuffer;
+
+		VmaVirtualBlock vertexBlock = VK_NULL_HANDLE;
+		VmaVirtualBlock indexBlock = VK_NULL_HANDLE;
+	};
+}
@@ -0,0 +1,403 @@
+#include "imageWriter.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace utility {
+
+	namespace {
+		/// <summary>
+		/// Writes bits least significant first, as deflate expects
+		/// </summary>
+		class BitWriter
+		{
+		public:
+			explicit BitWriter(std::vector<std::uint8_t>& inOutput) : output(inOutput) {}
+
+			void write(std::uint32_t value, int count) {
+				buffer |= std::uint64_t(value) << bitCount;
+				bitCount += count;
+				while (bitCount >= 8) {
+					output.emplace_back(std::uint8_t(buffer));
+					buffer >>= 8;
+					bitCount -= 8;
+				}
+			}
+
+			// Huffman codes are defined most significant bit first so are reversed before writing
+			void writeCode(std::uint32_t code, int count) {
+				std::uint32_t reversed = 0;
+				for (int i = 0; i < count; i++) {
+					reversed = (reversed << 1) | ((code >> i) & 1);
+				}
+				write(reversed, count);
+			}
+
+			void flush() {
+				if (bitCount > 0) {
+					output.emplace_back(std::uint8_t(buffer));
+				}
+				buffer = 0;
+				bitCount = 0;
+			}
+
+		private:
+			std::vector<std::uint8_t>& output;
+			std::uint64_t buffer = 0;
+			int bitCount = 0;
+		};
+
+		// Base lengths and distances of each deflate code and the extra bits following them
+		constexpr std::uint16_t kLengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+			35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+		constexpr std::uint8_t kLengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+			3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+		constexpr std::uint16_t kDistanceBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+			257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+		constexpr std::uint8_t kDistanceExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+			7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+		/// <summary>
+		/// Writes a literal or length symbol using the fixed Huffman code
+		/// </summary>
+		void writeFixedSymbol(BitWriter& bits, std::uint32_t symbol) {
+			if (symbol < 144) {
+				bits.writeCode(0x30 + symbol, 8);
+			}
+			else if (symbol < 256) {
+				bits.writeCode(0x190 + symbol - 144, 9);
+			}
+			else if (symbol < 280) {
+				bits.writeCode(symbol - 256, 7);
+			}
+			else {
+				bits.writeCode(0xC0 + symbol - 280, 8);
+			}
+		}
+
+		/// <summary>
+		/// Compresses data into a zlib stream using greedy LZ77 matching and the fixed Huffman codes.
+		/// Rendered frames compress well enough this way without building dynamic tables.
+		/// </summary>
+		std::vector<std::uint8_t> zlibCompress(const std::vector<std::uint8_t>& data) {
+			std::vector<std::uint8_t> output;
+			output.reserve(data.size() / 2 + 64);
+
+			// Header for a 32K window with no preset dictionary
+			output.emplace_back(0x78);
+			output.emplace_back(0x01);
+
+			BitWriter bits(output);
+			// Single final block using the fixed codes
+			bits.write(1, 1);
+			bits.write(1, 2);
+
+			// Hash chains over 3 byte sequences
+			constexpr std::size_t kWindowSize = 32768;
+			constexpr std::size_t kHashSize = 1 << 15;
+			constexpr int kMaxChain = 32;
+			std::vector<std::int64_t> head(kHashSize, -1);
+			std::vector<std::int64_t> previous(kWindowSize, -1);
+			auto hashAt = [&data](std::size_t i) {
+				return ((std::uint32_t(data[i]) << 10) ^ (std::uint32_t(data[i + 1]) << 5) ^ std::uint32_t(data[i + 2])) & (kHashSize - 1);
+			};
+			auto insert = [&](std::size_t i) {
+				if (i + 2 < data.size()) {
+					std::uint32_t hash = hashAt(i);
+					previous[i % kWindowSize] = head[hash];
+					head[hash] = std::int64_t(i);
+				}
+			};
+
+			std::size_t i = 0;
+			while (i < data.size()) {
+				// Find the longest match in the window
+				std::size_t bestLength = 0;
+				std::size_t bestDistance = 0;
+				if (i + 2 < data.size()) {
+					std::size_t const maxLength = std::min<std::size_t>(258, data.size() - i);
+					std::int64_t candidate = head[hashAt(i)];
+					for (int chain = 0; chain < kMaxChain && candidate >= 0 && i - std::size_t(candidate) <= kWindowSize; chain++) {
+						std::size_t length = 0;
+						while (length < maxLength && data[std::size_t(candidate) + length] == data[i + length]) {
+							length++;
+						}
+						if (length > bestLength) {
+							bestLength = length;
+							bestDistance = i - std::size_t(candidate);
+							if (length == maxLength) {
+								break;
+							}
+						}
+						std::int64_t next = previous[std::size_t(candidate) % kWindowSize];
+						if (next >= candidate) {
+							break;
+						}
+						candidate = next;
+					}
+				}
+
+				if (bestLength >= 3) {
+					// Length code
+					int lengthCode = 28;
+					while (kLengthBase[lengthCode] > bestLength) {
+						lengthCode--;
+					}
+					writeFixedSymbol(bits, 257 + lengthCode);
+					bits.write(std::uint32_t(bestLength - kLengthBase[lengthCode]), kLengthExtra[lengthCode]);
+
+					// Distance code (fixed 5 bit codes)
+					int distanceCode = 29;
+					while (kDistanceBase[distanceCode] > bestDistance) {
+						distanceCode--;
+					}
+					bits.writeCode(std::uint32_t(distanceCode), 5);
+					bits.write(std::uint32_t(bestDistance - kDistanceBase[distanceCode]), kDistanceExtra[distanceCode]);
+
+					for (std::size_t j = 0; j < bestLength; j++) {
+						insert(i + j);
+					}
+					i += bestLength;
+				}
+				else {
+					writeFixedSymbol(bits, data[i]);
+					insert(i);
+					i++;
+				}
+			}
+
+			// End of block
+			writeFixedSymbol(bits, 256);
+			bits.flush();
+
+			// Adler-32 of the uncompressed data (big endian)
+			std::uint32_t a = 1;
+			std::uint32_t b = 0;
+			for (std::uint8_t byte : data) {
+				a = (a + byte) % 65521;
+				b = (b + a) % 65521;
+			}
+			std::uint32_t adler = (b << 16) | a;
+			for (int shift = 24; shift >= 0; shift -= 8) {
+				output.emplace_back(std::uint8_t(adler >> shift));
+			}
+
+			return output;
+		}
+
+		std::uint32_t crc32(const std::uint8_t* data, std::size_t size, std::uint32_t crc = 0) {
+			static const std::array<std::uint32_t, 256> table = [] {
+				std::array<std::uint32_t, 256> values{};
+				for (std::uint32_t n = 0; n < 256; n++) {
+					std::uint32_t c = n;
+					for (int k = 0; k < 8; k++) {
+						c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+					}
+					values[n] = c;
+				}
+				return values;
+			}();
+
+			crc = ~crc;
+			for (std::size_t i = 0; i < size; i++) {
+				crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+			}
+			return ~crc;
+		}
+
+		void appendBigEndian(std::vector<std::uint8_t>& output, std::uint32_t value) {
+			for (int shift = 24; shift >= 0; shift -= 8) {
+				output.emplace_back(std::uint8_t(value >> shift));
+			}
+		}
+
+		/// <summary>
+		/// Adds a PNG chunk with its length and CRC
+		/// </summary>
+		void appendChunk(std::vector<std::uint8_t>& output, const char* type, const std::vector<std::uint8_t>& data) {
+			appendBigEndian(output, std::uint32_t(data.size()));
+			std::size_t const typeOffset = output.size();
+			output.insert(output.end(), type, type + 4);
+			output.insert(output.end(), data.begin(), data.end());
+			appendBigEndian(output, crc32(output.data() + typeOffset, data.size() + 4));
+		}
+
+		/// <summary>
+		/// The PNG Paeth predictor
+		/// </summary>
+		std::uint8_t paeth(std::uint8_t a, std::uint8_t b, std::uint8_t c) {
+			int p = int(a) + int(b) - int(c);
+			int pa = std::abs(p - int(a));
+			int pb = std::abs(p - int(b));
+			int pc = std::abs(p - int(c));
+			if (pa <= pb && pa <= pc) return a;
+			if (pb <= pc) return b;
+			return c;
+		}
+
+		void writeFile(char const* filePath, const void* data, std::size_t size) {
+			std::ofstream file(filePath, std::ios::binary | std::ios::trunc);
+			if (!file) {
+				throw std::runtime_error("Could not open " + std::string(filePath) + " for writing.");
+			}
+			file.write(static_cast<const char*>(data), std::streamsize(size));
+			if (!file) {
+				throw std::runtime_error("Failed to write " + std::string(filePath));
+			}
+		}
+
+		template<typename T>
+		void appendLittleEndian(std::vector<std::uint8_t>& output, T value) {
+			std::uint8_t bytes[sizeof(T)];
+			std::memcpy(bytes, &value, sizeof(T));
+			output.insert(output.end(), bytes, bytes + sizeof(T));
+		}
+
+		/// <summary>
+		/// Adds an EXR header attribute
+		/// </summary>
+		void appendAttribute(std::vector<std::uint8_t>& output, const char* name, const char* type, const std::vector<std::uint8_t>& value) {
+			output.insert(output.end(), name, name + std::strlen(name) + 1);
+			output.insert(output.end(), type, type + std::strlen(type) + 1);
+			appendLittleEndian(output, std::int32_t(value.size()));
+			output.insert(output.end(), value.begin(), value.end());
+		}
+	}
+
+	void writePNG(char const* filePath, std::uint32_t width, std::uint32_t height, const std::uint8_t* rgba) {
+		std::size_t const rowBytes = std::size_t(width) * 4;
+
+		// Filter each row with whichever filter gives the smallest sum of absolute differences
+		std::vector<std::uint8_t> filtered;
+		filtered.reserve((rowBytes + 1) * height);
+		std::vector<std::uint8_t> zeroRow(rowBytes, 0);
+		std::vector<std::uint8_t> candidate(rowBytes);
+		std::vector<std::uint8_t> bestRow(rowBytes);
+		for (std::uint32_t y = 0; y < height; y++) {
+			const std::uint8_t* row = rgba + rowBytes * y;
+			const std::uint8_t* above = y > 0 ? row - rowBytes : zeroRow.data();
+
+			std::uint64_t bestScore = std::numeric_limits<std::uint64_t>::max();
+			std::uint8_t bestFilter = 0;
+			for (std::uint8_t filter = 0; filter < 5; filter++) {
+				std::uint64_t score = 0;
+				for (std::size_t x = 0; x < rowBytes; x++) {
+					std::uint8_t left = x >= 4 ? row[x - 4] : 0;
+					std::uint8_t upLeft = x >= 4 ? above[x - 4] : 0;
+					std::uint8_t predicted = 0;
+					switch (filter) {
+					case 1: predicted = left; break;
+					case 2: predicted = above[x]; break;
+					case 3: predicted = std::uint8_t((int(left) + int(above[x])) / 2); break;
+					case 4: predicted = paeth(left, above[x], upLeft); break;
+					default: break;
+					}
+					candidate[x] = std::uint8_t(row[x] - predicted);
+					score += std::uint64_t(std::abs(int(std::int8_t(candidate[x]))));
+				}
+				if (score < bestScore) {
+					bestScore = score;
+					bestFilter = filter;
+					bestRow.swap(candidate);
+				}
+			}
+
+			filtered.emplace_back(bestFilter);
+			filtered.insert(filtered.end(), bestRow.begin(), bestRow.end());
+		}
+
+		// Build the file
+		std::vector<std::uint8_t> png = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+
+		std::vector<std::uint8_t> header;
+		appendBigEndian(header, width);
+		appendBigEndian(header, height);
+		header.emplace_back(8);		// Bit depth
+		header.emplace_back(6);		// RGBA
+		header.emplace_back(0);		// Deflate
+		header.emplace_back(0);		// Adaptive filtering
+		header.emplace_back(0);		// No interlacing
+		appendChunk(png, "IHDR", header);
+		appendChunk(png, "IDAT", zlibCompress(filtered));
+		appendChunk(png, "IEND", {});
+
+		writeFile(filePath, png.data(), png.size());
+	}
+
+	void writeEXR(char const* filePath, std::uint32_t width, std::uint32_t height, const std::uint16_t* rgba) {
+		std::vector<std::uint8_t> exr;
+
+		// Magic number and version 2 (single part scanline)
+		appendLittleEndian(exr, std::uint32_t(20000630));
+		appendLittleEndian(exr, std::uint32_t(2));
+
+		// Channels must be listed alphabetically, all are half floats
+		std::vector<std::uint8_t> channels;
+		for (const char* name : { "A", "B", "G", "R" }) {
+			channels.insert(channels.end(), name, name + 2);
+			appendLittleEndian(channels, std::int32_t(1));	// Half
+			appendLittleEndian(channels, std::uint32_t(0));	// Not perceptually linear, reserved bytes
+			appendLittleEndian(channels, std::int32_t(1));	// X sampling
+			appendLittleEndian(channels, std::int32_t(1));	// Y sampling
+		}
+		channels.emplace_back(0);
+		appendAttribute(exr, "channels", "chlist", channels);
+
+		appendAttribute(exr, "compression", "compression", { 0 });
+
+		std::vector<std::uint8_t> window;
+		appendLittleEndian(window, std::int32_t(0));
+		appendLittleEndian(window, std::int32_t(0));
+		appendLittleEndian(window, std::int32_t(width) - 1);
+		appendLittleEndian(window, std::int32_t(height) - 1);
+		appendAttribute(exr, "dataWindow", "box2i", window);
+		appendAttribute(exr, "displayWindow", "box2i", window);
+
+		appendAttribute(exr, "lineOrder", "lineOrder", { 0 });
+
+		std::vector<std::uint8_t> value;
+		appendLittleEndian(value, 1.f);
+		appendAttribute(exr, "pixelAspectRatio", "float", value);
+		value.clear();
+		appendLittleEndian(value, 0.f);
+		appendLittleEndian(value, 0.f);
+		appendAttribute(exr, "screenWindowCenter", "v2f", value);
+		value.clear();
+		appendLittleEndian(value, 1.f);
+		appendAttribute(exr, "screenWindowWidth", "float", value);
+
+		// End of header
+		exr.emplace_back(0);
+
+		// One uncompressed scanline per chunk, the offset table comes first
+		std::size_t const lineBytes = std::size_t(width) * 4 * sizeof(std::uint16_t);
+		std::uint64_t chunkOffset = exr.size() + std::size_t(height) * sizeof(std::uint64_t);
+		for (std::uint32_t y = 0; y < height; y++) {
+			appendLittleEndian(exr, chunkOffset);
+			chunkOffset += 8 + lineBytes;
+		}
+
+		// Each line holds all of one channel followed by the next
+		constexpr int kChannelOrder[4] = { 3, 2, 1, 0 };
+		exr.reserve(exr.size() + std::size_t(height) * (8 + lineBytes));
+		for (std::uint32_t y = 0; y < height; y++) {
+			appendLittleEndian(exr, std::int32_t(y));
+			appendLittleEndian(exr, std::int32_t(lineBytes));
+			const std::uint16_t* row = rgba + std::size_t(width) * 4 * y;
+			for (int channel : kChannelOrder) {
+				for (std::uint32_t x = 0; x < width; x++) {
+					appendLittleEndian(exr, row[x * 4 + channel]);
+				}
+			}
+		}
+
+		writeFile(filePath, exr.data(), exr.size());
+	}
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+
+namespace utility {
+	/// <summary>
+	/// Writes an 8 bit RGBA image to a PNG file
+	/// </summary>
+	/// <param name="filePath">Path of the file to write</param>
+	/// <param name="width">Width of the image in pixels</param>
+	/// <param name="height">Height of the image in pixels</param>
+	/// <param name="rgba">Tightly packed rows of RGBA8 pixels, top row first</param>
+	void writePNG(char const* filePath, std::uint32_t width, std::uint32_t height, const std::uint8_t* rgba);
+
+	/// <summary>
+	/// Writes a half float RGBA image to an uncompressed scanline OpenEXR file
+	/// </summary>
+	/// <param name="filePath">Path of the file to write</param>
+	/// <param name="width">Width of the image in pixels</param>
+	/// <param name="height">Height of the image in pixels</param>
+	/// <param name="rgba">Tightly packed rows of RGBA16F pixels, top row first</param>
+	void writeEXR(char const* filePath, std::uint32_t width, std::uint32_t height, const std::uint16_t* rgba);
+}
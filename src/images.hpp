@@ -4,8 +4,12 @@
 
 #include <vk_mem_alloc.h>
 
+#include <cstdint>
+#include <vector>
+
 #include "setup.hpp"
 #include "utility.hpp"
+#include "uploadBatch.hpp"
 
 namespace utility {
 	/// <summary>
@@ -34,17 +38,70 @@ namespace utility {
 	ImageSet createImageSet(app::AppContext& app, VmaAllocator& allocator, VkFormat format, 
 		VkImageUsageFlags usageFlags, VkImageAspectFlagBits aspectFlagBits, VkExtent2D extent);
 
+	/// <summary>
+	/// Where one mip level sits in the decoded texture data
+	/// </summary>
+	struct TextureMip
+	{
+		VkExtent3D extent;
+		std::uint32_t offset;
+		std::uint32_t size;
+	};
+
+	/// <summary>
+	/// A texture decoded on the CPU and ready to upload. Decoding touches no Vulkan objects so it can
+	/// be done on any thread, leaving only the upload for the thread that owns the upload batch.
+	/// </summary>
+	struct TextureData
+	{
+		VkFormat format = VK_FORMAT_UNDEFINED;
+		VkExtent3D extent{};
+		std::uint32_t mipLevels = 1;
+
+		// The stored mip levels, any more up to mipLevels are generated when uploading
+		std::vector<std::uint8_t> pixels;
+		std::vector<TextureMip> mips;
+
+		bool isAlpha = false;
+	};
+
+	/// <summary>
+	/// Decodes a compressed dds file (safe to call from any thread)
+	/// </summary>
+	/// <param name="filePath">Path to the .dds file</param>
+	/// <param name="isSRGB">Should the format be SRGB</param>
+	/// <returns>The texture data with every mip level in the file</returns>
+	TextureData loadDDSTextureData(char const* filePath, bool isSRGB = false);
+
+	/// <summary>
+	/// Decodes a png or jpg file to RGBA8 (safe to call from any thread)
+	/// </summary>
+	/// <param name="filePath">Path to the image file</param>
+	/// <returns>The texture data with only the top mip level</returns>
+	TextureData loadPNGTextureData(char const* filePath);
+
+	/// <summary>
+	/// Creates an image texture set from decoded texture data
+	/// </summary>
+	/// <param name="app">Application context</param>
+	/// <param name="texture">The decoded texture</param>
+	/// <param name="allocator">Memory allocator</param>
+	/// <param name="uploads">Upload batch the texture data is copied through</param>
+	/// <returns>An image set containing the VkImage and VkImageView</returns>
+	ImageSet createTextureImageSet(app::AppContext& app, const TextureData& texture, VmaAllocator& allocator,
+		UploadBatch& uploads);
+
 	/// <summary>
 	/// Creates an image texture set given a compressed dds file
 	/// </summary>
 	/// <param name="app">Application context</param>
 	/// <param name="filePath">Path to the .dds file</param>
 	/// <param name="allocator">Memory allocator</param>
-	/// <param name="commandPool">Command pool</param>
+	/// <param name="uploads">Upload batch the texture data is copied through</param>
 	/// <param name="isSRGB">Should the format be SRGB</param>
 	/// <returns>An image set containing the VkImage and VkImageView</returns>
 	ImageSet createDDSTextureImageSet(app::AppContext& app, char const* filePath, 
-		VmaAllocator& allocator, VkCommandPool commandPool, bool isSRGB = false);
+		VmaAllocator& allocator, UploadBatch& uploads, bool isSRGB = false);
 
 	/// <summary>
 	/// Creates an image texture set given a png file
@@ -52,8 +109,8 @@ namespace utility {
 	/// <param name="app">Application context</param>
 	/// <param name="filePath">Path to the .png file</param>
 	/// <param name="allocator">Memory allocator</param>
-	/// <param name="commandPool">Command pool</param>
+	/// <param name="uploads">Upload batch the texture data is copied through</param>
 	/// <returns>An image set containing the VkImage and VkImageView</returns>
 	ImageSet createPNGTextureImageSet(app::AppContext& app, char const* filePath, VmaAllocator& allocator,
-		VkCommandPool commandPool);
+		UploadBatch& uploads);
 }
@@ -0,0 +1,75 @@
+#include "indirectDraws.hpp"
+
+#include <algorithm>
+
+namespace indirect {
+
+	void appendDrawData(const std::vector<model::Mesh>& meshes, const model::MeshBounds& bounds, std::vector<DrawData>& outDraws) {
+		// The commands are laid out as appendDrawCommands does, the levels of each submesh in turn
+		std::uint32_t command = 0;
+		for (std::size_t i = 0; i < meshes.size(); i++) {
+			const model::Mesh& mesh = meshes[i];
+			if (i > 0 && mesh.submesh != meshes[i - 1].submesh) {
+				command += std::min(std::uint32_t(meshes[i - 1].lods.size()), MAX_DRAW_LODS);
+			}
+
+			DrawData draw;
+			draw.boundsCentre = glm::vec4(bounds.centreX[i], bounds.centreY[i], bounds.centreZ[i], mesh.boundsRadius);
+			draw.boundsExtent = glm::vec4(bounds.extentX[i], bounds.extentY[i], bounds.extentZ[i], 0.f);
+			draw.vertexOffset = std::int32_t(mesh.geometry.vertexOffset);
+			draw.instance = mesh.instance;
+			draw.command = command;
+
+			// Levels past the last that fits are never picked
+			draw.lodCount = std::min(std::uint32_t(mesh.lods.size()), MAX_DRAW_LODS);
+			for (std::uint32_t level = 0; level < draw.lodCount; level++) {
+				draw.lods[level].firstIndex = mesh.geometry.firstIndex + mesh.lods[level].firstIndex;
+				draw.lods[level].indexCount = mesh.lods[level].indexCount;
+				draw.lods[level].error = mesh.lods[level].error * mesh.scale;
+			}
+
+			outDraws.emplace_back(draw);
+		}
+	}
+
+	std::uint32_t appendDrawCommands(const std::vector<model::Mesh>& meshes, std::uint32_t firstInstance, std::vector<DrawCommand>& outCommands) {
+		std::size_t first = 0;
+		while (first < meshes.size()) {
+			// The instances of the submesh
+			std::size_t last = first + 1;
+			while (last < meshes.size() && meshes[last].submesh == meshes[first].submesh) {
+				last++;
+			}
+			std::uint32_t const instanceCount = std::uint32_t(last - first);
+
+			// Every instance may pick the same level so each level has room for all of them
+			const model::Mesh& mesh = meshes[first];
+			std::uint32_t const lodCount = std::min(std::uint32_t(mesh.lods.size()), MAX_DRAW_LODS);
+			for (std::uint32_t level = 0; level < lodCount; level++) {
+				DrawCommand command;
+				command.indexCount = mesh.lods[level].indexCount;
+				command.firstIndex = mesh.geometry.firstIndex + mesh.lods[level].firstIndex;
+				command.vertexOffset = std::int32_t(mesh.geometry.vertexOffset);
+				command.firstInstance = firstInstance;
+				outCommands.emplace_back(command);
+				firstInstance += instanceCount;
+			}
+			first = last;
+		}
+		return firstInstance;
+	}
+
+	CullConstants createCullConstants(const glm::mat4& projectionView, const model::LodView& lodView,
+		std::uint32_t firstDraw, std::uint32_t drawCount, std::uint32_t firstCommand, std::uint32_t commandCount,
+		CullPhase phase) {
+		CullConstants constants;
+		constants.projectionView = projectionView;
+		constants.viewPosition = glm::vec4(lodView.position, lodView.threshold / lodView.pixelsPerUnit);
+		constants.firstDraw = firstDraw;
+		constants.drawCount = drawCount;
+		constants.firstCommand = firstCommand;
+		constants.commandCount = commandCount;
+		constants.phase = phase;
+		return constants;
+	}
+}
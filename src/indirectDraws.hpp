@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "glm.hpp"
+
+#include "model.hpp"
+
+namespace indirect {
+	// Most levels of detail a draw can pick from on the GPU, must match MAX_DRAW_LODS in the shaders
+	constexpr std::uint32_t MAX_DRAW_LODS = 8;
+
+	// Where the culling shader keeps each count, must match the defines in cullShader.comp
+	// Draws and triangles inside the frustum that the depth pyramid hid
+	constexpr std::uint32_t OCCLUDED_DRAWS_COUNT = 0;
+	constexpr std::uint32_t OCCLUDED_TRIANGLES_COUNT = 1;
+	constexpr std::uint32_t COUNT_TOTAL = 2;
+
+	/// <summary>
+	/// What a culling dispatch tests, must match the phases in cullShader.comp
+	/// </summary>
+	enum class CullPhase : std::uint32_t
+	{
+		// Frustum only, every visible draw is written
+		All = 0,
+		// Frustum only, of the draws that were visible last frame
+		Early = 1,
+		// Frustum and depth pyramid, remembers which draws are visible and writes those not drawn early
+		Late = 2
+	};
+
+	/// <summary>
+	/// Matches VkDrawIndexedIndirectCommand and DrawCommand in the culling shader
+	/// </summary>
+	struct DrawCommand
+	{
+		std::uint32_t indexCount = 0;
+		std::uint32_t instanceCount = 0;
+		std::uint32_t firstIndex = 0;
+		std::int32_t vertexOffset = 0;
+		std::uint32_t firstInstance = 0;
+	};
+	static_assert(sizeof(DrawCommand) == 20);
+
+	/// <summary>
+	/// One level of detail of a draw, the first index is from the start of the geometry pool
+	/// </summary>
+	struct DrawLod
+	{
+		std::uint32_t firstIndex = 0;
+		std::uint32_t indexCount = 0;
+		float error = 0.f;
+		std::uint32_t padding = 0;
+	};
+
+	/// <summary>
+	/// Everything the GPU needs to cull and draw one instance of a mesh, laid out to match DrawData (std430) in the shaders
+	/// </summary>
+	struct DrawData
+	{
+		// Centre of the bounds with the radius of the bounding sphere in w
+		glm::vec4 boundsCentre = glm::vec4(0.f);
+		// Half size of the axis aligned bounds
+		glm::vec4 boundsExtent = glm::vec4(0.f);
+
+		std::int32_t vertexOffset = 0;
+		std::uint32_t lodCount = 0;
+		// The instance in the instance buffer
+		std::uint32_t instance = 0;
+		// The command of the first level of the draw's submesh from the start of a pass's commands, one follows for each level
+		std::uint32_t command = 0;
+
+		DrawLod lods[MAX_DRAW_LODS];
+	};
+	static_assert(sizeof(DrawData) == 48 + 16 * MAX_DRAW_LODS);
+
+	/// <summary>
+	/// Push constants of the culling compute shader, one dispatch culls a range of draws from one view
+	/// into its own range of draw commands
+	/// </summary>
+	struct CullConstants
+	{
+		// The frustum planes are taken from this and the late phase projects the bounds with it
+		glm::mat4 projectionView = glm::mat4(1.f);
+		// Position of the viewer, w is the largest level of detail error per unit of distance
+		glm::vec4 viewPosition = glm::vec4(0.f);
+
+		std::uint32_t firstDraw = 0;
+		std::uint32_t drawCount = 0;
+		std::uint32_t firstCommand = 0;
+		std::uint32_t commandCount = 0;
+
+		CullPhase phase = CullPhase::All;
+		std::uint32_t padding[3] = { 0, 0, 0 };
+	};
+	static_assert(sizeof(CullConstants) <= 128, "Push constants are only guaranteed 128 bytes");
+
+	/// <summary>
+	/// Appends the draw data of a list of meshes
+	/// </summary>
+	/// <param name="meshes">The meshes</param>
+	/// <param name="bounds">The axis aligned bounds of the meshes</param>
+	/// <param name="outDraws">The draw data is appended to this, in mesh order</param>
+	void appendDrawData(const std::vector<model::Mesh>& meshes, const model::MeshBounds& bounds, std::vector<DrawData>& outDraws);
+
+	/// <summary>
+	/// Appends the draw commands of one pass over a list of meshes, an instanced command for each level of each submesh.
+	/// The commands start with no instances, the culling shader adds each visible instance to the command of its level
+	/// and stores its id in the room the command has for every instance of the submesh.
+	/// </summary>
+	/// <param name="meshes">The meshes, the instances of a submesh next to each other</param>
+	/// <param name="firstInstance">Where the room for the visible instances of the commands starts</param>
+	/// <param name="outCommands">The commands are appended to this</param>
+	/// <returns>Where the room for the visible instances of the commands ends</returns>
+	std::uint32_t appendDrawCommands(const std::vector<model::Mesh>& meshes, std::uint32_t firstInstance, std::vector<DrawCommand>& outCommands);
+
+	/// <summary>
+	/// Creates the push constants for culling a range of draws from a view
+	/// </summary>
+	/// <param name="projectionView">The projection view matrix of the view</param>
+	/// <param name="lodView">Picks the levels of detail</param>
+	/// <param name="firstDraw">First draw to cull</param>
+	/// <param name="drawCount">Number of draws to cull</param>
+	/// <param name="firstCommand">Where the draw commands of the pass start</param>
+	/// <param name="commandCount">Number of draw commands of the pass</param>
+	/// <param name="phase">What the dispatch tests</param>
+	/// <returns>The push constants</returns>
+	CullConstants createCullConstants(const glm::mat4& projectionView, const model::LodView& lodView,
+		std::uint32_t firstDraw, std::uint32_t drawCount, std::uint32_t firstCommand, std::uint32_t commandCount,
+		CullPhase phase = CullPhase::All);
+}
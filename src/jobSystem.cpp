@@ -0,0 +1,242 @@
+#include "jobSystem.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <utility>
+
+namespace jobs {
+
+	namespace {
+		// The job system and queue the current thread belongs to, if it is a worker
+		thread_local JobSystem* currentSystem = nullptr;
+		thread_local std::uint32_t currentQueueIndex = 0;
+	}
+
+	JobSystem::JobSystem(std::uint32_t numWorkers) {
+		if (numWorkers == 0) {
+			numWorkers = std::max(1u, std::thread::hardware_concurrency()) - 1;
+		}
+
+		queues.reserve(numWorkers + 1);
+		for (std::uint32_t i = 0; i < numWorkers + 1; i++) {
+			queues.emplace_back(std::make_unique<WorkQueue>());
+		}
+
+		workers.reserve(numWorkers);
+		for (std::uint32_t i = 0; i < numWorkers; i++) {
+			workers.emplace_back(&JobSystem::workerLoop, this, i + 1);
+		}
+	}
+
+	JobSystem::~JobSystem() {
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex);
+			stopping = true;
+		}
+		wake.notify_all();
+
+		for (std::thread& worker : workers) {
+			worker.join();
+		}
+
+		// Without workers anything left is run here
+		while (tryRunOne(0)) {}
+	}
+
+	void JobSystem::run(Job job, Counter* counter) {
+		if (counter != nullptr) {
+			counter->pending.fetch_add(1, std::memory_order_relaxed);
+		}
+		push(Task{ std::move(job), counter });
+	}
+
+	void JobSystem::runAfter(Counter& dependency, Job job, Counter* counter) {
+		if (counter != nullptr) {
+			counter->pending.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		// The dependency's jobs may finish at any time so the check and the append are locked together
+		{
+			std::lock_guard<std::mutex> lock(dependency.mutex);
+			if (!dependency.isDone()) {
+				dependency.continuations.emplace_back(Task{ std::move(job), counter });
+				return;
+			}
+		}
+		push(Task{ std::move(job), counter });
+	}
+
+	void JobSystem::parallelFor(std::size_t count, std::size_t batchSize,
+		std::function<void(std::size_t, std::size_t)> body, Counter& counter) {
+
+		if (count == 0) {
+			return;
+		}
+
+		// A few batches per thread so threads that finish early can steal the rest
+		if (batchSize == 0) {
+			batchSize = std::max<std::size_t>(1, count / (std::size_t(threadCount()) * 4));
+		}
+
+		// Every batch shares the one copy of the body
+		auto sharedBody = std::make_shared<std::function<void(std::size_t, std::size_t)>>(std::move(body));
+		for (std::size_t begin = 0; begin < count; begin += batchSize) {
+			std::size_t end = std::min(count, begin + batchSize);
+			run([sharedBody, begin, end]() { (*sharedBody)(begin, end); }, &counter);
+		}
+	}
+
+	void JobSystem::parallelFor(std::size_t count, std::size_t batchSize,
+		std::function<void(std::size_t, std::size_t)> body) {
+
+		Counter counter;
+		parallelFor(count, batchSize, std::move(body), counter);
+		wait(counter);
+	}
+
+	void JobSystem::wait(Counter& counter) {
+		std::uint32_t const queueIndex = callingQueue();
+		while (!counter.isDone()) {
+			// Help out rather than block, the jobs being waited on may be sat in this thread's queue
+			if (!tryRunOne(queueIndex)) {
+				std::this_thread::yield();
+			}
+		}
+
+		std::exception_ptr error;
+		{
+			std::lock_guard<std::mutex> lock(counter.mutex);
+			error = std::exchange(counter.error, nullptr);
+		}
+		if (error) {
+			std::rethrow_exception(error);
+		}
+	}
+
+	void JobSystem::push(Task&& task) {
+		WorkQueue& queue = *queues[callingQueue()];
+		{
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			queue.tasks.emplace_back(std::move(task));
+		}
+		queuedTasks.fetch_add(1, std::memory_order_release);
+
+		// Taking the lock makes sure a worker that is about to sleep sees the new job
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex);
+		}
+		wake.notify_one();
+	}
+
+	bool JobSystem::tryRunOne(std::uint32_t queueIndex) {
+		Task task;
+		if (pop(queueIndex, task) || steal(queueIndex, task)) {
+			execute(task);
+			return true;
+		}
+		return false;
+	}
+
+	bool JobSystem::pop(std::uint32_t queueIndex, Task& task) {
+		// The owner takes its newest job, its data is the most likely to still be in cache
+		WorkQueue& queue = *queues[queueIndex];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.tasks.empty()) {
+			return false;
+		}
+		task = std::move(queue.tasks.back());
+		queue.tasks.pop_back();
+		queuedTasks.fetch_sub(1, std::memory_order_relaxed);
+		return true;
+	}
+
+	bool JobSystem::steal(std::uint32_t thiefIndex, Task& task) {
+		// Thieves take the oldest job, which tends to be the largest piece of remaining work
+		std::uint32_t const numQueues = std::uint32_t(queues.size());
+		for (std::uint32_t i = 1; i < numQueues; i++) {
+			WorkQueue& queue = *queues[(thiefIndex + i) % numQueues];
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			if (queue.tasks.empty()) {
+				continue;
+			}
+			task = std::move(queue.tasks.front());
+			queue.tasks.pop_front();
+			queuedTasks.fetch_sub(1, std::memory_order_relaxed);
+			return true;
+		}
+		return false;
+	}
+
+	void JobSystem::execute(Task& task) {
+		try {
+			task.job();
+		}
+		catch (...) {
+			if (task.counter != nullptr) {
+				std::lock_guard<std::mutex> lock(task.counter->mutex);
+				if (!task.counter->error) {
+					task.counter->error = std::current_exception();
+				}
+			}
+			else {
+				// Nothing waits on this job so the error can only be reported
+				try {
+					throw;
+				}
+				catch (const std::exception& e) {
+					std::cerr << "Job failed: " << e.what() << std::endl;
+				}
+				catch (...) {
+					std::cerr << "Job failed" << std::endl;
+				}
+			}
+		}
+		finish(task.counter);
+	}
+
+	void JobSystem::finish(Counter* counter) {
+		if (counter == nullptr) {
+			return;
+		}
+
+		// The last job of the counter releases anything that was waiting on it. The counter is only
+		// touched while locked, a waiter locks it too before returning so it can not be destroyed early.
+		std::vector<Task> ready;
+		{
+			std::lock_guard<std::mutex> lock(counter->mutex);
+			if (counter->pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+				ready.swap(counter->continuations);
+			}
+		}
+		for (Task& task : ready) {
+			push(std::move(task));
+		}
+	}
+
+	void JobSystem::workerLoop(std::uint32_t queueIndex) {
+		currentSystem = this;
+		currentQueueIndex = queueIndex;
+
+		while (true) {
+			if (tryRunOne(queueIndex)) {
+				continue;
+			}
+
+			// Sleep until there is something to do
+			std::unique_lock<std::mutex> lock(sleepMutex);
+			wake.wait(lock, [this]() { return stopping || queuedTasks.load(std::memory_order_acquire) > 0; });
+			if (stopping && queuedTasks.load(std::memory_order_acquire) == 0) {
+				return;
+			}
+		}
+	}
+
+	std::uint32_t JobSystem::callingQueue() const {
+		return currentSystem == this ? currentQueueIndex : 0;
+	}
+
+	JobSystem& shared() {
+		static JobSystem system;
+		return system;
+	}
+}
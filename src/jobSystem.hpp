@@ -0,0 +1,164 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace jobs {
+	class Counter;
+
+	/// <summary>
+	/// A unit of work
+	/// </summary>
+	using Job = std::function<void()>;
+
+	/// <summary>
+	/// A job queued to run along with the counter it reports to when finished
+	/// </summary>
+	struct Task
+	{
+		Job job;
+		Counter* counter = nullptr;
+	};
+
+	/// <summary>
+	/// Counts the unfinished jobs of a group. It can be waited on, and jobs can be made to start only
+	/// once it reaches zero. The first exception thrown by one of its jobs is kept and rethrown by wait.
+	/// </summary>
+	class Counter
+	{
+	public:
+		Counter() = default;
+
+		// Jobs hold a pointer to their counter so it can not be moved
+		Counter(Counter&) = delete;
+		Counter& operator= (Counter&) = delete;
+
+		/// <summary>
+		/// Checks if every job added to the counter has finished
+		/// </summary>
+		bool isDone() const { return pending.load(std::memory_order_acquire) == 0; }
+
+	private:
+		friend class JobSystem;
+
+		std::atomic<std::uint32_t> pending = 0;
+		std::mutex mutex;
+		std::vector<Task> continuations;
+		std::exception_ptr error;
+	};
+
+	/// <summary>
+	/// A work stealing thread pool. Every thread owns a deque of jobs, it pushes and pops its own
+	/// jobs at the back and steals from the front of the others when it runs out. Threads that did
+	/// not start in the pool (such as the main thread) share one extra deque and help run jobs
+	/// while they wait on a counter.
+	/// </summary>
+	class JobSystem
+	{
+	public:
+		/// <summary>
+		/// Parameterised constructor
+		/// </summary>
+		/// <param name="numWorkers">Number of threads to start, 0 to use one per core besides the calling thread</param>
+		explicit JobSystem(std::uint32_t numWorkers = 0);
+
+		/// <summary>
+		/// Destructor, finishes any queued jobs then joins the workers
+		/// </summary>
+		~JobSystem();
+
+		JobSystem(JobSystem&) = delete;
+		JobSystem& operator= (JobSystem&) = delete;
+
+		/// <summary>
+		/// Gets the number of threads that run jobs, including one calling thread
+		/// </summary>
+		std::uint32_t threadCount() const { return std::uint32_t(workers.size()) + 1; }
+
+		/// <summary>
+		/// Gets the index of the calling thread, 1 to threadCount() - 1 for the workers and 0 for
+		/// threads outside the pool (which share it, so per thread data should only be used by one of them)
+		/// </summary>
+		std::uint32_t threadIndex() const { return callingQueue(); }
+
+		/// <summary>
+		/// Queues a job to run on any thread
+		/// </summary>
+		/// <param name="job">The job</param>
+		/// <param name="counter">Counter to add the job to, or nullptr</param>
+		void run(Job job, Counter* counter = nullptr);
+
+		/// <summary>
+		/// Queues a job that only starts once every job of a dependency has finished
+		/// </summary>
+		/// <param name="dependency">The counter to wait for</param>
+		/// <param name="job">The job</param>
+		/// <param name="counter">Counter to add the job to, or nullptr</param>
+		void runAfter(Counter& dependency, Job job, Counter* counter = nullptr);
+
+		/// <summary>
+		/// Splits a range into batches and queues a job for each of them
+		/// </summary>
+		/// <param name="count">Number of items</param>
+		/// <param name="batchSize">Number of items each job handles (0 picks a size from the thread count)</param>
+		/// <param name="body">Called with the [begin, end) range of each batch</param>
+		/// <param name="counter">Counter to add the jobs to</param>
+		void parallelFor(std::size_t count, std::size_t batchSize,
+			std::function<void(std::size_t, std::size_t)> body, Counter& counter);
+
+		/// <summary>
+		/// Runs a parallel for and waits for it to finish, rethrowing the first exception of a batch
+		/// </summary>
+		/// <param name="count">Number of items</param>
+		/// <param name="batchSize">Number of items each job handles (0 picks a size from the thread count)</param>
+		/// <param name="body">Called with the [begin, end) range of each batch</param>
+		void parallelFor(std::size_t count, std::size_t batchSize,
+			std::function<void(std::size_t, std::size_t)> body);
+
+		/// <summary>
+		/// Runs queued jobs on the calling thread until the counter reaches zero, then rethrows the
+		/// first exception of its jobs if there was one
+		/// </summary>
+		/// <param name="counter">The counter to wait for</param>
+		void wait(Counter& counter);
+
+	private:
+		struct WorkQueue
+		{
+			std::mutex mutex;
+			std::deque<Task> tasks;
+		};
+
+		void push(Task&& task);
+		bool tryRunOne(std::uint32_t queueIndex);
+		bool pop(std::uint32_t queueIndex, Task& task);
+		bool steal(std::uint32_t thiefIndex, Task& task);
+		void execute(Task& task);
+		void finish(Counter* counter);
+		void workerLoop(std::uint32_t queueIndex);
+		std::uint32_t callingQueue() const;
+
+		// Queue 0 is shared by threads outside the pool, queue i + 1 belongs to worker i
+		std::vector<std::unique_ptr<WorkQueue>> queues;
+		std::vector<std::thread> workers;
+
+		// Sleeping workers are woken when a job is queued
+		std::atomic<std::uint32_t> queuedTasks = 0;
+		std::atomic<bool> stopping = false;
+		std::mutex sleepMutex;
+		std::condition_variable wake;
+	};
+
+	/// <summary>
+	/// Gets the job system shared by every subsystem, started the first time it is used
+	/// </summary>
+	JobSystem& shared();
+}
@@ -9,6 +9,7 @@
 #include <fstream>
 #include <stdexcept>
 #include <cstdlib>
+#include <cstring>
 #include <vector>
 #include <unordered_set>
 #include <string>
@@ -25,8 +26,38 @@
 #include "utility.hpp"
 #include "model.hpp"
 #include "FBXFileLoader.hpp"
+#include "sceneCache.hpp"
+#include "uploadBatch.hpp"
+#include "culling.hpp"
+#include "imageWriter.hpp"
+#include "profiler.hpp"
+#include "jobSystem.hpp"
+#include "indirectDraws.hpp"
+#include "depthPyramid.hpp"
+#include "commandRecording.hpp"
+#include "softwareOcclusion.hpp"
+#include "drawSorting.hpp"
+#include "uniformRing.hpp"
 
 #define DEPTH_RES 4096
+// Vertical fields of view of the camera and the light in degrees
+#define CAMERA_FOV 60.f
+#define LIGHT_FOV 100.f
+// Largest error in pixels a level of detail may show, the shadow map tolerates coarser levels
+#define LOD_PIXEL_ERROR 1.f
+#define SHADOW_LOD_PIXEL_ERROR 4.f
+// Meshlets projecting to fewer pixels across than this are not drawn
+#define CLUSTER_MIN_PIXELS 0.5f
+// Number of frames the CPU may record ahead of the GPU (2 or 3)
+#define FRAMES_IN_FLIGHT 2
+// Draws culled by each invocation group of the culling shader, must match local_size_x in cullShader.comp
+#define CULL_GROUP_SIZE 64
+// Most triangles the simplified mesh of a CPU occluder may have
+#define OCCLUDER_MAX_TRIANGLES 512
+// Size in bytes of the uniform ring of each frame in flight
+#define UNIFORM_RING_SIZE 65536
+
+static_assert(FRAMES_IN_FLIGHT == 2 || FRAMES_IN_FLIGHT == 3, "FRAMES_IN_FLIGHT must be 2 or 3");
 
 namespace {
 
@@ -38,6 +69,8 @@ namespace {
         glm::mat4 worldCameraMatrix = glm::mat4(1);
 
         bool isLooking = false;
+
+        bool saveTrace = false;
     };
 
     struct WorldView {
@@ -51,17 +84,195 @@ namespace {
         alignas(16) glm::vec3 lightColour;
     };
 
+    /// <summary>
+    /// Everything a single frame in flight owns, so one frame can be recorded while another executes
+    /// </summary>
+    struct FrameResources {
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        VkFence inFlight = VK_NULL_HANDLE;
+        VkSemaphore imageIsReady = VK_NULL_HANDLE;
+
+        // The world and lighting uniforms are written to the ring every frame and bound at their dynamic offsets
+        std::unique_ptr<uniforms::UniformRing> uniformRing;
+        VkDescriptorSet worldDescriptorSet = VK_NULL_HANDLE;
+        VkDescriptorSet lightingDescriptorSet = VK_NULL_HANDLE;
+
+        // The ids of the instances drawn, each instanced draw reads its own range. Written through a mapping by
+        // the CPU culling or by the culling shader, and bound with the instance data of the scene.
+        utility::BufferSet visibleInstances;
+        VkDescriptorSet instanceDescriptorSet = VK_NULL_HANDLE;
+
+        // Headless only: host visible copy of the rendered image and the frame number it holds
+        utility::BufferSet readbackBuffer;
+        std::int64_t readbackFrame = -1;
+
+        // GPU culling only: the draw commands and counts written by the culling shader
+        utility::BufferSet drawCommands;
+        utility::BufferSet drawCounts;
+        VkDescriptorSet cullDescriptorSet = VK_NULL_HANDLE;
+
+        // GPU culling only: host visible copy of the counts, read once the frame's fence has signalled
+        utility::BufferSet statsBuffer;
+        bool statsWritten = false;
+
+        // CPU culling only: records the draws of each pass into secondary command buffers on every thread
+        std::unique_ptr<recording::ParallelRecorder> recorder;
+    };
+
+    /// <summary>
+    /// The GPU driven path. A compute pass culls every mesh and picks its level of detail, adding each visible
+    /// instance to the instanced command of its submesh's level, then each pass is drawn with a single indirect call.
+    /// Draws are the opaque meshes followed by the alpha masked meshes. Each pass has its own range of commands,
+    /// copied from a template with no instances every frame, laid out as the shadow casters, the opaque meshes,
+    /// the alpha masked meshes, then the late opaque and alpha masked meshes.
+    /// The colour pass is split in two for occlusion culling. The early half draws what was visible last
+    /// frame, a depth pyramid is built from its depth and the late half draws what the pyramid shows is
+    /// no longer hidden.
+    /// </summary>
+    struct GpuCulling {
+        // Null when the meshes are culled on the CPU
+        VkPipeline pipeline = VK_NULL_HANDLE;
+        VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+        std::uint32_t opaqueDraws = 0;
+        std::uint32_t alphaDraws = 0;
+
+        // Commands of each pass over the opaque and alpha masked meshes, and the template they are reset from
+        std::uint32_t opaqueCommands = 0;
+        std::uint32_t alphaCommands = 0;
+        VkBuffer commandTemplate = VK_NULL_HANDLE;
+
+        // The light does not move so the shadow casters are always culled from the same view
+        glm::mat4 shadowProjectionView = glm::mat4(1.f);
+
+        // Which draws were visible at the end of the last frame, shared by every frame in flight
+        VkBuffer visibility = VK_NULL_HANDLE;
+
+        // The two halves of the colour pass and the depth pyramid built between them
+        VkRenderPass earlyRenderPass = VK_NULL_HANDLE;
+        VkRenderPass lateRenderPass = VK_NULL_HANDLE;
+        occlusion::DepthPyramid* depthPyramid = nullptr;
+    };
+
+    /// <summary>
+    /// Which part of the colour pass a render pass is for
+    /// </summary>
+    enum class ColourPass {
+        // Clears, draws and leaves the colour to be sampled
+        Whole,
+        // Clears, draws and leaves the depth to be read by the depth pyramid
+        Early,
+        // Loads what the early half drew, draws and leaves the colour to be sampled
+        Late
+    };
+
+    /// <summary>
+    /// Remembers what the shadow map was last rendered with, so the shadow pass can be skipped
+    /// while neither the light nor the set of shadow casters has changed
+    /// </summary>
+    struct ShadowCache {
+        bool valid = false;
+        glm::mat4 lightMatrix = glm::mat4(1);
+        std::vector<std::uint32_t> casters;
+
+        /// <summary>
+        /// Forces the shadow map to be rendered again, for when a caster moves or the image is remade
+        /// </summary>
+        void invalidate() { valid = false; }
+
+        /// <summary>
+        /// Checks if the shadow map is out of date and if so remembers the state it is about to be rendered with
+        /// </summary>
+        /// <param name="light">The light's projection view matrix</param>
+        /// <param name="shadowCasters">Indices of the meshes drawn into the shadow map</param>
+        /// <returns>True if the shadow pass needs recording</returns>
+        bool needsRender(const glm::mat4& light, const std::vector<std::uint32_t>& shadowCasters) {
+            if (valid && light == lightMatrix && shadowCasters == casters) {
+                return false;
+            }
+            valid = true;
+            lightMatrix = light;
+            casters = shadowCasters;
+            return true;
+        }
+    };
+
+    /// <summary>
+    /// Settings taken from the command line
+    /// </summary>
+    struct RenderOptions {
+        bool headless = false;
+        std::uint32_t frameCount = 1;
+        std::string outputPath = "frame.png";
+        VkExtent2D extent = { 1280, 720 };
+        model::VertexFormat vertexFormat = model::VertexFormat::Full;
+        bool gpuCulling = false;
+        bool softwareOcclusion = false;
+        bool staticScene = false;
+    };
+
     namespace paths {
         char const* colourVertexShaderPath = "Shaders/colourVert.spv";
+        char const* colourPackedVertexShaderPath = "Shaders/colourPackedVert.spv";
         char const* colourFragmentShaderPath = "Shaders/colourFrag.spv";
         char const* alphaFragmentShaderPath = "Shaders/alphaFrag.spv";
         char const* fullscreenVertexShaderPath = "Shaders/fullscreenVert.spv";
         char const* fullscreenFragmentShaderPath = "Shaders/fullscreenFrag.spv";
         char const* shadowVertexShaderPath = "Shaders/shadowVert.spv";
+        char const* shadowPackedVertexShaderPath = "Shaders/shadowPackedVert.spv";
         char const* shadowFragmentShaderPath = "Shaders/shadowFrag.spv";
+        char const* cullComputeShaderPath = "Shaders/cullComp.spv";
+        char const* depthPyramidComputeShaderPath = "Shaders/depthPyramidComp.spv";
         char const* textureFillPath = "EmptyTexture.png";
+        char const* frameTracePath = "frameTrace.json";
     }
 
+    /// <summary>
+    /// Reads the command line options
+    /// --headless renders without a window and writes each frame to an image file
+    /// --frames N, --output path(.png|.exr), --width W and --height H configure the headless render
+    /// --vertex-format full|packed picks how mesh vertices are stored on the GPU
+    /// --culling cpu|gpu picks where the meshes are culled and their levels of detail picked,
+    /// culling on the GPU also hides meshes behind what was drawn using a depth pyramid
+    /// --occlusion on|off hides meshes behind the largest meshes on screen when culling on the CPU
+    /// --static-scene on|off records the commands of each swapchain image once, drawing every mesh in full
+    /// so only the camera changes between frames (windowed only)
+    /// </summary>
+    /// <param name="argc">Number of arguments</param>
+    /// <param name="argv">The arguments</param>
+    /// <returns>The render options</returns>
+    RenderOptions parseOptions(int argc, char* argv[]);
+
+    /// <summary>
+    /// Gets the file a headless frame is written to. A single frame uses the output path as is,
+    /// otherwise the frame number is added before the extension.
+    /// </summary>
+    /// <param name="options">The render options</param>
+    /// <param name="frameNumber">The frame number</param>
+    /// <returns>The path of the image file</returns>
+    std::string getFramePath(const RenderOptions& options, std::uint32_t frameNumber);
+
+    /// <summary>
+    /// Writes a read back frame to a PNG or EXR file depending on the format of the offscreen image
+    /// </summary>
+    /// <param name="allocator">Memory allocator</param>
+    /// <param name="readbackBuffer">The host visible buffer the image was copied to</param>
+    /// <param name="extent">The size of the image</param>
+    /// <param name="format">The format of the image (RGBA8 or RGBA16F)</param>
+    /// <param name="filePath">The file to write</param>
+    void writeReadbackImage(VmaAllocator allocator, utility::BufferSet& readbackBuffer, VkExtent2D extent,
+        VkFormat format, const std::string& filePath);
+
+    /// <summary>
+    /// Queues a job to decode each texture of a set. Empty textures are filled with the default
+    /// texture and textures of an unsupported type are left empty.
+    /// </summary>
+    /// <param name="textures">The textures of the scene</param>
+    /// <param name="isSRGB">Should dds textures use an SRGB format</param>
+    /// <param name="decoded">Output decoded textures, one per input texture</param>
+    /// <param name="counter">Counter the decode jobs are added to</param>
+    void decodeTextures(const std::vector<fbx::Texture>& textures, bool isSRGB,
+        std::vector<std::optional<utility::TextureData>>& decoded, jobs::Counter& counter);
+
     /// <summary>
     /// Configure the key callback for the glfw window
     /// </summary>
@@ -101,8 +312,9 @@ namespace {
     /// Creates a colour render pass to generate the colours of the rendering
     /// </summary>
     /// <param name="app">The context of the application</param>
+    /// <param name="pass">Which part of the colour pass it is for, the parts all share a framebuffer</param>
     /// <returns>Render pass</returns>
-    VkRenderPass createColourRenderPass(app::AppContext& app);
+    VkRenderPass createColourRenderPass(app::AppContext& app, ColourPass pass = ColourPass::Whole);
 
     /// <summary>
     /// Creates a colour render pass to generate the colours of the rendering
@@ -153,13 +365,34 @@ namespace {
     /// <returns>Descriptor set layout</returns>
     VkDescriptorSetLayout createShadowDescriptorSetLayout(app::AppContext& app);
 
+    /// <summary>
+    /// Creates a descriptor set layout of storage buffers, one per binding starting at binding 0
+    /// </summary>
+    /// <param name="app">The context of the application</param>
+    /// <param name="bindingCount">Number of storage buffers</param>
+    /// <param name="stageFlags">The shader stages that read the buffers</param>
+    /// <returns>Descriptor set layout</returns>
+    VkDescriptorSetLayout createStorageDescriptorSetLayout(app::AppContext& app, std::uint32_t bindingCount,
+        VkShaderStageFlags stageFlags);
+
+    /// <summary>
+    /// Creates the descriptor set layout of the culling shader, five storage buffers
+    /// (draws, commands, counts, visibility and visible instances) followed by the depth pyramid
+    /// </summary>
+    /// <param name="app">The context of the application</param>
+    /// <returns>Descriptor set layout</returns>
+    VkDescriptorSetLayout createCullDescriptorSetLayout(app::AppContext& app);
+
     /// <summary>
     /// Creates a pipeline layout prior to making a pipeline
     /// </summary>
     /// <param name="app">The context of the application</param>
     /// <param name="descriptorSetLayouts">The set of desriptors to apply to the pipeline</param>
+    /// <param name="pushConstantSize">Size of the push constants, 0 for none</param>
+    /// <param name="pushConstantStages">The shader stages that read the push constants</param>
     /// <returns>Pipeline Layout</returns>
-    VkPipelineLayout createPipelineLayout(app::AppContext& app, std::vector<VkDescriptorSetLayout> descriptorSetLayouts);
+    VkPipelineLayout createPipelineLayout(app::AppContext& app, std::vector<VkDescriptorSetLayout> descriptorSetLayouts,
+        std::uint32_t pushConstantSize = 0, VkShaderStageFlags pushConstantStages = VK_SHADER_STAGE_VERTEX_BIT);
 
     /// <summary>
     /// Reads in and creates a shader module given the path to a shader
@@ -177,11 +410,12 @@ namespace {
     /// <param name="renderPass">The render pass to apply the pipeline to</param>
     /// <param name="vertexShader">The vertex shader to use</param>
     /// <param name="fragmentShader">The fragment shader to use</param>
+    /// <param name="vertexFormat">The layout of the mesh vertices</param>
     /// <param name="isAlpha">Is the pipeline using alpha masking / blending</param>
     /// <returns></returns>
     VkPipeline createPipeline(app::AppContext& app, VkPipelineLayout pipeLayout, 
         VkRenderPass renderPass, VkShaderModule vertexShader, VkShaderModule fragmentShader,
-        bool isAlpha = false);
+        model::VertexFormat vertexFormat, bool isAlpha = false);
 
     /// <summary>
     /// Creates a graphics pipeline to set how the rendering should be done
@@ -203,9 +437,20 @@ namespace {
     /// <param name="renderPass">The render pass to apply the pipeline to</param>
     /// <param name="vertexShader">The vertex shader to use</param>
     /// <param name="fragmentShader">The fragment shader to use</param>
+    /// <param name="vertexFormat">The layout of the mesh vertices</param>
     /// <returns></returns>
     VkPipeline createShadowPipeline(app::AppContext& app, VkPipelineLayout pipeLayout,
-        VkRenderPass renderPass, VkShaderModule vertexShader, VkShaderModule fragmentShader);
+        VkRenderPass renderPass, VkShaderModule vertexShader, VkShaderModule fragmentShader,
+        model::VertexFormat vertexFormat);
+
+    /// <summary>
+    /// Creates the compute pipeline that culls the draws on the GPU
+    /// </summary>
+    /// <param name="app"> The application context </param>
+    /// <param name="pipeLayout">A pipeline layout</param>
+    /// <param name="computeShader">The culling shader</param>
+    /// <returns>Compute pipeline</returns>
+    VkPipeline createCullPipeline(app::AppContext& app, VkPipelineLayout pipeLayout, VkShaderModule computeShader);
 
     /// <summary>
     /// Creates a frame buffer to store the output of a render pass
@@ -270,9 +515,29 @@ namespace {
     /// <param name="layout">Descriptor set layout</param>
     /// <param name="buffer">The buffer storing the data</param>
     /// <param name="descriptorType">The type of descriptor it will be</param>
+    /// <param name="range">Size of the data read through the descriptor, dynamic descriptors read this much from their offset</param>
     /// <returns></returns>
     VkDescriptorSet createBufferDescriptorSet(app::AppContext& app, VkDescriptorPool pool, VkDescriptorSetLayout layout, 
-        VkBuffer& buffer, VkDescriptorType descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
+        VkBuffer buffer, VkDescriptorType descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VkDeviceSize range = VK_WHOLE_SIZE);
+
+    /// <summary>
+    /// Creates a descriptor set of storage buffers and initialises it
+    /// </summary>
+    /// <param name="app">Application context</param>
+    /// <param name="pool">Descriptor pool</param>
+    /// <param name="layout">Descriptor set layout</param>
+    /// <param name="buffers">The buffers, each at the binding of its index</param>
+    /// <returns>Storage buffer descriptor set</returns>
+    VkDescriptorSet createStorageDescriptorSet(app::AppContext& app, VkDescriptorPool pool, VkDescriptorSetLayout layout,
+        const std::vector<VkBuffer>& buffers);
+
+    /// <summary>
+    /// Points a culling descriptor set at the depth pyramid, for when the pyramid is made or remade
+    /// </summary>
+    /// <param name="app">Application context</param>
+    /// <param name="descriptorSet">The culling descriptor set</param>
+    /// <param name="depthPyramid">The depth pyramid</param>
+    void updatePyramidDescriptor(app::AppContext& app, VkDescriptorSet descriptorSet, const occlusion::DepthPyramid& depthPyramid);
 
     /// <summary>
     /// Creates a descriptor set to contain multiple images and initialises it
@@ -300,16 +565,6 @@ namespace {
     /// <param name="cameraInfo">The camera info struct defining location and view</param>
     void updateWorldUniforms(WorldView& worldUniform, float screenAspect, CameraInfo& cameraInfo);
 
-    /// <summary>
-    /// Updates the lighting uniforms
-    /// </summary>
-    /// <param name="app">The application context</param>
-    /// <param name="lightingBuffer">The lighting buffer</param>
-    /// <param name="lightData">The data holding the lighting info</param>
-    /// <param name="commandPool">The command pool</param>
-    void updateLightingUniforms(app::AppContext& app, VkBuffer lightingBuffer, LightingData lightData,
-        VkCommandPool commandPool);
-
 
     /// <summary>
     /// Recreates the swapchain
@@ -321,8 +576,9 @@ namespace {
     /// Records the rendering information and sets up the draw calls
     /// </summary>
     /// <param name="commandBuffer">The command buffer to record to</param>
-    /// <param name="worldUniformBuffer">The world view uniform buffer</param>
     /// <param name="worldUniform">The world view struct</param>
+    /// <param name="worldOffset">Dynamic offset of the world view uniform in the frame's uniform ring</param>
+    /// <param name="lightingOffset">Dynamic offset of the lighting uniform in the frame's uniform ring</param>
     /// <param name="renderPass">The render pass</param>
     /// <param name="frameBuffer">The framebuffer to use</param>
     /// <param name="fullRenderPass">The fullscreen render pass</param>
@@ -343,11 +599,26 @@ namespace {
     /// <param name="fullscreenDescriptorSet">Descriptor set fullscreen image</param>
     /// <param name="meshes">Meshes</param>
     /// <param name="alphaMeshes">Alpha masked meshes</param>
-    /// <param name="vertexOffsets">Any vertex offsets</param>
-    /// <param name="materials">The materials for all meshes</param>
+    /// <param name="geometryPool">Pool holding the vertices and indices of every mesh</param>
+    /// <param name="shadowBatches">Instances of the meshes inside the light frustum, nearest the light first</param>
+    /// <param name="opaqueBatches">Instances of the visible opaque meshes, nearest first</param>
+    /// <param name="alphaBatches">Instances of the visible alpha masked meshes, nearest first</param>
+    /// <param name="renderShadows">False to skip the shadow pass and reuse the shadow map as it is</param>
+    /// <param name="cameraLodView">Picks the level of detail of each mesh in the colour pass culled on the GPU</param>
+    /// <param name="shadowLodView">Picks the level of detail of each mesh in the shadow pass culled on the GPU</param>
+    /// <param name="cameraClusterView">Culls the meshlets drawn in the colour pass</param>
+    /// <param name="shadowClusterView">Culls the meshlets drawn in the shadow pass</param>
+    /// <param name="gpuCulling">The GPU culling pipeline, when it is null the meshes are culled on the CPU</param>
+    /// <param name="frame">The frame in flight, holds its visible instances and the draw commands written by the GPU
+    /// culling or the recorder of the CPU culled draws</param>
+    /// <param name="readbackImage">Image to copy out after the fullscreen pass (headless only)</param>
+    /// <param name="readbackBuffer">Buffer to copy the image into, or VK_NULL_HANDLE to skip the copy</param>
+    /// <param name="profiler">Profiler that times each pass on the GPU, null when the commands are recorded once and
+    /// submitted every frame, which leaves out the timings</param>
     void recordCommands(
         VkCommandBuffer commandBuffer,                              // Command buffer
-        VkBuffer worldUniformBuffer, WorldView worldUniform,        // World Uniform
+        WorldView worldUniform,                                     // World Uniform
+        std::uint32_t worldOffset, std::uint32_t lightingOffset,    // Uniform ring offsets
         VkRenderPass renderPass, VkFramebuffer frameBuffer,         // Colour Render pass
         VkRenderPass fullRenderPass, VkFramebuffer swapFrameBuffer, // Full screen render pass
         VkRenderPass shadowRenderPass, VkFramebuffer shadowFrameBuffer, // Shadow render pass
@@ -365,17 +636,86 @@ namespace {
         VkDescriptorSet shadowDescriptorSet,                        // Shadow descriptor
         std::vector<model::Mesh>& meshes,                           // Mesh data
         std::vector<model::Mesh>& alphaMeshes,                      // Mesh data
-        std::vector<VkDeviceSize>& vertexOffsets,                   // Per vertex data
-        std::vector<fbx::Material>& materials                       // Material data
+        const model::GeometryPool& geometryPool,                    // Mesh data
+        const std::vector<model::InstanceBatch>& shadowBatches,     // Culling results
+        const std::vector<model::InstanceBatch>& opaqueBatches,     // Culling results
+        const std::vector<model::InstanceBatch>& alphaBatches,      // Culling results
+        bool renderShadows,                                         // Shadow caching
+        const model::LodView& cameraLodView,                        // Level of detail
+        const model::LodView& shadowLodView,                        // Level of detail
+        const culling::ClusterView& cameraClusterView,              // Meshlet culling
+        const culling::ClusterView& shadowClusterView,              // Meshlet culling
+        const GpuCulling& gpuCulling, const FrameResources& frame,  // GPU culling
+        VkImage readbackImage, VkBuffer readbackBuffer,             // Headless read back
+        profiling::FrameProfiler* profiler                          // GPU timings
     );
+
+    /// <summary>
+    /// Records the shadow render pass, drawing every shadow caster into the shadow map from the light's view
+    /// </summary>
+    /// <param name="commandBuffer">Command buffer outside of any render pass</param>
+    /// <param name="shadowRenderPass">The shadow render pass</param>
+    /// <param name="shadowFrameBuffer">Frame buffer holding the shadow map</param>
+    /// <param name="shadowArea">Size of the shadow map</param>
+    /// <param name="shadowPipeline">The shadow pipeline</param>
+    /// <param name="shadowPipelineLayout">Layout of the shadow pipeline</param>
+    /// <param name="lightingDescriptorSet">Descriptor set describing the lighting uniform</param>
+    /// <param name="lightingOffset">Offset of the lighting uniform in its ring</param>
+    /// <param name="meshes">Meshes</param>
+    /// <param name="geometryPool">Pool holding the vertices and indices of every mesh</param>
+    /// <param name="shadowBatches">Instances of the meshes inside the light frustum, nearest the light first</param>
+    /// <param name="shadowClusterView">Culls the meshlets</param>
+    /// <param name="frame">Holds the visible instances and the draw commands written by the GPU culling or the recorder of the CPU culled draws</param>
+    /// <param name="shadowCull">The constants the casters were culled on the GPU with, null when they are culled on the CPU</param>
+    void recordShadowPass(
+        VkCommandBuffer commandBuffer,
+        VkRenderPass shadowRenderPass, VkFramebuffer shadowFrameBuffer, VkRect2D shadowArea,
+        VkPipeline shadowPipeline, VkPipelineLayout shadowPipelineLayout,
+        VkDescriptorSet lightingDescriptorSet, std::uint32_t lightingOffset,
+        const std::vector<model::Mesh>& meshes, const model::GeometryPool& geometryPool,
+        const std::vector<model::InstanceBatch>& shadowBatches, const culling::ClusterView& shadowClusterView,
+        const FrameResources& frame, const indirect::CullConstants* shadowCull
+    );
+
+    /// <summary>
+    /// Draws a batch of instances with one instanced draw of their level of detail. A batch of one instance
+    /// only draws the meshlets of the level that survive culling, if the level has meshlets.
+    /// </summary>
+    /// <param name="commandBuffer">Command buffer with the geometry pool and visible instances bound</param>
+    /// <param name="mesh">The nearest mesh of the batch</param>
+    /// <param name="batch">The instances and their level of detail</param>
+    /// <param name="view">The view to cull the meshlets from</param>
+    /// <param name="cullBackfaces">False when the pipeline does not cull back faces</param>
+    /// <param name="draws">Scratch list of the index ranges to draw</param>
+    void drawClusters(VkCommandBuffer commandBuffer, const model::Mesh& mesh, const model::InstanceBatch& batch,
+        const culling::ClusterView& view, bool cullBackfaces, std::vector<culling::DrawRange>& draws);
+
+    /// <summary>
+    /// Records the culling shader for each pass, it adds the visible instances to the draw commands of the frame
+    /// </summary>
+    /// <param name="commandBuffer">Command buffer outside of any render pass</param>
+    /// <param name="gpuCulling">The GPU culling pipeline</param>
+    /// <param name="frame">The frame in flight the commands are written for</param>
+    /// <param name="passes">The constants of each pass to cull</param>
+    /// <param name="resetCounts">True for the first culling of the frame, the counts and commands are reset before it</param>
+    void recordGpuCulling(VkCommandBuffer commandBuffer, const GpuCulling& gpuCulling, const FrameResources& frame,
+        const std::vector<indirect::CullConstants>& passes, bool resetCounts);
+
+    /// <summary>
+    /// Draws the commands the culling shader wrote for one pass
+    /// </summary>
+    /// <param name="commandBuffer">Command buffer with the geometry pool and instances bound</param>
+    /// <param name="frame">The frame in flight holding the draw commands</param>
+    /// <param name="cull">The constants the pass was culled with</param>
+    void drawIndirect(VkCommandBuffer commandBuffer, const FrameResources& frame, const indirect::CullConstants& cull);
     
     /// <summary>
     /// Submits a command buffer to the graphics queue
     /// </summary>
     /// <param name="app">Application context</param>
     /// <param name="commandBuffer">Recorded Command buffer</param>
-    /// <param name="wait">Wait semaphore</param>
-    /// <param name="signal">Signal semaphore</param>
+    /// <param name="wait">Wait semaphore (VK_NULL_HANDLE for none)</param>
+    /// <param name="signal">Signal semaphore (VK_NULL_HANDLE for none)</param>
     /// <param name="fence">Fence to wait for</param>
     void submitCommands(app::AppContext app, VkCommandBuffer commandBuffer, VkSemaphore wait, 
         VkSemaphore signal, VkFence fence);
@@ -393,10 +733,15 @@ namespace {
 
 }
 
-int main() {
+int main(int argc, char* argv[]) {
     try {
+        RenderOptions options = parseOptions(argc, argv);
+
         // -- The setup -- //
-        app::AppContext application = app::setup();
+        // Headless renders go to an offscreen image, EXR output keeps the full range by rendering in half floats
+        app::AppContext application = options.headless ?
+            app::setupHeadless(options.extent, options.outputPath.ends_with(".exr") ? VK_FORMAT_R16G16B16A16_SFLOAT : VK_FORMAT_R8G8B8A8_SRGB) :
+            app::setup();
 
         // Set up the player camera state
         CameraInfo playerCamera;
@@ -404,23 +749,40 @@ int main() {
         playerCamera.worldCameraMatrix = playerCamera.worldCameraMatrix * glm::translate(playerCamera.position);
 
         // Set up the GLFW inputs
-        // Sets player camera as the user of the window
-        glfwSetWindowUserPointer(application.window, &playerCamera);
+        if (!application.headless) {
+            // Sets player camera as the user of the window
+            glfwSetWindowUserPointer(application.window, &playerCamera);
 
-        // Sets up the key call back function
-        glfwSetKeyCallback(application.window, keyCallback);
+            // Sets up the key call back function
+            glfwSetKeyCallback(application.window, keyCallback);
 
-        // Sets up the mouse button call back function
-        glfwSetMouseButtonCallback(application.window, &mouseButtonCallback);
+            // Sets up the mouse button call back function
+            glfwSetMouseButtonCallback(application.window, &mouseButtonCallback);
 
-        // Sets up the mouse call back function
-        glfwSetCursorPosCallback(application.window, &mouseCallback);
+            // Sets up the mouse call back function
+            glfwSetCursorPosCallback(application.window, &mouseCallback);
+        }
         
         // -- The setup -- //
         
         // Create the memory allocator
         VmaAllocator allocator = createMemoryAllocator(application);
 
+        // Static scenes reuse the commands of each swapchain image, headless frames are each read back so are always recorded
+        bool const staticScene = options.staticScene && !application.headless;
+        if (options.staticScene && !staticScene) {
+            std::cout << "Static scenes need a swapchain, recording every frame" << std::endl;
+        }
+
+        // GPU culling draws with indirect count draws, without them the meshes are culled on the CPU
+        // Static scenes draw every mesh so nothing is culled
+        bool const gpuCulling = options.gpuCulling && application.indirectCountDraws && !staticScene;
+        if (options.gpuCulling && !application.indirectCountDraws) {
+            std::cout << "Indirect count draws are not supported, culling on the CPU" << std::endl;
+        }
+        // The GPU culling has its own occlusion culling
+        bool const softwareOcclusion = options.softwareOcclusion && !gpuCulling && !staticScene;
+
         // Create the shadows render pass
         VkRenderPass renderPassShadows = createShadowRenderPass(application);
 
@@ -441,13 +803,18 @@ int main() {
         VkDescriptorSetLayout fullscreenDescriptorSetLayout = createFullscreenDescriptorSetLayout(application);
         // Fullscreen descriptor set layout contains the data for the fullscreen render pass
         VkDescriptorSetLayout shadowDescriptorSetLayout = createShadowDescriptorSetLayout(application);
+        // Instance descriptor set layout contains the transform and decode constants of every instance and the ids of the visible ones
+        VkDescriptorSetLayout instanceDescriptorSetLayout = createStorageDescriptorSetLayout(application, 2, VK_SHADER_STAGE_VERTEX_BIT);
+        // Cull descriptor set layout contains the buffers and depth pyramid of the culling shader
+        VkDescriptorSetLayout cullDescriptorSetLayout = createCullDescriptorSetLayout(application);
 
         // Create a vector of the descriptor sets to use
         std::vector<VkDescriptorSetLayout> descriptorSetLayouts;
 
         // Create shadow pipeline layout
         descriptorSetLayouts.emplace_back(lightDescriptorSetLayout);
-        VkPipelineLayout shadowPipelineLayout = createPipelineLayout(application, descriptorSetLayouts);;
+        descriptorSetLayouts.emplace_back(instanceDescriptorSetLayout);
+        VkPipelineLayout shadowPipelineLayout = createPipelineLayout(application, descriptorSetLayouts);
 
         // Create colour pipeline layout
         descriptorSetLayouts.clear();
@@ -455,6 +822,7 @@ int main() {
         descriptorSetLayouts.emplace_back(textureDescriptorSetLayout);
         descriptorSetLayouts.emplace_back(lightDescriptorSetLayout);
         descriptorSetLayouts.emplace_back(shadowDescriptorSetLayout);
+        descriptorSetLayouts.emplace_back(instanceDescriptorSetLayout);
         VkPipelineLayout pipelineLayout = createPipelineLayout(application, descriptorSetLayouts);
 
         // Create full screen
@@ -462,25 +830,46 @@ int main() {
         descriptorSetLayouts.emplace_back(fullscreenDescriptorSetLayout);
         VkPipelineLayout fullscreenPipelineLayout = createPipelineLayout(application, descriptorSetLayouts);
 
-        // Create the shaders
-        VkShaderModule colourVertexShader = createShaderModule(application, paths::colourVertexShaderPath);
+        // Create the culling pipeline layout
+        descriptorSetLayouts.clear();
+        descriptorSetLayouts.emplace_back(cullDescriptorSetLayout);
+        VkPipelineLayout cullPipelineLayout = createPipelineLayout(application, descriptorSetLayouts, sizeof(indirect::CullConstants),
+            VK_SHADER_STAGE_COMPUTE_BIT);
+
+        // Create the shaders (the vertex shaders decode the chosen vertex format)
+        // Packed vertices read their decode constants from the instance data
+        bool const packedVertices = options.vertexFormat == model::VertexFormat::Packed;
+        VkShaderModule colourVertexShader = createShaderModule(application,
+            packedVertices ? paths::colourPackedVertexShaderPath : paths::colourVertexShaderPath);
         VkShaderModule colourFragmentShader = createShaderModule(application, paths::colourFragmentShaderPath);
         VkShaderModule alphaFragmentShader = createShaderModule(application, paths::alphaFragmentShaderPath);
         VkShaderModule fullscreenVertexShader = createShaderModule(application, paths::fullscreenVertexShaderPath);
         VkShaderModule fullscreenFragmentShader = createShaderModule(application, paths::fullscreenFragmentShaderPath);
-        VkShaderModule shadowVertexShader = createShaderModule(application, paths::shadowVertexShaderPath);
+        VkShaderModule shadowVertexShader = createShaderModule(application,
+            packedVertices ? paths::shadowPackedVertexShaderPath : paths::shadowVertexShaderPath);
         VkShaderModule shadowFragmentShader = createShaderModule(application, paths::shadowFragmentShaderPath);
+        VkShaderModule cullComputeShader = gpuCulling ? createShaderModule(application, paths::cullComputeShaderPath) : VK_NULL_HANDLE;
 
         // Create the pipeline
-        VkPipeline pipeline = createPipeline(application, pipelineLayout, renderPassColour, colourVertexShader, colourFragmentShader);
-        VkPipeline alphaPipeline = createPipeline(application, pipelineLayout, renderPassColour, colourVertexShader, alphaFragmentShader, true);
+        VkPipeline pipeline = createPipeline(application, pipelineLayout, renderPassColour, colourVertexShader, colourFragmentShader,
+            options.vertexFormat);
+        VkPipeline alphaPipeline = createPipeline(application, pipelineLayout, renderPassColour, colourVertexShader, alphaFragmentShader,
+            options.vertexFormat, true);
         VkPipeline fullscreenPipeline = createFullscreenPipeline(application, fullscreenPipelineLayout, renderPassFullscreen, fullscreenVertexShader, fullscreenFragmentShader);
-        VkPipeline shadowPipeline = createShadowPipeline(application, shadowPipelineLayout, renderPassShadows, shadowVertexShader, shadowFragmentShader);
+        VkPipeline shadowPipeline = createShadowPipeline(application, shadowPipelineLayout, renderPassShadows, shadowVertexShader, shadowFragmentShader,
+            options.vertexFormat);
+
+        // The culling pipeline does not depend on the swapchain so it is never remade
+        GpuCulling gpuCull;
+        gpuCull.pipelineLayout = cullPipelineLayout;
+        if (gpuCulling) {
+            gpuCull.pipeline = createCullPipeline(application, cullPipelineLayout, cullComputeShader);
+        }
 
         // Create a vkImage and vkImageView to store the depth buffer
         utility::ImageSet depthBuffer = utility::createImageSet(application, allocator,
             VK_FORMAT_D32_SFLOAT, 
-            VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, 
+            VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, 
             VK_IMAGE_ASPECT_DEPTH_BIT, 
             application.swapchainExtent 
         );
@@ -509,6 +898,19 @@ int main() {
         VkFramebuffer colourFramebuffer = createFramebuffer(application, renderPassColour, colourAttatchments, 
             application.swapchainExtent.width, application.swapchainExtent.height);
 
+        // Occlusion culling splits the colour pass around the depth pyramid (both halves use the colour framebuffer)
+        std::optional<occlusion::DepthPyramid> depthPyramid;
+        if (gpuCulling) {
+            gpuCull.earlyRenderPass = createColourRenderPass(application, ColourPass::Early);
+            gpuCull.lateRenderPass = createColourRenderPass(application, ColourPass::Late);
+
+            VkShaderModule depthPyramidShader = createShaderModule(application, paths::depthPyramidComputeShaderPath);
+            depthPyramid.emplace(application, allocator, depthPyramidShader);
+            vkDestroyShaderModule(application.logicalDevice, depthPyramidShader, nullptr);
+            depthPyramid->resize(depthBuffer.imageView, application.swapchainExtent);
+            gpuCull.depthPyramid = &*depthPyramid;
+        }
+
         // Create a framebuffer to hold the results of the shadow render pass
         std::vector<VkImageView> shadowAttatchments;
         shadowAttatchments.emplace_back(shadowBuffer.imageView);
@@ -527,82 +929,188 @@ int main() {
                 application.swapchainExtent.width, application.swapchainExtent.height));
         }
 
+        // Without a swapchain the final pass draws into an offscreen image which is copied back to the host
+        utility::ImageSet offscreenTarget;
+        if (application.headless) {
+            offscreenTarget = utility::createImageSet(application, allocator,
+                application.swapchainFormat,
+                VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+                VK_IMAGE_ASPECT_COLOR_BIT,
+                application.swapchainExtent
+            );
+
+            std::vector<VkImageView> offscreenAttatchments;
+            offscreenAttatchments.emplace_back(offscreenTarget.imageView);
+            swapchainFramebuffers.emplace_back(createFramebuffer(application, renderPassFullscreen, offscreenAttatchments,
+                application.swapchainExtent.width, application.swapchainExtent.height));
+        }
+
         // Create the command pool
         VkCommandPool commandPool = utility::createCommandPool(application, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
 
-        // Load an FBX model
-        //fbx::Scene fbxScene = fbx::loadFBXFile("Bistro/BistroExterior.fbx");
-        fbx::Scene fbxScene = fbx::loadFBXFile("SunTemple/SunTemple.fbx");
+        // Load an FBX model (through the scene cache so warm starts skip the import)
+        //fbx::Scene fbxScene = fbx::loadScene("Bistro/BistroExterior.fbx");
+        fbx::Scene fbxScene = fbx::loadScene("SunTemple/SunTemple.fbx");
+
+        // Batch all the texture and mesh uploads into as few submits as possible
+        utility::UploadBatch uploads(application, allocator, commandPool);
+
+        // Decode all textures from the fbx model across the job system, only the uploads stay on this thread
+        std::vector<std::optional<utility::TextureData>> decodedColour, decodedSpecular, decodedNormal;
+        jobs::Counter textureDecodes;
+        decodeTextures(fbxScene.diffuseTextures, true, decodedColour, textureDecodes);
+        decodeTextures(fbxScene.specularTextures, false, decodedSpecular, textureDecodes);
+        decodeTextures(fbxScene.normalTextures, false, decodedNormal, textureDecodes);
+        jobs::shared().wait(textureDecodes);
 
-        // Load all textures from the fbx model
         // Load colour (diffuse) textures in
         std::vector<utility::ImageSet> colourTextures;
-        for (fbx::Texture texture : fbxScene.diffuseTextures) {
-            // If texture is not empty
-            if (texture.isEmpty) {
-                colourTextures.emplace_back(utility::createPNGTextureImageSet(application, paths::textureFillPath, allocator, commandPool));
-            }
-            // If texture is a dds texture
-            else if (texture.filePath.ends_with(".dds")) {
-                colourTextures.emplace_back(utility::createDDSTextureImageSet(application, texture.filePath.c_str(), allocator, commandPool, true));
+        for (std::optional<utility::TextureData>& texture : decodedColour) {
+            if (texture) {
+                colourTextures.emplace_back(utility::createTextureImageSet(application, *texture, allocator, uploads));
+                texture.reset();
             }
-            else if (texture.filePath.ends_with(".png") || texture.filePath.ends_with(".jpg")) {
-                colourTextures.emplace_back(utility::createPNGTextureImageSet(application, texture.filePath.c_str(), allocator, commandPool));
-            } 
         }
         // Load specular textures in
         std::vector<utility::ImageSet> specularTextures;
-        for (fbx::Texture texture : fbxScene.specularTextures) {
-            // If texture is not empty
-            if (texture.isEmpty) {
-                specularTextures.emplace_back(utility::createPNGTextureImageSet(application, paths::textureFillPath, allocator, commandPool));
-            }
-            // If texture is a dds texture
-            else if (texture.filePath.ends_with(".dds")) {
-                specularTextures.emplace_back(utility::createDDSTextureImageSet(application, texture.filePath.c_str(), allocator, commandPool));
-            }
-            else if (texture.filePath.ends_with(".png") || texture.filePath.ends_with(".jpg")) {
-                specularTextures.emplace_back(utility::createPNGTextureImageSet(application, texture.filePath.c_str(), allocator, commandPool));
+        for (std::optional<utility::TextureData>& texture : decodedSpecular) {
+            if (texture) {
+                specularTextures.emplace_back(utility::createTextureImageSet(application, *texture, allocator, uploads));
+                texture.reset();
             }
         }
         // Load normal map textures in
         std::vector<utility::ImageSet> normalTextures;
-        for (fbx::Texture texture : fbxScene.normalTextures) {
-            // If texture is not empty
-            if (texture.isEmpty) {
-                normalTextures.emplace_back(utility::createPNGTextureImageSet(application, paths::textureFillPath, allocator, commandPool));
-            }
-            // If texture is a dds texture
-            else if (texture.filePath.ends_with(".dds")) {
-                normalTextures.emplace_back(utility::createDDSTextureImageSet(application, texture.filePath.c_str(), allocator, commandPool));
-            }
-            else if (texture.filePath.ends_with(".png") || texture.filePath.ends_with(".jpg")) {
-                normalTextures.emplace_back(utility::createPNGTextureImageSet(application, texture.filePath.c_str(), allocator, commandPool));
+        for (std::optional<utility::TextureData>& texture : decodedNormal) {
+            if (texture) {
+                normalTextures.emplace_back(utility::createTextureImageSet(application, *texture, allocator, uploads));
+                texture.reset();
             }
         }
 
-        // Load all meshes from the fbx model (Separate the meshes that use alpha textures)
+        // Every mesh is stored in one geometry pool so each pass binds its buffers once
+        std::size_t sceneVertices = 0;
+        std::size_t sceneIndices = 0;
+        for (const fbx::Mesh& mesh : fbxScene.meshes) {
+            sceneVertices += mesh.vertexPositions.size();
+            sceneIndices += mesh.vertexIndices.size();
+        }
+        model::GeometryPool geometryPool = model::createGeometryPool(allocator, options.vertexFormat,
+            std::uint32_t(sceneVertices), std::uint32_t(sceneIndices));
+
+        // Load all meshes from the fbx model, each material of a mesh is drawn as its own submesh from the
+        // mesh's vertices (Separate the submeshes that use alpha textures)
+        // Each instance of a submesh is culled on its own with its own bounds, the instances of every submesh share one buffer
+        // and the visible instances of a submesh are drawn together
+        std::vector<glm::mat4> const singleInstance = { glm::mat4(1.f) };
         std::vector<model::Mesh> meshes;
+        std::vector<model::InstanceData> instances;
         std::vector<model::Mesh> alphaMeshes;
-        for (fbx::Mesh mesh : fbxScene.meshes) {
-            // Check all materials of the mesh to see if they require alpha testing
-            bool alpha = false;
-            for (int texID = 0; texID < mesh.materials.size(); texID++) {
-                if (colourTextures[mesh.materials[texID]].isAlpha) {
-                    alpha = true;
-                    break;
+        model::MeshBounds meshBounds;
+        model::MeshBounds alphaMeshBounds;
+        std::vector<occlusion::OccluderMesh> occluderMeshes;
+        std::uint32_t submeshIndex = 0;
+        for (fbx::Mesh& mesh : fbxScene.meshes) {
+            model::Mesh geometry = model::createMesh(uploads, geometryPool,
+                mesh.vertexPositions, mesh.vertexTextureCoords, mesh.vertexNormals, mesh.vertexTangents, mesh.vertexIndices,
+                options.vertexFormat);
+
+            for (const fbx::Submesh& submesh : mesh.submeshes) {
+                std::vector<simplification::LodLevel> lods(mesh.lods.begin() + submesh.firstLod,
+                    mesh.lods.begin() + submesh.firstLod + submesh.lodCount);
+                model::Mesh draw = model::createSubmesh(geometry, submesh.material, mesh.vertexPositions, mesh.vertexIndices,
+                    lods, mesh.meshlets);
+                draw.submesh = submeshIndex++;
+                const std::vector<glm::mat4>& transforms = mesh.instanceTransforms.empty() ? singleInstance : mesh.instanceTransforms;
+
+                // Check the material to see if it requires alpha testing
+                if (colourTextures[submesh.material].isAlpha) {
+                    for (const glm::mat4& transform : transforms) {
+                        alphaMeshes.emplace_back(model::createInstance(draw, transform, instances));
+                        model::addMeshBounds(alphaMeshBounds, submesh.boundsMin, submesh.boundsMax, transform);
+                    }
+                }
+                else {
+                    // Only opaque meshes hide what is behind them, the occluder is simplified once and placed on every instance
+                    occlusion::OccluderMesh occluder;
+                    if (softwareOcclusion) {
+                        occluder = occlusion::createOccluderMesh(mesh, submesh, OCCLUDER_MAX_TRIANGLES);
+                    }
+
+                    for (const glm::mat4& transform : transforms) {
+                        meshes.emplace_back(model::createInstance(draw, transform, instances));
+                        model::addMeshBounds(meshBounds, submesh.boundsMin, submesh.boundsMax, transform);
+
+                        if (softwareOcclusion) {
+                            occluderMeshes.emplace_back(occluder);
+                            for (glm::vec3& position : occluderMeshes.back().positions) {
+                                position = glm::vec3(transform * glm::vec4(position, 1.f));
+                            }
+                        }
+                    }
                 }
             }
-            if (alpha) {
-                alphaMeshes.emplace_back(model::createMesh(application, allocator, commandPool,
-                    mesh.vertexPositions, mesh.vertexTextureCoords, mesh.vertexNormals, mesh.vertexTangents, mesh.vertexMaterialIDs, mesh.vertexIndices));
-            }
-            else {
-                meshes.emplace_back(model::createMesh(application, allocator, commandPool,
-                    mesh.vertexPositions, mesh.vertexTextureCoords, mesh.vertexNormals, mesh.vertexTangents, mesh.vertexMaterialIDs, mesh.vertexIndices));
-            }
         }
 
+        // Storage buffers may not be empty
+        instances.resize(std::max<std::size_t>(instances.size(), 1));
+        utility::BufferSet instanceBuffer = uploads.uploadBuffer(instances.data(), instances.size() * sizeof(model::InstanceData),
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+
+        // The CPU occlusion culling runs on the job system while the CPU waits for the GPU
+        std::optional<occlusion::SoftwareOcclusion> occlusionCulling;
+        if (softwareOcclusion) {
+            occlusionCulling.emplace(jobs::shared(), meshBounds, alphaMeshBounds, std::move(occluderMeshes));
+        }
+
+        // The GPU culls and draws from the opaque draws followed by the alpha masked draws
+        // and remembers which of them were visible for the next frame
+        utility::BufferSet drawDataBuffer;
+        utility::BufferSet visibilityBuffer;
+        utility::BufferSet commandTemplateBuffer;
+        std::uint32_t visibleInstanceCount = 0;
+        if (gpuCulling) {
+            std::vector<indirect::DrawData> drawData;
+            indirect::appendDrawData(meshes, meshBounds, drawData);
+            indirect::appendDrawData(alphaMeshes, alphaMeshBounds, drawData);
+            gpuCull.opaqueDraws = std::uint32_t(meshes.size());
+            gpuCull.alphaDraws = std::uint32_t(alphaMeshes.size());
+
+            // Storage buffers may not be empty
+            drawData.resize(std::max<std::size_t>(drawData.size(), 1));
+            drawDataBuffer = uploads.uploadBuffer(drawData.data(), drawData.size() * sizeof(indirect::DrawData),
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+
+            // Nothing was visible before the first frame
+            std::vector<std::uint32_t> visibility(drawData.size(), 0);
+            visibilityBuffer = uploads.uploadBuffer(visibility.data(), visibility.size() * sizeof(std::uint32_t),
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+            gpuCull.visibility = visibilityBuffer.buffer;
+
+            // The commands of the shadow, opaque, alpha masked, late opaque and late alpha masked passes in turn,
+            // each frame copies them into its own commands before culling adds the visible instances
+            std::vector<indirect::DrawCommand> commandTemplate;
+            visibleInstanceCount = indirect::appendDrawCommands(meshes, visibleInstanceCount, commandTemplate);
+            gpuCull.opaqueCommands = std::uint32_t(commandTemplate.size());
+            visibleInstanceCount = indirect::appendDrawCommands(meshes, visibleInstanceCount, commandTemplate);
+            visibleInstanceCount = indirect::appendDrawCommands(alphaMeshes, visibleInstanceCount, commandTemplate);
+            gpuCull.alphaCommands = std::uint32_t(commandTemplate.size()) - 2 * gpuCull.opaqueCommands;
+            visibleInstanceCount = indirect::appendDrawCommands(meshes, visibleInstanceCount, commandTemplate);
+            visibleInstanceCount = indirect::appendDrawCommands(alphaMeshes, visibleInstanceCount, commandTemplate);
+
+            commandTemplate.resize(std::max<std::size_t>(commandTemplate.size(), 1));
+            commandTemplateBuffer = uploads.uploadBuffer(commandTemplate.data(), commandTemplate.size() * sizeof(indirect::DrawCommand),
+                VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+            gpuCull.commandTemplate = commandTemplateBuffer.buffer;
+        }
+        else {
+            // The CPU draws the shadow casters followed by the visible meshes, each of them once at most
+            visibleInstanceCount = 2 * std::uint32_t(instances.size());
+        }
+
+        // Wait for every upload to complete
+        uploads.flush();
+
         // Load all the lighting from the fbx model
         std::vector<LightingData> lights;
         for (fbx::Light light : fbxScene.lights) {
@@ -610,7 +1118,7 @@ int main() {
                 LightingData lightData;
                 
                 float const aspect = application.swapchainExtent.width / float(application.swapchainExtent.height);
-                glm::mat4 lightProjection = glm::perspectiveRH_NO(glm::radians(100.f), aspect, 1.f, 30.f);
+                glm::mat4 lightProjection = glm::perspectiveRH_NO(glm::radians(LIGHT_FOV), aspect, 1.f, 30.f);
                 lightProjection[1][1] *= -1.f;
                 glm::mat4 lightView = glm::translate(glm::mat4(1), light.location) * glm::rotate(glm::radians(210.f), glm::vec3(0, 1, 0));
                 glm::mat4 lightSpaceMatrix = lightProjection * glm::inverse(lightView);
@@ -652,46 +1160,96 @@ int main() {
         VkDescriptorSet shadowDescriptorSet = createFramebufferDescriptorSet(application, descriptorPool,
             shadowDescriptorSetLayout, shadowBuffer, shadowSampler);
 
-        // Create the world uniform buffer
-        utility::BufferSet worldUniformBuffer = utility::createBuffer(allocator, sizeof(WorldView),
-            VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-            VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE);
-
-        // Create and initialise the world descriptor set
-        VkDescriptorSet worldDescriptorSet = createBufferDescriptorSet(application, descriptorPool,
-            worldDescriptorSetLayout, worldUniformBuffer.buffer);
-
         // Create and initialise the texture descriptor sets
         VkDescriptorSet bindlessTextureDescriptorSet = createBindlessImageDescriptorSet(application, descriptorPool, 
             textureDescriptorSetLayout, colourTextures, specularTextures, normalTextures, sampler);
 
-        // Create the lighting uniform buffer
-        utility::BufferSet lightingUniformBuffer = utility::createBuffer(allocator, sizeof(LightingData),
-            VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-            VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE);
+        // Each target of the draws has its own list of visible instances, bound with the instances of every mesh.
+        // The culling shader writes the list on the GPU, the CPU culling writes it through a mapping.
+        auto createInstanceResources = [&](FrameResources& target) {
+            VkDeviceSize const size = std::max(visibleInstanceCount, 1u) * sizeof(std::uint32_t);
+            if (gpuCulling) {
+                target.visibleInstances = utility::createBuffer(allocator, size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                    VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE);
+            }
+            else {
+                target.visibleInstances = utility::createBuffer(allocator, size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                    VMA_MEMORY_USAGE_AUTO, VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT);
+            }
+            target.instanceDescriptorSet = createStorageDescriptorSet(application, descriptorPool, instanceDescriptorSetLayout,
+                { instanceBuffer.buffer, target.visibleInstances.buffer });
+        };
+
+        // Create the resources for each frame in flight
+        // The world uniform changes every frame so each frame needs its own copy
+        std::vector<FrameResources> frames(FRAMES_IN_FLIGHT);
+        for (FrameResources& frame : frames) {
+            frame.commandBuffer = utility::createCommandBuffer(application, commandPool);
+            frame.inFlight = utility::createFence(application, VK_FENCE_CREATE_SIGNALED_BIT);
+            frame.imageIsReady = utility::createSemaphore(application, 0);
+            frame.uniformRing = std::make_unique<uniforms::UniformRing>(application, allocator, UNIFORM_RING_SIZE);
+            frame.worldDescriptorSet = createBufferDescriptorSet(application, descriptorPool, worldDescriptorSetLayout,
+                frame.uniformRing->buffer(), VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, sizeof(WorldView));
+            frame.lightingDescriptorSet = createBufferDescriptorSet(application, descriptorPool, lightDescriptorSetLayout,
+                frame.uniformRing->buffer(), VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, sizeof(LightingData));
+
+            // Static scenes draw from the instances of each image and of the shadow commands instead
+            if (!staticScene) {
+                createInstanceResources(frame);
+            }
 
-        // Set the data for the lighting buffer
-        updateLightingUniforms(application, lightingUniformBuffer.buffer, lights[0], commandPool);
+            // Headless frames are copied here and written out once their fence has signalled
+            if (application.headless) {
+                VkDeviceSize const bytesPerPixel = application.swapchainFormat == VK_FORMAT_R16G16B16A16_SFLOAT ? 8 : 4;
+                frame.readbackBuffer = utility::createBuffer(allocator,
+                    bytesPerPixel * application.swapchainExtent.width * application.swapchainExtent.height,
+                    VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                    VMA_MEMORY_USAGE_AUTO,
+                    VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT);
+            }
 
-        // Create and initialise the lighting descriptor sets
-        VkDescriptorSet lightDescriptorSet = createBufferDescriptorSet(application, descriptorPool,
-            lightDescriptorSetLayout, lightingUniformBuffer.buffer);
+            // Secondary command buffers are reused once the frame's fence has signalled
+            if (!gpuCulling && !staticScene) {
+                frame.recorder = std::make_unique<recording::ParallelRecorder>(application, jobs::shared());
+            }
 
-        // Create the command buffers - one for each of the swapchain framebuffers
-        std::vector<VkCommandBuffer> commandBuffers;
-        for (size_t i = 0; i < swapchainFramebuffers.size(); i++) {
-            commandBuffers.emplace_back(utility::createCommandBuffer(application, commandPool));
+            // Commands are culled into every frame so a frame in flight can still be drawing from its own
+            if (gpuCulling) {
+                std::uint32_t const commandCount = std::max(3 * gpuCull.opaqueCommands + 2 * gpuCull.alphaCommands, 1u);
+                frame.drawCommands = utility::createBuffer(allocator, commandCount * sizeof(VkDrawIndexedIndirectCommand),
+                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                    VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE);
+                frame.drawCounts = utility::createBuffer(allocator, indirect::COUNT_TOTAL * sizeof(std::uint32_t),
+                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                    VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE);
+                frame.statsBuffer = utility::createBuffer(allocator, indirect::COUNT_TOTAL * sizeof(std::uint32_t),
+                    VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                    VMA_MEMORY_USAGE_AUTO,
+                    VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT);
+                frame.cullDescriptorSet = createStorageDescriptorSet(application, descriptorPool, cullDescriptorSetLayout,
+                    { drawDataBuffer.buffer, frame.drawCommands.buffer, frame.drawCounts.buffer, visibilityBuffer.buffer,
+                      frame.visibleInstances.buffer });
+                updatePyramidDescriptor(application, frame.cullDescriptorSet, *depthPyramid);
+            }
         }
 
-        // Create fences for each of the swapchain framebuffers / command buffers
-        std::vector<VkFence> fences;
+        // Static scenes record the commands of each swapchain image once, along with its own uniform ring.
+        // An image's commands can not be submitted again until the fence of the frame that last drew it has signalled.
+        std::vector<FrameResources> staticImages;
+        std::vector<VkFence> imageFences(application.swapchainImages.size(), VK_NULL_HANDLE);
+        bool staticCommandsRecorded = false;
+
+        // The shadow map of a static scene is drawn by commands of its own, submitted once ahead of the image commands
+        // that sample it and again only when the light, its casters or the shadow framebuffer change
+        FrameResources staticShadows;
+
+        // Create the render finished semaphores - one for each of the swapchain images
+        // The presentation engine holds on to these until the image is next acquired
+        std::vector<VkSemaphore> renderHasFinished;
         for (size_t i = 0; i < swapchainFramebuffers.size(); i++) {
-            fences.emplace_back(utility::createFence(application, VK_FENCE_CREATE_SIGNALED_BIT));
+            renderHasFinished.emplace_back(utility::createSemaphore(application, 0));
         }
-
-        // Create semaphores
-        VkSemaphore imageIsReady = utility::createSemaphore(application, 0);
-        VkSemaphore renderHasFinished = utility::createSemaphore(application, 0);
+        std::uint32_t currentFrame = 0;
 
         // Get the render area
         VkRect2D renderArea;
@@ -702,16 +1260,93 @@ int main() {
         shadowRenderArea.extent = VkExtent2D{DEPTH_RES, DEPTH_RES};
         shadowRenderArea.offset = VkOffset2D{ 0,0 };
 
-        // Get the set of offsets
-        std::vector<VkDeviceSize> meshOffsets = { 0, 0 };
+        // The light does not move so the shadow casters only need culling once
+        gpuCull.shadowProjectionView = lights[0].lightDirectionMatrix;
+        std::vector<std::uint32_t> shadowMeshes;
+        culling::cullMeshes(culling::extractFrustum(lights[0].lightDirectionMatrix), meshBounds, shadowMeshes);
 
+        // The shadow casters are drawn nearest the light first
+        {
+            std::vector<std::uint64_t> shadowDraws;
+            std::vector<std::uint64_t> shadowScratch;
+            sorting::appendSortKeys(sorting::Pass::Shadow, sorting::Pipeline::Opaque, lights[0].lightPosition,
+                meshBounds, shadowMeshes, shadowDraws);
+            sorting::radixSort(shadowDraws, shadowScratch, jobs::shared());
+            shadowMeshes.clear();
+            for (std::uint64_t key : shadowDraws) {
+                shadowMeshes.emplace_back(sorting::keyMesh(key));
+            }
+        }
+
+        // Levels of detail in the shadow map are picked from the light
+        model::LodView shadowLodView = model::createLodView(lights[0].lightPosition, glm::radians(LIGHT_FOV),
+            float(DEPTH_RES), SHADOW_LOD_PIXEL_ERROR);
+        culling::ClusterView shadowClusterView = culling::createClusterView(lights[0].lightDirectionMatrix, lights[0].lightPosition,
+            glm::radians(LIGHT_FOV), float(DEPTH_RES), CLUSTER_MIN_PIXELS);
+
+        // Neither the casters nor their levels change so their instances are batched once, at the start of every list of visible instances
+        std::vector<std::uint32_t> shadowInstances;
+        std::vector<model::InstanceBatch> shadowBatches;
+        model::batchInstances(meshes, shadowMeshes, shadowLodView, shadowInstances, shadowBatches);
+
+        // The shadow map is only rendered again when the light or its casters change
+        ShadowCache shadowCache;
+
+        // Visible mesh lists, their sorted draws and the batches of their instances are refilled every frame
+        std::vector<std::uint32_t> visibleMeshes;
+        std::vector<std::uint32_t> visibleAlphaMeshes;
+        std::vector<std::uint64_t> colourDraws;
+        std::vector<std::uint64_t> sortScratch;
+        std::vector<std::uint32_t> visibleInstances;
+        std::vector<model::InstanceBatch> opaqueBatches;
+        std::vector<model::InstanceBatch> alphaBatches;
+
+        // Batches the instances of the sorted draws after the shadow casters', keeping the draws nearest first
+        auto batchColourDraws = [&](const model::LodView& lodView) {
+            visibleMeshes.clear();
+            visibleAlphaMeshes.clear();
+            for (std::uint64_t key : colourDraws) {
+                if (sorting::keyPipeline(key) == sorting::Pipeline::Opaque) {
+                    visibleMeshes.emplace_back(sorting::keyMesh(key));
+                }
+                else {
+                    visibleAlphaMeshes.emplace_back(sorting::keyMesh(key));
+                }
+            }
+
+            visibleInstances = shadowInstances;
+            opaqueBatches.clear();
+            alphaBatches.clear();
+            model::batchInstances(meshes, visibleMeshes, lodView, visibleInstances, opaqueBatches);
+            model::batchInstances(alphaMeshes, visibleAlphaMeshes, lodView, visibleInstances, alphaBatches);
+        };
+
+        // The last commands that read the target's visible instances have finished
+        auto writeVisibleInstances = [&](FrameResources& target) {
+            void* data = nullptr;
+            if (vmaMapMemory(allocator, target.visibleInstances.allocation, &data) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to map the visible instance buffer.");
+            }
+            std::memcpy(data, visibleInstances.data(), visibleInstances.size() * sizeof(std::uint32_t));
+            vmaFlushAllocation(allocator, target.visibleInstances.allocation, 0, VK_WHOLE_SIZE);
+            vmaUnmapMemory(allocator, target.visibleInstances.allocation);
+        };
+
+        // Times each pass on the GPU and each stage of the loop on the CPU
+        profiling::FrameProfiler profiler(application, FRAMES_IN_FLIGHT);
 
         bool resizeWindow = false;
+        std::uint32_t framesRendered = 0;
+
+        // Main render loop (headless renders stop after the requested number of frames)
+        while (application.headless ? framesRendered < options.frameCount : !glfwWindowShouldClose(application.window)) {
+            profiler.beginFrame(currentFrame);
 
-        // Main render loop
-        while (!glfwWindowShouldClose(application.window)) {
             // Check for input events
-            glfwPollEvents();
+            if (!application.headless) {
+                profiling::CpuScope scope(profiler, "Poll events");
+                glfwPollEvents();
+            }
 
             // Has the window been resized and if so resize the swapchain
             if (resizeWindow) {
@@ -739,6 +1374,12 @@ int main() {
                     renderPassColour = createColourRenderPass(application);
                     renderPassFullscreen = createFinalRenderPass(application);
                     renderPassShadows = createShadowRenderPass(application);
+                    if (gpuCulling) {
+                        vkDestroyRenderPass(application.logicalDevice, gpuCull.earlyRenderPass, nullptr);
+                        vkDestroyRenderPass(application.logicalDevice, gpuCull.lateRenderPass, nullptr);
+                        gpuCull.earlyRenderPass = createColourRenderPass(application, ColourPass::Early);
+                        gpuCull.lateRenderPass = createColourRenderPass(application, ColourPass::Late);
+                    }
                 }
 
                 // Destroy the old framebuffers
@@ -761,9 +1402,17 @@ int main() {
                     vkDestroyImageView(application.logicalDevice, depthBuffer.imageView, nullptr);
                     depthBuffer = utility::createImageSet(application, allocator, 
                         VK_FORMAT_D32_SFLOAT,
-                        VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, 
+                        VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, 
                         VK_IMAGE_ASPECT_DEPTH_BIT, 
                         application.swapchainExtent);
+
+                    // The depth pyramid matches the depth buffer
+                    if (depthPyramid) {
+                        depthPyramid->resize(depthBuffer.imageView, application.swapchainExtent);
+                        for (FrameResources& frame : frames) {
+                            updatePyramidDescriptor(application, frame.cullDescriptorSet, *depthPyramid);
+                        }
+                    }
                 
                     // Remake the full screen buffer
                     vmaDestroyImage(allocator, fullscreenBuffer.image, fullscreenBuffer.allocation);
@@ -784,8 +1433,22 @@ int main() {
                         VK_IMAGE_ASPECT_DEPTH_BIT,
                         shadowExtent
                     );
+                    shadowCache.invalidate();
                 }
                 
+                // The static commands draw to the old framebuffers and pipelines, nothing is using them after waiting for idle
+                staticCommandsRecorded = false;
+                imageFences.assign(application.swapchainImages.size(), VK_NULL_HANDLE);
+
+                // The number of swapchain images may have changed
+                for (size_t i = 0; i < renderHasFinished.size(); i++) {
+                    vkDestroySemaphore(application.logicalDevice, renderHasFinished[i], nullptr);
+                }
+                renderHasFinished.clear();
+                for (size_t i = 0; i < application.swapchainImageViews.size(); i++) {
+                    renderHasFinished.emplace_back(utility::createSemaphore(application, 0));
+                }
+
                 // Remake the framebuffers
                 for (size_t i = 0; i < application.swapchainImageViews.size(); i++) {
                     // Get the attatchments
@@ -823,13 +1486,13 @@ int main() {
                     vkDestroyPipeline(application.logicalDevice, shadowPipeline, nullptr);
                     // Remake pipeline
                     pipeline = createPipeline(application, pipelineLayout, renderPassColour,
-                        colourVertexShader, colourFragmentShader);
+                        colourVertexShader, colourFragmentShader, options.vertexFormat);
                     alphaPipeline = createPipeline(application, pipelineLayout, renderPassColour,
-                        colourVertexShader, alphaFragmentShader, true);
+                        colourVertexShader, alphaFragmentShader, options.vertexFormat, true);
                     fullscreenPipeline = createFullscreenPipeline(application, fullscreenPipelineLayout, renderPassFullscreen, 
                         fullscreenVertexShader, fullscreenFragmentShader);
                     shadowPipeline = createShadowPipeline(application, shadowPipelineLayout, renderPassShadows, 
-                        shadowVertexShader, shadowFragmentShader);
+                        shadowVertexShader, shadowFragmentShader, options.vertexFormat);
                 
                     // Refresh the descriptor sets
                     frameBufferDescriptorSet = createFramebufferDescriptorSet(application, descriptorPool,
@@ -853,111 +1516,426 @@ int main() {
 
             }
 
-            // Get the next image in the swapchain to use
-            std::uint32_t nextImageIndex = 0;
-            auto const nextImageSuccess = vkAcquireNextImageKHR(application.logicalDevice, application.swapchain,
-                std::numeric_limits<std::uint64_t>::max(), imageIsReady, VK_NULL_HANDLE, 
-                &nextImageIndex);
+            FrameResources& frame = frames[currentFrame];
 
-            // Check to see if a deadlock has occured
-            if (VK_SUBOPTIMAL_KHR == nextImageSuccess || VK_ERROR_OUT_OF_DATE_KHR == nextImageSuccess) {
-                resizeWindow = true;
-                continue;
+            // Update the world view uniform
+            WorldView worldViewUniform;
+            float screenAspect = float(application.swapchainExtent.width) / float(application.swapchainExtent.height);
+            updateWorldUniforms(worldViewUniform, screenAspect, playerCamera);
+
+            // Cull the meshes outside of the camera's view, their meshlets are culled as they are drawn
+            // With GPU culling the meshes are culled by the culling shader instead
+            culling::ClusterView cameraClusterView = culling::createClusterView(worldViewUniform.projectionCameraMatrix,
+                worldViewUniform.cameraPosition, glm::radians(CAMERA_FOV), float(application.swapchainExtent.height), CLUSTER_MIN_PIXELS);
+            if (!gpuCulling && !staticScene) {
+                profiling::CpuScope scope(profiler, "Cull");
+                culling::cullMeshes(cameraClusterView.frustum, meshBounds, visibleMeshes);
+                culling::cullMeshes(cameraClusterView.frustum, alphaMeshBounds, visibleAlphaMeshes);
+
+                // The occluders are rasterised and the meshes tested while this thread waits for the GPU
+                if (occlusionCulling) {
+                    occlusionCulling->begin(worldViewUniform.projectionCameraMatrix, worldViewUniform.cameraPosition,
+                        visibleMeshes, visibleAlphaMeshes);
+                }
+            }
+
+            // Wait for the GPU to finish the last frame that used these resources
+            {
+                profiling::CpuScope scope(profiler, "Wait for frame");
+                if (vkWaitForFences(application.logicalDevice, 1, &frame.inFlight, VK_TRUE, std::numeric_limits<std::uint64_t>::max()) != VK_SUCCESS) {
+                    throw std::runtime_error("Fence buffer timed out.");
+                }
             }
-            if (nextImageSuccess != VK_SUCCESS) {
-                throw std::runtime_error("Failed to get next swapchain image");
+
+            // The last frame recorded with these resources has finished so its secondary command buffers can be reused
+            if (frame.recorder) {
+                frame.recorder->reset();
+            }
+
+            // Static commands hold no timings so nothing resets the queries, the CPU times of the last frame are collected here
+            if (staticScene) {
+                profiler.collectTimings();
             }
 
-            // Wait for the command buffer
-            if (vkWaitForFences(application.logicalDevice, 1, &fences[nextImageIndex], VK_TRUE, std::numeric_limits<std::uint64_t>::max()) != VK_SUCCESS) {
-                throw std::runtime_error("Fence buffer timed out.");
+            // The last frame culled on the GPU with these resources has finished so its counts can be read
+            if (frame.statsWritten) {
+                void* data = nullptr;
+                if (vmaMapMemory(allocator, frame.statsBuffer.allocation, &data) != VK_SUCCESS) {
+                    throw std::runtime_error("Failed to map the culling stats buffer.");
+                }
+                vmaInvalidateAllocation(allocator, frame.statsBuffer.allocation, 0, VK_WHOLE_SIZE);
+                const std::uint32_t* counts = static_cast<const std::uint32_t*>(data);
+                profiler.addCounter("Occluded draws", counts[indirect::OCCLUDED_DRAWS_COUNT]);
+                profiler.addCounter("Occluded triangles", counts[indirect::OCCLUDED_TRIANGLES_COUNT]);
+                vmaUnmapMemory(allocator, frame.statsBuffer.allocation);
+                frame.statsWritten = false;
             }
-            // Reset the fence for the next iteration
-            if (vkResetFences(application.logicalDevice, 1, &fences[nextImageIndex]) != VK_SUCCESS) {
+
+            // The last frame rendered with these resources has finished so its image can be written out
+            if (frame.readbackFrame >= 0) {
+                writeReadbackImage(allocator, frame.readbackBuffer, application.swapchainExtent, application.swapchainFormat,
+                    getFramePath(options, std::uint32_t(frame.readbackFrame)));
+                frame.readbackFrame = -1;
+            }
+
+            // Get the next image in the swapchain to use (headless always uses the one offscreen image)
+            std::uint32_t nextImageIndex = 0;
+            VkResult nextImageSuccess = VK_SUCCESS;
+            if (!application.headless) {
+                profiling::CpuScope scope(profiler, "Acquire");
+                nextImageSuccess = vkAcquireNextImageKHR(application.logicalDevice, application.swapchain,
+                    std::numeric_limits<std::uint64_t>::max(), frame.imageIsReady, VK_NULL_HANDLE,
+                    &nextImageIndex);
+
+                // Out of date images are not acquired so the semaphore is left unsignalled
+                // Suboptimal images are acquired so the frame is still rendered before resizing
+                if (VK_ERROR_OUT_OF_DATE_KHR == nextImageSuccess) {
+                    resizeWindow = true;
+                    continue;
+                }
+                if (nextImageSuccess != VK_SUCCESS && nextImageSuccess != VK_SUBOPTIMAL_KHR) {
+                    throw std::runtime_error("Failed to get next swapchain image");
+                }
+            }
+
+            // The image's static commands and world uniform may still be in use by the last frame that drew it
+            if (staticScene) {
+                if (imageFences[nextImageIndex] != VK_NULL_HANDLE && imageFences[nextImageIndex] != frame.inFlight) {
+                    profiling::CpuScope scope(profiler, "Wait for image");
+                    if (vkWaitForFences(application.logicalDevice, 1, &imageFences[nextImageIndex], VK_TRUE, std::numeric_limits<std::uint64_t>::max()) != VK_SUCCESS) {
+                        throw std::runtime_error("Fence buffer timed out.");
+                    }
+                }
+                imageFences[nextImageIndex] = frame.inFlight;
+            }
+
+            // Reset the fence only once work is certain to be submitted with it
+            if (vkResetFences(application.logicalDevice, 1, &frame.inFlight) != VK_SUCCESS) {
                 throw std::runtime_error("Fence buffer couldn't be reset.");
             }
             
-            // Update the world view uniform
-            WorldView worldViewUniform;
-            float screenAspect = float(application.swapchainExtent.width) / float(application.swapchainExtent.height);
-            updateWorldUniforms(worldViewUniform, screenAspect, playerCamera);
+            // Hide the meshes behind others, started before waiting on the GPU so the two overlap
+            if (occlusionCulling) {
+                profiling::CpuScope scope(profiler, "Occlusion cull");
+                std::uint32_t hiddenMeshes = occlusionCulling->finish(visibleMeshes, visibleAlphaMeshes);
+                profiler.addCpuCounter("Occluded meshes", hiddenMeshes);
+            }
 
-            // Record commands
-            recordCommands(
-                commandBuffers[nextImageIndex],
-                worldUniformBuffer.buffer,
-                worldViewUniform,
-                renderPassColour,
-                colourFramebuffer,
-                renderPassFullscreen,
-                swapchainFramebuffers[nextImageIndex],
-                renderPassShadows,
-                shadowFramebuffer,
-                renderArea,
-                shadowRenderArea,
-                pipeline,
-                alphaPipeline,
-                fullscreenPipeline,
-                shadowPipeline,
-                pipelineLayout,
-                fullscreenPipelineLayout,
-                shadowPipelineLayout,
-                worldDescriptorSet,
-                bindlessTextureDescriptorSet,
-                lightDescriptorSet,
-                frameBufferDescriptorSet,
-                shadowDescriptorSet,
-                meshes,
-                alphaMeshes,
-                meshOffsets,
-                fbxScene.materials
-            );
+            // Sort the visible meshes by pipeline then front to back, the GPU culling draws in its own order
+            // and static scenes sort once when their commands are recorded
+            model::LodView const cameraLodView = model::createLodView(worldViewUniform.cameraPosition, glm::radians(CAMERA_FOV),
+                float(application.swapchainExtent.height), LOD_PIXEL_ERROR);
+            if (!gpuCulling && !staticScene) {
+                colourDraws.clear();
+                profiling::CpuScope scope(profiler, "Sort draws");
+                sorting::appendSortKeys(sorting::Pass::Colour, sorting::Pipeline::Opaque, worldViewUniform.cameraPosition,
+                    meshBounds, visibleMeshes, colourDraws);
+                sorting::appendSortKeys(sorting::Pass::Colour, sorting::Pipeline::Alpha, worldViewUniform.cameraPosition,
+                    alphaMeshBounds, visibleAlphaMeshes, colourDraws);
+                sorting::radixSort(colourDraws, sortScratch, jobs::shared());
+
+                // The visible instances of each submesh and level are drawn together
+                batchColourDraws(cameraLodView);
+                writeVisibleInstances(frame);
+            }
+
+            // The world and lighting uniforms are written in the same order every frame, so a ring that has just been
+            // reset hands out the same offsets every time (which the static commands are recorded with)
+            auto writeUniforms = [&](uniforms::UniformRing& ring, std::uint32_t& worldOffset, std::uint32_t& lightingOffset) {
+                ring.reset();
+                worldOffset = ring.push(worldViewUniform);
+                lightingOffset = ring.push(lights[0]);
+                ring.flush();
+            };
+
+            // Record the static shadow pass when the shadow map is out of date or its framebuffer has been remade
+            bool submitStaticShadows = false;
+            if (staticScene && (shadowCache.needsRender(lights[0].lightDirectionMatrix, shadowMeshes) || !staticCommandsRecorded)) {
+                profiling::CpuScope scope(profiler, "Record static shadows");
+                if (staticShadows.commandBuffer == VK_NULL_HANDLE) {
+                    staticShadows.commandBuffer = utility::createCommandBuffer(application, commandPool);
+                    staticShadows.uniformRing = std::make_unique<uniforms::UniformRing>(application, allocator, UNIFORM_RING_SIZE);
+                    staticShadows.lightingDescriptorSet = createBufferDescriptorSet(application, descriptorPool, lightDescriptorSetLayout,
+                        staticShadows.uniformRing->buffer(), VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, sizeof(LightingData));
+                    staticShadows.recorder = std::make_unique<recording::ParallelRecorder>(application, jobs::shared());
+                    createInstanceResources(staticShadows);
+                }
+                else {
+                    // Frames in flight may still be reading the old commands, uniforms or shadow map
+                    vkDeviceWaitIdle(application.logicalDevice);
+                }
+
+                std::uint32_t worldOffset = 0;
+                std::uint32_t lightingOffset = 0;
+                writeUniforms(*staticShadows.uniformRing, worldOffset, lightingOffset);
+                staticShadows.recorder->reset();
+                visibleInstances = shadowInstances;
+                writeVisibleInstances(staticShadows);
+
+                VkCommandBufferBeginInfo recordInfo{};
+                recordInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+                recordInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+                if (vkBeginCommandBuffer(staticShadows.commandBuffer, &recordInfo) != VK_SUCCESS) {
+                    throw std::runtime_error("Failed to start command buffer recording.");
+                }
+                recordShadowPass(staticShadows.commandBuffer, renderPassShadows, shadowFramebuffer, shadowRenderArea,
+                    shadowPipeline, shadowPipelineLayout, staticShadows.lightingDescriptorSet, lightingOffset,
+                    meshes, geometryPool, shadowBatches, shadowClusterView, staticShadows, nullptr);
+                if (vkEndCommandBuffer(staticShadows.commandBuffer) != VK_SUCCESS) {
+                    throw std::runtime_error("Failed to record to the command buffer.");
+                }
+                submitStaticShadows = true;
+            }
 
-            // Submit commands
-            submitCommands(application, commandBuffers[nextImageIndex], imageIsReady, renderHasFinished, fences[nextImageIndex]);
+            // Record every image's commands, drawing every mesh at full detail as the camera is not known
+            if (staticScene && !staticCommandsRecorded) {
+                profiling::CpuScope scope(profiler, "Record static");
+
+                // Images added by a remade swapchain get their own resources, the descriptor pool never frees sets so
+                // the resources of images that went away are kept for if they come back
+                while (staticImages.size() < application.swapchainImages.size()) {
+                    FrameResources& image = staticImages.emplace_back();
+                    image.commandBuffer = utility::createCommandBuffer(application, commandPool);
+                    image.uniformRing = std::make_unique<uniforms::UniformRing>(application, allocator, UNIFORM_RING_SIZE);
+                    image.worldDescriptorSet = createBufferDescriptorSet(application, descriptorPool, worldDescriptorSetLayout,
+                        image.uniformRing->buffer(), VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, sizeof(WorldView));
+                    image.lightingDescriptorSet = createBufferDescriptorSet(application, descriptorPool, lightDescriptorSetLayout,
+                        image.uniformRing->buffer(), VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, sizeof(LightingData));
+                    image.recorder = std::make_unique<recording::ParallelRecorder>(application, jobs::shared(), true);
+                    createInstanceResources(image);
+                }
 
-            // Wait for commands to be submitted
-            if (vkWaitForFences(application.logicalDevice, 1, &fences[nextImageIndex], VK_TRUE, std::numeric_limits<std::uint64_t>::max()) != VK_SUCCESS) {
-                throw std::runtime_error("Fence buffer timed out.");
+                // Every mesh is drawn, sorted front to back from where the camera is now
+                visibleMeshes.resize(meshes.size());
+                for (std::uint32_t i = 0; i < visibleMeshes.size(); i++) {
+                    visibleMeshes[i] = i;
+                }
+                visibleAlphaMeshes.resize(alphaMeshes.size());
+                for (std::uint32_t i = 0; i < visibleAlphaMeshes.size(); i++) {
+                    visibleAlphaMeshes[i] = i;
+                }
+                colourDraws.clear();
+                sorting::appendSortKeys(sorting::Pass::Colour, sorting::Pipeline::Opaque, worldViewUniform.cameraPosition,
+                    meshBounds, visibleMeshes, colourDraws);
+                sorting::appendSortKeys(sorting::Pass::Colour, sorting::Pipeline::Alpha, worldViewUniform.cameraPosition,
+                    alphaMeshBounds, visibleAlphaMeshes, colourDraws);
+                sorting::radixSort(colourDraws, sortScratch, jobs::shared());
+
+                // No error is small enough to coarsen any mesh
+                model::LodView fullDetail;
+                fullDetail.threshold = 0.f;
+                batchColourDraws(fullDetail);
+
+                // The shadow map is drawn by the static shadow commands so the images only sample it
+                for (std::size_t i = 0; i < application.swapchainImages.size(); i++) {
+                    FrameResources& image = staticImages[i];
+                    std::uint32_t worldOffset = 0;
+                    std::uint32_t lightingOffset = 0;
+                    writeUniforms(*image.uniformRing, worldOffset, lightingOffset);
+                    image.recorder->reset();
+                    writeVisibleInstances(image);
+                    recordCommands(
+                        image.commandBuffer,
+                        worldViewUniform,
+                        worldOffset,
+                        lightingOffset,
+                        renderPassColour,
+                        colourFramebuffer,
+                        renderPassFullscreen,
+                        swapchainFramebuffers[i],
+                        renderPassShadows,
+                        shadowFramebuffer,
+                        renderArea,
+                        shadowRenderArea,
+                        pipeline,
+                        alphaPipeline,
+                        fullscreenPipeline,
+                        shadowPipeline,
+                        pipelineLayout,
+                        fullscreenPipelineLayout,
+                        shadowPipelineLayout,
+                        image.worldDescriptorSet,
+                        bindlessTextureDescriptorSet,
+                        image.lightingDescriptorSet,
+                        frameBufferDescriptorSet,
+                        shadowDescriptorSet,
+                        meshes,
+                        alphaMeshes,
+                        geometryPool,
+                        shadowBatches,
+                        opaqueBatches,
+                        alphaBatches,
+                        false,
+                        fullDetail,
+                        shadowLodView,
+                        culling::createUnculledView(),
+                        shadowClusterView,
+                        gpuCull,
+                        image,
+                        VK_NULL_HANDLE,
+                        VK_NULL_HANDLE,
+                        nullptr
+                    );
+                }
+                staticCommandsRecorded = true;
+            }
+
+            // Write the uniforms straight into the mapped ring, the last commands that read it have finished.
+            // Static commands read them from the ring of the image they draw to.
+            std::uint32_t worldOffset = 0;
+            std::uint32_t lightingOffset = 0;
+            {
+                profiling::CpuScope scope(profiler, "Update uniforms");
+                FrameResources& uniformFrame = staticScene ? staticImages[nextImageIndex] : frame;
+                writeUniforms(*uniformFrame.uniformRing, worldOffset, lightingOffset);
+            }
+
+            // Record commands
+            if (!staticScene) {
+                profiling::CpuScope scope(profiler, "Record");
+                recordCommands(
+                    frame.commandBuffer,
+                    worldViewUniform,
+                    worldOffset,
+                    lightingOffset,
+                    renderPassColour,
+                    colourFramebuffer,
+                    renderPassFullscreen,
+                    swapchainFramebuffers[nextImageIndex],
+                    renderPassShadows,
+                    shadowFramebuffer,
+                    renderArea,
+                    shadowRenderArea,
+                    pipeline,
+                    alphaPipeline,
+                    fullscreenPipeline,
+                    shadowPipeline,
+                    pipelineLayout,
+                    fullscreenPipelineLayout,
+                    shadowPipelineLayout,
+                    frame.worldDescriptorSet,
+                    bindlessTextureDescriptorSet,
+                    frame.lightingDescriptorSet,
+                    frameBufferDescriptorSet,
+                    shadowDescriptorSet,
+                    meshes,
+                    alphaMeshes,
+                    geometryPool,
+                    shadowBatches,
+                    opaqueBatches,
+                    alphaBatches,
+                    shadowCache.needsRender(lights[0].lightDirectionMatrix, shadowMeshes),
+                    cameraLodView,
+                    shadowLodView,
+                    cameraClusterView,
+                    shadowClusterView,
+                    gpuCull,
+                    frame,
+                    offscreenTarget.image,
+                    frame.readbackBuffer.buffer,
+                    &profiler
+                );
+                frame.statsWritten = gpuCulling;
+            }
+
+            // Submit commands, the fence is waited on when this frame's resources are next used
+            {
+                profiling::CpuScope scope(profiler, "Submit");
+                if (application.headless) {
+                    submitCommands(application, frame.commandBuffer, VK_NULL_HANDLE, VK_NULL_HANDLE, frame.inFlight);
+                    frame.readbackFrame = framesRendered;
+                }
+                else {
+                    // Submitted first so the image's commands sample the finished shadow map
+                    if (submitStaticShadows) {
+                        submitCommands(application, staticShadows.commandBuffer, VK_NULL_HANDLE, VK_NULL_HANDLE, VK_NULL_HANDLE);
+                    }
+                    VkCommandBuffer commandBuffer = staticScene ? staticImages[nextImageIndex].commandBuffer : frame.commandBuffer;
+                    submitCommands(application, commandBuffer, frame.imageIsReady, renderHasFinished[nextImageIndex], frame.inFlight);
+                }
+                profiler.markSubmitted();
             }
 
             // Present the image
-            resizeWindow = presentToScreen(application, renderHasFinished, nextImageIndex);
+            if (!application.headless) {
+                profiling::CpuScope scope(profiler, "Present");
+                resizeWindow = presentToScreen(application, renderHasFinished[nextImageIndex], nextImageIndex)
+                    || VK_SUBOPTIMAL_KHR == nextImageSuccess;
+            }
+            framesRendered++;
+
+            // T saves the recent frame timings
+            if (playerCamera.saveTrace) {
+                profiler.writeChromeTrace(paths::frameTracePath);
+                playerCamera.saveTrace = false;
+            }
+
+            // Move on to the next frame's resources
+            currentFrame = (currentFrame + 1) % FRAMES_IN_FLIGHT;
 
         }
 
         // Wait for the GPU to have finished all processes before cleanup
         vkDeviceWaitIdle(application.logicalDevice);
 
+        // Collect the timings of the frames still in flight and save the history
+        profiler.flush();
+        profiler.writeChromeTrace(paths::frameTracePath);
+
+        // Write out the headless frames that were still in flight (oldest first)
+        for (std::uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++) {
+            FrameResources& frame = frames[(currentFrame + i) % FRAMES_IN_FLIGHT];
+            if (frame.readbackFrame >= 0) {
+                writeReadbackImage(allocator, frame.readbackBuffer, application.swapchainExtent, application.swapchainFormat,
+                    getFramePath(options, std::uint32_t(frame.readbackFrame)));
+                frame.readbackFrame = -1;
+            }
+        }
+
         // Clean up and close the application
         // Destroy buffers
-        worldUniformBuffer.~BufferSet();
-        for (size_t i = 0; i < meshes.size(); i++) {
-            meshes[i].vertexPositions.~BufferSet();
-            meshes[i].vertexUVs.~BufferSet();
-            meshes[i].vertexNormals.~BufferSet();
-            meshes[i].vertexTangents.~BufferSet();
-            meshes[i].vertexMaterials.~BufferSet();
-            meshes[i].indices.~BufferSet();
-        }
-        for (size_t i = 0; i < alphaMeshes.size(); i++) {
-            alphaMeshes[i].vertexPositions.~BufferSet();
-            alphaMeshes[i].vertexUVs.~BufferSet();
-            alphaMeshes[i].vertexNormals.~BufferSet();
-            alphaMeshes[i].vertexTangents.~BufferSet();
-            alphaMeshes[i].vertexMaterials.~BufferSet();
-            alphaMeshes[i].indices.~BufferSet();
-        }
-        lightingUniformBuffer.~BufferSet();
+        for (size_t i = 0; i < frames.size(); i++) {
+            frames[i].uniformRing->cleanup();
+            frames[i].readbackBuffer.~BufferSet();
+            frames[i].visibleInstances.~BufferSet();
+            frames[i].drawCommands.~BufferSet();
+            frames[i].drawCounts.~BufferSet();
+            frames[i].statsBuffer.~BufferSet();
+            if (frames[i].recorder) {
+                frames[i].recorder->cleanup();
+            }
+        }
+        for (FrameResources& image : staticImages) {
+            image.uniformRing->cleanup();
+            image.visibleInstances.~BufferSet();
+            image.recorder->cleanup();
+        }
+        if (staticShadows.recorder) {
+            staticShadows.uniformRing->cleanup();
+            staticShadows.visibleInstances.~BufferSet();
+            staticShadows.recorder->cleanup();
+        }
+        geometryPool.cleanup();
+        drawDataBuffer.~BufferSet();
+        commandTemplateBuffer.~BufferSet();
+        instanceBuffer.~BufferSet();
+        visibilityBuffer.~BufferSet();
+        if (depthPyramid) {
+            depthPyramid->cleanup();
+        }
         
         // Destroy command related components
         vkDestroyDescriptorPool(application.logicalDevice, descriptorPool, nullptr);
-        vkDestroySemaphore(application.logicalDevice, renderHasFinished, nullptr);
-        vkDestroySemaphore(application.logicalDevice, imageIsReady, nullptr);
+        for (size_t i = 0; i < renderHasFinished.size(); i++) {
+            vkDestroySemaphore(application.logicalDevice, renderHasFinished[i], nullptr);
+        }
+        for (size_t i = 0; i < frames.size(); i++) {
+            vkDestroySemaphore(application.logicalDevice, frames[i].imageIsReady, nullptr);
+            vkDestroyFence(application.logicalDevice, frames[i].inFlight, nullptr);
+        }
         vkDestroyCommandPool(application.logicalDevice, commandPool, nullptr);
         for (size_t i = 0; i < swapchainFramebuffers.size(); i++) {
             vkDestroyFramebuffer(application.logicalDevice, swapchainFramebuffers[i], nullptr);
-            vkDestroyFence(application.logicalDevice, fences[i], nullptr);
         }
 
         // Destroy image related components
@@ -969,6 +1947,10 @@ int main() {
         vkDestroyImageView(application.logicalDevice, fullscreenBuffer.imageView, nullptr);
         vmaDestroyImage(allocator, depthBuffer.image, depthBuffer.allocation);
         vkDestroyImageView(application.logicalDevice, depthBuffer.imageView, nullptr);
+        if (application.headless) {
+            vmaDestroyImage(allocator, offscreenTarget.image, offscreenTarget.allocation);
+            vkDestroyImageView(application.logicalDevice, offscreenTarget.imageView, nullptr);
+        }
         for (size_t i = 0; i < colourTextures.size(); i++) {
             vmaDestroyImage(allocator, colourTextures[i].image, colourTextures[i].allocation);
             vkDestroyImageView(application.logicalDevice, colourTextures[i].imageView, nullptr);
@@ -987,6 +1969,7 @@ int main() {
         vkDestroyPipeline(application.logicalDevice, alphaPipeline, nullptr);
         vkDestroyPipeline(application.logicalDevice, fullscreenPipeline, nullptr);
         vkDestroyPipeline(application.logicalDevice, shadowPipeline, nullptr);
+        vkDestroyPipeline(application.logicalDevice, gpuCull.pipeline, nullptr);
         vkDestroyShaderModule(application.logicalDevice, colourVertexShader, nullptr);
         vkDestroyShaderModule(application.logicalDevice, colourFragmentShader, nullptr);
         vkDestroyShaderModule(application.logicalDevice, alphaFragmentShader, nullptr);
@@ -994,9 +1977,11 @@ int main() {
         vkDestroyShaderModule(application.logicalDevice, fullscreenFragmentShader, nullptr);
         vkDestroyShaderModule(application.logicalDevice, shadowVertexShader, nullptr);
         vkDestroyShaderModule(application.logicalDevice, shadowFragmentShader, nullptr);
+        vkDestroyShaderModule(application.logicalDevice, cullComputeShader, nullptr);
         vkDestroyPipelineLayout(application.logicalDevice, pipelineLayout, nullptr);
         vkDestroyPipelineLayout(application.logicalDevice, fullscreenPipelineLayout, nullptr);
         vkDestroyPipelineLayout(application.logicalDevice, shadowPipelineLayout, nullptr);
+        vkDestroyPipelineLayout(application.logicalDevice, cullPipelineLayout, nullptr);
 
         // Destroy descriptor set layouts
         vkDestroyDescriptorSetLayout(application.logicalDevice, worldDescriptorSetLayout, nullptr);
@@ -1004,16 +1989,23 @@ int main() {
         vkDestroyDescriptorSetLayout(application.logicalDevice, lightDescriptorSetLayout, nullptr);
         vkDestroyDescriptorSetLayout(application.logicalDevice, fullscreenDescriptorSetLayout, nullptr);
         vkDestroyDescriptorSetLayout(application.logicalDevice, shadowDescriptorSetLayout, nullptr);
+        vkDestroyDescriptorSetLayout(application.logicalDevice, instanceDescriptorSetLayout, nullptr);
+        vkDestroyDescriptorSetLayout(application.logicalDevice, cullDescriptorSetLayout, nullptr);
 
         // Destroy Renderpass
         vkDestroyRenderPass(application.logicalDevice, renderPassColour, nullptr);
         vkDestroyRenderPass(application.logicalDevice, renderPassFullscreen, nullptr);
         vkDestroyRenderPass(application.logicalDevice, renderPassShadows, nullptr);
+        vkDestroyRenderPass(application.logicalDevice, gpuCull.earlyRenderPass, nullptr);
+        vkDestroyRenderPass(application.logicalDevice, gpuCull.lateRenderPass, nullptr);
 
         // Destroy frame buffers
         vkDestroyFramebuffer(application.logicalDevice, colourFramebuffer, nullptr);
         vkDestroyFramebuffer(application.logicalDevice, shadowFramebuffer, nullptr);
         
+        // Destroy the timestamp queries
+        profiler.cleanup();
+
         // Destroy memory
         vmaDestroyAllocator(allocator);
 
@@ -1041,6 +2033,11 @@ namespace {
             glfwSetWindowShouldClose(window, GLFW_TRUE);
         }
 
+        // T key saves the recent frame timings as a trace
+        if (key == GLFW_KEY_T && action == GLFW_PRESS) {
+            camera->saveTrace = true;
+        }
+
         bool keyState = action;
         glm::vec3 movement = glm::vec3(0,0,0);
 
@@ -1169,15 +2166,21 @@ namespace {
         subpasses[0].pDepthStencilAttachment = &depthAttachment;
 
         // Set the dependencies of each subpass
-        VkSubpassDependency subpassDependencies[1]{};
-        // For the depth
-        subpassDependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+        VkSubpassDependency subpassDependencies[2]{};
+        // For the depth (the previous frame in flight may still be sampling the shadow map)
         subpassDependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
         subpassDependencies[0].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-        subpassDependencies[0].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+        subpassDependencies[0].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
         subpassDependencies[0].dstSubpass = 0;
         subpassDependencies[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
         subpassDependencies[0].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+        // For the colour pass sampling the shadow map
+        subpassDependencies[1].srcSubpass = 0;
+        subpassDependencies[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        subpassDependencies[1].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+        subpassDependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+        subpassDependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        subpassDependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
 
         // Combine all the data to create the renderpass info
         VkRenderPassCreateInfo renderPassInfo{};
@@ -1186,7 +2189,7 @@ namespace {
         renderPassInfo.pAttachments = attachments;
         renderPassInfo.subpassCount = 1;
         renderPassInfo.pSubpasses = subpasses;
-        renderPassInfo.dependencyCount = 1;
+        renderPassInfo.dependencyCount = 2;
         renderPassInfo.pDependencies = subpassDependencies;
 
         // Create the renderpass
@@ -1198,7 +2201,7 @@ namespace {
         return renderPass;
     }
 
-    VkRenderPass createColourRenderPass(app::AppContext& app) {
+    VkRenderPass createColourRenderPass(app::AppContext& app, ColourPass pass) {
         // Define the attatchments of the render pass
         // The swapchain attatchment
         VkAttachmentDescription attachments[2]{};
@@ -1216,6 +2219,18 @@ namespace {
         attachments[1].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
         attachments[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
+        // The early half hands its depth to the depth pyramid, the late half picks up where it left off
+        if (pass == ColourPass::Early) {
+            attachments[0].finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+            attachments[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+        }
+        else if (pass == ColourPass::Late) {
+            attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+            attachments[0].initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+            attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+            attachments[1].initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+        }
+
         // Define the attatchment propeties for a subpass
         VkAttachmentReference colourAttachment{};
         // Colour part of subpass using attatchment 0
@@ -1234,12 +2249,11 @@ namespace {
         subpasses[0].pDepthStencilAttachment = &depthAttachment;
 
         // Set the dependencies of each subpass
-        VkSubpassDependency subpassDependencies[2]{};
-        // For the colour
-        subpassDependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+        VkSubpassDependency subpassDependencies[3]{};
+        // For the colour (the previous frame in flight may still be sampling the colour buffer)
         subpassDependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
         subpassDependencies[0].srcAccessMask = 0;
-        subpassDependencies[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        subpassDependencies[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
         subpassDependencies[0].dstSubpass = 0;
         subpassDependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
         subpassDependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
@@ -1251,6 +2265,29 @@ namespace {
         subpassDependencies[1].dstSubpass = 0;
         subpassDependencies[1].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
         subpassDependencies[1].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+        // For the fullscreen pass sampling the colour buffer
+        subpassDependencies[2].srcSubpass = 0;
+        subpassDependencies[2].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        subpassDependencies[2].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        subpassDependencies[2].dstSubpass = VK_SUBPASS_EXTERNAL;
+        subpassDependencies[2].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        subpassDependencies[2].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+
+        if (pass == ColourPass::Early) {
+            // For the depth pyramid reading the depth and the late half drawing over the colour
+            subpassDependencies[2].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+            subpassDependencies[2].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+            subpassDependencies[2].dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+            subpassDependencies[2].dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        }
+        else if (pass == ColourPass::Late) {
+            // For the colour and depth drawn by the early half, the depth pyramid has finished reading the depth
+            subpassDependencies[0].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+            subpassDependencies[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+            subpassDependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+            subpassDependencies[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+            subpassDependencies[1].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+        }
 
         // Combine all the data to create the renderpass info
         VkRenderPassCreateInfo renderPassInfo{};
@@ -1259,7 +2296,7 @@ namespace {
         renderPassInfo.pAttachments = attachments;
         renderPassInfo.subpassCount = 1;
         renderPassInfo.pSubpasses = subpasses;
-        renderPassInfo.dependencyCount = 2;
+        renderPassInfo.dependencyCount = 3;
         renderPassInfo.pDependencies = subpassDependencies;
 
         // Create the renderpass
@@ -1280,7 +2317,8 @@ namespace {
         attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
         attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
         attachments[0].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        attachments[0].finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+        // Headless renders are copied back to the host instead of presented
+        attachments[0].finalLayout = app.headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
         // Define the attatchment propeties for a subpass
         VkAttachmentReference colourAttachment{};
@@ -1295,8 +2333,8 @@ namespace {
         subpasses[0].pColorAttachments = &colourAttachment;
 
         // Set the dependencies of each subpass
-        VkSubpassDependency subpassDependencies[1]{};
-        // For the colour
+        VkSubpassDependency subpassDependencies[2]{};
+        // For the colour (headless frames share one image so also wait for the previous copy out of it)
         subpassDependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
         subpassDependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
         subpassDependencies[0].srcAccessMask = 0;
@@ -1304,6 +2342,17 @@ namespace {
         subpassDependencies[0].dstSubpass = 0;
         subpassDependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
         subpassDependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        if (app.headless) {
+            subpassDependencies[0].dependencyFlags = 0;
+            subpassDependencies[0].srcStageMask |= VK_PIPELINE_STAGE_TRANSFER_BIT;
+        }
+        // For the copy back to the host (headless only)
+        subpassDependencies[1].srcSubpass = 0;
+        subpassDependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        subpassDependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        subpassDependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+        subpassDependencies[1].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        subpassDependencies[1].dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
 
         // Combine all the data to create the renderpass info
         VkRenderPassCreateInfo renderPassInfo{};
@@ -1312,7 +2361,7 @@ namespace {
         renderPassInfo.pAttachments = attachments;
         renderPassInfo.subpassCount = 1;
         renderPassInfo.pSubpasses = subpasses;
-        renderPassInfo.dependencyCount = 1;
+        renderPassInfo.dependencyCount = app.headless ? 2 : 1;
         renderPassInfo.pDependencies = subpassDependencies;
 
         // Create the renderpass
@@ -1330,8 +2379,9 @@ namespace {
         // All data passed into the shaders must have a binding
         int const numberOfBindings = 1;
         VkDescriptorSetLayoutBinding bindings[numberOfBindings]{};
+        // Read from the frame's uniform ring at a dynamic offset
         bindings[0].binding = 0;
-        bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
         bindings[0].descriptorCount = 1;
         bindings[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
 
@@ -1398,9 +2448,9 @@ namespace {
         //bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
         //bindings[0].descriptorCount = 1;         // MAX NUMBER OF BINDINGS
         //bindings[0].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-        // Lighting data
+        // Lighting data, read from the frame's uniform ring at a dynamic offset
         bindings[0].binding = 0;
-        bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
         bindings[0].descriptorCount = 1;         // MAX NUMBER OF LIGHTS
         bindings[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
 
@@ -1473,16 +2523,72 @@ namespace {
         return descriptorSetLayout;
     }
 
+    VkDescriptorSetLayout createStorageDescriptorSetLayout(app::AppContext& app, std::uint32_t bindingCount,
+        VkShaderStageFlags stageFlags) {
+        // One storage buffer per binding
+        std::vector<VkDescriptorSetLayoutBinding> bindings(bindingCount);
+        for (std::uint32_t i = 0; i < bindingCount; i++) {
+            bindings[i].binding = i;
+            bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            bindings[i].descriptorCount = 1;
+            bindings[i].stageFlags = stageFlags;
+        }
+
+        // Set the info of the descriptor
+        VkDescriptorSetLayoutCreateInfo descriptorSetLayoutInfo{};
+        descriptorSetLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        descriptorSetLayoutInfo.bindingCount = bindingCount;
+        descriptorSetLayoutInfo.pBindings = bindings.data();
+
+        VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+        if (vkCreateDescriptorSetLayout(app.logicalDevice, &descriptorSetLayoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create descriptor set layout");
+        }
+
+        return descriptorSetLayout;
+    }
+
+    VkDescriptorSetLayout createCullDescriptorSetLayout(app::AppContext& app) {
+        // The draws, commands, counts and visibility followed by the depth pyramid
+        VkDescriptorSetLayoutBinding bindings[5]{};
+        for (std::uint32_t i = 0; i < 5; i++) {
+            bindings[i].binding = i;
+            bindings[i].descriptorType = i < 4 ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            bindings[i].descriptorCount = 1;
+            bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        }
+
+        // Set the info of the descriptor
+        VkDescriptorSetLayoutCreateInfo descriptorSetLayoutInfo{};
+        descriptorSetLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        descriptorSetLayoutInfo.bindingCount = 5;
+        descriptorSetLayoutInfo.pBindings = bindings;
+
+        VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+        if (vkCreateDescriptorSetLayout(app.logicalDevice, &descriptorSetLayoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create descriptor set layout");
+        }
+
+        return descriptorSetLayout;
+    }
+
     VkPipelineLayout createPipelineLayout(app::AppContext& app, 
-        std::vector<VkDescriptorSetLayout> descriptorSetLayouts) {
+        std::vector<VkDescriptorSetLayout> descriptorSetLayouts, std::uint32_t pushConstantSize,
+        VkShaderStageFlags pushConstantStages) {
+
+        // Push constants are read by one shader stage
+        VkPushConstantRange pushConstantRange{};
+        pushConstantRange.stageFlags = pushConstantStages;
+        pushConstantRange.offset = 0;
+        pushConstantRange.size = pushConstantSize;
 
         // Set the info for the pipeline layout
         VkPipelineLayoutCreateInfo layoutInfo{};
         layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
         layoutInfo.setLayoutCount = descriptorSetLayouts.size();
         layoutInfo.pSetLayouts = descriptorSetLayouts.data();
-        layoutInfo.pushConstantRangeCount = 0;
-        layoutInfo.pPushConstantRanges = nullptr;
+        layoutInfo.pushConstantRangeCount = pushConstantSize > 0 ? 1 : 0;
+        layoutInfo.pPushConstantRanges = pushConstantSize > 0 ? &pushConstantRange : nullptr;
 
         VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
         if (vkCreatePipelineLayout(app.logicalDevice, &layoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
@@ -1527,7 +2633,7 @@ namespace {
 
     VkPipeline createPipeline(app::AppContext& app, VkPipelineLayout pipeLayout,
         VkRenderPass renderPass, VkShaderModule vertexShader, VkShaderModule fragmentShader,
-        bool isAlpha){
+        model::VertexFormat vertexFormat, bool isAlpha){
 
         // Detail the shader stages of the pipeline
         VkPipelineShaderStageCreateInfo shaderStages[2]{};
@@ -1541,7 +2647,7 @@ namespace {
         shaderStages[1].pName = "main";
 
         // Inputs into the vertex shader
-        VkVertexInputBindingDescription vertexInputs[5]{};
+        VkVertexInputBindingDescription vertexInputs[4]{};
         // Positions 3 floats
         vertexInputs[0].binding = 0;
         vertexInputs[0].stride = sizeof(float) * 3;
@@ -1558,13 +2664,9 @@ namespace {
         vertexInputs[3].binding = 3;
         vertexInputs[3].stride = sizeof(float) * 4;
         vertexInputs[3].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-        // Material ID 1 int
-        vertexInputs[4].binding = 4;
-        vertexInputs[4].stride = sizeof(uint32_t);
-        vertexInputs[4].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
 
-        // Attributes of the above inputs
-        VkVertexInputAttributeDescription vertexAttributes[5]{};
+        // Attributes of the above inputs (the material comes from the instance data)
+        VkVertexInputAttributeDescription vertexAttributes[4]{};
         // Positions
         vertexAttributes[0].binding = 0;
         vertexAttributes[0].location = 0;
@@ -1580,25 +2682,56 @@ namespace {
         vertexAttributes[2].location = 2;
         vertexAttributes[2].format = VK_FORMAT_R32G32B32_SFLOAT;
         vertexAttributes[2].offset = 0;
-        // Tangents
+        // Tangents (with the handedness in w)
         vertexAttributes[3].binding = 3;
         vertexAttributes[3].location = 3;
-        vertexAttributes[3].format = VK_FORMAT_R32G32B32_SFLOAT;
+        vertexAttributes[3].format = VK_FORMAT_R32G32B32A32_SFLOAT;
         vertexAttributes[3].offset = 0;
-        // Material ID
-        vertexAttributes[4].binding = 4;
-        vertexAttributes[4].location = 4;
-        vertexAttributes[4].format = VK_FORMAT_R8_SINT;
-        vertexAttributes[4].offset = 0;
 
         // Vertex shader info using the above descriptions
         VkPipelineVertexInputStateCreateInfo vertexInfo{};
         vertexInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-        vertexInfo.vertexBindingDescriptionCount = 5;
+        vertexInfo.vertexBindingDescriptionCount = 4;
         vertexInfo.pVertexBindingDescriptions = vertexInputs;
-        vertexInfo.vertexAttributeDescriptionCount = 5;
+        vertexInfo.vertexAttributeDescriptionCount = 4;
         vertexInfo.pVertexAttributeDescriptions = vertexAttributes;
 
+        // The packed format has two streams, the positions (read alone by the shadow pass) and the rest
+        if (vertexFormat == model::VertexFormat::Packed) {
+            // Quantised positions 4 shorts (the last is padding)
+            vertexInputs[0].binding = 0;
+            vertexInputs[0].stride = sizeof(model::PackedPosition);
+            vertexInputs[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+            // Texture coords, normals and tangents 10 bytes
+            vertexInputs[1].binding = 1;
+            vertexInputs[1].stride = sizeof(model::PackedSurface);
+            vertexInputs[1].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+            // Positions
+            vertexAttributes[0].binding = 0;
+            vertexAttributes[0].location = 0;
+            vertexAttributes[0].format = VK_FORMAT_R16G16B16A16_UINT;
+            vertexAttributes[0].offset = offsetof(model::PackedPosition, x);
+            // Texture coords
+            vertexAttributes[1].binding = 1;
+            vertexAttributes[1].location = 1;
+            vertexAttributes[1].format = VK_FORMAT_R16G16_SFLOAT;
+            vertexAttributes[1].offset = offsetof(model::PackedSurface, u);
+            // Octahedral normals
+            vertexAttributes[2].binding = 1;
+            vertexAttributes[2].location = 2;
+            vertexAttributes[2].format = VK_FORMAT_R16G16_SNORM;
+            vertexAttributes[2].offset = offsetof(model::PackedSurface, normalX);
+            // Octahedral tangents with the handedness
+            vertexAttributes[3].binding = 1;
+            vertexAttributes[3].location = 3;
+            vertexAttributes[3].format = VK_FORMAT_R8G8_SNORM;
+            vertexAttributes[3].offset = offsetof(model::PackedSurface, tangentX);
+
+            vertexInfo.vertexBindingDescriptionCount = 2;
+            vertexInfo.vertexAttributeDescriptionCount = 4;
+        }
+
         // Details about the topology of the input vertices
         VkPipelineInputAssemblyStateCreateInfo assemblyInfo{};
         assemblyInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
@@ -1790,7 +2923,8 @@ namespace {
     }
 
     VkPipeline createShadowPipeline(app::AppContext& app, VkPipelineLayout pipeLayout,
-        VkRenderPass renderPass, VkShaderModule vertexShader, VkShaderModule fragmentShader) {
+        VkRenderPass renderPass, VkShaderModule vertexShader, VkShaderModule fragmentShader,
+        model::VertexFormat vertexFormat) {
         
         // Detail the shader stages of the pipeline
         VkPipelineShaderStageCreateInfo shaderStages[2]{};
@@ -1818,6 +2952,12 @@ namespace {
         vertexAttributes[0].format = VK_FORMAT_R32G32B32_SFLOAT;
         vertexAttributes[0].offset = 0;
 
+        // Quantised positions, w is padding
+        if (vertexFormat == model::VertexFormat::Packed) {
+            vertexInputs[0].stride = sizeof(model::PackedPosition);
+            vertexAttributes[0].format = VK_FORMAT_R16G16B16A16_UINT;
+        }
+
         // Vertex shader info using the above descriptions
         VkPipelineVertexInputStateCreateInfo vertexInfo{};
         vertexInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
@@ -1900,6 +3040,27 @@ namespace {
         return pipeline;
     }
 
+    VkPipeline createCullPipeline(app::AppContext& app, VkPipelineLayout pipeLayout, VkShaderModule computeShader) {
+        // A compute pipeline only has the one shader stage
+        VkPipelineShaderStageCreateInfo shaderStage{};
+        shaderStage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        shaderStage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        shaderStage.module = computeShader;
+        shaderStage.pName = "main";
+
+        VkComputePipelineCreateInfo pipeInfo{};
+        pipeInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipeInfo.stage = shaderStage;
+        pipeInfo.layout = pipeLayout;
+
+        VkPipeline pipeline = VK_NULL_HANDLE;
+        if (vkCreateComputePipelines(app.logicalDevice, VK_NULL_HANDLE, 1, &pipeInfo, nullptr, &pipeline) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create compute pipeline.");
+        }
+
+        return pipeline;
+    }
+
     VkFramebuffer createFramebuffer(app::AppContext& app, VkRenderPass renderPass, std::vector<VkImageView>& buffers, uint32_t width, uint32_t height) {
         // Provides the information to create the framebuffer with
         VkFramebufferCreateInfo framebufferInfo{};
@@ -1967,17 +3128,23 @@ namespace {
 
     VkDescriptorPool createDescriptorPool(app::AppContext& app) {
         // How many different descriptors should be available
-        VkDescriptorPoolSize descriptorPoolSize[2];
+        VkDescriptorPoolSize descriptorPoolSize[4];
         // Uniform descriptors
         descriptorPoolSize[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
         descriptorPoolSize[0].descriptorCount = 1024;
         // Texture descriptors
         descriptorPoolSize[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
         descriptorPoolSize[1].descriptorCount = 1024;
+        // Storage buffer descriptors
+        descriptorPoolSize[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        descriptorPoolSize[2].descriptorCount = 64;
+        // Uniform ring descriptors
+        descriptorPoolSize[3].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        descriptorPoolSize[3].descriptorCount = 64;
 
         VkDescriptorPoolCreateInfo descriptorPoolInfo{};
         descriptorPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-        descriptorPoolInfo.poolSizeCount = 2;
+        descriptorPoolInfo.poolSizeCount = 4;
         descriptorPoolInfo.pPoolSizes = descriptorPoolSize;
         descriptorPoolInfo.maxSets = 2048;
         descriptorPoolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT;
@@ -2032,14 +3199,14 @@ namespace {
     }
 
     VkDescriptorSet createBufferDescriptorSet(app::AppContext& app, VkDescriptorPool pool, 
-        VkDescriptorSetLayout layout, VkBuffer& buffer, VkDescriptorType descriptorType) {
+        VkDescriptorSetLayout layout, VkBuffer buffer, VkDescriptorType descriptorType, VkDeviceSize range) {
         // Create the world descriptor set and fill with the information
         VkDescriptorSet descriptorSet = createDescriptorSet(app, pool, layout);
 
         // Buffer Info
         VkDescriptorBufferInfo bufferInfo{};
         bufferInfo.buffer = buffer;
-        bufferInfo.range = VK_WHOLE_SIZE;
+        bufferInfo.range = range;
 
         // Descritor info set up
         VkWriteDescriptorSet descriptor{};
@@ -2056,6 +3223,48 @@ namespace {
         return descriptorSet;
     }
 
+    VkDescriptorSet createStorageDescriptorSet(app::AppContext& app, VkDescriptorPool pool, VkDescriptorSetLayout layout,
+        const std::vector<VkBuffer>& buffers) {
+        VkDescriptorSet descriptorSet = createDescriptorSet(app, pool, layout);
+
+        // Each buffer is bound whole at the binding of its index
+        std::vector<VkDescriptorBufferInfo> bufferInfos(buffers.size());
+        std::vector<VkWriteDescriptorSet> descriptors(buffers.size());
+        for (std::size_t i = 0; i < buffers.size(); i++) {
+            bufferInfos[i].buffer = buffers[i];
+            bufferInfos[i].range = VK_WHOLE_SIZE;
+
+            descriptors[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptors[i].dstSet = descriptorSet;
+            descriptors[i].dstBinding = std::uint32_t(i);
+            descriptors[i].descriptorCount = 1;
+            descriptors[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            descriptors[i].pBufferInfo = &bufferInfos[i];
+        }
+
+        vkUpdateDescriptorSets(app.logicalDevice, std::uint32_t(descriptors.size()), descriptors.data(), 0, nullptr);
+
+        return descriptorSet;
+    }
+
+    void updatePyramidDescriptor(app::AppContext& app, VkDescriptorSet descriptorSet, const occlusion::DepthPyramid& depthPyramid) {
+        // The pyramid stays in the general layout
+        VkDescriptorImageInfo imageInfo{};
+        imageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        imageInfo.imageView = depthPyramid.view();
+        imageInfo.sampler = depthPyramid.sampler();
+
+        VkWriteDescriptorSet descriptor{};
+        descriptor.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptor.dstSet = descriptorSet;
+        descriptor.dstBinding = 4;
+        descriptor.descriptorCount = 1;
+        descriptor.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        descriptor.pImageInfo = &imageInfo;
+
+        vkUpdateDescriptorSets(app.logicalDevice, 1, &descriptor, 0, nullptr);
+    }
+
     VkDescriptorSet createBindlessImageDescriptorSet(app::AppContext& app, VkDescriptorPool pool, VkDescriptorSetLayout layout,
         std::vector<utility::ImageSet>& diffuseImages,
         std::vector<utility::ImageSet>& specularImages,
@@ -2118,7 +3327,7 @@ namespace {
 
     void updateWorldUniforms(WorldView& worldUniform, float screenAspect, CameraInfo& cameraInfo) {
         // Update the projection matrix
-        glm::mat4 projectionMatrix = glm::perspectiveRH_ZO(float(glm::radians(60.0f)), screenAspect, 0.1f, 100.0f);
+        glm::mat4 projectionMatrix = glm::perspectiveRH_ZO(float(glm::radians(CAMERA_FOV)), screenAspect, 0.1f, 100.0f);
         projectionMatrix[1][1] *= -1.f;
 
         // Update the camara matrix
@@ -2131,55 +3340,6 @@ namespace {
         worldUniform.cameraPosition = glm::vec3(cameraInfo.worldCameraMatrix[3]);
     }
 
-    void updateLightingUniforms(app::AppContext& app, VkBuffer lightingBuffer, LightingData lightData,
-        VkCommandPool commandPool) {
-        
-        // Create the command buffer
-        VkCommandBuffer commandBuffer = utility::createCommandBuffer(app, commandPool);
-
-        // Begin recording into the command buffer
-        VkCommandBufferBeginInfo recordInfo{};
-        recordInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-        if (vkBeginCommandBuffer(commandBuffer, &recordInfo) != VK_SUCCESS) {
-            throw std::runtime_error("Failed to start command buffer recording.");
-        }
-
-        // Place the data into the uniform buffer
-        vkCmdUpdateBuffer(commandBuffer, lightingBuffer, 0, sizeof(LightingData), &lightData);
-
-        // Transition to shader readable
-        utility::createBufferBarrier(lightingBuffer, VK_WHOLE_SIZE,
-            VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_UNIFORM_READ_BIT,
-            VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED,
-            commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT
-        );
-
-        // End the recording
-        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
-            throw std::runtime_error("Failed to end command buffer recording.");
-        }
-
-        // Use a fence to ensure that transfers are complete before moving on
-        VkFence submitComplete = utility::createFence(app);
-
-        // Submit the recorded commands for execution
-        VkSubmitInfo submitInfo{};
-        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-        submitInfo.commandBufferCount = 1;
-        submitInfo.pCommandBuffers = &commandBuffer;
-        if (vkQueueSubmit(app.graphicsQueue, 1, &submitInfo, submitComplete)) {
-            throw std::runtime_error("Failed to submit recorded commands.");
-        }
-
-        // Wait for the fence before clean up
-        if (vkWaitForFences(app.logicalDevice, 1, &submitComplete, VK_TRUE, std::numeric_limits<std::uint64_t>::max())) {
-            throw std::runtime_error("Fence failed to return as complete.");
-        }
-
-        vkFreeCommandBuffers(app.logicalDevice, commandPool, 1, &commandBuffer);
-        vkDestroyFence(app.logicalDevice, submitComplete, nullptr);
-    }
-
     void recreateSwapchain(app::AppContext& app) {
         // Wait for the device to idle
         vkDeviceWaitIdle(app.logicalDevice);
@@ -2204,7 +3364,8 @@ namespace {
 
     void recordCommands(
         VkCommandBuffer commandBuffer,                              // Command buffer
-        VkBuffer worldUniformBuffer, WorldView worldUniform,        // World Uniform
+        WorldView worldUniform,                                     // World Uniform
+        std::uint32_t worldOffset, std::uint32_t lightingOffset,    // Uniform ring offsets
         VkRenderPass renderPass, VkFramebuffer frameBuffer,         // Colour Render pass
         VkRenderPass fullRenderPass, VkFramebuffer swapFrameBuffer, // Full screen render pass
         VkRenderPass shadowRenderPass, VkFramebuffer shadowFrameBuffer, // Shadow render pass
@@ -2222,71 +3383,84 @@ namespace {
         VkDescriptorSet shadowDescriptorSet,                        // Shadow descriptor
         std::vector<model::Mesh>& meshes,                           // Mesh data
         std::vector<model::Mesh>& alphaMeshes,                      // Mesh data
-        std::vector<VkDeviceSize>& vertexOffsets,                   // Per vertex data
-        std::vector<fbx::Material>& materials                       // Material data
+        const model::GeometryPool& geometryPool,                    // Mesh data
+        const std::vector<model::InstanceBatch>& shadowBatches,     // Culling results
+        const std::vector<model::InstanceBatch>& opaqueBatches,     // Culling results
+        const std::vector<model::InstanceBatch>& alphaBatches,      // Culling results
+        bool renderShadows,                                         // Shadow caching
+        const model::LodView& cameraLodView,                        // Level of detail
+        const model::LodView& shadowLodView,                        // Level of detail
+        const culling::ClusterView& cameraClusterView,              // Meshlet culling
+        const culling::ClusterView& shadowClusterView,              // Meshlet culling
+        const GpuCulling& gpuCulling, const FrameResources& frame,  // GPU culling
+        VkImage readbackImage, VkBuffer readbackBuffer,             // Headless read back
+        profiling::FrameProfiler* profiler                          // GPU timings
     ) {
 
+        // Reused commands can not hold the timestamps of any one frame in flight
+        bool const reusable = profiler == nullptr;
+        auto beginScope = [&](const char* name) { return reusable ? 0u : profiler->beginGpuScope(commandBuffer, name); };
+        auto endScope = [&](std::uint32_t scope) {
+            if (!reusable) {
+                profiler->endGpuScope(commandBuffer, scope);
+            }
+        };
+
         // Set up and start the command buffer recording
         VkCommandBufferBeginInfo recordInfo{};
         recordInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-        recordInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        recordInfo.flags = reusable ? 0 : VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
         if (vkBeginCommandBuffer(commandBuffer, &recordInfo) != VK_SUCCESS) {
             throw std::runtime_error("Failed to start command buffer recording.");
         }
 
-        // Upload any uniforms that may have been updated
-        // Re-assign the usage of the buffer
-        utility::createBufferBarrier(worldUniformBuffer, VK_WHOLE_SIZE,
-            VK_ACCESS_UNIFORM_READ_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
-            VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED,
-            commandBuffer, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT
-        );
-        // Update
-        vkCmdUpdateBuffer(commandBuffer, worldUniformBuffer, 0, sizeof(WorldView), &worldUniform);
-        // Re-assign the usage of the buffer back to its original state
-        utility::createBufferBarrier(worldUniformBuffer, VK_WHOLE_SIZE,
-            VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_UNIFORM_READ_BIT,
-            VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED,
-            commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT
-        );
-
-        // Define a colour for the background of the shadow render pass
-        VkClearValue clearValuesShadow[1]{};
-        clearValuesShadow[0].depthStencil.depth = 1.f;
-
-        // Begin the shadows render pass ==========================================================
-        VkRenderPassBeginInfo renderPassInfoShadow{};
-        renderPassInfoShadow.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-        renderPassInfoShadow.renderPass = shadowRenderPass;
-        renderPassInfoShadow.framebuffer = shadowFrameBuffer;
-        renderPassInfoShadow.renderArea = shadowArea;
-        renderPassInfoShadow.clearValueCount = 1;
-        renderPassInfoShadow.pClearValues = clearValuesShadow;
-        vkCmdBeginRenderPass(commandBuffer, &renderPassInfoShadow, VK_SUBPASS_CONTENTS_INLINE);
-
-        // Select a pipeline to draw with
-        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, shadowPipeline);
-
-        // Bind the uniforms to the pipeline
-        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, shadowPipelineLayout, 0, 1, &lightingDescriptorSet, 0, nullptr);
-
-        // Draw each separate mesh to screen
-        for (size_t i = 0; i < meshes.size(); i++) {
-            // Bind the per vertex buffers
-            VkBuffer buffers[1] = { meshes[i].vertexPositions.buffer};
-            VkDeviceSize offsets[1]{};
-            vkCmdBindVertexBuffers(commandBuffer, 0, 1, buffers, offsets);
+        // Read back the timings this frame in flight last recorded and reset its queries
+        if (!reusable) {
+            profiler->resetQueries(commandBuffer);
+        }
 
-            // Bind the index buffer
-            vkCmdBindIndexBuffer(commandBuffer, meshes[i].indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+        // Draws culled on the CPU are recorded in chunks on every thread, each chunk into its own secondary command buffer
+        std::vector<VkCommandBuffer> secondaryBuffers;
+        std::uint32_t frameScope = beginScope("Frame");
+
+        // Each pass culls its own range of the draws into its own range of instanced commands.
+        // The early passes draw what was visible last frame, the late passes draw what the depth pyramid
+        // of the early passes shows has come into view.
+        bool const drawIndirectCommands = gpuCulling.pipeline != VK_NULL_HANDLE;
+        std::uint32_t const opaqueDraws = gpuCulling.opaqueDraws;
+        std::uint32_t const alphaDraws = gpuCulling.alphaDraws;
+        std::uint32_t const opaqueCommands = gpuCulling.opaqueCommands;
+        std::uint32_t const alphaCommands = gpuCulling.alphaCommands;
+        indirect::CullConstants const shadowCull = indirect::createCullConstants(gpuCulling.shadowProjectionView, shadowLodView,
+            0, opaqueDraws, 0, opaqueCommands);
+        indirect::CullConstants const opaqueCull = indirect::createCullConstants(worldUniform.projectionCameraMatrix, cameraLodView,
+            0, opaqueDraws, opaqueCommands, opaqueCommands, indirect::CullPhase::Early);
+        indirect::CullConstants const alphaCull = indirect::createCullConstants(worldUniform.projectionCameraMatrix, cameraLodView,
+            opaqueDraws, alphaDraws, 2 * opaqueCommands, alphaCommands, indirect::CullPhase::Early);
+        indirect::CullConstants const lateOpaqueCull = indirect::createCullConstants(worldUniform.projectionCameraMatrix, cameraLodView,
+            0, opaqueDraws, 2 * opaqueCommands + alphaCommands, opaqueCommands, indirect::CullPhase::Late);
+        indirect::CullConstants const lateAlphaCull = indirect::createCullConstants(worldUniform.projectionCameraMatrix, cameraLodView,
+            opaqueDraws, alphaDraws, 3 * opaqueCommands + alphaCommands, alphaCommands, indirect::CullPhase::Late);
+        if (drawIndirectCommands) {
+            std::vector<indirect::CullConstants> passes = { opaqueCull, alphaCull };
+            if (renderShadows) {
+                passes.emplace_back(shadowCull);
+            }
 
-            // Do the draw call
-            vkCmdDrawIndexed(commandBuffer, meshes[i].numberOfIndices, 1, 0, 0, 0);
+            std::uint32_t cullScope = beginScope("Cull");
+            recordGpuCulling(commandBuffer, gpuCulling, frame, passes, true);
+            endScope(cullScope);
         }
 
-        // End the renderpass for shadows =========================================================
-        vkCmdEndRenderPass(commandBuffer);
+        // The shadow map keeps its contents from the last time it was rendered when nothing has changed
+        if (renderShadows) {
+            std::uint32_t shadowScope = beginScope("Shadow pass");
+            recordShadowPass(commandBuffer, shadowRenderPass, shadowFrameBuffer, shadowArea, shadowPipeline, shadowPipelineLayout,
+                lightingDescriptorSet, lightingOffset, meshes, geometryPool, shadowBatches, shadowClusterView,
+                frame, drawIndirectCommands ? &shadowCull : nullptr);
+            endScope(shadowScope);
+        }
 
         // Define a colour for background of the renderpass
         VkClearValue backgroundColour[2]{};
@@ -2299,58 +3473,129 @@ namespace {
         backgroundColour[1].depthStencil.depth = 1.0f;
 
         // Begin the render pass for the colour ===================================================
+        std::uint32_t colourScope = beginScope("Colour pass");
         VkRenderPassBeginInfo renderPassInfo{};
         renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-        renderPassInfo.renderPass = renderPass;
+        renderPassInfo.renderPass = drawIndirectCommands ? gpuCulling.earlyRenderPass : renderPass;
         renderPassInfo.framebuffer = frameBuffer;
         renderPassInfo.renderArea = renderArea;
         renderPassInfo.clearValueCount = 2;
         renderPassInfo.pClearValues = backgroundColour;
-        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-        // Select a pipeline to draw with
-        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
-
-        // Bind the uniforms to the pipeline
-        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &worldDescriptorSet, 0, nullptr);
-        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 1, 1, &textureDescriptorSet, 0, nullptr);
-        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 2, 1, &lightingDescriptorSet, 0, nullptr);
-        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 3, 1, &shadowDescriptorSet, 0, nullptr);
-
-        // Draw each separate mesh to screen
-        for (size_t i = 0; i < meshes.size(); i++) {
-            // Bind the per vertex buffers
-            VkBuffer buffers[5] = { meshes[i].vertexPositions.buffer, meshes[i].vertexUVs.buffer, meshes[i].vertexNormals.buffer, meshes[i].vertexTangents.buffer,meshes[i].vertexMaterials.buffer};
-            VkDeviceSize offsets[5]{};
-            vkCmdBindVertexBuffers(commandBuffer, 0, 5, buffers, offsets);
-
-            // Bind the index buffer
-            vkCmdBindIndexBuffer(commandBuffer, meshes[i].indices.buffer, 0, VK_INDEX_TYPE_UINT32);
-
-            // Do the draw call
-            vkCmdDrawIndexed(commandBuffer, meshes[i].numberOfIndices, 1, 0, 0, 0);
+        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo,
+            drawIndirectCommands ? VK_SUBPASS_CONTENTS_INLINE : VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+        // Secondary command buffers start with nothing bound so every one binds the colour state itself
+        auto bindColourState = [&](VkCommandBuffer drawBuffer, VkPipeline firstPipeline) {
+            // Select a pipeline to draw with
+            vkCmdBindPipeline(drawBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, firstPipeline);
+
+            // Bind the uniforms to the pipeline
+            vkCmdBindDescriptorSets(drawBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &worldDescriptorSet, 1, &worldOffset);
+            vkCmdBindDescriptorSets(drawBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 1, 1, &textureDescriptorSet, 0, nullptr);
+            vkCmdBindDescriptorSets(drawBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 2, 1, &lightingDescriptorSet, 1, &lightingOffset);
+            vkCmdBindDescriptorSets(drawBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 3, 1, &shadowDescriptorSet, 0, nullptr);
+            vkCmdBindDescriptorSets(drawBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 4, 1, &frame.instanceDescriptorSet, 0, nullptr);
+
+            // Bind the vertices and indices of every mesh, the alpha pipeline uses the same bindings
+            geometryPool.bind(drawBuffer);
+        };
+
+        // Draw each separate visible mesh to screen, nearest first
+        if (drawIndirectCommands) {
+            bindColourState(commandBuffer, pipeline);
+            drawIndirect(commandBuffer, frame, opaqueCull);
+
+            // Select the alpha pipeline
+            std::uint32_t alphaScope = beginScope("Alpha draws");
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, alphaPipeline);
+            drawIndirect(commandBuffer, frame, alphaCull);
+            endScope(alphaScope);
         }
-
-        // Select the alpha pipeline
-        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, alphaPipeline);
-        // Draw each separate mesh to screen
-        for (size_t i = 0; i < alphaMeshes.size(); i++) {
-            // Bind the per vertex buffers
-            VkBuffer buffers[5] = { alphaMeshes[i].vertexPositions.buffer, alphaMeshes[i].vertexUVs.buffer, alphaMeshes[i].vertexNormals.buffer, alphaMeshes[i].vertexTangents.buffer, alphaMeshes[i].vertexMaterials.buffer};
-            VkDeviceSize offsets[5]{};
-            vkCmdBindVertexBuffers(commandBuffer, 0, 5, buffers, offsets);
-
-            // Bind the index buffer
-            vkCmdBindIndexBuffer(commandBuffer, alphaMeshes[i].indices.buffer, 0, VK_INDEX_TYPE_UINT32);
-
-            // Do the draw call
-            vkCmdDrawIndexed(commandBuffer, alphaMeshes[i].numberOfIndices, 1, 0, 0, 0);
+        else {
+            // The opaque batches are drawn before the alpha masked batches
+            std::size_t const opaqueCount = opaqueBatches.size();
+            frame.recorder->record(renderPass, frameBuffer, opaqueCount + alphaBatches.size(),
+                [&](VkCommandBuffer drawBuffer, std::size_t begin, std::size_t end) {
+                    bool boundOpaque = begin < opaqueCount;
+                    bindColourState(drawBuffer, boundOpaque ? pipeline : alphaPipeline);
+
+                    // Index ranges of the visible meshlets of the batch being drawn
+                    std::vector<culling::DrawRange> clusterDraws;
+                    for (std::size_t draw = begin; draw < end; draw++) {
+                        // A chunk that spans the change of pipeline switches to the alpha pipeline, which shares the layout
+                        bool const opaque = draw < opaqueCount;
+                        if (opaque != boundOpaque) {
+                            vkCmdBindPipeline(drawBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, alphaPipeline);
+                            boundOpaque = opaque;
+                        }
+
+                        // Alpha masked meshes are two sided so their meshlets skip the cone test
+                        const model::InstanceBatch& batch = opaque ? opaqueBatches[draw] : alphaBatches[draw - opaqueCount];
+                        const model::Mesh& mesh = opaque ? meshes[batch.mesh] : alphaMeshes[batch.mesh];
+                        drawClusters(drawBuffer, mesh, batch, cameraClusterView, opaque, clusterDraws);
+                    }
+                }, secondaryBuffers);
+            if (!secondaryBuffers.empty()) {
+                vkCmdExecuteCommands(commandBuffer, std::uint32_t(secondaryBuffers.size()), secondaryBuffers.data());
+            }
         }
 
         // End the renderpass for colour ==========================================================
         vkCmdEndRenderPass(commandBuffer);
+        endScope(colourScope);
+
+        // Draw what the early depth shows was hidden last frame but is not now =======================
+        if (drawIndirectCommands) {
+            std::uint32_t pyramidScope = beginScope("Depth pyramid");
+            gpuCulling.depthPyramid->build(commandBuffer);
+            endScope(pyramidScope);
+
+            std::uint32_t lateCullScope = beginScope("Late cull");
+            recordGpuCulling(commandBuffer, gpuCulling, frame, { lateOpaqueCull, lateAlphaCull }, false);
+            endScope(lateCullScope);
+
+            // Keep a copy of the counts so the host can read how much was occluded once the frame is done
+            utility::createBufferBarrier(frame.drawCounts.buffer, VK_WHOLE_SIZE,
+                VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+                VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED,
+                commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT
+            );
+            VkBufferCopy countsCopy{};
+            countsCopy.size = indirect::COUNT_TOTAL * sizeof(std::uint32_t);
+            vkCmdCopyBuffer(commandBuffer, frame.drawCounts.buffer, frame.statsBuffer.buffer, 1, &countsCopy);
+            utility::createBufferBarrier(frame.statsBuffer.buffer, VK_WHOLE_SIZE,
+                VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT,
+                VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED,
+                commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT
+            );
+
+            // The late half loads what the early half drew
+            std::uint32_t lateScope = beginScope("Late colour pass");
+            VkRenderPassBeginInfo renderPassInfoLate = renderPassInfo;
+            renderPassInfoLate.renderPass = gpuCulling.lateRenderPass;
+            renderPassInfoLate.clearValueCount = 0;
+            renderPassInfoLate.pClearValues = nullptr;
+            vkCmdBeginRenderPass(commandBuffer, &renderPassInfoLate, VK_SUBPASS_CONTENTS_INLINE);
+
+            // Bindings do not outlive the render pass so they are bound again
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &worldDescriptorSet, 1, &worldOffset);
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 1, 1, &textureDescriptorSet, 0, nullptr);
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 2, 1, &lightingDescriptorSet, 1, &lightingOffset);
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 3, 1, &shadowDescriptorSet, 0, nullptr);
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 4, 1, &frame.instanceDescriptorSet, 0, nullptr);
+            geometryPool.bind(commandBuffer);
+
+            drawIndirect(commandBuffer, frame, lateOpaqueCull);
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, alphaPipeline);
+            drawIndirect(commandBuffer, frame, lateAlphaCull);
+
+            vkCmdEndRenderPass(commandBuffer);
+            endScope(lateScope);
+        }
 
         // Begin the full screen render pass ======================================================
+        std::uint32_t fullscreenScope = beginScope("Fullscreen pass");
         VkRenderPassBeginInfo renderPassInfoSecond{};
         renderPassInfoSecond.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
         renderPassInfoSecond.renderPass = fullRenderPass;
@@ -2371,6 +3616,25 @@ namespace {
 
         // End the full screen render pass ========================================================
         vkCmdEndRenderPass(commandBuffer);
+        endScope(fullscreenScope);
+
+        // Copy the finished image to the host (the render pass left it in the transfer source layout)
+        if (readbackBuffer != VK_NULL_HANDLE) {
+            VkBufferImageCopy copyRegion{};
+            copyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            copyRegion.imageSubresource.layerCount = 1;
+            copyRegion.imageExtent = VkExtent3D{ renderArea.extent.width, renderArea.extent.height, 1 };
+            vkCmdCopyImageToBuffer(commandBuffer, readbackImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readbackBuffer, 1, &copyRegion);
+
+            // Make the copy visible to the host once the fence signals
+            utility::createBufferBarrier(readbackBuffer, VK_WHOLE_SIZE,
+                VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT,
+                VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED,
+                commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT
+            );
+        }
+
+        endScope(frameScope);
 
         // End the command buffer recording
         if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
@@ -2380,6 +3644,196 @@ namespace {
         return;
     }
 
+    void recordShadowPass(
+        VkCommandBuffer commandBuffer,
+        VkRenderPass shadowRenderPass, VkFramebuffer shadowFrameBuffer, VkRect2D shadowArea,
+        VkPipeline shadowPipeline, VkPipelineLayout shadowPipelineLayout,
+        VkDescriptorSet lightingDescriptorSet, std::uint32_t lightingOffset,
+        const std::vector<model::Mesh>& meshes, const model::GeometryPool& geometryPool,
+        const std::vector<model::InstanceBatch>& shadowBatches, const culling::ClusterView& shadowClusterView,
+        const FrameResources& frame, const indirect::CullConstants* shadowCull
+    ) {
+        std::vector<VkCommandBuffer> secondaryBuffers;
+
+        // Define a colour for the background of the shadow render pass
+        VkClearValue clearValuesShadow[1]{};
+        clearValuesShadow[0].depthStencil.depth = 1.f;
+
+        // Begin the shadows render pass ======================================================
+        VkRenderPassBeginInfo renderPassInfoShadow{};
+        renderPassInfoShadow.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        renderPassInfoShadow.renderPass = shadowRenderPass;
+        renderPassInfoShadow.framebuffer = shadowFrameBuffer;
+        renderPassInfoShadow.renderArea = shadowArea;
+        renderPassInfoShadow.clearValueCount = 1;
+        renderPassInfoShadow.pClearValues = clearValuesShadow;
+        vkCmdBeginRenderPass(commandBuffer, &renderPassInfoShadow,
+            shadowCull != nullptr ? VK_SUBPASS_CONTENTS_INLINE : VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+        // Secondary command buffers start with nothing bound so every one binds the shadow state itself
+        auto bindShadowState = [&](VkCommandBuffer drawBuffer) {
+            // Select a pipeline to draw with
+            vkCmdBindPipeline(drawBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, shadowPipeline);
+
+            // Bind the uniforms and instances to the pipeline
+            vkCmdBindDescriptorSets(drawBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, shadowPipelineLayout, 0, 1, &lightingDescriptorSet, 1, &lightingOffset);
+            vkCmdBindDescriptorSets(drawBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, shadowPipelineLayout, 1, 1, &frame.instanceDescriptorSet, 0, nullptr);
+
+            // Bind the positions and indices of every mesh
+            geometryPool.bind(drawBuffer, true);
+        };
+
+        // Draw each mesh that can cast a shadow into the light's view
+        if (shadowCull != nullptr) {
+            bindShadowState(commandBuffer);
+            drawIndirect(commandBuffer, frame, *shadowCull);
+        }
+        else {
+            frame.recorder->record(shadowRenderPass, shadowFrameBuffer, shadowBatches.size(),
+                [&](VkCommandBuffer drawBuffer, std::size_t begin, std::size_t end) {
+                    bindShadowState(drawBuffer);
+
+                    // Index ranges of the visible meshlets of the batch being drawn
+                    std::vector<culling::DrawRange> clusterDraws;
+                    for (std::size_t draw = begin; draw < end; draw++) {
+                        // The level of each batch is the one seen from the light, the shadow pipeline keeps back faces so no cone test
+                        const model::InstanceBatch& batch = shadowBatches[draw];
+                        drawClusters(drawBuffer, meshes[batch.mesh], batch, shadowClusterView, false, clusterDraws);
+                    }
+                }, secondaryBuffers);
+            if (!secondaryBuffers.empty()) {
+                vkCmdExecuteCommands(commandBuffer, std::uint32_t(secondaryBuffers.size()), secondaryBuffers.data());
+            }
+        }
+
+        // End the renderpass for shadows =====================================================
+        vkCmdEndRenderPass(commandBuffer);
+    }
+
+    void drawClusters(VkCommandBuffer commandBuffer, const model::Mesh& mesh, const model::InstanceBatch& batch,
+        const culling::ClusterView& view, bool cullBackfaces, std::vector<culling::DrawRange>& draws) {
+        // Levels and meshlets index from the start of the mesh's room in the pool
+        const simplification::LodLevel& lod = mesh.lods[batch.level];
+        std::uint32_t const firstIndex = mesh.geometry.firstIndex;
+        std::int32_t const vertexOffset = std::int32_t(mesh.geometry.vertexOffset);
+
+        // The instances each see different meshlets, so a batch of several draws the whole level once for all of them.
+        // The first instance points the vertex shader at the batch's ids in the visible instances.
+        if (lod.meshletCount == 0 || batch.instanceCount > 1) {
+            vkCmdDrawIndexed(commandBuffer, lod.indexCount, batch.instanceCount, firstIndex + lod.firstIndex, vertexOffset, batch.firstInstance);
+            return;
+        }
+
+        // The meshlets are stored where the first instance is, the other instances cull them from a view moved into that space.
+        // Neighbouring visible meshlets are merged so each draw covers as many as possible
+        const meshlets::Meshlet* clusters = mesh.meshlets->data() + lod.firstMeshlet;
+        if (mesh.transform == glm::mat4(1.f)) {
+            culling::cullClusters(view, clusters, lod.meshletCount, cullBackfaces, draws);
+        }
+        else {
+            culling::cullClusters(culling::transformClusterView(view, mesh.transform), clusters, lod.meshletCount, cullBackfaces, draws);
+        }
+        for (const culling::DrawRange& draw : draws) {
+            vkCmdDrawIndexed(commandBuffer, draw.indexCount, 1, firstIndex + draw.firstIndex, vertexOffset, batch.firstInstance);
+        }
+    }
+
+    void recordGpuCulling(VkCommandBuffer commandBuffer, const GpuCulling& gpuCulling, const FrameResources& frame,
+        const std::vector<indirect::CullConstants>& passes, bool resetCounts) {
+        if (resetCounts) {
+            // The pyramid is bound by the culling shader before this frame builds it
+            gpuCulling.depthPyramid->prepare(commandBuffer);
+
+            // The last frame drawn from these buffers has finished copying the counts before they are cleared
+            utility::createBufferBarrier(frame.drawCounts.buffer, VK_WHOLE_SIZE,
+                VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED,
+                commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT
+            );
+            vkCmdFillBuffer(commandBuffer, frame.drawCounts.buffer, 0, VK_WHOLE_SIZE, 0);
+            utility::createBufferBarrier(frame.drawCounts.buffer, VK_WHOLE_SIZE,
+                VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+                VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED,
+                commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT
+            );
+
+            // The commands start the frame with no instances, once the last frame's draws have read them
+            std::uint32_t const commandCount = 3 * gpuCulling.opaqueCommands + 2 * gpuCulling.alphaCommands;
+            utility::createBufferBarrier(frame.drawCommands.buffer, VK_WHOLE_SIZE,
+                VK_ACCESS_INDIRECT_COMMAND_READ_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED,
+                commandBuffer, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT
+            );
+            if (commandCount > 0) {
+                VkBufferCopy commandsCopy{};
+                commandsCopy.size = commandCount * sizeof(VkDrawIndexedIndirectCommand);
+                vkCmdCopyBuffer(commandBuffer, gpuCulling.commandTemplate, frame.drawCommands.buffer, 1, &commandsCopy);
+            }
+            utility::createBufferBarrier(frame.drawCommands.buffer, VK_WHOLE_SIZE,
+                VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+                VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED,
+                commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT
+            );
+
+            // The last frame's vertex shaders have read the visible instances before they are written again
+            utility::createBufferBarrier(frame.visibleInstances.buffer, VK_WHOLE_SIZE,
+                VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED,
+                commandBuffer, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT
+            );
+
+            // The visibility is shared by every frame in flight, the last frame's late culling wrote it
+            utility::createBufferBarrier(gpuCulling.visibility, VK_WHOLE_SIZE,
+                VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+                VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED,
+                commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT
+            );
+        }
+        else {
+            // The early draws have read their commands before the late culling adds to the late commands
+            utility::createBufferBarrier(frame.drawCommands.buffer, VK_WHOLE_SIZE,
+                VK_ACCESS_INDIRECT_COMMAND_READ_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+                VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED,
+                commandBuffer, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT
+            );
+        }
+
+        // One invocation per draw, each visible draw adds its instance to the command of its submesh's level
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, gpuCulling.pipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, gpuCulling.pipelineLayout, 0, 1, &frame.cullDescriptorSet, 0, nullptr);
+        for (const indirect::CullConstants& pass : passes) {
+            if (pass.drawCount == 0) {
+                continue;
+            }
+            vkCmdPushConstants(commandBuffer, gpuCulling.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT,
+                0, sizeof(indirect::CullConstants), &pass);
+            vkCmdDispatch(commandBuffer, (pass.drawCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+        }
+
+        // The commands are read by the indirect draws and the visible instances by their vertex shaders
+        utility::createBufferBarrier(frame.drawCommands.buffer, VK_WHOLE_SIZE,
+            VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT,
+            VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED,
+            commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT
+        );
+        utility::createBufferBarrier(frame.visibleInstances.buffer, VK_WHOLE_SIZE,
+            VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+            VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED,
+            commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT
+        );
+    }
+
+    void drawIndirect(VkCommandBuffer commandBuffer, const FrameResources& frame, const indirect::CullConstants& cull) {
+        if (cull.commandCount == 0) {
+            return;
+        }
+
+        // Every command of the pass is drawn, those with no visible instances draw nothing
+        vkCmdDrawIndexedIndirect(commandBuffer,
+            frame.drawCommands.buffer, cull.firstCommand * sizeof(VkDrawIndexedIndirectCommand),
+            cull.commandCount, sizeof(VkDrawIndexedIndirectCommand));
+    }
+
     void submitCommands(app::AppContext app, VkCommandBuffer commandBuffer, VkSemaphore wait, VkSemaphore signal, VkFence fence) {
         // Create the submission info
         VkSubmitInfo submitInfo{};
@@ -2389,12 +3843,12 @@ namespace {
 
         // Wait for the colour attatchment to be finished
         VkPipelineStageFlags waitForColour = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-        submitInfo.waitSemaphoreCount = 1;
+        submitInfo.waitSemaphoreCount = wait != VK_NULL_HANDLE ? 1 : 0;
         submitInfo.pWaitSemaphores = &wait;
         submitInfo.pWaitDstStageMask = &waitForColour;
 
         // Signal that there has been a submission
-        submitInfo.signalSemaphoreCount = 1;
+        submitInfo.signalSemaphoreCount = signal != VK_NULL_HANDLE ? 1 : 0;
         submitInfo.pSignalSemaphores = &signal;
 
         // Submit
@@ -2428,4 +3882,147 @@ namespace {
 
         return false;
     }
+
+    RenderOptions parseOptions(int argc, char* argv[]) {
+        RenderOptions options;
+
+        for (int i = 1; i < argc; i++) {
+            std::string argument = argv[i];
+
+            // Every option other than --headless takes a value
+            if (argument == "--headless") {
+                options.headless = true;
+                continue;
+            }
+            if (i + 1 >= argc) {
+                throw std::runtime_error("Missing value for " + argument);
+            }
+            std::string value = argv[++i];
+
+            if (argument == "--frames") {
+                options.frameCount = std::uint32_t(std::stoul(value));
+            }
+            else if (argument == "--output") {
+                options.outputPath = value;
+            }
+            else if (argument == "--width") {
+                options.extent.width = std::uint32_t(std::stoul(value));
+            }
+            else if (argument == "--height") {
+                options.extent.height = std::uint32_t(std::stoul(value));
+            }
+            else if (argument == "--vertex-format") {
+                if (value == "full") {
+                    options.vertexFormat = model::VertexFormat::Full;
+                }
+                else if (value == "packed") {
+                    options.vertexFormat = model::VertexFormat::Packed;
+                }
+                else {
+                    throw std::runtime_error("Unknown vertex format " + value + " (expected full or packed)");
+                }
+            }
+            else if (argument == "--culling") {
+                if (value == "cpu") {
+                    options.gpuCulling = false;
+                }
+                else if (value == "gpu") {
+                    options.gpuCulling = true;
+                }
+                else {
+                    throw std::runtime_error("Unknown culling mode " + value + " (expected cpu or gpu)");
+                }
+            }
+            else if (argument == "--static-scene") {
+                if (value == "on") {
+                    options.staticScene = true;
+                }
+                else if (value == "off") {
+                    options.staticScene = false;
+                }
+                else {
+                    throw std::runtime_error("Unknown static scene mode " + value + " (expected on or off)");
+                }
+            }
+            else if (argument == "--occlusion") {
+                if (value == "on") {
+                    options.softwareOcclusion = true;
+                }
+                else if (value == "off") {
+                    options.softwareOcclusion = false;
+                }
+                else {
+                    throw std::runtime_error("Unknown occlusion mode " + value + " (expected on or off)");
+                }
+            }
+            else {
+                throw std::runtime_error("Unknown option " + argument);
+            }
+        }
+
+        if (!options.outputPath.ends_with(".png") && !options.outputPath.ends_with(".exr")) {
+            throw std::runtime_error("Headless output must be a .png or .exr file");
+        }
+        if (options.extent.width == 0 || options.extent.height == 0) {
+            throw std::runtime_error("Headless output must have a non zero size");
+        }
+
+        return options;
+    }
+
+    std::string getFramePath(const RenderOptions& options, std::uint32_t frameNumber) {
+        if (options.frameCount == 1) {
+            return options.outputPath;
+        }
+
+        // Insert the zero padded frame number before the extension
+        std::string number = std::to_string(frameNumber);
+        number.insert(0, number.size() < 4 ? 4 - number.size() : 0, '0');
+        std::size_t const extension = options.outputPath.rfind('.');
+        return options.outputPath.substr(0, extension) + "_" + number + options.outputPath.substr(extension);
+    }
+
+    void writeReadbackImage(VmaAllocator allocator, utility::BufferSet& readbackBuffer, VkExtent2D extent,
+        VkFormat format, const std::string& filePath) {
+
+        void* data = nullptr;
+        if (vmaMapMemory(allocator, readbackBuffer.allocation, &data) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to map the read back buffer.");
+        }
+        // The memory may not be host coherent
+        vmaInvalidateAllocation(allocator, readbackBuffer.allocation, 0, VK_WHOLE_SIZE);
+
+        if (format == VK_FORMAT_R16G16B16A16_SFLOAT) {
+            utility::writeEXR(filePath.c_str(), extent.width, extent.height, static_cast<const std::uint16_t*>(data));
+        }
+        else {
+            utility::writePNG(filePath.c_str(), extent.width, extent.height, static_cast<const std::uint8_t*>(data));
+        }
+
+        vmaUnmapMemory(allocator, readbackBuffer.allocation);
+
+        std::cout << "Wrote " << filePath << std::endl;
+    }
+
+    void decodeTextures(const std::vector<fbx::Texture>& textures, bool isSRGB,
+        std::vector<std::optional<utility::TextureData>>& decoded, jobs::Counter& counter) {
+
+        decoded.resize(textures.size());
+        jobs::shared().parallelFor(textures.size(), 1, [&textures, isSRGB, &decoded](std::size_t begin, std::size_t end) {
+            for (std::size_t i = begin; i < end; i++) {
+                const fbx::Texture& texture = textures[i];
+                // If texture is empty
+                if (texture.isEmpty) {
+                    decoded[i] = utility::loadPNGTextureData(paths::textureFillPath);
+                }
+                // If texture is a dds texture
+                else if (texture.filePath.ends_with(".dds")) {
+                    decoded[i] = utility::loadDDSTextureData(texture.filePath.c_str(), isSRGB);
+                }
+                else if (texture.filePath.ends_with(".png") || texture.filePath.ends_with(".jpg")) {
+                    decoded[i] = utility::loadPNGTextureData(texture.filePath.c_str());
+                }
+            }
+        }, counter);
+    }
 }
\ No newline at end of file
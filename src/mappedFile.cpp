@@ -0,0 +1,128 @@
+#include "mappedFile.hpp"
+
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace utility {
+
+	MappedFile::MappedFile() = default;
+
+	MappedFile::MappedFile(const char* filename)
+	{
+#if defined(_WIN32)
+		// Open the file for reading
+		HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+			FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (file == INVALID_HANDLE_VALUE) {
+			throw std::runtime_error("Could not open file: " + std::string(filename));
+		}
+		fileHandle = file;
+
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(file, &fileSize)) {
+			CloseHandle(file);
+			throw std::runtime_error("Could not get the size of file: " + std::string(filename));
+		}
+		mappingSize = std::size_t(fileSize.QuadPart);
+
+		// Empty files can not be mapped but are still valid
+		if (mappingSize == 0) {
+			return;
+		}
+
+		// Map the whole file as read only
+		HANDLE fileMapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (fileMapping == nullptr) {
+			CloseHandle(file);
+			throw std::runtime_error("Could not map file: " + std::string(filename));
+		}
+		mappingHandle = fileMapping;
+
+		mapping = static_cast<const std::uint8_t*>(MapViewOfFile(fileMapping, FILE_MAP_READ, 0, 0, 0));
+		if (mapping == nullptr) {
+			CloseHandle(fileMapping);
+			CloseHandle(file);
+			throw std::runtime_error("Could not map a view of file: " + std::string(filename));
+		}
+#else
+		// Open the file for reading
+		fileDescriptor = open(filename, O_RDONLY);
+		if (fileDescriptor == -1) {
+			throw std::runtime_error("Could not open file: " + std::string(filename));
+		}
+
+		struct stat fileStats;
+		if (fstat(fileDescriptor, &fileStats) != 0) {
+			close(fileDescriptor);
+			throw std::runtime_error("Could not get the size of file: " + std::string(filename));
+		}
+		mappingSize = std::size_t(fileStats.st_size);
+
+		// Empty files can not be mapped but are still valid
+		if (mappingSize == 0) {
+			return;
+		}
+
+		// Map the whole file as read only
+		void* memory = mmap(nullptr, mappingSize, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+		if (memory == MAP_FAILED) {
+			close(fileDescriptor);
+			throw std::runtime_error("Could not map file: " + std::string(filename));
+		}
+		mapping = static_cast<const std::uint8_t*>(memory);
+#endif
+	}
+
+	MappedFile::~MappedFile()
+	{
+#if defined(_WIN32)
+		if (mapping != nullptr) {
+			UnmapViewOfFile(mapping);
+		}
+		if (mappingHandle != nullptr) {
+			CloseHandle(mappingHandle);
+		}
+		if (fileHandle != nullptr) {
+			CloseHandle(fileHandle);
+		}
+#else
+		if (mapping != nullptr) {
+			munmap(const_cast<std::uint8_t*>(mapping), mappingSize);
+		}
+		if (fileDescriptor != -1) {
+			close(fileDescriptor);
+		}
+#endif
+	}
+
+	MappedFile::MappedFile(MappedFile&& other) noexcept
+		: mapping(std::exchange(other.mapping, nullptr))
+		, mappingSize(std::exchange(other.mappingSize, 0))
+		, fileHandle(std::exchange(other.fileHandle, nullptr))
+		, mappingHandle(std::exchange(other.mappingHandle, nullptr))
+		, fileDescriptor(std::exchange(other.fileDescriptor, -1))
+	{
+	}
+
+	MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+	{
+		std::swap(mapping, other.mapping);
+		std::swap(mappingSize, other.mappingSize);
+		std::swap(fileHandle, other.fileHandle);
+		std::swap(mappingHandle, other.mappingHandle);
+		std::swap(fileDescriptor, other.fileDescriptor);
+		return *this;
+	}
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace utility {
+	/// <summary>
+	/// A read only view of a file that is mapped into memory by the operating system
+	/// </summary>
+	class MappedFile
+	{
+	public:
+
+		/// <summary>
+		/// Default constructor
+		/// </summary>
+		MappedFile();
+
+		/// <summary>
+		/// Parameterised constructor, maps the whole file into memory
+		/// </summary>
+		/// <param name="filename">Path to the file to map</param>
+		explicit MappedFile(const char* filename);
+
+		/// <summary>
+		/// Destructor
+		/// </summary>
+		~MappedFile();
+
+		// Delete the copy constructors to avoid unmapping the file twice
+		MappedFile(MappedFile&) = delete;
+		MappedFile& operator= (MappedFile&) = delete;
+
+		/// <summary>
+		/// Move constructor (Should not throw exceptions)
+		/// </summary>
+		/// <param name="other">The original mapping</param>
+		MappedFile(MappedFile&& other) noexcept;
+
+		/// <summary>
+		/// Move assignment operator (Should not throw exceptions)
+		/// </summary>
+		/// <param name="other">The original mapping</param>
+		/// <returns>A mapped file</returns>
+		MappedFile& operator = (MappedFile&& other) noexcept;
+
+		/// <summary>
+		/// Gets the start of the mapped file
+		/// </summary>
+		/// <returns>Pointer to the first byte of the file</returns>
+		const std::uint8_t* data() const { return mapping; }
+
+		/// <summary>
+		/// Gets the size of the mapped file
+		/// </summary>
+		/// <returns>Size of the file in bytes</returns>
+		std::size_t size() const { return mappingSize; }
+
+	private:
+		const std::uint8_t* mapping = nullptr;
+		std::size_t mappingSize = 0;
+
+		// Operating system handles (HANDLE on windows, file descriptor elsewhere)
+		void* fileHandle = nullptr;
+		void* mappingHandle = nullptr;
+		int fileDescriptor = -1;
+	};
+}
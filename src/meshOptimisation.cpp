@@ -0,0 +1,252 @@
+#include "meshOptimisation.hpp"
+
+#include <algorithm>
+#include <numeric>
+
+namespace optimisation {
+
+	namespace {
+		/// <summary>
+		/// A FIFO vertex cache. Each vertex remembers when it entered the cache, it is still there
+		/// until cacheSize more vertices have entered after it.
+		/// </summary>
+		class FifoCache
+		{
+		public:
+			FifoCache(std::size_t vertexCount, std::uint32_t inCacheSize)
+				: entryTime(vertexCount, 0), cacheSize(inCacheSize), time(inCacheSize + 1) {}
+
+			/// <summary>
+			/// Uses a vertex, adding it to the cache if it is not there
+			/// </summary>
+			/// <returns>True if the vertex had to be transformed</returns>
+			bool access(std::uint32_t vertex) {
+				if (time - entryTime[vertex] <= cacheSize) {
+					return false;
+				}
+				entryTime[vertex] = time++;
+				return true;
+			}
+
+		private:
+			std::vector<std::size_t> entryTime;
+			std::size_t cacheSize;
+			std::size_t time;
+		};
+	}
+
+	CacheStatistics analyseVertexCache(const std::vector<std::uint32_t>& indices, std::size_t vertexCount, std::uint32_t cacheSize) {
+		CacheStatistics statistics;
+		statistics.triangles = indices.size() / 3;
+
+		FifoCache cache(vertexCount, cacheSize);
+		std::vector<bool> used(vertexCount, false);
+		for (std::uint32_t index : indices) {
+			if (cache.access(index)) {
+				statistics.transforms++;
+			}
+			if (!used[index]) {
+				used[index] = true;
+				statistics.vertices++;
+			}
+		}
+
+		return statistics;
+	}
+
+	void optimiseVertexCache(std::vector<std::uint32_t>& indices, std::size_t vertexCount, std::uint32_t cacheSize) {
+		std::size_t const triangleCount = indices.size() / 3;
+		if (triangleCount == 0) {
+			return;
+		}
+
+		// The number of triangles each vertex is in that have not been emitted yet
+		std::vector<std::uint32_t> liveTriangles(vertexCount, 0);
+		for (std::size_t i = 0; i < triangleCount * 3; i++) {
+			liveTriangles[indices[i]]++;
+		}
+
+		// The triangles of each vertex
+		std::vector<std::uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+		for (std::size_t i = 0; i < vertexCount; i++) {
+			adjacencyOffsets[i + 1] = adjacencyOffsets[i] + liveTriangles[i];
+		}
+		std::vector<std::uint32_t> adjacency(triangleCount * 3);
+		std::vector<std::uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+		for (std::size_t i = 0; i < triangleCount * 3; i++) {
+			adjacency[fill[indices[i]]++] = std::uint32_t(i / 3);
+		}
+
+		std::vector<std::size_t> cacheTime(vertexCount, 0);
+		std::vector<bool> emitted(triangleCount, false);
+		std::vector<std::uint32_t> deadEnds;
+		std::vector<std::uint32_t> candidates;
+		std::vector<std::uint32_t> output;
+		output.reserve(triangleCount * 3);
+
+		std::size_t time = cacheSize + 1;
+		std::size_t cursor = 0;
+
+		// Finds the next vertex with triangles left in input order
+		auto nextLiveVertex = [&]() -> std::uint32_t {
+			for (; cursor < vertexCount; cursor++) {
+				if (liveTriangles[cursor] > 0) {
+					return std::uint32_t(cursor);
+				}
+			}
+			return UNUSED_VERTEX;
+		};
+
+		std::uint32_t fanning = nextLiveVertex();
+		while (fanning != UNUSED_VERTEX) {
+			// Emit every remaining triangle around the fanning vertex
+			candidates.clear();
+			for (std::uint32_t a = adjacencyOffsets[fanning]; a < adjacencyOffsets[fanning + 1]; a++) {
+				std::uint32_t triangle = adjacency[a];
+				if (emitted[triangle]) {
+					continue;
+				}
+
+				for (std::size_t corner = 0; corner < 3; corner++) {
+					std::uint32_t vertex = indices[triangle * 3 + corner];
+					output.emplace_back(vertex);
+					deadEnds.emplace_back(vertex);
+					candidates.emplace_back(vertex);
+					liveTriangles[vertex]--;
+					if (time - cacheTime[vertex] > cacheSize) {
+						cacheTime[vertex] = time++;
+					}
+				}
+				emitted[triangle] = true;
+			}
+
+			// Fan around the candidate that will still be in the cache once its triangles are emitted and
+			// has been there the longest, otherwise one with no cache preference
+			std::uint32_t best = UNUSED_VERTEX;
+			std::int64_t bestPriority = -1;
+			for (std::uint32_t vertex : candidates) {
+				if (liveTriangles[vertex] == 0) {
+					continue;
+				}
+
+				std::int64_t priority = 0;
+				std::int64_t age = std::int64_t(time - cacheTime[vertex]);
+				if (age + 2 * std::int64_t(liveTriangles[vertex]) <= std::int64_t(cacheSize)) {
+					priority = age;
+				}
+				if (priority > bestPriority) {
+					bestPriority = priority;
+					best = vertex;
+				}
+			}
+
+			// Dead end, go back to the most recent vertex that still has triangles
+			while (best == UNUSED_VERTEX && !deadEnds.empty()) {
+				std::uint32_t vertex = deadEnds.back();
+				deadEnds.pop_back();
+				if (liveTriangles[vertex] > 0) {
+					best = vertex;
+				}
+			}
+			if (best == UNUSED_VERTEX) {
+				best = nextLiveVertex();
+			}
+
+			fanning = best;
+		}
+
+		// Any incomplete triangle at the end is kept as it was
+		output.insert(output.end(), indices.begin() + triangleCount * 3, indices.end());
+		indices.swap(output);
+	}
+
+	void optimiseOverdraw(std::vector<std::uint32_t>& indices, const std::vector<glm::vec3>& positions, std::uint32_t cacheSize) {
+		std::size_t const triangleCount = indices.size() / 3;
+		if (triangleCount < 2) {
+			return;
+		}
+
+		// Split the triangles into clusters wherever a triangle misses the cache on all three vertices,
+		// so reordering the clusters does not make the cache any worse
+		std::vector<std::size_t> clusterStarts;
+		FifoCache cache(positions.size(), cacheSize);
+		for (std::size_t triangle = 0; triangle < triangleCount; triangle++) {
+			int misses = 0;
+			for (std::size_t corner = 0; corner < 3; corner++) {
+				misses += cache.access(indices[triangle * 3 + corner]) ? 1 : 0;
+			}
+			if (triangle == 0 || misses == 3) {
+				clusterStarts.emplace_back(triangle);
+			}
+		}
+		clusterStarts.emplace_back(triangleCount);
+
+		std::size_t const clusterCount = clusterStarts.size() - 1;
+		if (clusterCount < 2) {
+			return;
+		}
+
+		// Area weighted centroid and normal of each cluster and of the whole mesh
+		std::vector<glm::vec3> clusterCentroids(clusterCount, glm::vec3(0));
+		std::vector<glm::vec3> clusterNormals(clusterCount, glm::vec3(0));
+		std::vector<float> clusterAreas(clusterCount, 0.f);
+		glm::vec3 meshCentroid(0);
+		float meshArea = 0.f;
+		for (std::size_t cluster = 0; cluster < clusterCount; cluster++) {
+			for (std::size_t triangle = clusterStarts[cluster]; triangle < clusterStarts[cluster + 1]; triangle++) {
+				glm::vec3 v0 = positions[indices[triangle * 3]];
+				glm::vec3 v1 = positions[indices[triangle * 3 + 1]];
+				glm::vec3 v2 = positions[indices[triangle * 3 + 2]];
+
+				glm::vec3 normal = glm::cross(v1 - v0, v2 - v0);
+				float area = glm::length(normal);
+				glm::vec3 centroid = (v0 + v1 + v2) / 3.f;
+
+				clusterCentroids[cluster] += centroid * area;
+				clusterNormals[cluster] += normal;
+				clusterAreas[cluster] += area;
+			}
+			meshCentroid += clusterCentroids[cluster];
+			meshArea += clusterAreas[cluster];
+		}
+		if (meshArea > 0.f) {
+			meshCentroid /= meshArea;
+		}
+
+		// Clusters that face further out from the centre are more likely to hide the rest
+		std::vector<float> clusterSortKeys(clusterCount, 0.f);
+		for (std::size_t cluster = 0; cluster < clusterCount; cluster++) {
+			float normalLength = glm::length(clusterNormals[cluster]);
+			if (clusterAreas[cluster] > 0.f && normalLength > 0.f) {
+				glm::vec3 centroid = clusterCentroids[cluster] / clusterAreas[cluster];
+				clusterSortKeys[cluster] = glm::dot(centroid - meshCentroid, clusterNormals[cluster] / normalLength);
+			}
+		}
+
+		std::vector<std::uint32_t> clusterOrder(clusterCount);
+		std::iota(clusterOrder.begin(), clusterOrder.end(), 0);
+		std::stable_sort(clusterOrder.begin(), clusterOrder.end(), [&clusterSortKeys](std::uint32_t a, std::uint32_t b) {
+			return clusterSortKeys[a] > clusterSortKeys[b];
+		});
+
+		std::vector<std::uint32_t> output;
+		output.reserve(indices.size());
+		for (std::uint32_t cluster : clusterOrder) {
+			output.insert(output.end(), indices.begin() + clusterStarts[cluster] * 3, indices.begin() + clusterStarts[cluster + 1] * 3);
+		}
+		output.insert(output.end(), indices.begin() + triangleCount * 3, indices.end());
+		indices.swap(output);
+	}
+
+	std::vector<std::uint32_t> optimiseVertexFetch(std::vector<std::uint32_t>& indices, std::size_t vertexCount) {
+		std::vector<std::uint32_t> remap(vertexCount, UNUSED_VERTEX);
+		std::uint32_t nextVertex = 0;
+		for (std::uint32_t& index : indices) {
+			if (remap[index] == UNUSED_VERTEX) {
+				remap[index] = nextVertex++;
+			}
+			index = remap[index];
+		}
+		return remap;
+	}
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "glm.hpp"
+
+namespace optimisation {
+	/// <summary>
+	/// Marks a vertex that is not used by any triangle in a remap table
+	/// </summary>
+	constexpr std::uint32_t UNUSED_VERTEX = std::numeric_limits<std::uint32_t>::max();
+
+	/// <summary>
+	/// How well an index buffer uses a FIFO post-transform vertex cache
+	/// </summary>
+	struct CacheStatistics
+	{
+		std::size_t triangles = 0;
+		std::size_t vertices = 0;
+		std::size_t transforms = 0;
+
+		/// <summary>
+		/// Average cache miss ratio, vertices transformed per triangle (0.5 is ideal, 3 is the worst)
+		/// </summary>
+		float acmr() const { return triangles == 0 ? 0.f : float(transforms) / float(triangles); }
+
+		/// <summary>
+		/// Average transform to vertex ratio, times each vertex is transformed (1 is ideal)
+		/// </summary>
+		float atvr() const { return vertices == 0 ? 0.f : float(transforms) / float(vertices); }
+
+		CacheStatistics& operator+= (const CacheStatistics& other) {
+			triangles += other.triangles;
+			vertices += other.vertices;
+			transforms += other.transforms;
+			return *this;
+		}
+	};
+
+	/// <summary>
+	/// The cache statistics of a mesh before and after it was optimised
+	/// </summary>
+	struct OptimisationReport
+	{
+		CacheStatistics before;
+		CacheStatistics after;
+	};
+
+	/// <summary>
+	/// Simulates a FIFO vertex cache to count how many vertices an index buffer transforms
+	/// </summary>
+	/// <param name="indices">Triangle list indices</param>
+	/// <param name="vertexCount">Number of vertices the indices refer to</param>
+	/// <param name="cacheSize">Number of entries in the simulated cache</param>
+	/// <returns>The cache statistics</returns>
+	CacheStatistics analyseVertexCache(const std::vector<std::uint32_t>& indices, std::size_t vertexCount, std::uint32_t cacheSize = 16);
+
+	/// <summary>
+	/// Reorders the triangles for the post-transform vertex cache using Tipsify (Sander et al. 2007),
+	/// fanning around each vertex in turn and moving on to the best vertex still in the cache
+	/// </summary>
+	/// <param name="indices">Triangle list indices, reordered in place</param>
+	/// <param name="vertexCount">Number of vertices the indices refer to</param>
+	/// <param name="cacheSize">Number of entries in the targeted cache</param>
+	void optimiseVertexCache(std::vector<std::uint32_t>& indices, std::size_t vertexCount, std::uint32_t cacheSize = 16);
+
+	/// <summary>
+	/// Reorders clusters of cache optimised triangles so those facing away from the centre of the mesh are
+	/// drawn first and hide those behind them. Clusters are split where the cache is fully missed so the
+	/// cache efficiency is kept.
+	/// </summary>
+	/// <param name="indices">Cache optimised triangle list indices, reordered in place</param>
+	/// <param name="positions">The vertex positions</param>
+	/// <param name="cacheSize">Number of entries in the targeted cache</param>
+	void optimiseOverdraw(std::vector<std::uint32_t>& indices, const std::vector<glm::vec3>& positions, std::uint32_t cacheSize = 16);
+
+	/// <summary>
+	/// Renumbers the vertices in the order the indices first use them so vertex fetches walk forwards
+	/// through memory
+	/// </summary>
+	/// <param name="indices">Triangle list indices, rewritten in place</param>
+	/// <param name="vertexCount">Number of vertices the indices refer to</param>
+	/// <returns>The new index of each old vertex (UNUSED_VERTEX if no triangle uses it)</returns>
+	std::vector<std::uint32_t> optimiseVertexFetch(std::vector<std::uint32_t>& indices, std::size_t vertexCount);
+
+	/// <summary>
+	/// Moves a per vertex attribute into the order given by a remap table, dropping unused vertices
+	/// </summary>
+	/// <param name="values">The attribute, rewritten in place</param>
+	/// <param name="remap">The remap table from optimiseVertexFetch</param>
+	/// <param name="newVertexCount">Number of vertices after the remap</param>
+	template<typename T>
+	void remapVertices(std::vector<T>& values, const std::vector<std::uint32_t>& remap, std::size_t newVertexCount) {
+		std::vector<T> remapped(newVertexCount);
+		for (std::size_t i = 0; i < values.size(); i++) {
+			if (remap[i] != UNUSED_VERTEX) {
+				remapped[remap[i]] = values[i];
+			}
+		}
+		values.swap(remapped);
+	}
+}
@@ -0,0 +1,425 @@
+#include "meshSimplification.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+#include "meshOptimisation.hpp"
+
+namespace simplification {
+
+	namespace {
+		/// <summary>
+		/// The sum of the squared distances to a set of planes, kept as the symmetric matrix A, the vector b
+		/// and the constant c of p.A.p + 2b.p + c. Triangle planes are weighted by their area.
+		/// </summary>
+		struct Quadric
+		{
+			double a00 = 0.0, a11 = 0.0, a22 = 0.0;
+			double a01 = 0.0, a02 = 0.0, a12 = 0.0;
+			double b0 = 0.0, b1 = 0.0, b2 = 0.0;
+			double c = 0.0;
+
+			// Total area of the triangles, the error is averaged over it
+			double area = 0.0;
+
+			void addPlane(glm::dvec3 normal, double distance, double weight) {
+				a00 += weight * normal.x * normal.x;
+				a11 += weight * normal.y * normal.y;
+				a22 += weight * normal.z * normal.z;
+				a01 += weight * normal.x * normal.y;
+				a02 += weight * normal.x * normal.z;
+				a12 += weight * normal.y * normal.z;
+				b0 += weight * normal.x * distance;
+				b1 += weight * normal.y * distance;
+				b2 += weight * normal.z * distance;
+				c += weight * distance * distance;
+			}
+
+			Quadric& operator+= (const Quadric& other) {
+				a00 += other.a00; a11 += other.a11; a22 += other.a22;
+				a01 += other.a01; a02 += other.a02; a12 += other.a12;
+				b0 += other.b0; b1 += other.b1; b2 += other.b2;
+				c += other.c;
+				area += other.area;
+				return *this;
+			}
+
+			/// <summary>
+			/// Gets the root mean square distance of a point from the planes
+			/// </summary>
+			double error(glm::dvec3 p) const {
+				double const rx = a00 * p.x + a01 * p.y + a02 * p.z;
+				double const ry = a01 * p.x + a11 * p.y + a12 * p.z;
+				double const rz = a02 * p.x + a12 * p.y + a22 * p.z;
+				double const sum = p.x * rx + p.y * ry + p.z * rz + 2.0 * (b0 * p.x + b1 * p.y + b2 * p.z) + c;
+				return std::sqrt(std::max(sum, 0.0) / std::max(area, 1e-12));
+			}
+		};
+
+		/// <summary>
+		/// Moving a vertex onto a neighbour
+		/// </summary>
+		struct Collapse
+		{
+			std::uint32_t from;
+			std::uint32_t to;
+			float error;
+		};
+
+		// Borders and seams are held in place by planes through the edge this much stronger than the triangles
+		constexpr double BOUNDARY_WEIGHT = 10.0;
+
+		std::uint64_t edgeKey(std::uint32_t a, std::uint32_t b) {
+			return a < b ? (std::uint64_t(a) << 32) | b : (std::uint64_t(b) << 32) | a;
+		}
+
+		std::size_t countEdge(const std::vector<std::uint64_t>& sortedEdges, std::uint64_t key) {
+			auto range = std::equal_range(sortedEdges.begin(), sortedEdges.end(), key);
+			return std::size_t(range.second - range.first);
+		}
+
+		glm::dvec3 triangleNormal(glm::dvec3 p0, glm::dvec3 p1, glm::dvec3 p2) {
+			return glm::cross(p1 - p0, p2 - p0);
+		}
+	}
+
+	float simplify(std::vector<std::uint32_t>& indices, const std::vector<glm::vec3>& positions,
+		std::size_t targetIndexCount, float maxError) {
+
+		std::size_t const vertexCount = positions.size();
+		indices.resize(indices.size() / 3 * 3);
+		if (indices.size() <= targetIndexCount || vertexCount == 0) {
+			return 0.f;
+		}
+
+		// Group the vertices that share a position, every vertex of a group points at the first one and the
+		// group's vertices (its wedges) are linked in a ring
+		std::vector<std::uint32_t> sortedVertices(vertexCount);
+		std::iota(sortedVertices.begin(), sortedVertices.end(), 0);
+		std::sort(sortedVertices.begin(), sortedVertices.end(), [&positions](std::uint32_t a, std::uint32_t b) {
+			const glm::vec3& pa = positions[a];
+			const glm::vec3& pb = positions[b];
+			return pa.x != pb.x ? pa.x < pb.x : pa.y != pb.y ? pa.y < pb.y : pa.z != pb.z ? pa.z < pb.z : a < b;
+		});
+
+		std::vector<std::uint32_t> positionID(vertexCount);
+		std::vector<std::uint32_t> nextWedge(vertexCount);
+		std::vector<std::uint32_t> wedgeCount(vertexCount, 0);
+		for (std::size_t begin = 0; begin < vertexCount;) {
+			std::size_t end = begin + 1;
+			while (end < vertexCount && positions[sortedVertices[end]] == positions[sortedVertices[begin]]) {
+				end++;
+			}
+			std::uint32_t const first = sortedVertices[begin];
+			for (std::size_t i = begin; i < end; i++) {
+				positionID[sortedVertices[i]] = first;
+				nextWedge[sortedVertices[i]] = sortedVertices[i + 1 < end ? i + 1 : begin];
+			}
+			wedgeCount[first] = std::uint32_t(end - begin);
+			begin = end;
+		}
+
+		// Every triangle adds its plane to the quadrics of its corners
+		std::vector<Quadric> quadrics(vertexCount);
+		std::size_t triangleCount = indices.size() / 3;
+		for (std::size_t triangle = 0; triangle < triangleCount; triangle++) {
+			glm::dvec3 const p0 = positions[indices[triangle * 3]];
+			glm::dvec3 const p1 = positions[indices[triangle * 3 + 1]];
+			glm::dvec3 const p2 = positions[indices[triangle * 3 + 2]];
+			glm::dvec3 normal = triangleNormal(p0, p1, p2);
+			double const length = glm::length(normal);
+			if (length <= 0.0) {
+				continue;
+			}
+			normal /= length;
+			double const area = length * 0.5;
+
+			Quadric plane;
+			plane.addPlane(normal, -glm::dot(normal, p0), area);
+			plane.area = area;
+			for (std::size_t corner = 0; corner < 3; corner++) {
+				quadrics[positionID[indices[triangle * 3 + corner]]] += plane;
+			}
+		}
+
+		// Edges used by only one triangle are borders, or seams when another vertex with the same position
+		// has the other side. A plane through the edge at right angles to its triangle keeps it in place.
+		std::vector<std::uint64_t> vertexEdges;
+		vertexEdges.reserve(indices.size());
+		for (std::size_t i = 0; i < indices.size(); i++) {
+			std::size_t const next = i % 3 == 2 ? i - 2 : i + 1;
+			vertexEdges.emplace_back(edgeKey(indices[i], indices[next]));
+		}
+		std::sort(vertexEdges.begin(), vertexEdges.end());
+		for (std::size_t i = 0; i < indices.size(); i++) {
+			std::size_t const next = i % 3 == 2 ? i - 2 : i + 1;
+			if (countEdge(vertexEdges, edgeKey(indices[i], indices[next])) != 1) {
+				continue;
+			}
+
+			std::size_t const triangle = i / 3;
+			glm::dvec3 const p0 = positions[indices[triangle * 3]];
+			glm::dvec3 const p1 = positions[indices[triangle * 3 + 1]];
+			glm::dvec3 const p2 = positions[indices[triangle * 3 + 2]];
+			glm::dvec3 const edgeStart = positions[indices[i]];
+			glm::dvec3 const edge = glm::dvec3(positions[indices[next]]) - edgeStart;
+			glm::dvec3 normal = glm::cross(edge, triangleNormal(p0, p1, p2));
+			double const length = glm::length(normal);
+			if (length <= 0.0) {
+				continue;
+			}
+			normal /= length;
+
+			Quadric plane;
+			plane.addPlane(normal, -glm::dot(normal, edgeStart), glm::dot(edge, edge) * BOUNDARY_WEIGHT);
+			quadrics[positionID[indices[i]]] += plane;
+			quadrics[positionID[indices[next]]] += plane;
+		}
+
+		std::size_t const targetTriangles = targetIndexCount / 3;
+		float resultError = 0.f;
+
+		std::vector<std::uint32_t> adjacencyOffsets(vertexCount + 1);
+		std::vector<std::uint32_t> adjacency;
+		std::vector<std::uint64_t> boundaryEdges;
+		std::vector<std::uint32_t> boundaryCount(vertexCount);
+		std::vector<std::uint64_t> positionEdges;
+		std::vector<Collapse> collapses;
+		std::vector<bool> locked(vertexCount);
+		std::vector<std::pair<std::uint32_t, std::uint32_t>> wedgeTargets;
+
+		// Each pass collapses the cheapest edges whose neighbourhoods do not overlap, then removes the
+		// triangles that collapsed
+		while (triangleCount > targetTriangles) {
+			// The triangles around each position
+			std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+			for (std::uint32_t index : indices) {
+				adjacencyOffsets[positionID[index] + 1]++;
+			}
+			std::partial_sum(adjacencyOffsets.begin(), adjacencyOffsets.end(), adjacencyOffsets.begin());
+			adjacency.resize(indices.size());
+			std::vector<std::uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+			for (std::size_t i = 0; i < indices.size(); i++) {
+				adjacency[fill[positionID[indices[i]]]++] = std::uint32_t(i / 3);
+			}
+
+			// Borders and seams between positions, and how many of them meet at each position
+			vertexEdges.clear();
+			positionEdges.clear();
+			for (std::size_t i = 0; i < indices.size(); i++) {
+				std::size_t const next = i % 3 == 2 ? i - 2 : i + 1;
+				vertexEdges.emplace_back(edgeKey(indices[i], indices[next]));
+				positionEdges.emplace_back(edgeKey(positionID[indices[i]], positionID[indices[next]]));
+			}
+			std::sort(vertexEdges.begin(), vertexEdges.end());
+
+			boundaryEdges.clear();
+			for (std::size_t i = 0; i < indices.size(); i++) {
+				std::size_t const next = i % 3 == 2 ? i - 2 : i + 1;
+				if (countEdge(vertexEdges, edgeKey(indices[i], indices[next])) == 1) {
+					boundaryEdges.emplace_back(positionEdges[i]);
+				}
+			}
+			std::sort(boundaryEdges.begin(), boundaryEdges.end());
+			boundaryEdges.erase(std::unique(boundaryEdges.begin(), boundaryEdges.end()), boundaryEdges.end());
+			std::fill(boundaryCount.begin(), boundaryCount.end(), 0);
+			for (std::uint64_t key : boundaryEdges) {
+				boundaryCount[std::uint32_t(key >> 32)]++;
+				boundaryCount[std::uint32_t(key)]++;
+			}
+
+			// A position may move if it is inside a single surface, or along the border or seam it sits on
+			// as long as it is not a corner of one
+			auto canCollapse = [&](std::uint32_t from, std::uint32_t to) {
+				if (wedgeCount[from] > 2) {
+					return false;
+				}
+				if (boundaryCount[from] == 0) {
+					return wedgeCount[from] == 1;
+				}
+				return boundaryCount[from] == 2 &&
+					std::binary_search(boundaryEdges.begin(), boundaryEdges.end(), edgeKey(from, to));
+			};
+
+			// Cost each edge in the cheaper direction it can collapse
+			std::sort(positionEdges.begin(), positionEdges.end());
+			positionEdges.erase(std::unique(positionEdges.begin(), positionEdges.end()), positionEdges.end());
+			collapses.clear();
+			for (std::uint64_t key : positionEdges) {
+				std::uint32_t const a = std::uint32_t(key >> 32);
+				std::uint32_t const b = std::uint32_t(key);
+				if (a == b) {
+					continue;
+				}
+
+				Quadric combined = quadrics[a];
+				combined += quadrics[b];
+				bool const aToB = canCollapse(a, b);
+				bool const bToA = canCollapse(b, a);
+				double const errorAtB = aToB ? combined.error(positions[b]) : 0.0;
+				double const errorAtA = bToA ? combined.error(positions[a]) : 0.0;
+				if (aToB && (!bToA || errorAtB <= errorAtA)) {
+					collapses.emplace_back(Collapse{ a, b, float(errorAtB) });
+				}
+				else if (bToA) {
+					collapses.emplace_back(Collapse{ b, a, float(errorAtA) });
+				}
+			}
+			std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) {
+				return a.error < b.error;
+			});
+
+			std::fill(locked.begin(), locked.end(), false);
+			std::size_t trianglesLeft = triangleCount;
+			std::size_t collapsed = 0;
+			for (const Collapse& collapse : collapses) {
+				if (trianglesLeft <= targetTriangles || collapse.error > maxError) {
+					break;
+				}
+				if (locked[collapse.from] || locked[collapse.to]) {
+					continue;
+				}
+
+				// Each wedge moves onto the wedge of the target it shares a triangle with, keeping the
+				// attributes on each side of a seam apart. A wedge with no such triangle can not move.
+				wedgeTargets.clear();
+				bool valid = true;
+				std::uint32_t wedge = collapse.from;
+				do {
+					std::uint32_t target = optimisation::UNUSED_VERTEX;
+					bool used = false;
+					for (std::uint32_t a = adjacencyOffsets[collapse.from]; a < adjacencyOffsets[collapse.from + 1]; a++) {
+						const std::uint32_t* triangle = &indices[adjacency[a] * 3];
+						if (triangle[0] != wedge && triangle[1] != wedge && triangle[2] != wedge) {
+							continue;
+						}
+						used = true;
+						for (std::size_t corner = 0; corner < 3; corner++) {
+							if (positionID[triangle[corner]] == collapse.to) {
+								target = triangle[corner];
+							}
+						}
+						if (target != optimisation::UNUSED_VERTEX) {
+							break;
+						}
+					}
+					if (used) {
+						if (target == optimisation::UNUSED_VERTEX) {
+							valid = false;
+							break;
+						}
+						wedgeTargets.emplace_back(wedge, target);
+					}
+					wedge = nextWedge[wedge];
+				} while (wedge != collapse.from);
+
+				// The triangles that stay must not fold over or become slivers
+				glm::dvec3 const newPosition = positions[collapse.to];
+				for (std::uint32_t a = adjacencyOffsets[collapse.from]; valid && a < adjacencyOffsets[collapse.from + 1]; a++) {
+					const std::uint32_t* triangle = &indices[adjacency[a] * 3];
+					glm::dvec3 corners[3];
+					glm::dvec3 moved[3];
+					bool onEdge = false;
+					for (std::size_t corner = 0; corner < 3; corner++) {
+						std::uint32_t const position = positionID[triangle[corner]];
+						onEdge = onEdge || position == collapse.to;
+						corners[corner] = positions[triangle[corner]];
+						moved[corner] = position == collapse.from ? newPosition : corners[corner];
+					}
+					if (onEdge) {
+						continue;
+					}
+
+					glm::dvec3 const oldNormal = triangleNormal(corners[0], corners[1], corners[2]);
+					glm::dvec3 const newNormal = triangleNormal(moved[0], moved[1], moved[2]);
+					if (glm::dot(oldNormal, newNormal) <= 0.25 * glm::length(oldNormal) * glm::length(newNormal)) {
+						valid = false;
+					}
+				}
+				if (!valid) {
+					continue;
+				}
+
+				// Move the wedges, the triangles along the edge become degenerate
+				for (std::uint32_t a = adjacencyOffsets[collapse.from]; a < adjacencyOffsets[collapse.from + 1]; a++) {
+					std::uint32_t* triangle = &indices[adjacency[a] * 3];
+					bool degenerate = false;
+					for (std::size_t corner = 0; corner < 3; corner++) {
+						locked[positionID[triangle[corner]]] = true;
+						degenerate = degenerate || positionID[triangle[corner]] == collapse.to;
+						for (const std::pair<std::uint32_t, std::uint32_t>& wedgeTarget : wedgeTargets) {
+							if (triangle[corner] == wedgeTarget.first) {
+								triangle[corner] = wedgeTarget.second;
+								break;
+							}
+						}
+					}
+					if (degenerate) {
+						trianglesLeft--;
+					}
+				}
+
+				quadrics[collapse.to] += quadrics[collapse.from];
+				resultError = std::max(resultError, collapse.error);
+				collapsed++;
+			}
+
+			if (collapsed == 0) {
+				break;
+			}
+
+			// Remove the collapsed triangles
+			std::size_t written = 0;
+			for (std::size_t triangle = 0; triangle < triangleCount; triangle++) {
+				std::uint32_t const a = indices[triangle * 3];
+				std::uint32_t const b = indices[triangle * 3 + 1];
+				std::uint32_t const c = indices[triangle * 3 + 2];
+				if (positionID[a] == positionID[b] || positionID[b] == positionID[c] || positionID[a] == positionID[c]) {
+					continue;
+				}
+				indices[written++] = a;
+				indices[written++] = b;
+				indices[written++] = c;
+			}
+			indices.resize(written);
+			triangleCount = written / 3;
+		}
+
+		return resultError;
+	}
+
+	std::vector<LodLevel> buildLodChain(std::vector<std::uint32_t>& indices, const std::vector<glm::vec3>& positions,
+		std::uint32_t maxLevels, float reduction, std::size_t minTriangles) {
+
+		std::vector<LodLevel> levels;
+		levels.emplace_back(LodLevel{ 0, std::uint32_t(indices.size()), 0.f });
+
+		// Every level is simplified from the full mesh so its error is measured against it
+		std::vector<std::uint32_t> const fullMesh = indices;
+		std::size_t previousCount = fullMesh.size();
+		for (std::uint32_t level = 1; level < maxLevels; level++) {
+			if (previousCount / 3 < minTriangles) {
+				break;
+			}
+
+			std::vector<std::uint32_t> lodIndices = fullMesh;
+			std::size_t const targetCount = std::size_t(float(previousCount / 3) * reduction) * 3;
+			float error = simplify(lodIndices, positions, targetCount);
+
+			// Stop once the seams and borders stop the mesh getting much smaller
+			if (float(lodIndices.size()) > float(previousCount) * (1.f + reduction) * 0.5f) {
+				break;
+			}
+
+			optimisation::optimiseVertexCache(lodIndices, positions.size());
+
+			levels.emplace_back(LodLevel{ std::uint32_t(indices.size()), std::uint32_t(lodIndices.size()),
+				std::max(error, levels.back().error) });
+			indices.insert(indices.end(), lodIndices.begin(), lodIndices.end());
+			previousCount = lodIndices.size();
+		}
+
+		return levels;
+	}
+}
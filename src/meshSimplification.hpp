@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "glm.hpp"
+
+namespace simplification {
+	/// <summary>
+	/// One level of detail of a mesh. Every level indexes the same vertex buffer and is stored one after
+	/// the other in the mesh's index buffer, level 0 is the full mesh.
+	/// </summary>
+	struct LodLevel
+	{
+		std::uint32_t firstIndex = 0;
+		std::uint32_t indexCount = 0;
+
+		// Largest distance (in world units) the simplified surface may be from the full mesh
+		float error = 0.f;
+
+		// The meshlets covering this level's indices
+		std::uint32_t firstMeshlet = 0;
+		std::uint32_t meshletCount = 0;
+	};
+
+	/// <summary>
+	/// Simplifies a triangle list with quadric error metric edge collapses (Garland and Heckbert 1997).
+	/// Vertices only ever collapse onto one of their neighbours so the result keeps using the original
+	/// vertex buffer. Vertices that share a position but not their other attributes form a seam, seams and
+	/// open borders only collapse along themselves and their corners are never moved.
+	/// </summary>
+	/// <param name="indices">Triangle list indices, replaced with the simplified triangles</param>
+	/// <param name="positions">The vertex positions</param>
+	/// <param name="targetIndexCount">Number of indices to stop at</param>
+	/// <param name="maxError">Largest error a collapse may add</param>
+	/// <returns>The error of the simplified mesh in world units</returns>
+	float simplify(std::vector<std::uint32_t>& indices, const std::vector<glm::vec3>& positions,
+		std::size_t targetIndexCount, float maxError = std::numeric_limits<float>::max());
+
+	/// <summary>
+	/// Builds coarser levels of detail of a mesh, each simplified from the full mesh. The levels are
+	/// appended to the index buffer and optimised for the vertex cache. Levels stop once simplifying
+	/// no longer removes enough triangles.
+	/// </summary>
+	/// <param name="indices">The full mesh's triangle list indices, the levels are appended to it</param>
+	/// <param name="positions">The vertex positions</param>
+	/// <param name="maxLevels">Most levels to output, including the full mesh</param>
+	/// <param name="reduction">Fraction of the triangles kept from one level to the next</param>
+	/// <param name="minTriangles">Meshes with fewer triangles than this are not simplified any further</param>
+	/// <returns>The levels, level 0 being the full mesh</returns>
+	std::vector<LodLevel> buildLodChain(std::vector<std::uint32_t>& indices, const std::vector<glm::vec3>& positions,
+		std::uint32_t maxLevels, float reduction, std::size_t minTriangles);
+}
@@ -0,0 +1,220 @@
+#include "meshlets.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace meshlets {
+
+	namespace {
+		/// <summary>
+		/// Counts the corners of a triangle that are not in the meshlet yet
+		/// </summary>
+		std::uint32_t countNewVertices(const std::uint32_t* triangle, const std::vector<bool>& inMeshlet) {
+			std::uint32_t count = 0;
+			for (std::size_t corner = 0; corner < 3; corner++) {
+				bool const repeated = (corner > 0 && triangle[corner] == triangle[0]) || (corner > 1 && triangle[corner] == triangle[1]);
+				if (!inMeshlet[triangle[corner]] && !repeated) {
+					count++;
+				}
+			}
+			return count;
+		}
+	}
+
+	void buildMeshlets(std::vector<std::uint32_t>& indices, std::size_t firstIndex, std::size_t indexCount,
+		const std::vector<glm::vec3>& positions, std::uint32_t maxVertices, std::uint32_t maxTriangles,
+		std::vector<Meshlet>& outMeshlets) {
+
+		std::size_t const triangleCount = indexCount / 3;
+		if (triangleCount == 0) {
+			return;
+		}
+		const std::uint32_t* const source = indices.data() + firstIndex;
+		std::size_t const vertexCount = positions.size();
+		std::size_t const firstMeshlet = outMeshlets.size();
+
+		// The triangles of each vertex
+		std::vector<std::uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+		for (std::size_t i = 0; i < triangleCount * 3; i++) {
+			adjacencyOffsets[source[i] + 1]++;
+		}
+		for (std::size_t i = 0; i < vertexCount; i++) {
+			adjacencyOffsets[i + 1] += adjacencyOffsets[i];
+		}
+		std::vector<std::uint32_t> adjacency(triangleCount * 3);
+		std::vector<std::uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+		for (std::size_t i = 0; i < triangleCount * 3; i++) {
+			adjacency[fill[source[i]]++] = std::uint32_t(i / 3);
+		}
+
+		std::vector<glm::vec3> centroids(triangleCount);
+		for (std::size_t triangle = 0; triangle < triangleCount; triangle++) {
+			centroids[triangle] = (positions[source[triangle * 3]] + positions[source[triangle * 3 + 1]] + positions[source[triangle * 3 + 2]]) / 3.f;
+		}
+
+		std::vector<bool> emitted(triangleCount, false);
+		std::vector<bool> inMeshlet(vertexCount, false);
+		std::vector<std::uint32_t> meshletVertices;
+		std::vector<std::uint32_t> meshletTriangles;
+		std::vector<std::vector<std::uint32_t>> groups;
+
+		glm::vec3 centroidSum(0.f);
+		std::size_t cursor = 0;
+
+		// Closes the current meshlet, its triangles are kept in their input order
+		auto flush = [&]() {
+			std::sort(meshletTriangles.begin(), meshletTriangles.end());
+			groups.emplace_back(std::move(meshletTriangles));
+			meshletTriangles.clear();
+
+			for (std::uint32_t vertex : meshletVertices) {
+				inMeshlet[vertex] = false;
+			}
+			meshletVertices.clear();
+			centroidSum = glm::vec3(0.f);
+		};
+
+		for (std::size_t added = 0; added < triangleCount; added++) {
+			// Prefer the neighbouring triangle adding the fewest vertices, then the one nearest the centre
+			std::uint32_t best = std::numeric_limits<std::uint32_t>::max();
+			std::uint32_t bestNewVertices = 4;
+			float bestDistance = std::numeric_limits<float>::max();
+			glm::vec3 const centre = meshletTriangles.empty() ? glm::vec3(0.f) : centroidSum / float(meshletTriangles.size());
+			for (std::uint32_t vertex : meshletVertices) {
+				for (std::uint32_t a = adjacencyOffsets[vertex]; a < adjacencyOffsets[vertex + 1]; a++) {
+					std::uint32_t const triangle = adjacency[a];
+					if (emitted[triangle]) {
+						continue;
+					}
+
+					std::uint32_t const newVertices = countNewVertices(&source[triangle * 3], inMeshlet);
+					glm::vec3 const offset = centroids[triangle] - centre;
+					float const distance = glm::dot(offset, offset);
+					if (newVertices < bestNewVertices || (newVertices == bestNewVertices && distance < bestDistance)) {
+						best = triangle;
+						bestNewVertices = newVertices;
+						bestDistance = distance;
+					}
+				}
+			}
+
+			// Nothing connects to the meshlet, carry on from the next triangle in the input order
+			if (best == std::numeric_limits<std::uint32_t>::max()) {
+				while (emitted[cursor]) {
+					cursor++;
+				}
+				best = std::uint32_t(cursor);
+				bestNewVertices = countNewVertices(&source[best * 3], inMeshlet);
+			}
+
+			// Start a new meshlet if the triangle does not fit, it seeds the next one
+			if (meshletVertices.size() + bestNewVertices > maxVertices || meshletTriangles.size() + 1 > maxTriangles) {
+				flush();
+			}
+
+			emitted[best] = true;
+			for (std::size_t corner = 0; corner < 3; corner++) {
+				std::uint32_t const vertex = source[best * 3 + corner];
+				if (!inMeshlet[vertex]) {
+					inMeshlet[vertex] = true;
+					meshletVertices.emplace_back(vertex);
+				}
+			}
+			meshletTriangles.emplace_back(best);
+			centroidSum += centroids[best];
+		}
+		flush();
+
+		// The range was already ordered for the vertex cache and overdraw, so the meshlets are placed by their
+		// earliest triangle and keep that order inside and between them
+		std::sort(groups.begin(), groups.end(),
+			[](const std::vector<std::uint32_t>& a, const std::vector<std::uint32_t>& b) { return a.front() < b.front(); });
+
+		std::vector<std::uint32_t> output;
+		output.reserve(triangleCount * 3);
+		for (const std::vector<std::uint32_t>& group : groups) {
+			Meshlet meshlet;
+			meshlet.firstIndex = std::uint32_t(firstIndex + output.size());
+			meshlet.triangleCount = std::uint32_t(group.size());
+			std::uint32_t vertexCount = 0;
+			for (std::uint32_t triangle : group) {
+				for (std::size_t corner = 0; corner < 3; corner++) {
+					std::uint32_t const vertex = source[triangle * 3 + corner];
+					output.emplace_back(vertex);
+					if (!inMeshlet[vertex]) {
+						inMeshlet[vertex] = true;
+						vertexCount++;
+					}
+				}
+			}
+			for (std::size_t i = output.size() - group.size() * 3; i < output.size(); i++) {
+				inMeshlet[output[i]] = false;
+			}
+			meshlet.vertexCount = vertexCount;
+			outMeshlets.emplace_back(meshlet);
+		}
+
+		// Write the grouped triangles back, any incomplete triangle at the end is kept as it was
+		std::copy(output.begin(), output.end(), indices.begin() + firstIndex);
+
+		for (std::size_t i = firstMeshlet; i < outMeshlets.size(); i++) {
+			calculateBounds(outMeshlets[i], indices, positions);
+		}
+	}
+
+	void calculateBounds(Meshlet& meshlet, const std::vector<std::uint32_t>& indices, const std::vector<glm::vec3>& positions) {
+		std::size_t const begin = meshlet.firstIndex;
+		std::size_t const end = begin + std::size_t(meshlet.triangleCount) * 3;
+		if (begin == end) {
+			return;
+		}
+
+		// Sphere around the centre of the bounding box
+		glm::vec3 boundsMin = positions[indices[begin]];
+		glm::vec3 boundsMax = boundsMin;
+		for (std::size_t i = begin; i < end; i++) {
+			boundsMin = glm::min(boundsMin, positions[indices[i]]);
+			boundsMax = glm::max(boundsMax, positions[indices[i]]);
+		}
+		meshlet.centre = (boundsMin + boundsMax) * 0.5f;
+		meshlet.radius = 0.f;
+		for (std::size_t i = begin; i < end; i++) {
+			meshlet.radius = std::max(meshlet.radius, glm::length(positions[indices[i]] - meshlet.centre));
+		}
+
+		// The cone axis is the average facing, the cutoff is the sine of the widest angle from it
+		std::vector<glm::vec3> normals;
+		normals.reserve(meshlet.triangleCount);
+		glm::vec3 axis(0.f);
+		for (std::size_t i = begin; i < end; i += 3) {
+			glm::vec3 const p0 = positions[indices[i]];
+			glm::vec3 normal = glm::cross(positions[indices[i + 1]] - p0, positions[indices[i + 2]] - p0);
+			float const length = glm::length(normal);
+			if (length > 0.f) {
+				normal /= length;
+				normals.emplace_back(normal);
+				axis += normal;
+			}
+		}
+
+		float const axisLength = glm::length(axis);
+		meshlet.coneAxis = glm::vec3(0.f, 0.f, 1.f);
+		meshlet.coneCutoff = 1.f;
+		if (axisLength <= 0.f) {
+			return;
+		}
+		axis /= axisLength;
+
+		float minDot = 1.f;
+		for (const glm::vec3& normal : normals) {
+			minDot = std::min(minDot, glm::dot(normal, axis));
+		}
+
+		// Triangles facing more than 90 degrees apart can never all face away together
+		meshlet.coneAxis = axis;
+		if (minDot > 0.f) {
+			meshlet.coneCutoff = std::sqrt(1.f - minDot * minDot);
+		}
+	}
+}
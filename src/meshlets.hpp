@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "glm.hpp"
+
+namespace meshlets {
+	/// <summary>
+	/// A small cluster of triangles stored as a contiguous range of its mesh's index buffer, along with
+	/// the bounds used to cull it. Laid out to match std430 so it can be read by shaders as is.
+	/// </summary>
+	struct Meshlet
+	{
+		// Bounding sphere of the vertices
+		glm::vec3 centre = glm::vec3(0.f);
+		float radius = 0.f;
+
+		// Normal cone, every triangle faces within asin(coneCutoff) of the axis (cutoff 1 can not be back face culled)
+		glm::vec3 coneAxis = glm::vec3(0.f, 0.f, 1.f);
+		float coneCutoff = 1.f;
+
+		std::uint32_t firstIndex = 0;
+		std::uint32_t triangleCount = 0;
+		std::uint32_t vertexCount = 0;
+		std::uint32_t padding = 0;
+	};
+	static_assert(sizeof(Meshlet) == 48);
+
+	/// <summary>
+	/// Splits a range of a triangle list into meshlets. Each meshlet is grown from a seed triangle by adding
+	/// the neighbouring triangle that brings in the fewest new vertices, nearest the meshlet's centre on a tie,
+	/// so the meshlets stay compact and their bounds tight. The triangles of the range are reordered so each
+	/// meshlet is contiguous, keeping the input order within and between the meshlets so an earlier vertex cache
+	/// and overdraw optimisation is mostly preserved.
+	/// </summary>
+	/// <param name="indices">Triangle list indices, the range is reordered in place</param>
+	/// <param name="firstIndex">First index of the range</param>
+	/// <param name="indexCount">Number of indices in the range</param>
+	/// <param name="positions">The vertex positions</param>
+	/// <param name="maxVertices">Most unique vertices in a meshlet</param>
+	/// <param name="maxTriangles">Most triangles in a meshlet</param>
+	/// <param name="outMeshlets">The meshlets are appended to this</param>
+	void buildMeshlets(std::vector<std::uint32_t>& indices, std::size_t firstIndex, std::size_t indexCount,
+		const std::vector<glm::vec3>& positions, std::uint32_t maxVertices, std::uint32_t maxTriangles,
+		std::vector<Meshlet>& outMeshlets);
+
+	/// <summary>
+	/// Calculates the bounding sphere and normal cone of a meshlet from its triangles
+	/// </summary>
+	/// <param name="meshlet">The meshlet, its index range must be set</param>
+	/// <param name="indices">Triangle list indices</param>
+	/// <param name="positions">The vertex positions</param>
+	void calculateBounds(Meshlet& meshlet, const std::vector<std::uint32_t>& indices, const std::vector<glm::vec3>& positions);
+}
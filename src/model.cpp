@@ -1,168 +1,292 @@
 #include "model.hpp"
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <unordered_map>
+
+#include "gtc/packing.hpp"
+
 namespace model {
-	Mesh createMesh(app::AppContext app, VmaAllocator& allocator, VkCommandPool commandPool,
+
+	namespace {
+		/// <summary>
+		/// Maps a unit vector onto the octahedron and unfolds it into the [-1, 1] square.
+		/// Must match octDecode in the vertex shaders.
+		/// </summary>
+		glm::vec2 octEncode(glm::vec3 vector) {
+			float const length = std::abs(vector.x) + std::abs(vector.y) + std::abs(vector.z);
+			if (length == 0.f) {
+				return glm::vec2(0.f);
+			}
+			vector /= length;
+
+			glm::vec2 encoded(vector.x, vector.y);
+			if (vector.z < 0.f) {
+				// Fold the lower half over the diagonals
+				encoded.x = (1.f - std::abs(vector.y)) * (vector.x >= 0.f ? 1.f : -1.f);
+				encoded.y = (1.f - std::abs(vector.x)) * (vector.y >= 0.f ? 1.f : -1.f);
+			}
+			return encoded;
+		}
+
+		std::int16_t toSnorm16(float value) {
+			return std::int16_t(std::lround(glm::clamp(value, -1.f, 1.f) * 32767.f));
+		}
+
+		std::uint16_t toUnorm16(float value) {
+			return std::uint16_t(std::lround(glm::clamp(value, 0.f, 1.f) * 65535.f));
+		}
+
+		std::int8_t toSnorm8(float value) {
+			return std::int8_t(std::lround(glm::clamp(value, -1.f, 1.f) * 127.f));
+		}
+
+		/// <summary>
+		/// Stores y in [1, 127] with its sign as the handedness, y = 0 would lose the sign
+		/// </summary>
+		std::int8_t toSignedSnorm8(float value, float handedness) {
+			long const magnitude = std::lround((glm::clamp(value, -1.f, 1.f) * 0.5f + 0.5f) * 126.f) + 1;
+			return std::int8_t(handedness < 0.f ? -magnitude : magnitude);
+		}
+	}
+
+	GeometryPool createGeometryPool(VmaAllocator& allocator, VertexFormat format, std::uint32_t vertexCapacity, std::uint32_t indexCapacity) {
+		if (format == VertexFormat::Packed) {
+			return GeometryPool(allocator, { sizeof(PackedPosition), sizeof(PackedSurface) }, vertexCapacity, indexCapacity);
+		}
+		return GeometryPool(allocator, { sizeof(glm::vec3), sizeof(glm::vec2), sizeof(glm::vec3), sizeof(glm::vec4) },
+			vertexCapacity, indexCapacity);
+	}
+
+	Mesh createMesh(utility::UploadBatch& uploads,
+		GeometryPool& pool,
 		std::vector<glm::vec3>& vPositions,
 		std::vector<glm::vec2>& vTextureCoords,
 		std::vector<glm::vec3>& vNormals,
 		std::vector<glm::vec4>& vTangents,
-		std::vector<std::uint32_t>& vMaterials,
-		std::vector<std::uint32_t>& indices
+		std::vector<std::uint32_t>& indices,
+		VertexFormat format
 	){
-		// Size of the input data in bytes (use long long since the number can be very large)
-		unsigned long long sizeOfPositions = vPositions.size() * sizeof(glm::vec3);
-		unsigned long long sizeOfUVs = vTextureCoords.size() * sizeof(glm::vec2);
-		unsigned long long sizeOfNormals = vNormals.size() * sizeof(glm::vec3);
-		unsigned long long sizeOfTangents = vTangents.size() * sizeof(glm::vec4);
-		unsigned long long sizeOfMatIDs = vMaterials.size() * sizeof(std::uint32_t);
-		unsigned long long sizeOfIndices = indices.size() * sizeof(std::uint32_t);
-		
-		// Set up the vertex positions
-		utility::BufferSet positionBuffer = setupMemoryBuffer(
-			app, 
-			allocator, 
-			commandPool, 
-			sizeOfPositions, 
-			vPositions.data(), 
-			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT
-		);
-
-		// Set up the vertex texture coordinates
-		utility::BufferSet UVBuffer = setupMemoryBuffer(
-			app,
-			allocator,
-			commandPool,
-			sizeOfUVs,
-			vTextureCoords.data(),
-			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT
-		);
+		Mesh outputMesh;
 
-		// Set up the vertex texture coordinates
-		utility::BufferSet normalBuffer = setupMemoryBuffer(
-			app,
-			allocator,
-			commandPool,
-			sizeOfNormals,
-			vNormals.data(),
-			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT
-		);
+		// Reserve the mesh's room in the pool, the levels of detail and meshlets of its submeshes index from its start
+		outputMesh.vertexFormat = format;
+		outputMesh.geometry = pool.allocate(std::uint32_t(vPositions.size()), std::uint32_t(indices.size()));
+		outputMesh.numberOfVertices = uint32_t(vPositions.size());
+		outputMesh.numberOfIndices = uint32_t(indices.size());
 
-		// Set up the vertex texture coordinates
-		utility::BufferSet tangentBuffer = setupMemoryBuffer(
-			app,
-			allocator,
-			commandPool,
-			sizeOfTangents,
-			vTangents.data(),
-			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT
-		);
+		if (format == VertexFormat::Packed) {
+			std::vector<PackedPosition> packedPositions;
+			std::vector<PackedSurface> packedSurfaces;
+			outputMesh.constants = packVertices(vPositions, vTextureCoords, vNormals, vTangents,
+				packedPositions, packedSurfaces);
 
-		// Set up the vertex material ids
-		utility::BufferSet matBuffer = setupMemoryBuffer(
-			app,
-			allocator,
-			commandPool,
-			sizeOfMatIDs,
-			vMaterials.data(),
-			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT
-		);
+			pool.uploadVertices(uploads, outputMesh.geometry, 0, packedPositions.data());
+			pool.uploadVertices(uploads, outputMesh.geometry, 1, packedSurfaces.data());
+		}
+		else {
+			pool.uploadVertices(uploads, outputMesh.geometry, 0, vPositions.data());
+			pool.uploadVertices(uploads, outputMesh.geometry, 1, vTextureCoords.data());
+			pool.uploadVertices(uploads, outputMesh.geometry, 2, vNormals.data());
+			pool.uploadVertices(uploads, outputMesh.geometry, 3, vTangents.data());
+		}
+		pool.uploadIndices(uploads, outputMesh.geometry, indices.data());
 
-		// Set up the indices
-		utility::BufferSet indexBuffer = setupMemoryBuffer(
-			app,
-			allocator,
-			commandPool,
-			sizeOfIndices,
-			indices.data(),
-			VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT
-		);
+		return outputMesh;
+	}
 
+	Mesh createSubmesh(const Mesh& mesh,
+		std::uint32_t materialID,
+		const std::vector<glm::vec3>& vPositions,
+		const std::vector<std::uint32_t>& indices,
+		const std::vector<simplification::LodLevel>& lods,
+		const std::vector<meshlets::Meshlet>& meshlets
+	) {
 		Mesh outputMesh;
+		outputMesh.vertexFormat = mesh.vertexFormat;
+		outputMesh.geometry = mesh.geometry;
+		outputMesh.numberOfVertices = mesh.numberOfVertices;
+		outputMesh.numberOfIndices = mesh.numberOfIndices;
+		outputMesh.constants = mesh.constants;
+		outputMesh.materialID = materialID;
 
-		outputMesh.vertexPositions = std::move(positionBuffer);
-		outputMesh.vertexUVs = std::move(UVBuffer);
-		outputMesh.vertexNormals = std::move(normalBuffer);
-		outputMesh.vertexTangents = std::move(tangentBuffer);
-		outputMesh.vertexMaterials = std::move(matBuffer);
-		outputMesh.indices = std::move(indexBuffer);
-		outputMesh.numberOfVertices = uint32_t(vPositions.size());
-		outputMesh.numberOfIndices = uint32_t(indices.size());
+		// Keep only the meshlets of the submesh's levels, renumbered from the first
+		std::vector<meshlets::Meshlet> submeshMeshlets;
+		outputMesh.lods = lods;
+		for (simplification::LodLevel& lod : outputMesh.lods) {
+			if (lod.meshletCount > 0 && !meshlets.empty()) {
+				std::uint32_t const firstMeshlet = std::uint32_t(submeshMeshlets.size());
+				submeshMeshlets.insert(submeshMeshlets.end(),
+					meshlets.begin() + lod.firstMeshlet, meshlets.begin() + lod.firstMeshlet + lod.meshletCount);
+				lod.firstMeshlet = firstMeshlet;
+			}
+			else {
+				lod.firstMeshlet = 0;
+				lod.meshletCount = 0;
+			}
+		}
+		outputMesh.meshlets = std::make_shared<const std::vector<meshlets::Meshlet>>(std::move(submeshMeshlets));
+		if (outputMesh.lods.empty()) {
+			return outputMesh;
+		}
+
+		// Bounding sphere around the centre of the bounds of the full triangles
+		simplification::LodLevel const& full = outputMesh.lods[0];
+		if (full.indexCount > 0) {
+			glm::vec3 boundsMin = vPositions[indices[full.firstIndex]];
+			glm::vec3 boundsMax = boundsMin;
+			for (std::uint32_t i = full.firstIndex; i < full.firstIndex + full.indexCount; i++) {
+				boundsMin = glm::min(boundsMin, vPositions[indices[i]]);
+				boundsMax = glm::max(boundsMax, vPositions[indices[i]]);
+			}
+			outputMesh.boundsCentre = (boundsMin + boundsMax) * 0.5f;
+			for (std::uint32_t i = full.firstIndex; i < full.firstIndex + full.indexCount; i++) {
+				outputMesh.boundsRadius = std::max(outputMesh.boundsRadius, glm::length(vPositions[indices[i]] - outputMesh.boundsCentre));
+			}
+		}
 
 		return outputMesh;
+	}
 
+	Mesh createInstance(const Mesh& submesh, const glm::mat4& transform, std::vector<InstanceData>& instances) {
+		Mesh outputMesh = submesh;
+		outputMesh.instance = std::uint32_t(instances.size());
+		outputMesh.transform = transform;
+		instances.emplace_back(InstanceData{ transform, submesh.constants, submesh.materialID });
+
+		// The sphere moves with the instance and grows by its largest scale
+		outputMesh.scale = std::max({ glm::length(glm::vec3(transform[0])), glm::length(glm::vec3(transform[1])),
+			glm::length(glm::vec3(transform[2])) });
+		outputMesh.boundsCentre = glm::vec3(transform * glm::vec4(submesh.boundsCentre, 1.f));
+		outputMesh.boundsRadius = submesh.boundsRadius * outputMesh.scale;
+		return outputMesh;
 	}
 
-	utility::BufferSet setupMemoryBuffer(app::AppContext app, VmaAllocator& allocator, VkCommandPool commandPool, VkDeviceSize sizeOfData, const void* data, VkBufferUsageFlags usageFlags) {
-		// Set up the on GPU buffer
-		utility::BufferSet buffer = utility::createBuffer(
-			allocator,
-			sizeOfData,
-			usageFlags,
-			VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE
+	MeshConstants packVertices(const std::vector<glm::vec3>& vPositions,
+		const std::vector<glm::vec2>& vTextureCoords,
+		const std::vector<glm::vec3>& vNormals,
+		const std::vector<glm::vec4>& vTangents,
+		std::vector<PackedPosition>& outPositions,
+		std::vector<PackedSurface>& outSurfaces
+	) {
+		// Quantise the positions across the bounds of the mesh
+		glm::vec3 boundsMin(std::numeric_limits<float>::max());
+		glm::vec3 boundsMax(std::numeric_limits<float>::lowest());
+		for (glm::vec3 const& position : vPositions) {
+			boundsMin = glm::min(boundsMin, position);
+			boundsMax = glm::max(boundsMax, position);
+		}
+		if (vPositions.empty()) {
+			boundsMin = boundsMax = glm::vec3(0.f);
+		}
+		glm::vec3 const extent = boundsMax - boundsMin;
+		glm::vec3 const inverseExtent(
+			extent.x > 0.f ? 1.f / extent.x : 0.f,
+			extent.y > 0.f ? 1.f / extent.y : 0.f,
+			extent.z > 0.f ? 1.f / extent.z : 0.f
 		);
 
-		// Set up the staging buffer
-		utility::BufferSet staging = utility::createBuffer(
-			allocator,
-			sizeOfData,
-			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-			VMA_MEMORY_USAGE_AUTO,
-			VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT
-		);
+		MeshConstants constants;
+		constants.positionOffset = glm::vec4(boundsMin, 0.f);
+		constants.positionScale = glm::vec4(extent / 65535.f, 0.f);
 
-		// Map the memory
-		void* memory = nullptr;
-		vmaMapMemory(allocator, staging.allocation, &memory);
-		std::memcpy(memory, data, sizeOfData);
-		vmaUnmapMemory(allocator, staging.allocation);
-
-		// Create a command buffer to record the data into
-		VkCommandBuffer commandBuffer = utility::createCommandBuffer(app, commandPool);
-
-		// Begin recording into the command buffer
-		VkCommandBufferBeginInfo recordInfo{};
-		recordInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-		if (vkBeginCommandBuffer(commandBuffer, &recordInfo) != VK_SUCCESS) {
-			throw std::runtime_error("Failed to start command buffer recording.");
-		}
-
-		// Copy the data from staging to GPU
-		VkBufferCopy copy{};
-		copy.size = sizeOfData;
-		vkCmdCopyBuffer(commandBuffer, staging.buffer, buffer.buffer, 1, &copy);
-		utility::createBufferBarrier(buffer.buffer, VK_WHOLE_SIZE,
-			VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
-			VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED,
-			commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT
-		);
+		outPositions.resize(vPositions.size());
+		outSurfaces.resize(vPositions.size());
+		for (std::size_t i = 0; i < vPositions.size(); i++) {
+			glm::vec3 const position = (vPositions[i] - boundsMin) * inverseExtent;
+			outPositions[i].x = toUnorm16(position.x);
+			outPositions[i].y = toUnorm16(position.y);
+			outPositions[i].z = toUnorm16(position.z);
+			outPositions[i].padding = 0;
 
-		// End the recording
-		if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
-			throw std::runtime_error("Failed to end command buffer recording.");
+			glm::vec2 const normal = octEncode(vNormals[i]);
+			glm::vec2 const tangent = octEncode(glm::vec3(vTangents[i]));
+			outSurfaces[i].u = glm::packHalf1x16(vTextureCoords[i].x);
+			outSurfaces[i].v = glm::packHalf1x16(vTextureCoords[i].y);
+			outSurfaces[i].normalX = toSnorm16(normal.x);
+			outSurfaces[i].normalY = toSnorm16(normal.y);
+			outSurfaces[i].tangentX = toSnorm8(tangent.x);
+			outSurfaces[i].tangentY = toSignedSnorm8(tangent.y, vTangents[i].w);
 		}
 
-		// Use a fence to ensure that transfers are complete before moving on
-		VkFence submitComplete = utility::createFence(app);
+		return constants;
+	}
+
+	utility::BufferSet setupMemoryBuffer(utility::UploadBatch& uploads, VkDeviceSize sizeOfData, const void* data, VkBufferUsageFlags usageFlags) {
+		// Create the on GPU buffer and record the copy from the staging arena
+		return uploads.uploadBuffer(data, sizeOfData, usageFlags);
+	}
+
+	LodView createLodView(glm::vec3 position, float verticalFov, float viewportHeight, float threshold) {
+		LodView view;
+		view.position = position;
+		view.pixelsPerUnit = viewportHeight / (2.f * std::tan(verticalFov * 0.5f));
+		view.threshold = threshold;
+		return view;
+	}
+
+	const simplification::LodLevel& selectLod(const Mesh& mesh, const LodView& view) {
+		// The nearest point of the bounds sees the error largest, inside them only the full mesh will do
+		float const distance = glm::length(mesh.boundsCentre - view.position) - mesh.boundsRadius;
+		if (distance <= 0.f) {
+			return mesh.lods[0];
+		}
 
-		// Submit the recorded commands for execution
-		VkSubmitInfo submitInfo{};
-		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &commandBuffer;
-		if (vkQueueSubmit(app.graphicsQueue, 1, &submitInfo, submitComplete)) {
-			throw std::runtime_error("Failed to submit recorded commands.");
+		// The levels get coarser and their errors only grow, the errors are in the space of the first instance
+		float const maxError = view.threshold * distance / (view.pixelsPerUnit * mesh.scale);
+		std::size_t level = 0;
+		while (level + 1 < mesh.lods.size() && mesh.lods[level + 1].error <= maxError) {
+			level++;
 		}
+		return mesh.lods[level];
+	}
 
-		// Wait for the fence before clean up
-		if (vkWaitForFences(app.logicalDevice, 1, &submitComplete, VK_TRUE, std::numeric_limits<std::uint64_t>::max())) {
-			throw std::runtime_error("Fence failed to return as complete.");
+	void batchInstances(const std::vector<Mesh>& meshes, const std::vector<std::uint32_t>& drawOrder, const LodView& view,
+		std::vector<std::uint32_t>& visibleInstances, std::vector<InstanceBatch>& outBatches) {
+		// Find the batch of each draw, a batch is made by the first (nearest) draw of its submesh and level
+		std::size_t const firstBatch = outBatches.size();
+		std::unordered_map<std::uint64_t, std::uint32_t> batchOfLevel;
+		batchOfLevel.reserve(drawOrder.size());
+		std::vector<std::uint32_t> drawBatches(drawOrder.size());
+		for (std::size_t draw = 0; draw < drawOrder.size(); draw++) {
+			const Mesh& mesh = meshes[drawOrder[draw]];
+			std::uint32_t const level = std::uint32_t(&selectLod(mesh, view) - mesh.lods.data());
+			auto [entry, added] = batchOfLevel.try_emplace((std::uint64_t(mesh.submesh) << 32) | level, std::uint32_t(outBatches.size()));
+			if (added) {
+				outBatches.emplace_back(InstanceBatch{ drawOrder[draw], level, 0, 0 });
+			}
+			outBatches[entry->second].instanceCount++;
+			drawBatches[draw] = entry->second;
 		}
 
-		vkFreeCommandBuffers(app.logicalDevice, commandPool, 1, &commandBuffer);
-		vkDestroyFence(app.logicalDevice, submitComplete, nullptr);
+		// Each batch's instances follow the last batch's, then are filled in draw order
+		std::uint32_t firstInstance = std::uint32_t(visibleInstances.size());
+		for (std::size_t batch = firstBatch; batch < outBatches.size(); batch++) {
+			outBatches[batch].firstInstance = firstInstance;
+			firstInstance += outBatches[batch].instanceCount;
+			outBatches[batch].instanceCount = 0;
+		}
+		visibleInstances.resize(firstInstance);
+		for (std::size_t draw = 0; draw < drawOrder.size(); draw++) {
+			InstanceBatch& batch = outBatches[drawBatches[draw]];
+			visibleInstances[batch.firstInstance + batch.instanceCount++] = meshes[drawOrder[draw]].instance;
+		}
+	}
 
-		return buffer;
+	void addMeshBounds(MeshBounds& bounds, glm::vec3 boundsMin, glm::vec3 boundsMax, const glm::mat4& transform) {
+		// Stored as centre and half extents as that is what the plane tests use, each axis of the
+		// transformed box reaches as far as the absolute transformed extents added together
+		glm::vec3 centre = glm::vec3(transform * glm::vec4((boundsMin + boundsMax) * 0.5f, 1.f));
+		glm::mat3 const absolute(glm::abs(glm::vec3(transform[0])), glm::abs(glm::vec3(transform[1])), glm::abs(glm::vec3(transform[2])));
+		glm::vec3 extent = absolute * ((boundsMax - boundsMin) * 0.5f);
 
+		bounds.centreX.emplace_back(centre.x);
+		bounds.centreY.emplace_back(centre.y);
+		bounds.centreZ.emplace_back(centre.z);
+		bounds.extentX.emplace_back(extent.x);
+		bounds.extentY.emplace_back(extent.y);
+		bounds.extentZ.emplace_back(extent.z);
 	}
 
 
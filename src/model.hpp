@@ -5,65 +5,278 @@
 
 #include <iostream>
 #include <cstdlib>
+#include <memory>
+#include <vector>
 
 #include <vk_mem_alloc.h>
 #include "setup.hpp"
 #include "utility.hpp"
+#include "uploadBatch.hpp"
+#include "geometryPool.hpp"
+#include "meshSimplification.hpp"
+#include "meshlets.hpp"
 
 #include "glm.hpp"
 #include "vec3.hpp"
 
 namespace model {
+	/// <summary>
+	/// How the vertices of a mesh are laid out on the GPU
+	/// Full: one 32 bit float stream per attribute (48 bytes per vertex)
+	/// Packed: two quantised streams, positions and everything else (18 bytes per vertex)
+	/// </summary>
+	enum class VertexFormat {
+		Full,
+		Packed
+	};
+
+	/// <summary>
+	/// A vertex position quantised to 16 bits per axis across the bounds of its mesh, padded so every position is aligned
+	/// </summary>
+	struct PackedPosition {
+		std::uint16_t x, y, z;
+		std::uint16_t padding;
+	};
+	static_assert(sizeof(PackedPosition) == 8);
+
+	/// <summary>
+	/// The rest of a packed vertex. Texture coords are half floats, the normal is octahedral encoded
+	/// into two 16 bit snorms and the tangent into two 8 bit snorms with the sign of y holding the handedness.
+	/// </summary>
+	struct PackedSurface {
+		std::uint16_t u, v;
+		std::int16_t normalX, normalY;
+		std::int8_t tangentX, tangentY;
+	};
+	static_assert(sizeof(PackedSurface) == 10);
+
+	/// <summary>
+	/// Per draw constants of a mesh, packed positions are decoded as offset + position * scale
+	/// </summary>
+	struct MeshConstants {
+		glm::vec4 positionOffset = glm::vec4(0.f);
+		glm::vec4 positionScale = glm::vec4(1.f);
+	};
+
+	/// <summary>
+	/// Per instance data read by the vertex shaders with the instance index. Must match Instance in the vertex shaders.
+	/// </summary>
+	struct InstanceData {
+		glm::mat4 transform = glm::mat4(1.f);
+		MeshConstants constants;
+		// The material of the submesh being drawn
+		std::uint32_t materialID = 0;
+		std::uint32_t padding[3] = { 0, 0, 0 };
+	};
+	static_assert(sizeof(InstanceData) == 112);
+
+	/// <summary>
+	/// One instance of the triangles of a mesh that use one material. The submeshes of a mesh share its geometry
+	/// and the instances of a submesh share its levels and meshlets. Each instance is culled on its own and the
+	/// visible instances of a submesh are drawn together.
+	/// </summary>
 	struct Mesh {
-		// Vertex data
-		utility::BufferSet vertexPositions;
-		utility::BufferSet vertexUVs;
-		utility::BufferSet vertexNormals;
-		utility::BufferSet vertexTangents;
-		utility::BufferSet vertexMaterials;
-		utility::BufferSet indices;
-
-		// Size data
+		// Vertex data, stored in the streams of a geometry pool laid out for the vertex format
+		VertexFormat vertexFormat = VertexFormat::Full;
+		GeometryAllocation geometry;
+
+		// Size data (the indices hold every level of detail)
 		std::uint32_t numberOfVertices;
 		std::uint32_t numberOfIndices;
 
-		// Material data
-		std::uint32_t materialID;
+		// Levels of detail and the bounding sphere (of this instance) they are picked with
+		std::vector<simplification::LodLevel> lods;
+		glm::vec3 boundsCentre = glm::vec3(0.f);
+		float boundsRadius = 0.f;
+
+		// Clusters of triangles culled before drawing, each level points at its own.
+		// Shared by every instance and in the space of the first, see transform.
+		std::shared_ptr<const std::vector<meshlets::Meshlet>> meshlets;
+
+		// Material data, read by the shaders from the instance data
+		std::uint32_t materialID = 0;
+
+		// Decoding data
+		MeshConstants constants;
+
+		// The instance in the scene's instance buffer and the transform that places the first instance's geometry where it is
+		std::uint32_t instance = 0;
+		glm::mat4 transform = glm::mat4(1.f);
+
+		// Largest axis scale of the transform, the errors of the levels grow by it
+		float scale = 1.f;
+
+		// The submesh this is an instance of, the instances of a submesh are next to each other in their list
+		std::uint32_t submesh = 0;
 	};
 
 	/// <summary>
-	/// Creates a mesh and completes all of the necessary memory steps required for the data to be used.
+	/// The visible instances of a submesh that use the same level of detail, drawn with one instanced draw.
+	/// The instance ids are stored from firstInstance in the frame's list of visible instances.
+	/// </summary>
+	struct InstanceBatch {
+		// The nearest of the instances, the geometry and levels are drawn from it
+		std::uint32_t mesh = 0;
+		std::uint32_t level = 0;
+		std::uint32_t firstInstance = 0;
+		std::uint32_t instanceCount = 0;
+	};
+
+	/// <summary>
+	/// Axis aligned bounds of a list of meshes kept as a structure of arrays, so the culling
+	/// can load the same component of several meshes into one SIMD register.
+	/// Index i holds the bounds of mesh i.
+	/// </summary>
+	struct MeshBounds {
+		std::vector<float> centreX;
+		std::vector<float> centreY;
+		std::vector<float> centreZ;
+		std::vector<float> extentX;
+		std::vector<float> extentY;
+		std::vector<float> extentZ;
+
+		std::size_t size() const { return centreX.size(); }
+	};
+
+	/// <summary>
+	/// A viewpoint levels of detail are picked for. A level is used when its error covers no more than
+	/// the threshold in pixels once projected.
+	/// </summary>
+	struct LodView {
+		glm::vec3 position = glm::vec3(0.f);
+		float pixelsPerUnit = 1.f;
+		float threshold = 1.f;
+	};
+
+	/// <summary>
+	/// Creates a view for picking levels of detail through a perspective projection
+	/// </summary>
+	/// <param name="position">The position of the viewer</param>
+	/// <param name="verticalFov">The vertical field of view in radians</param>
+	/// <param name="viewportHeight">The height of the viewport in pixels</param>
+	/// <param name="threshold">Largest error in pixels a level may show</param>
+	/// <returns>The view</returns>
+	LodView createLodView(glm::vec3 position, float verticalFov, float viewportHeight, float threshold);
+
+	/// <summary>
+	/// Picks the coarsest level of detail of a mesh whose error is not visible from a view
+	/// </summary>
+	/// <param name="mesh">The mesh</param>
+	/// <param name="view">The view</param>
+	/// <returns>The level to draw</returns>
+	const simplification::LodLevel& selectLod(const Mesh& mesh, const LodView& view);
+
+	/// <summary>
+	/// Groups the visible instances of each submesh that pick the same level of detail into batches. A batch is
+	/// placed where its nearest instance is in the draw order, and its instance ids are stored in that order.
+	/// </summary>
+	/// <param name="meshes">The meshes</param>
+	/// <param name="drawOrder">Indices of the visible meshes in the order they are drawn</param>
+	/// <param name="view">Picks the level of detail of each instance</param>
+	/// <param name="visibleInstances">The instance ids of the batches are appended to this</param>
+	/// <param name="outBatches">The batches are appended to this</param>
+	void batchInstances(const std::vector<Mesh>& meshes, const std::vector<std::uint32_t>& drawOrder, const LodView& view,
+		std::vector<std::uint32_t>& visibleInstances, std::vector<InstanceBatch>& outBatches);
+
+	/// <summary>
+	/// Appends the bounds of a mesh to the end of a set of bounds, as the box around the transformed box
+	/// </summary>
+	/// <param name="bounds">The set of bounds to add to</param>
+	/// <param name="boundsMin">The minimum corner of the mesh</param>
+	/// <param name="boundsMax">The maximum corner of the mesh</param>
+	/// <param name="transform">The transform of the mesh's instance</param>
+	void addMeshBounds(MeshBounds& bounds, glm::vec3 boundsMin, glm::vec3 boundsMax, const glm::mat4& transform);
+
+	/// <summary>
+	/// Creates the draw of one instance of a submesh and appends its instance data
+	/// </summary>
+	/// <param name="submesh">The submesh in the space of its first instance</param>
+	/// <param name="transform">Places the first instance's geometry where this instance is</param>
+	/// <param name="instances">The instance data of the scene</param>
+	/// <returns>The draw, with the bounding sphere moved onto the instance</returns>
+	Mesh createInstance(const Mesh& submesh, const glm::mat4& transform, std::vector<InstanceData>& instances);
+
+	/// <summary>
+	/// Creates a geometry pool with one vertex stream per buffer the vertex format's pipelines bind
+	/// Full: positions, texture coords, normals and tangents
+	/// Packed: packed positions and packed surfaces
 	/// </summary>
-	/// <param name="app">Application context</param>
 	/// <param name="allocator">Vulkan memory allocator</param>
-	/// <param name="commandPool">Vulkan command pool</param>
+	/// <param name="format">The layout the vertices are stored in</param>
+	/// <param name="vertexCapacity">Number of vertices the pool can hold</param>
+	/// <param name="indexCapacity">Number of indices the pool can hold</param>
+	/// <returns>The pool</returns>
+	GeometryPool createGeometryPool(VmaAllocator& allocator, VertexFormat format, std::uint32_t vertexCapacity, std::uint32_t indexCapacity);
+
+	/// <summary>
+	/// Creates a mesh and completes all of the necessary memory steps required for the data to be used.
+	/// The result holds only the geometry, its submeshes are created from it to be drawn.
+	/// </summary>
+	/// <param name="uploads">Upload batch the vertex data is copied through</param>
+	/// <param name="pool">Geometry pool the vertices and indices are stored in, created for the same format</param>
 	/// <param name="vPositions">Vertex positions</param>
 	/// <param name="vTextureCoords">Vertex texture coords</param>
 	/// <param name="vNormals">Vertex normals</param>
 	/// <param name="vTangents">Vertex tangents</param>
-	/// <param name="vMaterials">Vertex material ids</param>
-	/// <param name="indices">Vertex indices</param>
+	/// <param name="indices">Vertex indices of every level of detail of every submesh</param>
+	/// <param name="format">The layout to store the vertices in</param>
 	/// <returns>A mesh data structure</returns>
-	Mesh createMesh(app::AppContext app, VmaAllocator& allocator, VkCommandPool commandPool,
+	Mesh createMesh(utility::UploadBatch& uploads,
+		GeometryPool& pool,
 		std::vector<glm::vec3>& vPositions,
 		std::vector<glm::vec2>& vTextureCoords,
 		std::vector<glm::vec3>& vNormals,
 		std::vector<glm::vec4>& vTangents,
-		std::vector<std::uint32_t>& vMaterials,
-		std::vector<std::uint32_t>& indices
+		std::vector<std::uint32_t>& indices,
+		VertexFormat format = VertexFormat::Full
 	);
 
 	/// <summary>
-	/// Sets up a memory buffer for a given set of data on the GPU
+	/// Creates the triangles of a mesh that use one material, each instance of them is drawn from a copy
 	/// </summary>
-	/// <param name="app">Application context</param>
-	/// <param name="allocator">Vulkan memory allocator</param>
-	/// <param name="commandPool">Vulkan command pool</param>
+	/// <param name="mesh">The mesh holding the geometry</param>
+	/// <param name="materialID">The material of the triangles</param>
+	/// <param name="vPositions">Vertex positions of the mesh</param>
+	/// <param name="indices">Vertex indices of the mesh</param>
+	/// <param name="lods">The submesh's levels of detail, the first is all of its triangles</param>
+	/// <param name="meshlets">The meshlets of the mesh, only those the levels use are kept (empty to always draw whole levels)</param>
+	/// <returns>The submesh</returns>
+	Mesh createSubmesh(const Mesh& mesh,
+		std::uint32_t materialID,
+		const std::vector<glm::vec3>& vPositions,
+		const std::vector<std::uint32_t>& indices,
+		const std::vector<simplification::LodLevel>& lods,
+		const std::vector<meshlets::Meshlet>& meshlets
+	);
+
+	/// <summary>
+	/// Quantises and packs the vertices of a mesh
+	/// </summary>
+	/// <param name="vPositions">Vertex positions</param>
+	/// <param name="vTextureCoords">Vertex texture coords</param>
+	/// <param name="vNormals">Vertex normals</param>
+	/// <param name="vTangents">Vertex tangents with the handedness in w</param>
+	/// <param name="outPositions">The packed positions</param>
+	/// <param name="outSurfaces">The packed texture coords, normals and tangents</param>
+	/// <returns>The constants that decode the positions</returns>
+	MeshConstants packVertices(const std::vector<glm::vec3>& vPositions,
+		const std::vector<glm::vec2>& vTextureCoords,
+		const std::vector<glm::vec3>& vNormals,
+		const std::vector<glm::vec4>& vTangents,
+		std::vector<PackedPosition>& outPositions,
+		std::vector<PackedSurface>& outSurfaces
+	);
+
+	/// <summary>
+	/// Sets up a memory buffer for a given set of data on the GPU. The copy is recorded into the
+	/// upload batch and the buffer can be used once the batch has been flushed.
+	/// </summary>
+	/// <param name="uploads">Upload batch the data is copied through</param>
 	/// <param name="sizeOfData">The size of the input data</param>
 	/// <param name="data">A pointer to the input data</param>
 	/// <param name="usageFlags">Usage flags for the buffer</param>
 	/// <returns>A memory buffer</returns>
-	utility::BufferSet setupMemoryBuffer(app::AppContext app, VmaAllocator& allocator, VkCommandPool commandPool,
+	utility::BufferSet setupMemoryBuffer(utility::UploadBatch& uploads,
 		VkDeviceSize sizeOfData, 
 		const void* data, 
 		VkBufferUsageFlags usageFlags
@@ -0,0 +1,226 @@
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+
+namespace profiling {
+
+	FrameProfiler::FrameProfiler(app::AppContext& inApp, std::uint32_t framesInFlight, std::uint32_t inMaxGpuScopes, std::uint32_t inHistorySize)
+		: app(inApp)
+		, maxGpuScopes(inMaxGpuScopes)
+		, pendingFrames(framesInFlight)
+		, historySize(inHistorySize)
+		, startTime(std::chrono::steady_clock::now())
+	{
+		history.reserve(historySize);
+
+		// Timestamps are only usable if the graphics queue has valid bits for them
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(app.physicalDevice, &properties);
+		std::uint32_t numQueues = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties(app.physicalDevice, &numQueues, nullptr);
+		std::vector<VkQueueFamilyProperties> families(numQueues);
+		vkGetPhysicalDeviceQueueFamilyProperties(app.physicalDevice, &numQueues, families.data());
+
+		std::uint32_t validBits = families[app.graphicsFamilyIndex].timestampValidBits;
+		if (validBits == 0 || properties.limits.timestampPeriod == 0.f) {
+			std::cout << "GPU timestamps are not supported, only CPU scopes will be profiled" << std::endl;
+			return;
+		}
+		timestampsSupported = true;
+		timestampPeriod = properties.limits.timestampPeriod;
+		timestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+		// Each frame in flight gets a begin and end query for every scope
+		VkQueryPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		poolInfo.queryCount = framesInFlight * maxGpuScopes * 2;
+		if (vkCreateQueryPool(app.logicalDevice, &poolInfo, nullptr, &queryPool) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create the timestamp query pool.");
+		}
+	}
+
+	void FrameProfiler::beginFrame(std::uint32_t frameIndex) {
+		// A frame that was never submitted (such as when the swapchain was remade) keeps its CPU times
+		if (!currentSubmitted && !currentRecord.cpuEvents.empty()) {
+			pushHistory(std::move(currentRecord));
+		}
+
+		currentFrameIndex = frameIndex;
+		currentRecord = FrameRecord{};
+		currentRecord.frameNumber = frameCounter++;
+		currentScopeNames.clear();
+		currentSubmitted = false;
+	}
+
+	void FrameProfiler::resetQueries(VkCommandBuffer commandBuffer) {
+		// The fence of this frame has signalled so its last set of timestamps can be read
+		collectGpuTimes(currentFrameIndex);
+
+		if (timestampsSupported) {
+			vkCmdResetQueryPool(commandBuffer, queryPool, currentFrameIndex * maxGpuScopes * 2, maxGpuScopes * 2);
+		}
+	}
+
+	void FrameProfiler::collectTimings() {
+		collectGpuTimes(currentFrameIndex);
+	}
+
+	std::uint32_t FrameProfiler::beginGpuScope(VkCommandBuffer commandBuffer, const char* name) {
+		if (!timestampsSupported || currentScopeNames.size() >= maxGpuScopes) {
+			return std::numeric_limits<std::uint32_t>::max();
+		}
+
+		std::uint32_t scope = std::uint32_t(currentScopeNames.size());
+		currentScopeNames.emplace_back(name);
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, (currentFrameIndex * maxGpuScopes + scope) * 2);
+		return scope;
+	}
+
+	void FrameProfiler::endGpuScope(VkCommandBuffer commandBuffer, std::uint32_t scope) {
+		if (scope == std::numeric_limits<std::uint32_t>::max()) {
+			return;
+		}
+
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, (currentFrameIndex * maxGpuScopes + scope) * 2 + 1);
+	}
+
+	void FrameProfiler::markSubmitted() {
+		PendingFrame& pending = pendingFrames[currentFrameIndex];
+		pending.submitted = true;
+		pending.record = std::move(currentRecord);
+		pending.gpuScopeNames = std::move(currentScopeNames);
+		pending.submitTime = toMicroseconds(std::chrono::steady_clock::now());
+		currentSubmitted = true;
+	}
+
+	void FrameProfiler::addCpuEvent(const char* name, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end) {
+		// Scopes after the submit (such as presenting) still belong to the submitted frame
+		FrameRecord& record = currentSubmitted ? pendingFrames[currentFrameIndex].record : currentRecord;
+
+		double const startMicroseconds = toMicroseconds(start);
+		record.cpuEvents.emplace_back(TimedEvent{ name, startMicroseconds, toMicroseconds(end) - startMicroseconds });
+	}
+
+	void FrameProfiler::addCounter(const char* name, std::uint64_t value) {
+		// The counts are read back with the frame's timings so they belong to the submitted frame
+		PendingFrame& pending = pendingFrames[currentFrameIndex];
+		if (!pending.submitted) {
+			return;
+		}
+
+		pending.record.counters.emplace_back(FrameCounter{ name, pending.submitTime, value });
+	}
+
+	void FrameProfiler::addCpuCounter(const char* name, std::uint64_t value) {
+		FrameRecord& record = currentSubmitted ? pendingFrames[currentFrameIndex].record : currentRecord;
+		record.counters.emplace_back(FrameCounter{ name, toMicroseconds(std::chrono::steady_clock::now()), value });
+	}
+
+	void FrameProfiler::flush() {
+		for (std::uint32_t i = 0; i < pendingFrames.size(); i++) {
+			collectGpuTimes(i);
+		}
+	}
+
+	void FrameProfiler::writeChromeTrace(const char* filePath) {
+		std::ofstream file(filePath, std::ios::trunc);
+		if (!file) {
+			throw std::runtime_error("Could not open " + std::string(filePath) + " for writing.");
+		}
+
+		file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+		file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"CPU\"}},\n";
+		file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"GPU\"}}";
+
+		auto writeEvent = [&file](const TimedEvent& event, int thread, std::uint64_t frameNumber) {
+			file << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << thread
+				<< ",\"ts\":" << event.start << ",\"dur\":" << event.duration
+				<< ",\"args\":{\"frame\":" << frameNumber << "}}";
+		};
+
+		// Oldest frame first
+		file.precision(3);
+		file << std::fixed;
+		for (std::size_t i = 0; i < history.size(); i++) {
+			const FrameRecord& record = history[(historyStart + i) % history.size()];
+			for (const TimedEvent& event : record.cpuEvents) {
+				writeEvent(event, 1, record.frameNumber);
+			}
+			for (const TimedEvent& event : record.gpuEvents) {
+				writeEvent(event, 2, record.frameNumber);
+			}
+			for (const FrameCounter& counter : record.counters) {
+				file << ",\n{\"name\":\"" << counter.name << "\",\"ph\":\"C\",\"pid\":1,\"ts\":" << counter.time
+					<< ",\"args\":{\"value\":" << counter.value << "}}";
+			}
+		}
+
+		file << "\n]}\n";
+
+		std::cout << "Wrote frame trace of " << history.size() << " frames to " << filePath << std::endl;
+	}
+
+	void FrameProfiler::cleanup() {
+		if (queryPool != VK_NULL_HANDLE) {
+			vkDestroyQueryPool(app.logicalDevice, queryPool, nullptr);
+			queryPool = VK_NULL_HANDLE;
+		}
+	}
+
+	void FrameProfiler::collectGpuTimes(std::uint32_t frameIndex) {
+		PendingFrame& pending = pendingFrames[frameIndex];
+		if (!pending.submitted) {
+			return;
+		}
+		pending.submitted = false;
+
+		std::size_t const scopeCount = pending.gpuScopeNames.size();
+		if (timestampsSupported && scopeCount > 0) {
+			// Each query returns its value and availability, the frame's fence has already signalled
+			// so the results are not waited on
+			std::vector<std::uint64_t> results(scopeCount * 4);
+			VkResult result = vkGetQueryPoolResults(app.logicalDevice, queryPool, frameIndex * maxGpuScopes * 2, std::uint32_t(scopeCount * 2),
+				results.size() * sizeof(std::uint64_t), results.data(), 2 * sizeof(std::uint64_t),
+				VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+
+			if (result == VK_SUCCESS) {
+				// GPU times are placed relative to the submit so the two tracks line up in the trace
+				std::uint64_t const frameBegin = results[0];
+				for (std::size_t scope = 0; scope < scopeCount; scope++) {
+					std::uint64_t begin = results[scope * 4];
+					std::uint64_t end = results[scope * 4 + 2];
+					bool available = results[scope * 4 + 1] != 0 && results[scope * 4 + 3] != 0;
+					if (!available) {
+						continue;
+					}
+
+					double const offset = double((begin - frameBegin) & timestampMask) * timestampPeriod / 1000.0;
+					double const duration = double((end - begin) & timestampMask) * timestampPeriod / 1000.0;
+					pending.record.gpuEvents.emplace_back(TimedEvent{ pending.gpuScopeNames[scope], pending.submitTime + offset, duration });
+				}
+			}
+		}
+
+		pushHistory(std::move(pending.record));
+		pending.record = FrameRecord{};
+	}
+
+	void FrameProfiler::pushHistory(FrameRecord&& record) {
+		if (history.size() < historySize) {
+			history.emplace_back(std::move(record));
+		}
+		else {
+			history[historyStart] = std::move(record);
+			historyStart = (historyStart + 1) % historySize;
+		}
+	}
+
+	double FrameProfiler::toMicroseconds(std::chrono::steady_clock::time_point time) const {
+		return std::chrono::duration<double, std::micro>(time - startTime).count();
+	}
+}
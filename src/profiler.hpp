@@ -0,0 +1,198 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include "setup.hpp"
+
+namespace profiling {
+	/// <summary>
+	/// A single timed scope, times are in microseconds from when the profiler was created
+	/// </summary>
+	struct TimedEvent
+	{
+		const char* name;
+		double start;
+		double duration;
+	};
+
+	/// <summary>
+	/// A value counted during a frame, the time is in microseconds from when the profiler was created
+	/// </summary>
+	struct FrameCounter
+	{
+		const char* name;
+		double time;
+		std::uint64_t value;
+	};
+
+	/// <summary>
+	/// Everything timed and counted during one frame
+	/// </summary>
+	struct FrameRecord
+	{
+		std::uint64_t frameNumber = 0;
+		std::vector<TimedEvent> cpuEvents;
+		std::vector<TimedEvent> gpuEvents;
+		std::vector<FrameCounter> counters;
+	};
+
+	/// <summary>
+	/// Times CPU scopes and GPU passes for every frame and keeps a rolling history of them.
+	/// Each frame in flight writes its timestamps into its own range of the query pool, and
+	/// the results are only read once that frame's fence has signalled so nothing ever stalls.
+	/// </summary>
+	class FrameProfiler
+	{
+	public:
+		/// <summary>
+		/// Parameterised constructor
+		/// </summary>
+		/// <param name="app">Application context</param>
+		/// <param name="framesInFlight">Number of frames that can be recorded ahead of the GPU</param>
+		/// <param name="maxGpuScopes">Most GPU scopes a single frame can time</param>
+		/// <param name="historySize">Number of frames kept in the history</param>
+		FrameProfiler(app::AppContext& app, std::uint32_t framesInFlight, std::uint32_t maxGpuScopes = 16, std::uint32_t historySize = 300);
+
+		FrameProfiler(FrameProfiler&) = delete;
+		FrameProfiler& operator= (FrameProfiler&) = delete;
+
+		/// <summary>
+		/// Starts timing a new frame that will use the given frame in flight
+		/// </summary>
+		/// <param name="frameIndex">Index of the frame in flight</param>
+		void beginFrame(std::uint32_t frameIndex);
+
+		/// <summary>
+		/// Collects the GPU timings this frame in flight recorded last time and resets its queries.
+		/// Must be recorded after the frame's fence has been waited on and before any GPU scope.
+		/// </summary>
+		/// <param name="commandBuffer">The frame's command buffer</param>
+		void resetQueries(VkCommandBuffer commandBuffer);
+
+		/// <summary>
+		/// Collects the timings this frame in flight recorded last time without resetting its queries,
+		/// for frames that submit commands recorded earlier. Must be called after the frame's fence has been waited on.
+		/// </summary>
+		void collectTimings();
+
+		/// <summary>
+		/// Writes the starting timestamp of a GPU scope
+		/// </summary>
+		/// <param name="commandBuffer">The frame's command buffer</param>
+		/// <param name="name">Name of the scope (must outlive the profiler)</param>
+		/// <returns>Handle to pass to endGpuScope</returns>
+		std::uint32_t beginGpuScope(VkCommandBuffer commandBuffer, const char* name);
+
+		/// <summary>
+		/// Writes the ending timestamp of a GPU scope
+		/// </summary>
+		/// <param name="commandBuffer">The frame's command buffer</param>
+		/// <param name="scope">Handle returned by beginGpuScope</param>
+		void endGpuScope(VkCommandBuffer commandBuffer, std::uint32_t scope);
+
+		/// <summary>
+		/// Notes the time the frame was submitted, the GPU timings are placed relative to it
+		/// </summary>
+		void markSubmitted();
+
+		/// <summary>
+		/// Adds a CPU scope to the current frame
+		/// </summary>
+		/// <param name="name">Name of the scope (must outlive the profiler)</param>
+		/// <param name="start">When the scope started</param>
+		/// <param name="end">When the scope ended</param>
+		void addCpuEvent(const char* name, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end);
+
+		/// <summary>
+		/// Adds a value the GPU counted to the frame this frame in flight last submitted.
+		/// Must be called after the frame's fence has been waited on and before resetQueries.
+		/// </summary>
+		/// <param name="name">Name of the counter (must outlive the profiler)</param>
+		/// <param name="value">The value counted</param>
+		void addCounter(const char* name, std::uint64_t value);
+
+		/// <summary>
+		/// Adds a value counted on the CPU to the current frame
+		/// </summary>
+		/// <param name="name">Name of the counter (must outlive the profiler)</param>
+		/// <param name="value">The value counted</param>
+		void addCpuCounter(const char* name, std::uint64_t value);
+
+		/// <summary>
+		/// Collects the timings of every frame still in flight, call once the device is idle
+		/// </summary>
+		void flush();
+
+		/// <summary>
+		/// Writes the history as Chrome trace_event JSON (viewable in chrome://tracing or Perfetto)
+		/// </summary>
+		/// <param name="filePath">The file to write</param>
+		void writeChromeTrace(const char* filePath);
+
+		/// <summary>
+		/// Destroys the query pool (the device must still be alive)
+		/// </summary>
+		void cleanup();
+
+	private:
+		struct PendingFrame
+		{
+			bool submitted = false;
+			FrameRecord record;
+			std::vector<const char*> gpuScopeNames;
+			double submitTime = 0.0;
+		};
+
+		void collectGpuTimes(std::uint32_t frameIndex);
+		void pushHistory(FrameRecord&& record);
+		double toMicroseconds(std::chrono::steady_clock::time_point time) const;
+
+		app::AppContext& app;
+		VkQueryPool queryPool = VK_NULL_HANDLE;
+		bool timestampsSupported = false;
+		double timestampPeriod = 1.0;
+		std::uint64_t timestampMask = ~0ull;
+		std::uint32_t maxGpuScopes;
+
+		// Submitted frames waiting on their GPU timings
+		std::vector<PendingFrame> pendingFrames;
+
+		// The frame being recorded
+		FrameRecord currentRecord;
+		std::vector<const char*> currentScopeNames;
+		std::uint32_t currentFrameIndex = 0;
+		bool currentSubmitted = false;
+		std::uint64_t frameCounter = 0;
+
+		std::vector<FrameRecord> history;
+		std::size_t historySize;
+		std::size_t historyStart = 0;
+
+		std::chrono::steady_clock::time_point startTime;
+	};
+
+	/// <summary>
+	/// Times the enclosing scope on the CPU and adds it to the current frame of a profiler
+	/// </summary>
+	class CpuScope
+	{
+	public:
+		CpuScope(FrameProfiler& inProfiler, const char* inName)
+			: profiler(inProfiler), name(inName), start(std::chrono::steady_clock::now()) {}
+
+		~CpuScope() { profiler.addCpuEvent(name, start, std::chrono::steady_clock::now()); }
+
+		CpuScope(CpuScope&) = delete;
+		CpuScope& operator= (CpuScope&) = delete;
+
+	private:
+		FrameProfiler& profiler;
+		const char* name;
+		std::chrono::steady_clock::time_point start;
+	};
+}
@@ -0,0 +1,471 @@
+#include "sceneCache.hpp"
+
+#include "mappedFile.hpp"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <type_traits>
+
+// Bump whenever the layout of the cache or the processing done by the loader changes
+#define SCENE_CACHE_VERSION 10
+// Arrays are copied out of the mapping into the scene, this only keeps each one aligned for its element type
+#define SCENE_CACHE_ALIGNMENT 16
+
+namespace fbx {
+
+    namespace {
+        constexpr char kCacheMagic[8] = { 'V', 'R', 'S', 'C', 'E', 'N', 'E', '\0' };
+        constexpr std::uint32_t kEndianCheck = 0x01020304;
+
+        struct ArrayRecord
+        {
+            std::uint64_t offset;
+            std::uint64_t count;
+        };
+
+        struct CacheHeader
+        {
+            char magic[8];
+            std::uint32_t version;
+            std::uint32_t endianCheck;
+
+            // Source file key
+            std::uint64_t fileSize;
+            std::int64_t modifiedTime;
+            std::uint64_t contentHash;
+
+            // Table sizes
+            std::uint64_t meshCount;
+            std::uint64_t materialCount;
+            std::uint64_t lightCount;
+            std::uint64_t textureCounts[4];		// Diffuse, specular, normal, emissive
+
+            // Table locations
+            std::uint64_t meshTableOffset;
+            std::uint64_t materialTableOffset;
+            std::uint64_t textureTableOffset;
+            std::uint64_t lightTableOffset;
+            ArrayRecord strings;
+        };
+
+        struct MeshRecord
+        {
+            ArrayRecord positions;
+            ArrayRecord textureCoords;
+            ArrayRecord normals;
+            ArrayRecord tangents;
+            ArrayRecord indices;
+            ArrayRecord submeshes;
+            ArrayRecord lods;
+            ArrayRecord meshlets;
+            ArrayRecord instanceTransforms;
+        };
+
+        struct MaterialRecord
+        {
+            ArrayRecord name;
+            std::uint32_t diffuseTextureID;
+            std::uint32_t specularTextureID;
+            std::uint32_t normalTextureID;
+            std::uint32_t emissiveTextureID;
+            std::uint32_t isAlphaMapped;
+            std::uint32_t padding;
+        };
+
+        struct TextureRecord
+        {
+            ArrayRecord path;
+            std::uint32_t isEmpty;
+            std::uint32_t padding;
+        };
+
+        struct LightRecord
+        {
+            std::uint32_t isPointLight;
+            glm::vec3 location;
+            glm::vec3 colour;
+            glm::mat4 direction;
+        };
+
+        static_assert(std::is_trivially_copyable_v<CacheHeader> && std::is_trivially_copyable_v<MeshRecord> &&
+            std::is_trivially_copyable_v<MaterialRecord> && std::is_trivially_copyable_v<TextureRecord> &&
+            std::is_trivially_copyable_v<LightRecord>, "Cache records must be plain data");
+
+        /// <summary>
+        /// Writes the cache sequentially while keeping track of the offset
+        /// </summary>
+        class CacheWriter
+        {
+        public:
+            explicit CacheWriter(const std::string& filename) : stream(filename, std::ios::binary | std::ios::trunc) {
+                if (!stream) {
+                    throw std::runtime_error("Could not create scene cache: " + filename);
+                }
+            }
+
+            void write(const void* data, std::size_t size) {
+                stream.write(static_cast<const char*>(data), std::streamsize(size));
+                position += size;
+            }
+
+            void align(std::uint64_t alignment) {
+                static const char zeros[SCENE_CACHE_ALIGNMENT] = {};
+                std::uint64_t padding = (alignment - position % alignment) % alignment;
+                write(zeros, std::size_t(padding));
+            }
+
+            template<typename T>
+            ArrayRecord writeArray(const std::vector<T>& values) {
+                static_assert(std::is_trivially_copyable_v<T>);
+                align(SCENE_CACHE_ALIGNMENT);
+                ArrayRecord record{ position, values.size() };
+                write(values.data(), values.size() * sizeof(T));
+                return record;
+            }
+
+            template<typename T>
+            void writeRecord(const T& record) {
+                write(&record, sizeof(T));
+            }
+
+            void rewriteHeader(const CacheHeader& header) {
+                stream.seekp(0);
+                stream.write(reinterpret_cast<const char*>(&header), sizeof(CacheHeader));
+            }
+
+            void close() {
+                stream.close();
+                if (stream.fail()) {
+                    throw std::runtime_error("Failed to write scene cache.");
+                }
+            }
+
+            std::uint64_t offset() const { return position; }
+
+        private:
+            std::ofstream stream;
+            std::uint64_t position = 0;
+        };
+
+        /// <summary>
+        /// Reads the cache out of a mapped file with bounds checks
+        /// </summary>
+        class CacheReader
+        {
+        public:
+            explicit CacheReader(const utility::MappedFile& file) : file(file) {}
+
+            template<typename T>
+            T readRecord(std::uint64_t offset) const {
+                check(offset, sizeof(T));
+                T record;
+                std::memcpy(&record, file.data() + offset, sizeof(T));
+                return record;
+            }
+
+            template<typename T>
+            void readArray(const ArrayRecord& record, std::vector<T>& output) const {
+                if (record.count > file.size() / sizeof(T)) {
+                    throw std::runtime_error("Scene cache array is too large.");
+                }
+                check(record.offset, record.count * sizeof(T));
+                output.resize(std::size_t(record.count));
+                std::memcpy(output.data(), file.data() + record.offset, std::size_t(record.count) * sizeof(T));
+            }
+
+            std::string readString(const ArrayRecord& strings, const ArrayRecord& record) const {
+                if (record.offset > strings.count || record.count > strings.count - record.offset) {
+                    throw std::runtime_error("Scene cache string is out of range.");
+                }
+                return std::string(reinterpret_cast<const char*>(file.data() + strings.offset + record.offset), std::size_t(record.count));
+            }
+
+            void check(std::uint64_t offset, std::uint64_t size) const {
+                if (offset > file.size() || size > file.size() - offset) {
+                    throw std::runtime_error("Scene cache is truncated.");
+                }
+            }
+
+        private:
+            const utility::MappedFile& file;
+        };
+
+        /// <summary>
+        /// Gets the modified time of a file as a plain number
+        /// </summary>
+        std::int64_t getModifiedTime(const char* filename) {
+            return std::int64_t(std::filesystem::last_write_time(filename).time_since_epoch().count());
+        }
+
+        std::uint64_t rotateLeft(std::uint64_t value, int bits) {
+            return (value << bits) | (value >> (64 - bits));
+        }
+    }
+
+    Scene loadScene(const char* filename) {
+        std::string cachePath = getSceneCachePath(filename);
+
+        // Build the key of the source file, the content hash is only computed when it is needed
+        SourceKey key;
+        key.fileSize = std::uint64_t(std::filesystem::file_size(filename));
+        key.modifiedTime = getModifiedTime(filename);
+
+        Scene scene;
+        if (readSceneCache(cachePath.c_str(), filename, key, scene)) {
+            std::cout << "Loaded " << filename << " from " << cachePath << std::endl;
+
+            // The contents matched but the file was touched, refresh the cache so the next start skips the hash
+            if (key.contentHash != 0) {
+                try {
+                    writeSceneCache(cachePath.c_str(), key, scene);
+                }
+                catch (const std::exception& e) {
+                    std::cerr << e.what() << std::endl;
+                }
+            }
+            return scene;
+        }
+
+        // The cache is missing or stale so import the .fbx file and rebuild it
+        scene = loadFBXFile(filename);
+        if (key.contentHash == 0) {
+            key.contentHash = hashFile(filename);
+        }
+        try {
+            writeSceneCache(cachePath.c_str(), key, scene);
+        }
+        catch (const std::exception& e) {
+            // Not being able to cache the scene is not fatal
+            std::cerr << e.what() << std::endl;
+        }
+
+        return scene;
+    }
+
+    std::string getSceneCachePath(const char* filename) {
+        return std::string(filename) + ".scenecache";
+    }
+
+    bool readSceneCache(const char* cacheFilename, const char* sourceFilename, SourceKey& key, Scene& outputScene) {
+        if (!std::filesystem::exists(cacheFilename)) {
+            return false;
+        }
+
+        try {
+            utility::MappedFile file(cacheFilename);
+            CacheReader reader(file);
+
+            // Check that the cache is from this version and this source file
+            CacheHeader header = reader.readRecord<CacheHeader>(0);
+            if (std::memcmp(header.magic, kCacheMagic, sizeof(kCacheMagic)) != 0 ||
+                header.version != SCENE_CACHE_VERSION || header.endianCheck != kEndianCheck ||
+                header.fileSize != key.fileSize) {
+                return false;
+            }
+            if (header.modifiedTime != key.modifiedTime) {
+                // The file has been touched, only trust the cache if the contents are the same
+                key.contentHash = hashFile(sourceFilename);
+                if (header.contentHash != key.contentHash) {
+                    return false;
+                }
+            }
+
+            Scene scene;
+
+            // Meshes
+            scene.meshes.resize(std::size_t(header.meshCount));
+            for (std::uint64_t i = 0; i < header.meshCount; i++) {
+                MeshRecord record = reader.readRecord<MeshRecord>(header.meshTableOffset + i * sizeof(MeshRecord));
+                Mesh& mesh = scene.meshes[std::size_t(i)];
+                reader.readArray(record.positions, mesh.vertexPositions);
+                reader.readArray(record.textureCoords, mesh.vertexTextureCoords);
+                reader.readArray(record.normals, mesh.vertexNormals);
+                reader.readArray(record.tangents, mesh.vertexTangents);
+                reader.readArray(record.indices, mesh.vertexIndices);
+                reader.readArray(record.submeshes, mesh.submeshes);
+                reader.readArray(record.lods, mesh.lods);
+                reader.readArray(record.meshlets, mesh.meshlets);
+                reader.readArray(record.instanceTransforms, mesh.instanceTransforms);
+            }
+
+            // Materials
+            scene.materials.resize(std::size_t(header.materialCount));
+            for (std::uint64_t i = 0; i < header.materialCount; i++) {
+                MaterialRecord record = reader.readRecord<MaterialRecord>(header.materialTableOffset + i * sizeof(MaterialRecord));
+                Material& material = scene.materials[std::size_t(i)];
+                material.materialName = reader.readString(header.strings, record.name);
+                material.diffuseTextureID = record.diffuseTextureID;
+                material.specularTextureID = record.specularTextureID;
+                material.normalTextureID = record.normalTextureID;
+                material.emissiveTextureID = record.emissiveTextureID;
+                material.isAlphaMapped = record.isAlphaMapped != 0;
+            }
+
+            // Textures
+            std::vector<Texture>* textureSets[4] = { &scene.diffuseTextures, &scene.specularTextures, &scene.normalTextures, &scene.emissiveTextures };
+            std::uint64_t textureOffset = header.textureTableOffset;
+            for (int set = 0; set < 4; set++) {
+                textureSets[set]->resize(std::size_t(header.textureCounts[set]));
+                for (Texture& texture : *textureSets[set]) {
+                    TextureRecord record = reader.readRecord<TextureRecord>(textureOffset);
+                    textureOffset += sizeof(TextureRecord);
+                    texture.filePath = reader.readString(header.strings, record.path);
+                    texture.isEmpty = record.isEmpty != 0;
+                }
+            }
+
+            // Lights
+            scene.lights.resize(std::size_t(header.lightCount));
+            for (std::uint64_t i = 0; i < header.lightCount; i++) {
+                LightRecord record = reader.readRecord<LightRecord>(header.lightTableOffset + i * sizeof(LightRecord));
+                Light& light = scene.lights[std::size_t(i)];
+                light.isPointLight = record.isPointLight != 0;
+                light.location = record.location;
+                light.colour = record.colour;
+                light.direction = record.direction;
+            }
+
+            outputScene = std::move(scene);
+            return true;
+        }
+        catch (const std::exception& e) {
+            // A broken cache is simply rebuilt
+            std::cerr << "Ignoring scene cache " << cacheFilename << ": " << e.what() << std::endl;
+            return false;
+        }
+    }
+
+    void writeSceneCache(const char* cacheFilename, const SourceKey& key, const Scene& scene) {
+        // Write to a temporary file first so a half written cache is never picked up
+        std::string temporaryFilename = std::string(cacheFilename) + ".tmp";
+        CacheWriter writer(temporaryFilename);
+
+        CacheHeader header{};
+        std::memcpy(header.magic, kCacheMagic, sizeof(kCacheMagic));
+        header.version = SCENE_CACHE_VERSION;
+        header.endianCheck = kEndianCheck;
+        header.fileSize = key.fileSize;
+        header.modifiedTime = key.modifiedTime;
+        header.contentHash = key.contentHash;
+        header.meshCount = scene.meshes.size();
+        header.materialCount = scene.materials.size();
+        header.lightCount = scene.lights.size();
+        header.textureCounts[0] = scene.diffuseTextures.size();
+        header.textureCounts[1] = scene.specularTextures.size();
+        header.textureCounts[2] = scene.normalTextures.size();
+        header.textureCounts[3] = scene.emissiveTextures.size();
+
+        // The header is written again at the end once all the offsets are known
+        writer.writeRecord(header);
+
+        // Write the per mesh arrays
+        std::vector<MeshRecord> meshRecords;
+        meshRecords.reserve(scene.meshes.size());
+        for (const Mesh& mesh : scene.meshes) {
+            MeshRecord record;
+            record.positions = writer.writeArray(mesh.vertexPositions);
+            record.textureCoords = writer.writeArray(mesh.vertexTextureCoords);
+            record.normals = writer.writeArray(mesh.vertexNormals);
+            record.tangents = writer.writeArray(mesh.vertexTangents);
+            record.indices = writer.writeArray(mesh.vertexIndices);
+            record.submeshes = writer.writeArray(mesh.submeshes);
+            record.lods = writer.writeArray(mesh.lods);
+            record.meshlets = writer.writeArray(mesh.meshlets);
+            record.instanceTransforms = writer.writeArray(mesh.instanceTransforms);
+            meshRecords.emplace_back(record);
+        }
+
+        // Strings are gathered into one block written after the tables
+        std::string strings;
+        auto addString = [&strings](const std::string& value) {
+            ArrayRecord record{ strings.size(), value.size() };
+            strings += value;
+            return record;
+        };
+
+        writer.align(8);
+        header.meshTableOffset = writer.offset();
+        for (const MeshRecord& record : meshRecords) {
+            writer.writeRecord(record);
+        }
+
+        header.materialTableOffset = writer.offset();
+        for (const Material& material : scene.materials) {
+            MaterialRecord record{};
+            record.name = addString(material.materialName);
+            record.diffuseTextureID = material.diffuseTextureID;
+            record.specularTextureID = material.specularTextureID;
+            record.normalTextureID = material.normalTextureID;
+            record.emissiveTextureID = material.emissiveTextureID;
+            record.isAlphaMapped = material.isAlphaMapped ? 1 : 0;
+            writer.writeRecord(record);
+        }
+
+        header.textureTableOffset = writer.offset();
+        for (const std::vector<Texture>* textureSet : { &scene.diffuseTextures, &scene.specularTextures, &scene.normalTextures, &scene.emissiveTextures }) {
+            for (const Texture& texture : *textureSet) {
+                TextureRecord record{};
+                record.path = addString(texture.filePath);
+                record.isEmpty = texture.isEmpty ? 1 : 0;
+                writer.writeRecord(record);
+            }
+        }
+
+        header.lightTableOffset = writer.offset();
+        for (const Light& light : scene.lights) {
+            LightRecord record{};
+            record.isPointLight = light.isPointLight ? 1 : 0;
+            record.location = light.location;
+            record.colour = light.colour;
+            record.direction = light.direction;
+            writer.writeRecord(record);
+        }
+
+        header.strings = ArrayRecord{ writer.offset(), strings.size() };
+        writer.write(strings.data(), strings.size());
+
+        writer.rewriteHeader(header);
+        writer.close();
+
+        std::filesystem::rename(temporaryFilename, cacheFilename);
+    }
+
+    std::uint64_t hashFile(const char* filename) {
+        utility::MappedFile file(filename);
+        const std::uint8_t* data = file.data();
+        std::size_t size = file.size();
+
+        // Four independent lanes over 32 byte blocks so the multiplies can overlap
+        constexpr std::uint64_t prime1 = 0x9E3779B185EBCA87ull;
+        constexpr std::uint64_t prime2 = 0xC2B2AE3D27D4EB4Full;
+        std::uint64_t lanes[4] = { prime1 + prime2, prime2, 0, 0 - prime1 };
+
+        std::size_t offset = 0;
+        for (; offset + 32 <= size; offset += 32) {
+            for (int lane = 0; lane < 4; lane++) {
+                std::uint64_t word;
+                std::memcpy(&word, data + offset + lane * 8, 8);
+                lanes[lane] = rotateLeft(lanes[lane] + word * prime2, 31) * prime1;
+            }
+        }
+
+        std::uint64_t hash = rotateLeft(lanes[0], 1) + rotateLeft(lanes[1], 7) + rotateLeft(lanes[2], 12) + rotateLeft(lanes[3], 18);
+        hash += std::uint64_t(size);
+
+        // Remaining bytes
+        for (; offset < size; offset++) {
+            hash = rotateLeft(hash ^ (data[offset] * prime1), 11) * prime2;
+        }
+
+        // Final mix
+        hash ^= hash >> 33;
+        hash *= prime2;
+        hash ^= hash >> 29;
+        hash *= prime1;
+        hash ^= hash >> 32;
+        return hash;
+    }
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+#include "FBXFileLoader.hpp"
+
+/// A versioned binary cache of a fully processed fbx::Scene so warm starts can skip the FBX import.
+namespace fbx {
+	/// <summary>
+	/// Identifies the exact source file a cache was built from
+	/// </summary>
+	struct SourceKey
+	{
+		std::uint64_t fileSize = 0;
+		std::int64_t modifiedTime = 0;
+		std::uint64_t contentHash = 0;
+	};
+
+	/// <summary>
+	/// Loads a scene through the cache. The cache file sits next to the source file and is
+	/// rebuilt from the .fbx file whenever it is missing, out of date or from an older version.
+	/// </summary>
+	/// <param name="filename">The .fbx file path</param>
+	/// <returns>A Scene structure</returns>
+	Scene loadScene(const char* filename);
+
+	/// <summary>
+	/// Gets the path of the cache file for a given source file
+	/// </summary>
+	/// <param name="filename">The .fbx file path</param>
+	/// <returns>The cache file path</returns>
+	std::string getSceneCachePath(const char* filename);
+
+	/// <summary>
+	/// Reads a scene cache if it matches the source file. The size and modified time are checked
+	/// first and the content hash is only computed (and compared) when the modified time differs.
+	/// </summary>
+	/// <param name="cacheFilename">The cache file path</param>
+	/// <param name="sourceFilename">The .fbx file path</param>
+	/// <param name="key">The key of the source file, the hash is filled in if it had to be computed</param>
+	/// <param name="outputScene">The scene read from the cache</param>
+	/// <returns>True if the cache was valid and has been read</returns>
+	bool readSceneCache(const char* cacheFilename, const char* sourceFilename, SourceKey& key, Scene& outputScene);
+
+	/// <summary>
+	/// Writes a scene cache for the given source file
+	/// </summary>
+	/// <param name="cacheFilename">The cache file path</param>
+	/// <param name="key">The key of the source file</param>
+	/// <param name="scene">The processed scene</param>
+	void writeSceneCache(const char* cacheFilename, const SourceKey& key, const Scene& scene);
+
+	/// <summary>
+	/// Hashes the contents of a file
+	/// </summary>
+	/// <param name="filename">The file path</param>
+	/// <returns>A 64 bit hash of the file contents</returns>
+	std::uint64_t hashFile(const char* filename);
+}
@@ -15,11 +15,12 @@ namespace {
 
     // Declaration of functions to be implemented
     GLFWwindow* createWindow(uint32_t width, uint32_t height, const char* name);
-    VkInstance createInstance();
+    VkInstance createInstance(bool headless);
     VkDebugUtilsMessengerEXT createDebugMessenger(VkInstance aInstance);
     void deviceSetup(app::AppContext* aApp);
     VkPhysicalDevice selectPhysicalDevice(VkInstance aInstance, VkSurfaceKHR aSurface);
-    VkDevice createLogicalDevice(VkPhysicalDevice aPhysicalDev, std::vector<std::uint32_t>& aQueueIndices, std::vector<char const*>& aExtensions);
+    VkDevice createLogicalDevice(VkPhysicalDevice aPhysicalDev, std::vector<std::uint32_t>& aQueueIndices, std::vector<char const*>& aExtensions,
+        bool& aIndirectCountDraws);
     std::optional<std::uint32_t> findQueueFamily(VkPhysicalDevice aPhysicalDev, VkQueueFlags aQueueFlags, VkSurfaceKHR aSurface);
     void swapchainSetup(app::AppContext* aApp);
     void createSwapchainImages(app::AppContext* aApp);
@@ -55,7 +56,9 @@ namespace app {
         }
 
         // Destroy the swapchain
-        vkDestroySwapchainKHR(logicalDevice, swapchain, nullptr);
+        if (!headless) {
+            vkDestroySwapchainKHR(logicalDevice, swapchain, nullptr);
+        }
 
         // Destroy the logical device
         vkDestroyDevice(logicalDevice, nullptr);
@@ -66,16 +69,20 @@ namespace app {
 #		endif
 
         // Destroy the surface of the window
-		vkDestroySurfaceKHR(instance, surface, nullptr);
+        if (!headless) {
+            vkDestroySurfaceKHR(instance, surface, nullptr);
+        }
 
         // Destroy the Vulkan instance
 		vkDestroyInstance(instance, nullptr);
 
         // Destroy the GLFW window
-		glfwDestroyWindow(window);
+        if (!headless) {
+            glfwDestroyWindow(window);
 
-        // End the program
-		glfwTerminate();
+            // End the program
+            glfwTerminate();
+        }
 	}
 
 	AppContext setup() {
@@ -85,7 +92,7 @@ namespace app {
         context.window = createWindow(windowSettings::width, windowSettings::height, windowSettings::name);
 
         // Create a vulkan instance
-        context.instance = createInstance();
+        context.instance = createInstance(false);
 
         // Set up the debug messenger if in debug mode
 #		if !defined(NDEBUG)
@@ -110,6 +117,28 @@ namespace app {
         return context;
 	}
 
+    AppContext setupHeadless(VkExtent2D extent, VkFormat format) {
+        AppContext context;
+        context.headless = true;
+
+        // Create a vulkan instance without any of the surface extensions
+        context.instance = createInstance(true);
+
+        // Set up the debug messenger if in debug mode
+#		if !defined(NDEBUG)
+        context.debugMessenger = createDebugMessenger(context.instance);
+#		endif
+
+        // Get and set the device to use with Vulkan (with no surface there is no present support to check)
+        deviceSetup(&context);
+
+        // There is no swapchain, these describe the offscreen image that is rendered to instead
+        context.swapchainFormat = format;
+        context.swapchainExtent = extent;
+
+        return context;
+    }
+
     void swapchainSetup(app::AppContext* aApp) {
         // Get the capabilities of the swapchain
         VkSurfaceCapabilitiesKHR capabilities;
@@ -261,8 +290,9 @@ namespace {
     /// This function specifies which extensions and layers can be used with this application and
     /// which debug settings will be used. 
     /// </summary>
+    /// <param name="headless">If true no window surface extensions are requested</param>
     /// <returns>Vulkan instance</returns>
-    VkInstance createInstance() {
+    VkInstance createInstance(bool headless) {
         // Fill out the details for the application info
         VkApplicationInfo appInfo{};
         appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
@@ -282,9 +312,9 @@ namespace {
         for (auto& extension : supportedExtensions) {
             supportedExtensionNames.insert(extension.extensionName);
         }
-        // Get the extensions required for GLFW
+        // Get the extensions required for GLFW (a headless instance needs none)
         std::uint32_t extensionCount = 0;
-        char const** extensionNames = glfwGetRequiredInstanceExtensions(&extensionCount);
+        char const** extensionNames = headless ? nullptr : glfwGetRequiredInstanceExtensions(&extensionCount);
         // Check if the extensions are available before enabling them
         std::vector<char const*> extensionsToEnable;
         for (std::uint32_t i = 0; i < extensionCount; i++) {
@@ -412,7 +442,9 @@ namespace {
 
         // Get the extensions required for the logical device
         std::vector<char const*> extensionsToEnable;
-        extensionsToEnable.emplace_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+        if (!aApp->headless) {
+            extensionsToEnable.emplace_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+        }
 
         // Get the graphics queue(s) Ideally one graphics queue can do both jobs
         // Store the indices of the graphics queue and the present queue if used.
@@ -434,7 +466,8 @@ namespace {
         }
 
         // Create the logical device
-        aApp->logicalDevice = createLogicalDevice(aApp->physicalDevice, aApp->queueFamilyIndices, extensionsToEnable);
+        aApp->logicalDevice = createLogicalDevice(aApp->physicalDevice, aApp->queueFamilyIndices, extensionsToEnable,
+            aApp->indirectCountDraws);
 
         // Set the queues in the app context
         vkGetDeviceQueue(aApp->logicalDevice, aApp->graphicsFamilyIndex, 0, &aApp->graphicsQueue);
@@ -488,8 +521,8 @@ namespace {
                 deviceExtensionNames.insert(ext.extensionName);
             }
 
-            // Check that VK_KHR_swapchain is supported
-            if (!deviceExtensionNames.count(VK_KHR_SWAPCHAIN_EXTENSION_NAME)) continue;
+            // Check that VK_KHR_swapchain is supported (only needed when there is a surface)
+            if (VK_NULL_HANDLE != aSurface && !deviceExtensionNames.count(VK_KHR_SWAPCHAIN_EXTENSION_NAME)) continue;
 
             // Check that it can present to the surface
             if (!findQueueFamily(device, VK_QUEUE_GRAPHICS_BIT, aSurface)) continue;
@@ -546,8 +579,10 @@ namespace {
     /// <param name="aPhysicalDev">The physical device selected</param>
     /// <param name="aQueueIndices">The indices of the queues to use</param>
     /// <param name="aExtensions">Any extensions to be enabled</param>
+    /// <param name="aIndirectCountDraws">Set to true if indirect draws with a GPU written count were enabled</param>
     /// <returns>A logical Vulkan device</returns>
-    VkDevice createLogicalDevice(VkPhysicalDevice aPhysicalDev, std::vector<std::uint32_t>& aQueueIndices, std::vector<char const*>& aExtensions) {
+    VkDevice createLogicalDevice(VkPhysicalDevice aPhysicalDev, std::vector<std::uint32_t>& aQueueIndices, std::vector<char const*>& aExtensions,
+        bool& aIndirectCountDraws) {
         // Priority for all queues requested
         float queuePriority = 1.0f;
         
@@ -576,13 +611,36 @@ namespace {
         }
 
         features.fillModeNonSolid = VK_TRUE;
+
+        // Multi draw indirect with the draw index passed as the first instance lets the GPU cull and draw every mesh in one call
+        bool const multiDrawIndirect = availableFeatures.features.multiDrawIndirect && availableFeatures.features.drawIndirectFirstInstance;
+        if (multiDrawIndirect) {
+            features.multiDrawIndirect = VK_TRUE;
+            features.drawIndirectFirstInstance = VK_TRUE;
+        }
         
-        // Enable all descriptor features available
+        // Enable all descriptor features available, Vulkan 1.2 devices go through the 1.2 features so the
+        // indirect draw count can be enabled with them (the two structures may not both be chained)
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(aPhysicalDev, &properties);
         VkPhysicalDeviceDescriptorIndexingFeatures descriptorIndexingFeatures{};
         descriptorIndexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
-        availableFeatures.pNext = &descriptorIndexingFeatures;
+        VkPhysicalDeviceVulkan12Features vulkan12Features{};
+        vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+        bool const vulkan12 = properties.apiVersion >= VK_API_VERSION_1_2;
+        if (vulkan12) {
+            availableFeatures.pNext = &vulkan12Features;
+        }
+        else {
+            availableFeatures.pNext = &descriptorIndexingFeatures;
+        }
         vkGetPhysicalDeviceFeatures2(aPhysicalDev, &availableFeatures);
 
+        aIndirectCountDraws = vulkan12 && multiDrawIndirect && vulkan12Features.drawIndirectCount;
+        if (aIndirectCountDraws) {
+            std::printf("Indirect count draws enabled\n");
+        }
+
         // Set up the device info prior to creation
         VkDeviceCreateInfo deviceInfo{};
         deviceInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -591,7 +649,7 @@ namespace {
         deviceInfo.enabledExtensionCount = std::uint32_t(aExtensions.size());
         deviceInfo.ppEnabledExtensionNames = aExtensions.data();
         deviceInfo.pEnabledFeatures = &features;
-        deviceInfo.pNext = &descriptorIndexingFeatures;
+        deviceInfo.pNext = vulkan12 ? static_cast<void*>(&vulkan12Features) : static_cast<void*>(&descriptorIndexingFeatures);
 
         VkDevice device = VK_NULL_HANDLE;
         if (vkCreateDevice(aPhysicalDev, &deviceInfo, nullptr, &device) != VK_SUCCESS)
@@ -15,15 +15,21 @@ namespace app
 {
 	class AppContext {
 	public:
-        // Window
-		GLFWwindow* window;
+        // Window (left null when running headless)
+		GLFWwindow* window = nullptr;
 		VkInstance instance;
-		VkSurfaceKHR surface;
+		VkSurfaceKHR surface = VK_NULL_HANDLE;
+
+		// Headless contexts have no window, surface or swapchain
+		bool headless = false;
 
         // Device
         VkPhysicalDevice physicalDevice;
 		VkDevice logicalDevice;
 
+		// Multi draw indirect with a GPU written draw count is enabled (needed for GPU culling)
+		bool indirectCountDraws = false;
+
 		// Queues
 		std::vector<std::uint32_t> queueFamilyIndices;
 		std::uint32_t graphicsFamilyIndex = 0;
@@ -31,8 +37,8 @@ namespace app
 		std::uint32_t presentFamilyIndex = 0;
 		VkQueue presentQueue = VK_NULL_HANDLE;
 
-		// Swapchain
-		VkSwapchainKHR swapchain;
+		// Swapchain (when headless only the format and extent are set, describing the offscreen target)
+		VkSwapchainKHR swapchain = VK_NULL_HANDLE;
 		VkFormat swapchainFormat;
 		VkExtent2D swapchainExtent;
 		std::vector<VkImage> swapchainImages;
@@ -53,6 +59,15 @@ namespace app
 	/// <returns>The application context / settings</returns>
 	AppContext setup();
 
+	/// <summary>
+	/// Sets up the vulkan application without a window, surface or swapchain so it can run on
+	/// display-less machines and software implementations such as lavapipe
+	/// </summary>
+	/// <param name="extent">The size of the offscreen image that will be rendered to</param>
+	/// <param name="format">The format of the offscreen image that will be rendered to</param>
+	/// <returns>The application context / settings</returns>
+	AppContext setupHeadless(VkExtent2D extent, VkFormat format);
+
 	/// <summary>
 	/// Creates the swapchain for the application
 	/// </summary>
@@ -0,0 +1,357 @@
+#include "softwareOcclusion.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include <immintrin.h>
+
+// Most occluders rasterised each frame and the most triangles between them
+#define MAX_OCCLUDERS 32
+#define OCCLUDER_TRIANGLE_BUDGET 16384
+
+// Rows of the depth buffer each rasterising job fills
+#define BAND_ROWS 16
+
+namespace occlusion {
+
+	OccluderMesh createOccluderMesh(const fbx::Mesh& mesh, const fbx::Submesh& submesh, std::uint32_t maxTriangles) {
+		OccluderMesh occluder;
+		if (submesh.lodCount == 0) {
+			return occluder;
+		}
+
+		// The coarsest level (the first is the whole submesh)
+		std::uint32_t const firstIndex = mesh.lods[submesh.firstLod + submesh.lodCount - 1].firstIndex;
+		std::uint32_t const indexCount = mesh.lods[submesh.firstLod + submesh.lodCount - 1].indexCount;
+		if (indexCount == 0 || indexCount / 3 > maxTriangles) {
+			return occluder;
+		}
+
+		// Only the vertices the level uses are kept, renumbered in the order they are first used
+		std::vector<std::uint32_t> remap(mesh.vertexPositions.size(), std::numeric_limits<std::uint32_t>::max());
+		occluder.indices.reserve(indexCount);
+		for (std::uint32_t i = firstIndex; i < firstIndex + indexCount; i++) {
+			std::uint32_t const vertex = mesh.vertexIndices[i];
+			if (remap[vertex] == std::numeric_limits<std::uint32_t>::max()) {
+				remap[vertex] = std::uint32_t(occluder.positions.size());
+				occluder.positions.emplace_back(mesh.vertexPositions[vertex]);
+			}
+			occluder.indices.emplace_back(remap[vertex]);
+		}
+
+		return occluder;
+	}
+
+	SoftwareOcclusion::SoftwareOcclusion(jobs::JobSystem& inJobSystem, const model::MeshBounds& meshBounds, const model::MeshBounds& alphaMeshBounds,
+		std::vector<OccluderMesh> inOccluders)
+		: jobSystem(inJobSystem)
+		, occluders(std::move(inOccluders))
+		, depth(OCCLUSION_WIDTH * OCCLUSION_HEIGHT, 1.f)
+	{
+		lists[0].bounds = &meshBounds;
+		lists[1].bounds = &alphaMeshBounds;
+	}
+
+	SoftwareOcclusion::~SoftwareOcclusion() {
+		// Nothing can be reported from here, the jobs only need to stop using the culler
+		try {
+			wait();
+		}
+		catch (...) {}
+	}
+
+	void SoftwareOcclusion::begin(const glm::mat4& inProjectionView, glm::vec3 viewPosition,
+		const std::vector<std::uint32_t>& visibleMeshes, const std::vector<std::uint32_t>& visibleAlphaMeshes) {
+		// A cull that was never finished is thrown away
+		wait();
+
+		projectionView = inProjectionView;
+		lists[0].indices = visibleMeshes;
+		lists[1].indices = visibleAlphaMeshes;
+
+		// Without an occluder nothing can be hidden
+		selectOccluders(viewPosition);
+		if (selected.empty()) {
+			return;
+		}
+
+		started = true;
+		jobSystem.run([this]() { cull(); }, &running);
+	}
+
+	std::uint32_t SoftwareOcclusion::finish(std::vector<std::uint32_t>& visibleMeshes, std::vector<std::uint32_t>& visibleAlphaMeshes) {
+		if (!started) {
+			return 0;
+		}
+		wait();
+
+		// Keep the meshes that were not hidden, in the order they were given
+		std::uint32_t hiddenCount = 0;
+		std::vector<std::uint32_t>* outputs[2] = { &visibleMeshes, &visibleAlphaMeshes };
+		for (int list = 0; list < 2; list++) {
+			outputs[list]->clear();
+			for (std::size_t i = 0; i < lists[list].indices.size(); i++) {
+				if (lists[list].hidden[i]) {
+					hiddenCount++;
+				}
+				else {
+					outputs[list]->emplace_back(lists[list].indices[i]);
+				}
+			}
+		}
+
+		return hiddenCount;
+	}
+
+	void SoftwareOcclusion::wait() {
+		if (started) {
+			started = false;
+			jobSystem.wait(running);
+		}
+	}
+
+	void SoftwareOcclusion::selectOccluders(glm::vec3 viewPosition) {
+		// Meshes are ranked by how large their bounds look from the camera
+		const model::MeshBounds& bounds = *lists[0].bounds;
+		std::vector<std::pair<float, std::uint32_t>> ranked;
+		for (std::uint32_t i : lists[0].indices) {
+			if (i >= occluders.size() || occluders[i].indices.empty()) {
+				continue;
+			}
+
+			float const radius = glm::length(glm::vec3(bounds.extentX[i], bounds.extentY[i], bounds.extentZ[i]));
+			float const distance = glm::length(glm::vec3(bounds.centreX[i], bounds.centreY[i], bounds.centreZ[i]) - viewPosition);
+			ranked.emplace_back(radius / std::max(distance, radius), i);
+		}
+
+		std::size_t const count = std::min<std::size_t>(ranked.size(), MAX_OCCLUDERS);
+		std::partial_sort(ranked.begin(), ranked.begin() + count, ranked.end(),
+			[](const std::pair<float, std::uint32_t>& a, const std::pair<float, std::uint32_t>& b) { return a.first > b.first; });
+
+		// The largest occluders are taken until the triangle budget runs out
+		selected.clear();
+		std::size_t triangles = 0;
+		for (std::size_t i = 0; i < count; i++) {
+			std::size_t const occluderTriangles = occluders[ranked[i].second].indices.size() / 3;
+			if (triangles + occluderTriangles > OCCLUDER_TRIANGLE_BUDGET) {
+				continue;
+			}
+			triangles += occluderTriangles;
+			selected.emplace_back(ranked[i].second);
+		}
+
+		if (screenVertices.size() < selected.size()) {
+			screenVertices.resize(selected.size());
+		}
+	}
+
+	void SoftwareOcclusion::cull() {
+		jobSystem.parallelFor(selected.size(), 1, [this](std::size_t begin, std::size_t end) {
+			for (std::size_t i = begin; i < end; i++) {
+				transformOccluder(i);
+			}
+		});
+
+		// Bands do not overlap so each job writes its own rows without locking
+		jobSystem.parallelFor(OCCLUSION_HEIGHT / BAND_ROWS, 1, [this](std::size_t begin, std::size_t end) {
+			for (std::size_t band = begin; band < end; band++) {
+				rasteriseBand(std::uint32_t(band * BAND_ROWS), std::uint32_t((band + 1) * BAND_ROWS));
+			}
+		});
+
+		for (CullList& list : lists) {
+			list.hidden.assign(list.indices.size(), 0);
+			jobSystem.parallelFor(list.indices.size(), 0, [this, &list](std::size_t begin, std::size_t end) {
+				for (std::size_t i = begin; i < end; i++) {
+					list.hidden[i] = isOccluded(*list.bounds, list.indices[i]) ? 1 : 0;
+				}
+			});
+		}
+	}
+
+	void SoftwareOcclusion::transformOccluder(std::size_t occluder) {
+		const OccluderMesh& mesh = occluders[selected[occluder]];
+		std::vector<ScreenVertex>& vertices = screenVertices[occluder];
+		vertices.resize(mesh.positions.size());
+
+		for (std::size_t i = 0; i < mesh.positions.size(); i++) {
+			glm::vec4 const clip = projectionView * glm::vec4(mesh.positions[i], 1.f);
+
+			// Triangles reaching past the near plane are dropped rather than clipped
+			if (clip.w <= 0.f || clip.z < 0.f) {
+				vertices[i] = ScreenVertex{ 0.f, 0.f, 0.f, false };
+				continue;
+			}
+			float const inverseW = 1.f / clip.w;
+			vertices[i] = ScreenVertex{
+				(clip.x * inverseW * 0.5f + 0.5f) * float(OCCLUSION_WIDTH),
+				(clip.y * inverseW * 0.5f + 0.5f) * float(OCCLUSION_HEIGHT),
+				clip.z * inverseW,
+				true
+			};
+		}
+	}
+
+	void SoftwareOcclusion::rasteriseBand(std::uint32_t firstRow, std::uint32_t endRow) {
+		std::fill(depth.begin() + firstRow * OCCLUSION_WIDTH, depth.begin() + endRow * OCCLUSION_WIDTH, 1.f);
+
+		for (std::size_t occluder = 0; occluder < selected.size(); occluder++) {
+			const std::vector<std::uint32_t>& indices = occluders[selected[occluder]].indices;
+			const std::vector<ScreenVertex>& vertices = screenVertices[occluder];
+			for (std::size_t i = 0; i + 2 < indices.size(); i += 3) {
+				rasteriseTriangle(vertices[indices[i]], vertices[indices[i + 1]], vertices[indices[i + 2]], firstRow, endRow);
+			}
+		}
+	}
+
+	void SoftwareOcclusion::rasteriseTriangle(ScreenVertex v0, ScreenVertex v1, ScreenVertex v2, std::uint32_t firstRow, std::uint32_t endRow) {
+		if (!v0.valid || !v1.valid || !v2.valid) {
+			return;
+		}
+
+		// Front faces wind counter clockwise in framebuffer space (y down) so their area is negative.
+		// The colour pipeline culls back faces, so they hide nothing and are skipped.
+		float const area = (v1.x - v0.x) * (v2.y - v0.y) - (v1.y - v0.y) * (v2.x - v0.x);
+		if (area >= 0.f) {
+			return;
+		}
+		std::swap(v1, v2);
+
+		// Pixels whose centres may be inside the triangle, within the band
+		int const minX = std::max(int(std::floor(std::min({ v0.x, v1.x, v2.x }))), 0);
+		int const maxX = std::min(int(std::ceil(std::max({ v0.x, v1.x, v2.x }))), OCCLUSION_WIDTH - 1);
+		int const minY = std::max(int(std::floor(std::min({ v0.y, v1.y, v2.y }))), int(firstRow));
+		int const maxY = std::min(int(std::ceil(std::max({ v0.y, v1.y, v2.y }))), int(endRow) - 1);
+		if (minX > maxX || minY > maxY) {
+			return;
+		}
+
+		// Edge functions a * x + b * y + c, positive inside. Each is the weight of the vertex opposite it.
+		ScreenVertex const* corners[3] = { &v0, &v1, &v2 };
+		float edgeA[3], edgeB[3], edgeC[3];
+		for (int edge = 0; edge < 3; edge++) {
+			const ScreenVertex& from = *corners[(edge + 1) % 3];
+			const ScreenVertex& to = *corners[(edge + 2) % 3];
+			edgeA[edge] = from.y - to.y;
+			edgeB[edge] = to.x - from.x;
+			edgeC[edge] = (to.y - from.y) * from.x - (to.x - from.x) * from.y;
+		}
+
+		// Depth is a plane in screen space, built from the edge functions scaled by the area
+		float const inverseArea = -1.f / area;
+		float const depthA = (edgeA[0] * v0.z + edgeA[1] * v1.z + edgeA[2] * v2.z) * inverseArea;
+		float const depthB = (edgeB[0] * v0.z + edgeB[1] * v1.z + edgeB[2] * v2.z) * inverseArea;
+		float const depthC = (edgeC[0] * v0.z + edgeC[1] * v1.z + edgeC[2] * v2.z) * inverseArea;
+
+#if defined(__AVX__)
+		// Spans start on a multiple of 8 so the last one never runs off the end of a row
+		int const firstX = minX & ~7;
+		__m256 const laneOffsets = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+		__m256 const depthStepA = _mm256_set1_ps(depthA);
+		__m256 edgeStepA[3];
+		for (int edge = 0; edge < 3; edge++) {
+			edgeStepA[edge] = _mm256_set1_ps(edgeA[edge]);
+		}
+
+		for (int y = minY; y <= maxY; y++) {
+			float const pixelY = float(y) + 0.5f;
+			float* row = depth.data() + y * OCCLUSION_WIDTH;
+
+			for (int x = firstX; x <= maxX; x += 8) {
+				__m256 const pixelX = _mm256_add_ps(_mm256_set1_ps(float(x)), laneOffsets);
+
+				// Pixels inside every edge are covered
+				__m256 covered = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+				for (int edge = 0; edge < 3; edge++) {
+					__m256 const value = _mm256_add_ps(_mm256_mul_ps(edgeStepA[edge], pixelX), _mm256_set1_ps(edgeB[edge] * pixelY + edgeC[edge]));
+					covered = _mm256_and_ps(covered, _mm256_cmp_ps(value, _mm256_setzero_ps(), _CMP_GE_OQ));
+				}
+				if (_mm256_movemask_ps(covered) == 0) {
+					continue;
+				}
+
+				// Keep the nearest depth of the covered pixels
+				__m256 const triangleDepth = _mm256_add_ps(_mm256_mul_ps(depthStepA, pixelX), _mm256_set1_ps(depthB * pixelY + depthC));
+				__m256 const current = _mm256_loadu_ps(row + x);
+				_mm256_storeu_ps(row + x, _mm256_blendv_ps(current, _mm256_min_ps(current, triangleDepth), covered));
+			}
+		}
+#else
+		for (int y = minY; y <= maxY; y++) {
+			float const pixelY = float(y) + 0.5f;
+			float* row = depth.data() + y * OCCLUSION_WIDTH;
+
+			for (int x = minX; x <= maxX; x++) {
+				float const pixelX = float(x) + 0.5f;
+				bool covered = true;
+				for (int edge = 0; edge < 3; edge++) {
+					covered = covered && edgeA[edge] * pixelX + edgeB[edge] * pixelY + edgeC[edge] >= 0.f;
+				}
+				if (covered) {
+					row[x] = std::min(row[x], depthA * pixelX + depthB * pixelY + depthC);
+				}
+			}
+		}
+#endif
+	}
+
+	bool SoftwareOcclusion::isOccluded(const model::MeshBounds& bounds, std::uint32_t index) const {
+		glm::vec3 const centre(bounds.centreX[index], bounds.centreY[index], bounds.centreZ[index]);
+		glm::vec3 const extent(bounds.extentX[index], bounds.extentY[index], bounds.extentZ[index]);
+
+		// Screen rectangle and nearest depth of the box
+		glm::vec3 boundsMin(std::numeric_limits<float>::max());
+		glm::vec3 boundsMax(std::numeric_limits<float>::lowest());
+		for (int corner = 0; corner < 8; corner++) {
+			glm::vec3 const direction((corner & 1) ? 1.f : -1.f, (corner & 2) ? 1.f : -1.f, (corner & 4) ? 1.f : -1.f);
+			glm::vec4 const clip = projectionView * glm::vec4(centre + extent * direction, 1.f);
+
+			// Boxes reaching past the near plane are never hidden
+			if (clip.w <= 0.f || clip.z < 0.f) {
+				return false;
+			}
+			glm::vec3 const ndc = glm::vec3(clip) / clip.w;
+			boundsMin = glm::min(boundsMin, ndc);
+			boundsMax = glm::max(boundsMax, ndc);
+		}
+
+		int const minX = std::max(int(std::floor((boundsMin.x * 0.5f + 0.5f) * float(OCCLUSION_WIDTH))), 0);
+		int const maxX = std::min(int(std::floor((boundsMax.x * 0.5f + 0.5f) * float(OCCLUSION_WIDTH))), OCCLUSION_WIDTH - 1);
+		int const minY = std::max(int(std::floor((boundsMin.y * 0.5f + 0.5f) * float(OCCLUSION_HEIGHT))), 0);
+		int const maxY = std::min(int(std::floor((boundsMax.y * 0.5f + 0.5f) * float(OCCLUSION_HEIGHT))), OCCLUSION_HEIGHT - 1);
+		if (minX > maxX || minY > maxY) {
+			return false;
+		}
+
+		// Hidden only if every pixel it covers has something nearer than the box
+		float const nearest = boundsMin.z;
+
+#if defined(__AVX__)
+		__m256 const boxDepth = _mm256_set1_ps(nearest);
+		for (int y = minY; y <= maxY; y++) {
+			const float* row = depth.data() + y * OCCLUSION_WIDTH;
+			for (int x = minX & ~7; x <= maxX; x += 8) {
+				// Lanes outside the rectangle are ignored
+				int const lanes = (0xFF << std::max(minX - x, 0)) & (0xFF >> std::max(x + 7 - maxX, 0));
+
+				__m256 const visible = _mm256_cmp_ps(_mm256_loadu_ps(row + x), boxDepth, _CMP_GE_OQ);
+				if ((_mm256_movemask_ps(visible) & lanes) != 0) {
+					return false;
+				}
+			}
+		}
+#else
+		for (int y = minY; y <= maxY; y++) {
+			const float* row = depth.data() + y * OCCLUSION_WIDTH;
+			for (int x = minX; x <= maxX; x++) {
+				if (row[x] >= nearest) {
+					return false;
+				}
+			}
+		}
+#endif
+
+		return true;
+	}
+}
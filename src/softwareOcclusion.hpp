@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "glm.hpp"
+
+#include "model.hpp"
+#include "FBXFileLoader.hpp"
+#include "jobSystem.hpp"
+
+// Size of the CPU depth buffer, the width must be a multiple of 8
+#define OCCLUSION_WIDTH 256
+#define OCCLUSION_HEIGHT 128
+
+namespace occlusion {
+	/// <summary>
+	/// A simplified copy of a mesh kept on the CPU to be rasterised as an occluder.
+	/// Positions are in world space, an empty mesh is never used as an occluder.
+	/// </summary>
+	struct OccluderMesh {
+		std::vector<glm::vec3> positions;
+		std::vector<std::uint32_t> indices;
+	};
+
+	/// <summary>
+	/// Creates the occluder of a submesh from its coarsest level of detail, keeping only the vertices that level uses
+	/// </summary>
+	/// <param name="mesh">The mesh holding the submesh's vertices and levels</param>
+	/// <param name="submesh">The submesh</param>
+	/// <param name="maxTriangles">Most triangles the occluder may have, submeshes that can not be simplified that far get no occluder</param>
+	/// <returns>The occluder (empty if there is none)</returns>
+	OccluderMesh createOccluderMesh(const fbx::Mesh& mesh, const fbx::Submesh& submesh, std::uint32_t maxTriangles);
+
+	/// <summary>
+	/// Occlusion culling on the CPU for devices without a fast GPU. The opaque meshes covering the most of the
+	/// screen are picked as occluders, their simplified meshes are rasterised into a small depth buffer a band
+	/// of rows per job, and the bounds of every visible mesh are tested against it. Rasterising and testing use
+	/// AVX when the build enables it to work on 8 pixels at a time, writing through a coverage mask, and one
+	/// pixel at a time otherwise.
+	/// Culling runs on the job system between begin and finish so it can overlap with waiting on the GPU.
+	/// </summary>
+	class SoftwareOcclusion
+	{
+	public:
+		/// <summary>
+		/// Parameterised constructor
+		/// </summary>
+		/// <param name="jobSystem">Job system to cull on</param>
+		/// <param name="meshBounds">Bounds of the opaque meshes (must outlive the culler)</param>
+		/// <param name="alphaMeshBounds">Bounds of the alpha masked meshes (must outlive the culler)</param>
+		/// <param name="occluders">The occluder of each opaque mesh, alpha masked meshes never hide anything</param>
+		SoftwareOcclusion(jobs::JobSystem& jobSystem, const model::MeshBounds& meshBounds, const model::MeshBounds& alphaMeshBounds,
+			std::vector<OccluderMesh> occluders);
+
+		/// <summary>
+		/// Destructor, waits for any culling still running
+		/// </summary>
+		~SoftwareOcclusion();
+
+		// Jobs hold a pointer to the culler so it can not be copied
+		SoftwareOcclusion(SoftwareOcclusion&) = delete;
+		SoftwareOcclusion& operator= (SoftwareOcclusion&) = delete;
+
+		/// <summary>
+		/// Starts culling the meshes inside the frustum on the job system. The visible lists are copied so
+		/// a cull that is never finished (such as when a frame is skipped) is simply replaced by the next one.
+		/// </summary>
+		/// <param name="projectionView">Projection view matrix of the camera</param>
+		/// <param name="viewPosition">Position of the camera</param>
+		/// <param name="visibleMeshes">Indices of the opaque meshes inside the frustum</param>
+		/// <param name="visibleAlphaMeshes">Indices of the alpha masked meshes inside the frustum</param>
+		void begin(const glm::mat4& projectionView, glm::vec3 viewPosition,
+			const std::vector<std::uint32_t>& visibleMeshes, const std::vector<std::uint32_t>& visibleAlphaMeshes);
+
+		/// <summary>
+		/// Waits for the culling started by begin and writes out the meshes that are not hidden
+		/// </summary>
+		/// <param name="visibleMeshes">Indices of the visible opaque meshes</param>
+		/// <param name="visibleAlphaMeshes">Indices of the visible alpha masked meshes</param>
+		/// <returns>Number of meshes that were hidden</returns>
+		std::uint32_t finish(std::vector<std::uint32_t>& visibleMeshes, std::vector<std::uint32_t>& visibleAlphaMeshes);
+
+	private:
+		struct ScreenVertex {
+			float x, y, z;
+			// False if the vertex is in front of the near plane
+			bool valid;
+		};
+
+		// Meshes inside the frustum with a flag for each that is set if it is hidden
+		struct CullList {
+			const model::MeshBounds* bounds;
+			std::vector<std::uint32_t> indices;
+			std::vector<std::uint8_t> hidden;
+		};
+
+		void cull();
+		void selectOccluders(glm::vec3 viewPosition);
+		void transformOccluder(std::size_t occluder);
+		void rasteriseBand(std::uint32_t firstRow, std::uint32_t endRow);
+		void rasteriseTriangle(ScreenVertex v0, ScreenVertex v1, ScreenVertex v2, std::uint32_t firstRow, std::uint32_t endRow);
+		bool isOccluded(const model::MeshBounds& bounds, std::uint32_t index) const;
+		void wait();
+
+		jobs::JobSystem& jobSystem;
+		std::vector<OccluderMesh> occluders;
+
+		// Opaque then alpha masked
+		CullList lists[2];
+		glm::mat4 projectionView = glm::mat4(1.f);
+
+		// The picked occluders and their vertices in pixels, reused every frame
+		std::vector<std::uint32_t> selected;
+		std::vector<std::vector<ScreenVertex>> screenVertices;
+
+		// Depth of each pixel, row 0 is the top of the screen
+		std::vector<float> depth;
+
+		jobs::Counter running;
+		bool started = false;
+	};
+}
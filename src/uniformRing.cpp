@@ -0,0 +1,71 @@
+#include "uniformRing.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace uniforms {
+
+	UniformRing::UniformRing(app::AppContext& inApp, VmaAllocator inAllocator, VkDeviceSize inCapacity)
+		: app(inApp)
+		, allocator(inAllocator)
+		, capacity(inCapacity)
+	{
+		// Dynamic offsets must be multiples of the device's alignment, which is always a power of two
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(app.physicalDevice, &properties);
+		alignment = std::max<VkDeviceSize>(properties.limits.minUniformBufferOffsetAlignment, 1);
+
+		VkBufferCreateInfo bufferInfo{};
+		bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		bufferInfo.size = capacity;
+		bufferInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+
+		// Written once per frame in order by the CPU and read by the GPU, so sequential writes suit it
+		VmaAllocationCreateInfo allocationInfo{};
+		allocationInfo.usage = VMA_MEMORY_USAGE_AUTO;
+		allocationInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+		VmaAllocationInfo allocationResult{};
+		if (vmaCreateBuffer(allocator, &bufferInfo, &allocationInfo, &ringBuffer, &allocation, &allocationResult) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create uniform ring buffer.");
+		}
+		mapping = static_cast<std::uint8_t*>(allocationResult.pMappedData);
+	}
+
+	UniformRing::~UniformRing()
+	{
+		cleanup();
+	}
+
+	void UniformRing::reset() {
+		head = 0;
+	}
+
+	std::uint32_t UniformRing::push(const void* data, VkDeviceSize size) {
+		VkDeviceSize const offset = (head + alignment - 1) & ~(alignment - 1);
+		if (offset + size > capacity) {
+			throw std::runtime_error("Uniform ring is full.");
+		}
+
+		std::memcpy(mapping + offset, data, size);
+		head = offset + size;
+		return std::uint32_t(offset);
+	}
+
+	void UniformRing::flush() {
+		if (head > 0) {
+			vmaFlushAllocation(allocator, allocation, 0, head);
+		}
+	}
+
+	void UniformRing::cleanup() {
+		if (ringBuffer != VK_NULL_HANDLE) {
+			// The allocation was created mapped so destroying it unmaps it
+			vmaDestroyBuffer(allocator, ringBuffer, allocation);
+			ringBuffer = VK_NULL_HANDLE;
+			allocation = VK_NULL_HANDLE;
+			mapping = nullptr;
+		}
+	}
+}
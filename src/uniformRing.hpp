@@ -0,0 +1,90 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <cstdint>
+
+#include <vk_mem_alloc.h>
+#include "setup.hpp"
+
+namespace uniforms {
+	/// <summary>
+	/// A host visible uniform buffer that stays mapped and is filled front to back with a bump pointer.
+	/// Every write starts at a multiple of minUniformBufferOffsetAlignment and is bound through a dynamic
+	/// uniform descriptor with the offset it was written at, so uniforms reach the GPU without a transfer
+	/// or any barriers (the host writes are made visible by the submit).
+	/// A ring belongs to one frame in flight and is reset once the frame's fence has signalled.
+	/// </summary>
+	class UniformRing
+	{
+	public:
+		/// <summary>
+		/// Parameterised constructor
+		/// </summary>
+		/// <param name="app">Application context</param>
+		/// <param name="allocator">Vulkan memory allocator</param>
+		/// <param name="capacity">Size of the buffer in bytes</param>
+		UniformRing(app::AppContext& app, VmaAllocator allocator, VkDeviceSize capacity);
+
+		/// <summary>
+		/// Destructor
+		/// </summary>
+		~UniformRing();
+
+		// The ring owns its buffer so it can not be copied
+		UniformRing(UniformRing&) = delete;
+		UniformRing& operator= (UniformRing&) = delete;
+
+		/// <summary>
+		/// Starts writing from the front of the buffer again. The GPU must have finished every command
+		/// that reads what was written since the last reset.
+		/// </summary>
+		void reset();
+
+		/// <summary>
+		/// Copies data to the next aligned offset of the buffer
+		/// </summary>
+		/// <param name="data">The data</param>
+		/// <param name="size">Size of the data in bytes</param>
+		/// <returns>The dynamic offset to bind the data with</returns>
+		std::uint32_t push(const void* data, VkDeviceSize size);
+
+		/// <summary>
+		/// Copies a value to the next aligned offset of the buffer
+		/// </summary>
+		/// <param name="value">The value</param>
+		/// <returns>The dynamic offset to bind the value with</returns>
+		template<typename T>
+		std::uint32_t push(const T& value) { return push(&value, sizeof(T)); }
+
+		/// <summary>
+		/// Flushes what has been written since the last reset, for memory that is not host coherent.
+		/// Must be called before the commands reading it are submitted.
+		/// </summary>
+		void flush();
+
+		/// <summary>
+		/// The buffer the uniforms are written to
+		/// </summary>
+		VkBuffer buffer() const { return ringBuffer; }
+
+		/// <summary>
+		/// Destroys the buffer, the ring can not be used afterwards
+		/// </summary>
+		void cleanup();
+
+	private:
+		app::AppContext& app;
+		VmaAllocator allocator;
+
+		VkBuffer ringBuffer = VK_NULL_HANDLE;
+		VmaAllocation allocation = VK_NULL_HANDLE;
+		std::uint8_t* mapping = nullptr;
+
+		VkDeviceSize capacity;
+		VkDeviceSize alignment = 1;
+		// Offset of the next write
+		VkDeviceSize head = 0;
+	};
+}
@@ -0,0 +1,180 @@
+#include "uploadBatch.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+
+namespace utility {
+
+	UploadBatch::UploadBatch(app::AppContext& inApp, VmaAllocator& inAllocator, VkCommandPool inCommandPool,
+		VkDeviceSize inBlockSize, VkDeviceSize inFlushThreshold)
+		: app(inApp)
+		, allocator(inAllocator)
+		, commandPool(inCommandPool)
+		, blockSize(inBlockSize)
+		, flushThreshold(inFlushThreshold)
+	{
+	}
+
+	UploadBatch::~UploadBatch()
+	{
+		// Anything still pending is uploaded, never throw from the destructor
+		try {
+			flush();
+		}
+		catch (const std::exception& e) {
+			std::cerr << e.what() << std::endl;
+		}
+	}
+
+	BufferSet UploadBatch::uploadBuffer(const void* data, VkDeviceSize sizeOfData, VkBufferUsageFlags usageFlags) {
+		// Set up the on GPU buffer
+		BufferSet buffer = createBuffer(
+			allocator,
+			sizeOfData,
+			usageFlags | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE
+		);
+
+		// Empty buffers have nothing to copy
+		if (sizeOfData == 0) {
+			return buffer;
+		}
+
+		// Copy the data into the arena and record the copy to the GPU
+		StagingAllocation staging = allocateStaging(sizeOfData);
+		std::memcpy(staging.memory, data, sizeOfData);
+
+		VkBufferCopy copy{};
+		copy.srcOffset = staging.offset;
+		copy.size = sizeOfData;
+		vkCmdCopyBuffer(commandBuffer(), staging.buffer, buffer.buffer, 1, &copy);
+
+		countBytes(sizeOfData);
+
+		return buffer;
+	}
+
+	StagingAllocation UploadBatch::allocateStaging(VkDeviceSize size, VkDeviceSize alignment) {
+		// Keep the staging memory bounded for very large scenes
+		if (stagingInUse + size > flushThreshold && stagingInUse > 0) {
+			flush();
+		}
+
+		// Use the last block if the allocation fits
+		StagingBlock* block = blocks.empty() ? nullptr : &blocks.back();
+		VkDeviceSize offset = 0;
+		if (block != nullptr) {
+			offset = (block->used + alignment - 1) & ~(alignment - 1);
+		}
+		if (block == nullptr || offset + size > block->size) {
+			// Start a new block (larger than usual if a single allocation needs it)
+			StagingBlock newBlock;
+			newBlock.size = std::max(blockSize, size);
+			newBlock.buffer = createBuffer(
+				allocator,
+				newBlock.size,
+				VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+				VMA_MEMORY_USAGE_AUTO,
+				VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT
+			);
+			if (vmaMapMemory(allocator, newBlock.buffer.allocation, &newBlock.memory) != VK_SUCCESS) {
+				throw std::runtime_error("Failed to map staging memory.");
+			}
+			blocks.emplace_back(std::move(newBlock));
+			block = &blocks.back();
+			offset = 0;
+		}
+
+		block->used = offset + size;
+		stagingInUse += size;
+
+		StagingAllocation allocation;
+		allocation.buffer = block->buffer.buffer;
+		allocation.offset = offset;
+		allocation.memory = static_cast<std::uint8_t*>(block->memory) + offset;
+		return allocation;
+	}
+
+	VkCommandBuffer UploadBatch::commandBuffer() {
+		if (recordingBuffer == VK_NULL_HANDLE) {
+			beginRecording();
+		}
+		return recordingBuffer;
+	}
+
+	void UploadBatch::beginRecording() {
+		recordingBuffer = createCommandBuffer(app, commandPool);
+
+		// Begin recording into the command buffer
+		VkCommandBufferBeginInfo recordInfo{};
+		recordInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		recordInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		if (vkBeginCommandBuffer(recordingBuffer, &recordInfo) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to start command buffer recording.");
+		}
+
+		batchStart = std::chrono::steady_clock::now();
+	}
+
+	void UploadBatch::flush() {
+		if (recordingBuffer == VK_NULL_HANDLE) {
+			return;
+		}
+
+		// Make every transfer visible to anything that reads vertex, index, uniform, storage or texture data,
+		// including the culling compute shader, the draw commands read by indirect draws and buffers copied from
+		VkMemoryBarrier memoryBarrier{};
+		memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT |
+			VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+		vkCmdPipelineBarrier(recordingBuffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+			0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+		// End the recording
+		if (vkEndCommandBuffer(recordingBuffer) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to end command buffer recording.");
+		}
+
+		// One fence for the whole batch
+		VkFence submitComplete = createFence(app);
+
+		// Submit the recorded commands for execution
+		VkSubmitInfo submitInfo{};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &recordingBuffer;
+		if (vkQueueSubmit(app.graphicsQueue, 1, &submitInfo, submitComplete) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to submit recorded commands.");
+		}
+
+		// Wait for the fence before clean up
+		if (vkWaitForFences(app.logicalDevice, 1, &submitComplete, VK_TRUE, std::numeric_limits<std::uint64_t>::max()) != VK_SUCCESS) {
+			throw std::runtime_error("Fence failed to return as complete.");
+		}
+		vkDestroyFence(app.logicalDevice, submitComplete, nullptr);
+
+		// Release the command buffer and the staging arena
+		vkFreeCommandBuffers(app.logicalDevice, commandPool, 1, &recordingBuffer);
+		recordingBuffer = VK_NULL_HANDLE;
+		for (StagingBlock& block : blocks) {
+			vmaUnmapMemory(allocator, block.buffer.allocation);
+		}
+		blocks.clear();
+		stagingInUse = 0;
+
+		// Report the throughput of the batch
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - batchStart).count();
+		totalBytes += pendingBytes;
+		totalTime += seconds;
+		std::cout << "Uploaded " << double(pendingBytes) / (1024.0 * 1024.0) << " MB in " << seconds * 1000.0 << " ms ("
+			<< (seconds > 0.0 ? double(pendingBytes) / (1024.0 * 1024.0) / seconds : 0.0) << " MB/s)" << std::endl;
+		pendingBytes = 0;
+	}
+}
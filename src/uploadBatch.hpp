@@ -0,0 +1,124 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include <chrono>
+
+#include <vk_mem_alloc.h>
+#include "setup.hpp"
+#include "utility.hpp"
+
+namespace utility {
+	/// <summary>
+	/// A region of the staging arena that data can be written into
+	/// </summary>
+	struct StagingAllocation
+	{
+		VkBuffer buffer = VK_NULL_HANDLE;
+		VkDeviceSize offset = 0;
+		void* memory = nullptr;
+	};
+
+	/// <summary>
+	/// Collects many buffer and image uploads into one staging arena and one command buffer so they
+	/// can be submitted and fenced once. Staging memory is only released when the batch is flushed.
+	/// </summary>
+	class UploadBatch
+	{
+	public:
+
+		/// <summary>
+		/// Parameterised constructor
+		/// </summary>
+		/// <param name="app">Application context</param>
+		/// <param name="allocator">Vulkan memory allocator</param>
+		/// <param name="commandPool">Command pool to record the uploads with</param>
+		/// <param name="blockSize">Size of each block of the staging arena</param>
+		/// <param name="flushThreshold">Staging memory in use at which the batch is flushed automatically</param>
+		UploadBatch(app::AppContext& app, VmaAllocator& allocator, VkCommandPool commandPool,
+			VkDeviceSize blockSize = 64ull << 20, VkDeviceSize flushThreshold = 512ull << 20);
+
+		/// <summary>
+		/// Destructor, flushes anything still pending (the device must still be alive if anything is)
+		/// </summary>
+		~UploadBatch();
+
+		// The batch holds a recording command buffer so it can not be copied
+		UploadBatch(UploadBatch&) = delete;
+		UploadBatch& operator= (UploadBatch&) = delete;
+
+		/// <summary>
+		/// Creates a device local buffer and records a copy of the data into it
+		/// </summary>
+		/// <param name="data">The data to upload</param>
+		/// <param name="sizeOfData">The size of the data</param>
+		/// <param name="usageFlags">Usage flags for the buffer (transfer dst is added)</param>
+		/// <returns>The device local buffer, only valid for use once the batch has been flushed</returns>
+		BufferSet uploadBuffer(const void* data, VkDeviceSize sizeOfData, VkBufferUsageFlags usageFlags);
+
+		/// <summary>
+		/// Reserves space in the staging arena for the caller to fill and copy from
+		/// </summary>
+		/// <param name="size">The number of bytes needed</param>
+		/// <param name="alignment">The alignment of the offset (must be a power of 2)</param>
+		/// <returns>The staging buffer, offset and mapped memory</returns>
+		StagingAllocation allocateStaging(VkDeviceSize size, VkDeviceSize alignment = 16);
+
+		/// <summary>
+		/// Gets the command buffer the uploads are being recorded into
+		/// </summary>
+		/// <returns>A command buffer in the recording state</returns>
+		VkCommandBuffer commandBuffer();
+
+		/// <summary>
+		/// Adds to the number of bytes counted as uploaded by this batch
+		/// </summary>
+		/// <param name="bytes">Number of bytes</param>
+		void countBytes(VkDeviceSize bytes) { pendingBytes += bytes; }
+
+		/// <summary>
+		/// Submits everything recorded so far, waits for it on a single fence and releases the staging memory
+		/// </summary>
+		void flush();
+
+		/// <summary>
+		/// Gets the total number of bytes uploaded over all flushes
+		/// </summary>
+		VkDeviceSize totalBytesUploaded() const { return totalBytes; }
+
+		/// <summary>
+		/// Gets the total time spent from the first recorded upload to the end of each flush
+		/// </summary>
+		double totalSeconds() const { return totalTime; }
+
+	private:
+		struct StagingBlock
+		{
+			BufferSet buffer;
+			void* memory = nullptr;
+			VkDeviceSize size = 0;
+			VkDeviceSize used = 0;
+		};
+
+		void beginRecording();
+
+		app::AppContext& app;
+		VmaAllocator& allocator;
+		VkCommandPool commandPool;
+		VkDeviceSize blockSize;
+		VkDeviceSize flushThreshold;
+
+		std::vector<StagingBlock> blocks;
+		VkDeviceSize stagingInUse = 0;
+
+		VkCommandBuffer recordingBuffer = VK_NULL_HANDLE;
+
+		// Statistics
+		VkDeviceSize pendingBytes = 0;
+		VkDeviceSize totalBytes = 0;
+		double totalTime = 0.0;
+		std::chrono::steady_clock::time_point batchStart;
+	};
+}
@@ -143,13 +143,13 @@ namespace utility {
 		return commandPool;
 	}
 
-	VkCommandBuffer createCommandBuffer(app::AppContext& app, VkCommandPool commandPool) {
+	VkCommandBuffer createCommandBuffer(app::AppContext& app, VkCommandPool commandPool, VkCommandBufferLevel level) {
 		// Set the information required of the command buffer
 		VkCommandBufferAllocateInfo commandBufferInfo{};
 		commandBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
 		commandBufferInfo.commandPool = commandPool;
 		commandBufferInfo.commandBufferCount = 1;
-		commandBufferInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		commandBufferInfo.level = level;
 
 		// Create / allocate the command buffer
 		VkCommandBuffer commandBuffer;
@@ -139,8 +139,10 @@ namespace utility {
 	/// </summary>
 	/// <param name="app">Application context</param>
 	/// <param name="commandPool">The command pool</param>
+	/// <param name="level">Primary, or secondary to be executed by a primary</param>
 	/// <returns>The command buffer</returns>
-	VkCommandBuffer createCommandBuffer(app::AppContext& app, VkCommandPool commandPool);
+	VkCommandBuffer createCommandBuffer(app::AppContext& app, VkCommandPool commandPool,
+		VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY);
 
 	/// <summary>
 	/// Creates a fence given a set of flags